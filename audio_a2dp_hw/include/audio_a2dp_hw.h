@@ -86,6 +86,7 @@ typedef enum {
   A2DP_CTRL_SET_OUTPUT_AUDIO_CONFIG,
   A2DP_CTRL_CMD_OFFLOAD_START,
   A2DP_CTRL_GET_PRESENTATION_POSITION,
+  A2DP_CTRL_CMD_SETUP_SHM,
 } tA2DP_CTRL_CMD;
 
 typedef enum {
@@ -0,0 +1,140 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*****************************************************************************
+ *
+ *  Filename:      audio_a2dp_hw_shm.h
+ *
+ *  Description:   Shared memory PCM transport between the A2DP audio HAL
+ *                 and the Bluetooth stack.
+ *
+ *****************************************************************************/
+
+#ifndef AUDIO_A2DP_HW_SHM_H
+#define AUDIO_A2DP_HW_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*****************************************************************************
+ *  Constants & Macros
+ *****************************************************************************/
+
+// Number of file descriptors exchanged over the control channel when the
+// shared memory transport is set up: the memfd backing the ring, the eventfd
+// signalled by the writer when data is available, and the eventfd signalled
+// by the reader when space is available.
+#define A2DP_SHM_NUM_FDS 3
+
+// Capacity of the PCM ring in bytes. Must be a power of two. It is sized to
+// hold at least the same amount of audio as the data socket buffer
+// |AUDIO_STREAM_OUTPUT_BUFFER_SZ| so the playback latency does not grow when
+// switching transports.
+#define A2DP_SHM_RING_CAPACITY (16 * 1024)
+
+// Number of write timestamps kept in the ring header. Used by the reader to
+// measure the latency of every chunk written by the HAL.
+#define A2DP_SHM_TIMESTAMP_SLOTS 64
+
+/*****************************************************************************
+ *  Type definitions
+ *****************************************************************************/
+
+struct a2dp_shm_ring_header;
+
+// Reader-side transport statistics. All times are in microseconds.
+struct a2dp_shm_stats {
+  uint64_t total_bytes;
+  uint64_t total_chunks;
+  uint64_t total_reads;
+  uint64_t total_wakeups;
+  uint64_t underflow_count;
+  uint64_t overrun_count;  // invalid write positions, the ring was flushed
+  uint64_t latency_min_us;
+  uint64_t latency_max_us;
+  uint64_t latency_total_us;
+  // Interarrival jitter estimate, computed as in RFC 3550 section 6.4.1.
+  uint64_t jitter_us;
+  uint64_t last_latency_us;
+};
+
+// A single-producer single-consumer ring of PCM bytes backed by a memfd and
+// shared between the audio HAL (producer) and the stack (consumer).
+struct a2dp_shm_ring {
+  int mem_fd;
+  int data_evt_fd;   // signalled by the writer when data was written
+  int space_evt_fd;  // signalled by the reader when data was consumed
+  size_t map_size;
+  struct a2dp_shm_ring_header* header;
+  uint8_t* data;
+  struct a2dp_shm_stats stats;
+};
+
+/*****************************************************************************
+ *  Functions
+ *****************************************************************************/
+
+// Initializes |ring| to the detached state.
+void a2dp_shm_ring_init(struct a2dp_shm_ring* ring);
+
+// Returns true if |ring| is mapped and can be used for transfers.
+bool a2dp_shm_ring_is_attached(const struct a2dp_shm_ring* ring);
+
+// Creates a new memfd-backed ring and its signalling eventfds, and maps it
+// into |ring|. Used by the producer.
+// Returns 0 on success, otherwise -1.
+int a2dp_shm_ring_create(struct a2dp_shm_ring* ring);
+
+// Maps an existing ring created by the peer process. |fds| contains
+// |A2DP_SHM_NUM_FDS| descriptors in the order (mem, data event, space event);
+// ownership of the descriptors is transferred to |ring|. Used by the consumer.
+// Returns 0 on success, otherwise -1 and the descriptors are closed.
+int a2dp_shm_ring_attach(struct a2dp_shm_ring* ring, const int* fds);
+
+// Fills |fds| with the |A2DP_SHM_NUM_FDS| descriptors of |ring| in the order
+// expected by |a2dp_shm_ring_attach|.
+void a2dp_shm_ring_get_fds(const struct a2dp_shm_ring* ring, int* fds);
+
+// Unmaps |ring| and closes all its descriptors. Safe to call on a detached
+// ring.
+void a2dp_shm_ring_close(struct a2dp_shm_ring* ring);
+
+// Writes |len| bytes from |buf| into |ring|, waiting at most |timeout_ms| in
+// total for the consumer to free up space.
+// Returns the number of bytes written, or -1 if the wait timed out or failed.
+int a2dp_shm_ring_write(struct a2dp_shm_ring* ring, const void* buf,
+                        size_t len, int timeout_ms);
+
+// Reads up to |len| bytes from |ring| into |buf|, waiting at most
+// |timeout_ms| each time the ring runs empty before |len| bytes were read.
+// Returns the number of bytes read.
+size_t a2dp_shm_ring_read(struct a2dp_shm_ring* ring, void* buf, size_t len,
+                          int timeout_ms);
+
+// Discards all data currently queued in |ring|. Must be called by the
+// consumer.
+void a2dp_shm_ring_flush(struct a2dp_shm_ring* ring);
+
+// Returns the number of bytes currently queued in |ring|, at most
+// |A2DP_SHM_RING_CAPACITY|.
+size_t a2dp_shm_ring_queued_bytes(const struct a2dp_shm_ring* ring);
+
+// Returns whether the shared memory audio transport is enabled.
+bool a2dp_shm_transport_enabled();
+
+#endif /* AUDIO_A2DP_HW_SHM_H */
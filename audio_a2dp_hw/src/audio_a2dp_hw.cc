@@ -49,6 +49,7 @@
 #include "osi/include/socket_utils/sockets.h"
 
 #include "audio_a2dp_hw.h"
+#include "audio_a2dp_hw_shm.h"
 
 /*****************************************************************************
  *  Constants & Macros
@@ -125,6 +126,11 @@ struct a2dp_stream_common {
   size_t buffer_sz;
   struct a2dp_config cfg;
   a2dp_state_t state;
+  // Shared memory audio transport. When attached, audio data is written to
+  // the ring instead of |audio_fd|.
+  struct a2dp_shm_ring shm_ring;
+  bool shm_writing;        // a write to |shm_ring| is in progress unlocked
+  bool shm_close_pending;  // |shm_ring| must be closed once the write is done
 };
 
 struct a2dp_stream_out {
@@ -342,6 +348,41 @@ static int skt_disconnect(int fd) {
   return 0;
 }
 
+// Sends |n_fds| file descriptors from |fds| over |fd| with SCM_RIGHTS,
+// attached to a single dummy octet.
+// On success, returns 0, otherwise -1.
+static int skt_send_fds(int fd, const int* fds, size_t n_fds) {
+  uint8_t dummy = 0;
+  struct iovec iov;
+  iov.iov_base = &dummy;
+  iov.iov_len = sizeof(dummy);
+
+  char control[CMSG_SPACE(sizeof(int) * A2DP_SHM_NUM_FDS)];
+  if (n_fds > A2DP_SHM_NUM_FDS) return -1;
+  memset(control, 0, sizeof(control));
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+
+  ssize_t sent;
+  OSI_NO_INTR(sent = sendmsg(fd, &msg, MSG_NOSIGNAL));
+  if (sent != sizeof(dummy)) {
+    ERROR("sendmsg failed (%s)", strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
 /*****************************************************************************
  *
  *  AUDIO CONTROL PATH
@@ -469,6 +510,62 @@ static int a2dp_command(struct a2dp_stream_common* common, tA2DP_CTRL_CMD cmd) {
   return 0;
 }
 
+// Sets up the shared memory audio transport for stream |common|: creates the
+// ring and hands its file descriptors over to the stack. The data socket is
+// kept connected and used as fallback if anything fails.
+// On success, returns 0, otherwise -1.
+static int a2dp_shm_datapath_open(struct a2dp_stream_common* common) {
+  int fds[A2DP_SHM_NUM_FDS];
+  tA2DP_CTRL_CMD cmd = A2DP_CTRL_CMD_SETUP_SHM;
+  char ack;
+  ssize_t sent;
+
+  if (common->ctrl_fd == AUDIO_SKT_DISCONNECTED) return -1;
+
+  if (a2dp_shm_ring_create(&common->shm_ring) < 0) {
+    WARN("unable to create shared memory ring, using socket transport");
+    return -1;
+  }
+
+  OSI_NO_INTR(sent = send(common->ctrl_fd, &cmd, 1, MSG_NOSIGNAL));
+  if (sent == -1) {
+    ERROR("cmd failed (%s): command=%s", strerror(errno),
+          audio_a2dp_hw_dump_ctrl_event(cmd));
+    goto error;
+  }
+
+  a2dp_shm_ring_get_fds(&common->shm_ring, fds);
+  if (skt_send_fds(common->ctrl_fd, fds, A2DP_SHM_NUM_FDS) < 0) goto error;
+
+  if (a2dp_ctrl_receive(common, &ack, 1) < 0) {
+    ERROR("A2DP COMMAND %s: no ACK", audio_a2dp_hw_dump_ctrl_event(cmd));
+    goto error;
+  }
+  if (ack != A2DP_CTRL_ACK_SUCCESS) {
+    WARN("A2DP COMMAND %s error %d, using socket transport",
+         audio_a2dp_hw_dump_ctrl_event(cmd), ack);
+    goto error;
+  }
+
+  INFO("shared memory audio transport attached");
+  return 0;
+
+error:
+  a2dp_shm_ring_close(&common->shm_ring);
+  return -1;
+}
+
+static void a2dp_shm_datapath_close(struct a2dp_stream_common* common) {
+  if (!a2dp_shm_ring_is_attached(&common->shm_ring)) return;
+
+  if (common->shm_writing) {
+    // out_write() still uses the mapping; it closes the ring when done.
+    common->shm_close_pending = true;
+    return;
+  }
+  a2dp_shm_ring_close(&common->shm_ring);
+}
+
 static int check_a2dp_ready(struct a2dp_stream_common* common) {
   if (a2dp_command(common, A2DP_CTRL_CMD_CHECK_READY) < 0) {
     ERROR("check a2dp ready failed");
@@ -822,11 +919,17 @@ static void a2dp_stream_common_init(struct a2dp_stream_common* common) {
 
   /* manages max capacity of socket pipe */
   common->buffer_sz = AUDIO_STREAM_OUTPUT_BUFFER_SZ;
+
+  a2dp_shm_ring_init(&common->shm_ring);
+  common->shm_writing = false;
+  common->shm_close_pending = false;
 }
 
 static void a2dp_stream_common_destroy(struct a2dp_stream_common* common) {
   FNLOG();
 
+  a2dp_shm_ring_close(&common->shm_ring);
+
   delete common->mutex;
   common->mutex = NULL;
 }
@@ -884,6 +987,7 @@ static int stop_audio_datapath(struct a2dp_stream_common* common) {
   common->state = (a2dp_state_t)AUDIO_A2DP_STATE_STOPPED;
 
   /* disconnect audio path */
+  a2dp_shm_datapath_close(common);
   skt_disconnect(common->audio_fd);
   common->audio_fd = AUDIO_SKT_DISCONNECTED;
 
@@ -904,6 +1008,7 @@ static int suspend_audio_datapath(struct a2dp_stream_common* common,
     common->state = AUDIO_A2DP_STATE_SUSPENDED;
 
   /* disconnect audio path */
+  a2dp_shm_datapath_close(common);
   skt_disconnect(common->audio_fd);
 
   common->audio_fd = AUDIO_SKT_DISCONNECTED;
@@ -938,6 +1043,7 @@ static ssize_t out_write(struct audio_stream_out* stream, const void* buffer,
     if (start_audio_datapath(&out->common) < 0) {
       goto finish;
     }
+    if (a2dp_shm_transport_enabled()) a2dp_shm_datapath_open(&out->common);
   } else if (out->common.state != AUDIO_A2DP_STATE_STARTED) {
     ERROR("stream not in stopped or standby");
     goto finish;
@@ -956,9 +1062,22 @@ static ssize_t out_write(struct audio_stream_out* stream, const void* buffer,
           out->common.audio_fd);
   }
 
-  lock.unlock();
-  sent = skt_write(out->common.audio_fd, buffer, write_bytes);
-  lock.lock();
+  if (a2dp_shm_ring_is_attached(&out->common.shm_ring)) {
+    out->common.shm_writing = true;
+    lock.unlock();
+    sent = a2dp_shm_ring_write(&out->common.shm_ring, buffer, write_bytes,
+                               SOCK_SEND_TIMEOUT_MS);
+    lock.lock();
+    out->common.shm_writing = false;
+    if (out->common.shm_close_pending || sent == -1) {
+      out->common.shm_close_pending = false;
+      a2dp_shm_ring_close(&out->common.shm_ring);
+    }
+  } else {
+    lock.unlock();
+    sent = skt_write(out->common.audio_fd, buffer, write_bytes);
+    lock.lock();
+  }
 
   if (sent == -1) {
     skt_disconnect(out->common.audio_fd);
@@ -0,0 +1,453 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*****************************************************************************
+ *
+ *  Filename:      audio_a2dp_hw_shm.cc
+ *
+ *  Description:   Lock-free single-producer single-consumer PCM ring shared
+ *                 between the A2DP audio HAL and the Bluetooth stack.
+ *
+ *  The ring lives in a sealed memfd mapped by both processes. Positions are
+ *  free-running 32-bit byte counters; the capacity is a power of two so the
+ *  difference between the write and read positions is always the number of
+ *  queued bytes. Each side only sleeps (in poll() on an eventfd) after it
+ *  published a "waiting" flag, and the other side only signals the eventfd
+ *  when it observes that flag, so no syscall is made while audio flows.
+ *
+ *****************************************************************************/
+
+#define LOG_TAG "bt_a2dp_hw_shm"
+
+#include "audio_a2dp_hw_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+#include "osi/include/properties.h"
+
+/*****************************************************************************
+ *  Constants & Macros
+ *****************************************************************************/
+
+#define A2DP_SHM_MAGIC 0x41324453 /* "A2DS" */
+#define A2DP_SHM_CACHE_LINE 64
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+static_assert((A2DP_SHM_RING_CAPACITY & (A2DP_SHM_RING_CAPACITY - 1)) == 0,
+              "A2DP_SHM_RING_CAPACITY must be a power of two");
+
+/*****************************************************************************
+ *  Local type definitions
+ *****************************************************************************/
+
+struct a2dp_shm_timestamp {
+  uint32_t end_pos;  // write position once the chunk has been written
+  uint32_t reserved;
+  uint64_t timestamp_ns;  // CLOCK_MONOTONIC time the chunk was written
+};
+
+struct a2dp_shm_ring_header {
+  uint32_t magic;
+  uint32_t capacity;
+
+  // Producer-owned state
+  alignas(A2DP_SHM_CACHE_LINE) std::atomic<uint32_t> write_pos;
+  std::atomic<uint32_t> ts_write_idx;
+  std::atomic<uint32_t> writer_waiting;
+
+  // Consumer-owned state
+  alignas(A2DP_SHM_CACHE_LINE) std::atomic<uint32_t> read_pos;
+  std::atomic<uint32_t> ts_read_idx;
+  std::atomic<uint32_t> reader_waiting;
+
+  alignas(A2DP_SHM_CACHE_LINE) a2dp_shm_timestamp
+      timestamps[A2DP_SHM_TIMESTAMP_SLOTS];
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2,
+              "The shared ring requires lock-free 32-bit atomics");
+
+/*****************************************************************************
+ *  Static functions
+ *****************************************************************************/
+
+static size_t a2dp_shm_data_offset() {
+  return (sizeof(a2dp_shm_ring_header) + A2DP_SHM_CACHE_LINE - 1) &
+         ~(size_t)(A2DP_SHM_CACHE_LINE - 1);
+}
+
+static size_t a2dp_shm_map_size() {
+  return a2dp_shm_data_offset() + A2DP_SHM_RING_CAPACITY;
+}
+
+static uint64_t a2dp_shm_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void a2dp_shm_signal(int evt_fd) {
+  uint64_t value = 1;
+  ssize_t ret;
+  OSI_NO_INTR(ret = write(evt_fd, &value, sizeof(value)));
+  if (ret < 0 && errno != EAGAIN) {
+    LOG_ERROR(LOG_TAG, "%s: eventfd write failed: %s", __func__,
+              strerror(errno));
+  }
+}
+
+// Blocks until |evt_fd| is signalled or |timeout_ms| elapsed.
+// Returns true if the event was signalled.
+static bool a2dp_shm_wait(int evt_fd, int timeout_ms) {
+  struct pollfd pfd;
+  pfd.fd = evt_fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  int ret;
+  OSI_NO_INTR(ret = poll(&pfd, 1, timeout_ms));
+  if (ret <= 0) return false;
+
+  uint64_t value;
+  OSI_NO_INTR(ret = read(evt_fd, &value, sizeof(value)));
+  return true;
+}
+
+static int a2dp_shm_memfd_create(const char* name) {
+#if defined(__NR_memfd_create)
+  return syscall(__NR_memfd_create, name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+static int a2dp_shm_map(struct a2dp_shm_ring* ring) {
+  ring->map_size = a2dp_shm_map_size();
+  void* addr = mmap(nullptr, ring->map_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, ring->mem_fd, 0);
+  if (addr == MAP_FAILED) {
+    LOG_ERROR(LOG_TAG, "%s: mmap failed: %s", __func__, strerror(errno));
+    ring->map_size = 0;
+    return -1;
+  }
+  ring->header = static_cast<a2dp_shm_ring_header*>(addr);
+  ring->data = static_cast<uint8_t*>(addr) + a2dp_shm_data_offset();
+  return 0;
+}
+
+// Consumes the write timestamps of all chunks that have been fully read and
+// updates the latency and jitter statistics.
+static void a2dp_shm_update_latency(struct a2dp_shm_ring* ring,
+                                    uint32_t read_pos) {
+  a2dp_shm_ring_header* header = ring->header;
+  a2dp_shm_stats* stats = &ring->stats;
+  uint32_t idx = header->ts_read_idx.load(std::memory_order_relaxed);
+  uint32_t end = header->ts_write_idx.load(std::memory_order_acquire);
+  uint64_t now_ns = 0;
+
+  // The index is written by the peer, don't walk past the slots it can have
+  // filled
+  if (end - idx > A2DP_SHM_TIMESTAMP_SLOTS)
+    idx = end - A2DP_SHM_TIMESTAMP_SLOTS;
+
+  for (; idx != end; idx++) {
+    const a2dp_shm_timestamp& ts =
+        header->timestamps[idx % A2DP_SHM_TIMESTAMP_SLOTS];
+    if ((int32_t)(read_pos - ts.end_pos) < 0) break;
+    if (now_ns == 0) now_ns = a2dp_shm_now_ns();
+
+    uint64_t latency_us =
+        (now_ns > ts.timestamp_ns) ? (now_ns - ts.timestamp_ns) / 1000 : 0;
+    if (stats->total_chunks == 0 || latency_us < stats->latency_min_us)
+      stats->latency_min_us = latency_us;
+    stats->latency_max_us = std::max(stats->latency_max_us, latency_us);
+    stats->latency_total_us += latency_us;
+    if (stats->total_chunks > 0) {
+      int64_t delta = (int64_t)latency_us - (int64_t)stats->last_latency_us;
+      if (delta < 0) delta = -delta;
+      int64_t jitter = (int64_t)stats->jitter_us;
+      jitter += (delta - jitter) / 16;
+      stats->jitter_us = (uint64_t)jitter;
+    }
+    stats->last_latency_us = latency_us;
+    stats->total_chunks++;
+  }
+  header->ts_read_idx.store(idx, std::memory_order_release);
+}
+
+/*****************************************************************************
+ *  Functions
+ *****************************************************************************/
+
+void a2dp_shm_ring_init(struct a2dp_shm_ring* ring) {
+  memset(ring, 0, sizeof(*ring));
+  ring->mem_fd = -1;
+  ring->data_evt_fd = -1;
+  ring->space_evt_fd = -1;
+}
+
+bool a2dp_shm_ring_is_attached(const struct a2dp_shm_ring* ring) {
+  return ring->header != nullptr;
+}
+
+int a2dp_shm_ring_create(struct a2dp_shm_ring* ring) {
+  a2dp_shm_ring_init(ring);
+
+  ring->mem_fd = a2dp_shm_memfd_create("a2dp_audio_ring");
+  if (ring->mem_fd < 0) {
+    LOG_ERROR(LOG_TAG, "%s: memfd_create failed: %s", __func__,
+              strerror(errno));
+    goto error;
+  }
+  if (ftruncate(ring->mem_fd, a2dp_shm_map_size()) < 0) {
+    LOG_ERROR(LOG_TAG, "%s: ftruncate failed: %s", __func__, strerror(errno));
+    goto error;
+  }
+#if defined(F_ADD_SEALS)
+  // Prevent the size from being changed once the peer has mapped the ring.
+  if (fcntl(ring->mem_fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+    LOG_ERROR(LOG_TAG, "%s: sealing failed: %s", __func__, strerror(errno));
+    goto error;
+  }
+#endif
+
+  ring->data_evt_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  ring->space_evt_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (ring->data_evt_fd < 0 || ring->space_evt_fd < 0) {
+    LOG_ERROR(LOG_TAG, "%s: eventfd failed: %s", __func__, strerror(errno));
+    goto error;
+  }
+
+  if (a2dp_shm_map(ring) < 0) goto error;
+
+  ring->header->magic = A2DP_SHM_MAGIC;
+  ring->header->capacity = A2DP_SHM_RING_CAPACITY;
+  ring->header->write_pos.store(0);
+  ring->header->ts_write_idx.store(0);
+  ring->header->writer_waiting.store(0);
+  ring->header->read_pos.store(0);
+  ring->header->ts_read_idx.store(0);
+  ring->header->reader_waiting.store(0);
+  return 0;
+
+error:
+  a2dp_shm_ring_close(ring);
+  return -1;
+}
+
+int a2dp_shm_ring_attach(struct a2dp_shm_ring* ring, const int* fds) {
+  a2dp_shm_ring_init(ring);
+  ring->mem_fd = fds[0];
+  ring->data_evt_fd = fds[1];
+  ring->space_evt_fd = fds[2];
+
+  struct stat st;
+  if (fstat(ring->mem_fd, &st) < 0 ||
+      (size_t)st.st_size < a2dp_shm_map_size()) {
+    LOG_ERROR(LOG_TAG, "%s: invalid shared memory region", __func__);
+    goto error;
+  }
+#if defined(F_GET_SEALS)
+  {
+    int seals = fcntl(ring->mem_fd, F_GET_SEALS);
+    if (seals < 0 || (seals & F_SEAL_SHRINK) == 0) {
+      LOG_ERROR(LOG_TAG, "%s: shared memory region is not sealed", __func__);
+      goto error;
+    }
+  }
+#endif
+
+  if (a2dp_shm_map(ring) < 0) goto error;
+
+  if (ring->header->magic != A2DP_SHM_MAGIC ||
+      ring->header->capacity != A2DP_SHM_RING_CAPACITY) {
+    LOG_ERROR(LOG_TAG, "%s: unexpected ring layout (magic 0x%x capacity %u)",
+              __func__, ring->header->magic, ring->header->capacity);
+    goto error;
+  }
+  return 0;
+
+error:
+  a2dp_shm_ring_close(ring);
+  return -1;
+}
+
+void a2dp_shm_ring_get_fds(const struct a2dp_shm_ring* ring, int* fds) {
+  fds[0] = ring->mem_fd;
+  fds[1] = ring->data_evt_fd;
+  fds[2] = ring->space_evt_fd;
+}
+
+void a2dp_shm_ring_close(struct a2dp_shm_ring* ring) {
+  if (ring->header != nullptr) munmap(ring->header, ring->map_size);
+  if (ring->mem_fd >= 0) close(ring->mem_fd);
+  if (ring->data_evt_fd >= 0) close(ring->data_evt_fd);
+  if (ring->space_evt_fd >= 0) close(ring->space_evt_fd);
+  a2dp_shm_ring_init(ring);
+}
+
+int a2dp_shm_ring_write(struct a2dp_shm_ring* ring, const void* buf,
+                        size_t len, int timeout_ms) {
+  a2dp_shm_ring_header* header = ring->header;
+  const uint8_t* src = static_cast<const uint8_t*>(buf);
+  uint32_t pos = header->write_pos.load(std::memory_order_relaxed);
+  size_t written = 0;
+
+  // Publish the chunk timestamp before any data so the reader can account
+  // for it as soon as the last byte of the chunk is consumed.
+  uint32_t ts_idx = header->ts_write_idx.load(std::memory_order_relaxed);
+  if (ts_idx - header->ts_read_idx.load(std::memory_order_acquire) <
+      A2DP_SHM_TIMESTAMP_SLOTS) {
+    a2dp_shm_timestamp& ts =
+        header->timestamps[ts_idx % A2DP_SHM_TIMESTAMP_SLOTS];
+    ts.end_pos = pos + (uint32_t)len;
+    ts.timestamp_ns = a2dp_shm_now_ns();
+    header->ts_write_idx.store(ts_idx + 1, std::memory_order_release);
+  }
+
+  while (written < len) {
+    uint32_t queued = pos - header->read_pos.load(std::memory_order_acquire);
+    if (queued > A2DP_SHM_RING_CAPACITY) {
+      LOG_ERROR(LOG_TAG, "%s: invalid read position, %u bytes queued",
+                __func__, queued);
+      return -1;
+    }
+    uint32_t free_bytes = A2DP_SHM_RING_CAPACITY - queued;
+    if (free_bytes == 0) {
+      header->writer_waiting.store(1);
+      free_bytes = A2DP_SHM_RING_CAPACITY - (pos - header->read_pos.load());
+      if (free_bytes == 0) {
+        uint64_t start_ns = a2dp_shm_now_ns();
+        bool signalled = a2dp_shm_wait(ring->space_evt_fd, timeout_ms);
+        timeout_ms -= (a2dp_shm_now_ns() - start_ns) / 1000000;
+        if (!signalled || timeout_ms < 0) {
+          header->writer_waiting.store(0);
+          return -1;
+        }
+      }
+      header->writer_waiting.store(0);
+      continue;
+    }
+
+    size_t n = std::min(len - written, (size_t)free_bytes);
+    size_t offset = pos & (A2DP_SHM_RING_CAPACITY - 1);
+    size_t first = std::min(n, (size_t)A2DP_SHM_RING_CAPACITY - offset);
+    memcpy(ring->data + offset, src + written, first);
+    memcpy(ring->data, src + written + first, n - first);
+
+    pos += (uint32_t)n;
+    written += n;
+    header->write_pos.store(pos);
+    if (header->reader_waiting.load()) a2dp_shm_signal(ring->data_evt_fd);
+  }
+
+  return (int)written;
+}
+
+size_t a2dp_shm_ring_read(struct a2dp_shm_ring* ring, void* buf, size_t len,
+                          int timeout_ms) {
+  a2dp_shm_ring_header* header = ring->header;
+  uint8_t* dst = static_cast<uint8_t*>(buf);
+  uint32_t pos = header->read_pos.load(std::memory_order_relaxed);
+  size_t n_read = 0;
+
+  while (n_read < len) {
+    uint32_t avail = header->write_pos.load(std::memory_order_acquire) - pos;
+    if (avail == 0) {
+      header->reader_waiting.store(1);
+      avail = header->write_pos.load() - pos;
+      if (avail == 0) {
+        bool signalled = a2dp_shm_wait(ring->data_evt_fd, timeout_ms);
+        header->reader_waiting.store(0);
+        if (!signalled) break;
+        ring->stats.total_wakeups++;
+        continue;
+      }
+      header->reader_waiting.store(0);
+    }
+    if (avail > A2DP_SHM_RING_CAPACITY) {
+      // The write position comes from the peer process and can't be trusted:
+      // drop whatever it claims to have queued
+      LOG_ERROR(LOG_TAG, "%s: invalid write position, %u bytes queued",
+                __func__, avail);
+      ring->stats.overrun_count++;
+      a2dp_shm_ring_flush(ring);
+      pos = header->read_pos.load(std::memory_order_relaxed);
+      break;
+    }
+
+    size_t n = std::min(len - n_read, (size_t)avail);
+    size_t offset = pos & (A2DP_SHM_RING_CAPACITY - 1);
+    size_t first = std::min(n, (size_t)A2DP_SHM_RING_CAPACITY - offset);
+    memcpy(dst + n_read, ring->data + offset, first);
+    memcpy(dst + n_read + first, ring->data, n - first);
+
+    pos += (uint32_t)n;
+    n_read += n;
+    header->read_pos.store(pos);
+    if (header->writer_waiting.load()) a2dp_shm_signal(ring->space_evt_fd);
+  }
+
+  a2dp_shm_update_latency(ring, pos);
+  ring->stats.total_reads++;
+  ring->stats.total_bytes += n_read;
+  if (n_read < len) ring->stats.underflow_count++;
+
+  return n_read;
+}
+
+void a2dp_shm_ring_flush(struct a2dp_shm_ring* ring) {
+  a2dp_shm_ring_header* header = ring->header;
+  header->read_pos.store(header->write_pos.load(std::memory_order_acquire));
+  header->ts_read_idx.store(
+      header->ts_write_idx.load(std::memory_order_acquire));
+  if (header->writer_waiting.load()) a2dp_shm_signal(ring->space_evt_fd);
+}
+
+size_t a2dp_shm_ring_queued_bytes(const struct a2dp_shm_ring* ring) {
+  const a2dp_shm_ring_header* header = ring->header;
+  uint32_t queued = header->write_pos.load(std::memory_order_acquire) -
+                    header->read_pos.load(std::memory_order_acquire);
+  return std::min(queued, (uint32_t)A2DP_SHM_RING_CAPACITY);
+}
+
+bool a2dp_shm_transport_enabled() {
+  return !osi_property_get_bool("persist.bluetooth.a2dp_shm.disabled", false);
+}
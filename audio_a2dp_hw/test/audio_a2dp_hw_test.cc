@@ -17,8 +17,14 @@
  ******************************************************************************/
 
 #include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <vector>
 
 #include "audio_a2dp_hw/include/audio_a2dp_hw.h"
+#include "audio_a2dp_hw/include/audio_a2dp_hw_shm.h"
 
 namespace {
 static uint32_t codec_sample_rate2value(
@@ -145,3 +151,118 @@ TEST_F(AudioA2dpHwTest, test_compute_buffer_size) {
     }
   }
 }
+
+TEST_F(AudioA2dpHwTest, test_shm_ring_write_read) {
+  struct a2dp_shm_ring writer;
+  struct a2dp_shm_ring reader;
+  ASSERT_EQ(a2dp_shm_ring_create(&writer), 0);
+
+  // Attach a second mapping the same way the stack does
+  int fds[A2DP_SHM_NUM_FDS];
+  a2dp_shm_ring_get_fds(&writer, fds);
+  for (int& fd : fds) fd = dup(fd);
+  ASSERT_EQ(a2dp_shm_ring_attach(&reader, fds), 0);
+  EXPECT_TRUE(a2dp_shm_ring_is_attached(&reader));
+
+  // Write and read enough data to wrap around the ring several times
+  const size_t chunk = 1000;
+  std::vector<uint8_t> in(chunk);
+  std::vector<uint8_t> out(chunk);
+  for (size_t i = 0; i < 4 * A2DP_SHM_RING_CAPACITY / chunk; i++) {
+    for (size_t j = 0; j < chunk; j++) in[j] = (uint8_t)(i + j);
+    EXPECT_EQ(a2dp_shm_ring_write(&writer, in.data(), chunk, 0), (int)chunk);
+    EXPECT_EQ(a2dp_shm_ring_queued_bytes(&reader), chunk);
+    EXPECT_EQ(a2dp_shm_ring_read(&reader, out.data(), chunk, 0), chunk);
+    EXPECT_EQ(in, out);
+  }
+  EXPECT_EQ(reader.stats.underflow_count, 0u);
+  EXPECT_GT(reader.stats.total_chunks, 0u);
+
+  // Reading from an empty ring times out and counts an underflow
+  EXPECT_EQ(a2dp_shm_ring_read(&reader, out.data(), chunk, 0), 0u);
+  EXPECT_EQ(reader.stats.underflow_count, 1u);
+
+  a2dp_shm_ring_close(&reader);
+  a2dp_shm_ring_close(&writer);
+  EXPECT_FALSE(a2dp_shm_ring_is_attached(&writer));
+}
+
+TEST_F(AudioA2dpHwTest, test_shm_ring_full_and_flush) {
+  struct a2dp_shm_ring ring;
+  ASSERT_EQ(a2dp_shm_ring_create(&ring), 0);
+
+  std::vector<uint8_t> buf(A2DP_SHM_RING_CAPACITY);
+  EXPECT_EQ(a2dp_shm_ring_write(&ring, buf.data(), buf.size(), 0),
+            (int)buf.size());
+
+  // No space left: the write must time out
+  EXPECT_EQ(a2dp_shm_ring_write(&ring, buf.data(), 1, 0), -1);
+
+  a2dp_shm_ring_flush(&ring);
+  EXPECT_EQ(a2dp_shm_ring_queued_bytes(&ring), 0u);
+  EXPECT_EQ(a2dp_shm_ring_write(&ring, buf.data(), 1, 0), 1);
+
+  a2dp_shm_ring_close(&ring);
+}
+
+TEST_F(AudioA2dpHwTest, test_shm_ring_invalid_write_pos) {
+  struct a2dp_shm_ring writer;
+  struct a2dp_shm_ring reader;
+  ASSERT_EQ(a2dp_shm_ring_create(&writer), 0);
+
+  int fds[A2DP_SHM_NUM_FDS];
+  a2dp_shm_ring_get_fds(&writer, fds);
+  for (int& fd : fds) fd = dup(fd);
+  ASSERT_EQ(a2dp_shm_ring_attach(&reader, fds), 0);
+
+  // The write position is the first field on the second cache line of the
+  // header. Move it past the capacity, as a misbehaving peer could.
+  size_t map_size = lseek(fds[0], 0, SEEK_END);
+  void* addr =
+      mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+  ASSERT_NE(addr, MAP_FAILED);
+  uint32_t* write_pos = reinterpret_cast<uint32_t*>((uint8_t*)addr + 64);
+  *write_pos = 3 * A2DP_SHM_RING_CAPACITY;
+
+  EXPECT_EQ(a2dp_shm_ring_queued_bytes(&reader),
+            (size_t)A2DP_SHM_RING_CAPACITY);
+  std::vector<uint8_t> out(4 * A2DP_SHM_RING_CAPACITY);
+  EXPECT_EQ(a2dp_shm_ring_read(&reader, out.data(), out.size(), 0), 0u);
+  EXPECT_EQ(reader.stats.overrun_count, 1u);
+  EXPECT_EQ(a2dp_shm_ring_queued_bytes(&reader), 0u);
+
+  munmap(addr, map_size);
+  a2dp_shm_ring_close(&reader);
+  a2dp_shm_ring_close(&writer);
+}
+
+TEST_F(AudioA2dpHwTest, test_shm_ring_attach_unsealed) {
+  struct a2dp_shm_ring writer;
+  struct a2dp_shm_ring reader;
+  ASSERT_EQ(a2dp_shm_ring_create(&writer), 0);
+
+  int fds[A2DP_SHM_NUM_FDS];
+  a2dp_shm_ring_get_fds(&writer, fds);
+  for (int& fd : fds) fd = dup(fd);
+
+  // A copy of the ring in a regular file, which can't be sealed
+#if defined(OS_GENERIC)
+  char path[] = "/tmp/a2dp_shm_XXXXXX";
+#else
+  char path[] = "/data/local/tmp/a2dp_shm_XXXXXX";
+#endif  // !defined(OS_GENERIC)
+  int file_fd = mkstemp(path);
+  ASSERT_GE(file_fd, 0);
+  unlink(path);
+  std::vector<uint8_t> content(lseek(fds[0], 0, SEEK_END));
+  ASSERT_EQ(pread(fds[0], content.data(), content.size(), 0),
+            (ssize_t)content.size());
+  ASSERT_EQ(write(file_fd, content.data(), content.size()),
+            (ssize_t)content.size());
+  close(fds[0]);
+  fds[0] = file_fd;
+  EXPECT_LT(a2dp_shm_ring_attach(&reader, fds), 0);
+  EXPECT_FALSE(a2dp_shm_ring_is_attached(&reader));
+
+  a2dp_shm_ring_close(&writer);
+}
@@ -523,6 +523,11 @@ void bta_av_sink_data_cback(uint8_t handle, BT_HDR* p_pkt, uint32_t time_stamp,
     osi_free(p_pkt);
     return;
   }
+  /* Pass the timestamp in the headroom left by the stripped RTP header */
+  if (p_pkt->offset >= BTA_AV_SINK_MEDIA_TS_SIZE) {
+    memcpy((uint8_t*)(p_pkt + 1) + p_pkt->offset - BTA_AV_SINK_MEDIA_TS_SIZE,
+           &time_stamp, sizeof(time_stamp));
+  }
   p_pkt->event = BTA_AV_SINK_MEDIA_DATA_EVT;
   p_scb->seps[p_scb->sep_idx].p_app_sink_data_cback(BTA_AV_SINK_MEDIA_DATA_EVT,
                                                     (tBTA_AV_MEDIA*)p_pkt);
@@ -2085,6 +2090,59 @@ void bta_av_reconfig(tBTA_AV_SCB* p_scb, tBTA_AV_DATA* p_data) {
   }
 }
 
+/*******************************************************************************
+ *
+ * Function         bta_av_media_headroom
+ *
+ * Description      Get the number of bytes AVDTP, L2CAP and HCI prepend to an
+ *                  encoded media packet of the stream.
+ *
+ * Returns          the headroom in bytes
+ *
+ ******************************************************************************/
+static uint16_t bta_av_media_headroom(const tBTA_AV_SCB* p_scb) {
+  bool add_rtp_header =
+      !p_scb->no_rtp_header &&
+      A2DP_UsesRtpHeader(p_scb->cfg.num_protect > 0, p_scb->cfg.codec_info);
+  if (add_rtp_header) return AVDT_MEDIA_OFFSET;
+  return AVDT_MEDIA_OFFSET - AVDT_MEDIA_HDR_SIZE;
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_av_ensure_media_headroom
+ *
+ * Description      Make sure an encoded media packet has enough headroom for
+ *                  the headers prepended by the lower layers, so it can be
+ *                  passed down to the controller without further copies.
+ *                  The encoders reserve the headroom when they allocate the
+ *                  packets; if one did not, the packet is copied to a new
+ *                  buffer.
+ *
+ * Returns          the packet to send, possibly a new buffer
+ *
+ ******************************************************************************/
+static BT_HDR* bta_av_ensure_media_headroom(tBTA_AV_SCB* p_scb,
+                                            BT_HDR* p_buf) {
+  uint16_t headroom = bta_av_media_headroom(p_scb);
+  if (p_buf->offset >= headroom) return p_buf;
+
+  APPL_TRACE_WARNING("%s: packet offset %d is below the headroom %d", __func__,
+                     p_buf->offset, headroom);
+  BT_HDR* p_new = (BT_HDR*)osi_malloc(BT_HDR_SIZE + headroom + p_buf->len);
+  p_new->event = p_buf->event;
+  p_new->len = p_buf->len;
+  p_new->offset = headroom;
+  p_new->layer_specific = p_buf->layer_specific;
+  memcpy((uint8_t*)(p_new + 1) + p_new->offset,
+         (uint8_t*)(p_buf + 1) + p_buf->offset, p_buf->len);
+  osi_free(p_buf);
+
+  p_scb->media_path_stats.headroom_copies++;
+  p_scb->media_path_stats.total_copied_bytes += p_new->len;
+  return p_new;
+}
+
 /*******************************************************************************
  *
  * Function         bta_av_data_path
@@ -2098,6 +2156,7 @@ void bta_av_data_path(tBTA_AV_SCB* p_scb, UNUSED_ATTR tBTA_AV_DATA* p_data) {
   BT_HDR* p_buf = NULL;
   uint32_t timestamp;
   bool new_buf = false;
+  bool zero_copy = false;
   uint8_t m_pt = 0x60;
   tAVDT_DATA_OPT_MASK opt;
 
@@ -2122,6 +2181,10 @@ void bta_av_data_path(tBTA_AV_SCB* p_scb, UNUSED_ATTR tBTA_AV_DATA* p_data) {
     p_buf = p_scb->p_cos->data(p_scb->cfg.codec_info, &timestamp);
 
     if (p_buf) {
+      BT_HDR* p_orig = p_buf;
+      p_buf = bta_av_ensure_media_headroom(p_scb, p_buf);
+      zero_copy = (p_buf == p_orig);
+
       /* use the offset area for the time stamp */
       *(uint32_t*)(p_buf + 1) = timestamp;
 
@@ -2162,7 +2225,8 @@ void bta_av_data_path(tBTA_AV_SCB* p_scb, UNUSED_ATTR tBTA_AV_DATA* p_data) {
         size_t fragment_len = data_end - data_begin;
         if (fragment_len > p_scb->stream_mtu) fragment_len = p_scb->stream_mtu;
 
-        BT_HDR* p_buf2 = (BT_HDR*)osi_malloc(BT_DEFAULT_BUFFER_SIZE);
+        BT_HDR* p_buf2 =
+            (BT_HDR*)osi_malloc(BT_HDR_SIZE + p_buf->offset + fragment_len);
         p_buf2->offset = p_buf->offset;
         p_buf2->len = 0;
         p_buf2->layer_specific = 0;
@@ -2172,6 +2236,16 @@ void bta_av_data_path(tBTA_AV_SCB* p_scb, UNUSED_ATTR tBTA_AV_DATA* p_data) {
         p_buf2->len += fragment_len;
         extra_fragments.push_back(p_buf2);
         p_buf->len -= fragment_len;
+        p_scb->media_path_stats.fragment_copies++;
+        p_scb->media_path_stats.total_copied_bytes += fragment_len;
+      }
+
+      // Only a buffer sent as the encoder handed it over is zero-copy.
+      // Buffers taken from |a2dp_list| are requeued packets or copies made
+      // by bta_av_dup_audio_buf(), and are never counted.
+      p_scb->media_path_stats.total_packets++;
+      if (zero_copy && extra_fragments.empty()) {
+        p_scb->media_path_stats.zero_copy_packets++;
       }
 
       if (!extra_fragments.empty()) {
@@ -454,6 +454,16 @@ typedef union {
 #define BTA_AV_COLL_API_CALLED \
   0x02 /* API open was called while incoming timer is running */
 
+/* media packet path statistics of an audio stream */
+typedef struct {
+  uint64_t total_packets;      /* encoded packets written to the stream */
+  uint64_t zero_copy_packets;  /* encoder buffers handed to AVDTP as is */
+  uint64_t headroom_copies;    /* packets copied for missing header headroom */
+  uint64_t fragment_copies;    /* extra fragments copied out of a packet */
+  uint64_t dup_copies;         /* packets copied for another audio stream */
+  uint64_t total_copied_bytes; /* bytes copied by all the above */
+} tBTA_AV_MEDIA_PATH_STATS;
+
 /* type for AV stream control block */
 // TODO: This should be renamed and changed to a proper class
 struct tBTA_AV_SCB final {
@@ -514,6 +524,7 @@ struct tBTA_AV_SCB final {
   uint16_t uuid_int; /*intended UUID of Initiator to connect to */
   bool offload_start_pending;
   bool offload_started;
+  tBTA_AV_MEDIA_PATH_STATS media_path_stats;
 
   /**
    * Called to setup the state when connected to a peer.
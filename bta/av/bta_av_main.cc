@@ -25,6 +25,7 @@
 #define LOG_TAG "bt_bta_av"
 
 #include <base/logging.h>
+#include <inttypes.h>
 #include <string.h>
 
 #include "bt_target.h"
@@ -1141,6 +1142,8 @@ void bta_av_dup_audio_buf(tBTA_AV_SCB* p_scb, BT_HDR* p_buf) {
     BT_HDR* p_new = (BT_HDR*)osi_malloc(copy_size);
     memcpy(p_new, p_buf, copy_size);
     list_append(p_scbi->a2dp_list, p_new);
+    p_scbi->media_path_stats.dup_copies++;
+    p_scbi->media_path_stats.total_copied_bytes += p_buf->len;
 
     if (list_length(p_scbi->a2dp_list) > p_bta_av_cfg->audio_mqs) {
       // Drop the oldest packet
@@ -1484,5 +1487,15 @@ void bta_debug_av_dump(int fd) {
             p_scb->no_rtp_header ? "true" : "false");
     dprintf(fd, "    Intended UUID of Initiator to connect to: 0x%x\n",
             p_scb->uuid_int);
+    const tBTA_AV_MEDIA_PATH_STATS& stats = p_scb->media_path_stats;
+    dprintf(fd, "    Media packets (total/zero-copy): %" PRIu64 " / %" PRIu64
+            "\n",
+            stats.total_packets, stats.zero_copy_packets);
+    dprintf(fd,
+            "    Media packet copies (headroom/fragment/duplicate): %" PRIu64
+            " / %" PRIu64 " / %" PRIu64 "\n",
+            stats.headroom_copies, stats.fragment_copies, stats.dup_copies);
+    dprintf(fd, "    Media copied bytes: %" PRIu64 "\n",
+            stats.total_copied_bytes);
   }
 }
@@ -695,6 +695,7 @@ void bta_gattc_disc_cmpl(tBTA_GATTC_CLCB* p_clcb,
     if (p_clcb->p_srcb) {
       // clear reallocating
       std::vector<tBTA_GATTC_SERVICE>().swap(p_clcb->p_srcb->srvc_cache);
+      bta_gattc_clear_handle_index(p_clcb->p_srcb);
     }
 
     /* used to reset cache in application */
@@ -844,14 +845,25 @@ void bta_gattc_confirm(tBTA_GATTC_CLCB* p_clcb, tBTA_GATTC_DATA* p_data) {
 
 /** read complete */
 void bta_gattc_read_cmpl(tBTA_GATTC_CLCB* p_clcb, tBTA_GATTC_OP_CMPL* p_data) {
-  GATT_READ_OP_CB cb = p_clcb->p_q_cmd->api_read.read_cb;
-  void* my_cb_data = p_clcb->p_q_cmd->api_read.read_cb_data;
+  GATT_READ_OP_CB cb;
+  void* my_cb_data;
+  uint16_t handle;
+
+  if (p_clcb->p_q_cmd->hdr.event == BTA_GATTC_API_READ_MULTI_EVT) {
+    /* read multiple returns the concatenated values, with the first handle */
+    cb = p_clcb->p_q_cmd->api_read_multi.read_cb;
+    my_cb_data = p_clcb->p_q_cmd->api_read_multi.read_cb_data;
+    handle = p_clcb->p_q_cmd->api_read_multi.handles[0];
+  } else {
+    cb = p_clcb->p_q_cmd->api_read.read_cb;
+    my_cb_data = p_clcb->p_q_cmd->api_read.read_cb_data;
 
-  /* if it was read by handle, return the handle requested, if read by UUID, use
-   * handle returned from remote
-   */
-  uint16_t handle = p_clcb->p_q_cmd->api_read.handle;
-  if (handle == 0) handle = p_data->p_cmpl->att_value.handle;
+    /* if it was read by handle, return the handle requested, if read by UUID,
+     * use handle returned from remote
+     */
+    handle = p_clcb->p_q_cmd->api_read.handle;
+    if (handle == 0) handle = p_data->p_cmpl->att_value.handle;
+  }
 
   osi_free_and_reset((void**)&p_clcb->p_q_cmd);
 
@@ -927,8 +939,11 @@ void bta_gattc_op_cmpl(tBTA_GATTC_CLCB* p_clcb, tBTA_GATTC_DATA* p_data) {
     return;
   }
 
-  if (p_clcb->p_q_cmd->hdr.event !=
-      bta_gattc_opcode_to_int_evt[op - GATTC_OPTYPE_READ]) {
+  /* a read multiple request completes as a read */
+  bool read_multi = op == GATTC_OPTYPE_READ &&
+                    p_clcb->p_q_cmd->hdr.event == BTA_GATTC_API_READ_MULTI_EVT;
+  if (!read_multi && p_clcb->p_q_cmd->hdr.event !=
+                         bta_gattc_opcode_to_int_evt[op - GATTC_OPTYPE_READ]) {
     mapped_op =
         p_clcb->p_q_cmd->hdr.event - BTA_GATTC_API_READ_EVT + GATTC_OPTYPE_READ;
     if (mapped_op > GATTC_OPTYPE_INDICATION) mapped_op = 0;
@@ -1108,6 +1123,7 @@ void bta_gattc_process_api_refresh(const RawAddress& remote_bda) {
 
     // clear reallocating
     std::vector<tBTA_GATTC_SERVICE>().swap(p_srvc_cb->srvc_cache);
+    bta_gattc_clear_handle_index(p_srvc_cb);
   }
 
   /* used to reset cache in application */
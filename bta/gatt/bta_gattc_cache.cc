@@ -32,7 +32,10 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "bt_common.h"
+#include "bta_gattc_cache_store.h"
 #include "bta_gattc_int.h"
 #include "bta_sys.h"
 #include "btm_api.h"
@@ -49,6 +52,7 @@ using base::StringPrintf;
 
 static void bta_gattc_cache_write(const RawAddress& server_bda,
                                   uint16_t num_attr, tBTA_GATTC_NV_ATTR* attr);
+static bool bta_gattc_cache_load_file(tBTA_GATTC_CLCB* p_clcb);
 static void bta_gattc_char_dscpt_disc_cmpl(uint16_t conn_id,
                                            tBTA_GATTC_SERV* p_srvc_cb);
 static tGATT_STATUS bta_gattc_sdp_service_disc(uint16_t conn_id,
@@ -62,6 +66,20 @@ tBTA_GATTC_CHARACTERISTIC* bta_gattc_get_characteristic_srcb(
 
 #define GATT_CACHE_PREFIX "/data/misc/bluetooth/gatt_cache_"
 #define GATT_CACHE_VERSION 4
+#define GATT_CACHE_STORE_PATH "/data/misc/bluetooth/gatt_cache_store"
+
+/* Caches of all the servers, mapped on first use. The per server files are
+ * only used if the store can't be mapped, and to migrate their caches. */
+static GattCacheStore gatt_cache_store;
+static bool gatt_cache_store_opened = false;
+
+static GattCacheStore* bta_gattc_cache_store() {
+  if (!gatt_cache_store_opened) {
+    gatt_cache_store_opened = true;
+    gatt_cache_store.Open(GATT_CACHE_STORE_PATH, GATT_CACHE_VERSION);
+  }
+  return gatt_cache_store.IsOpen() ? &gatt_cache_store : NULL;
+}
 
 static void bta_gattc_generate_cache_file_name(char* buffer, size_t buffer_len,
                                                const RawAddress& bda) {
@@ -145,9 +163,117 @@ tGATT_STATUS bta_gattc_init_cache(tBTA_GATTC_SERV* p_srvc_cb) {
   // clear reallocating
   std::vector<tBTA_GATTC_SERVICE>().swap(p_srvc_cb->srvc_cache);
   std::vector<tBTA_GATTC_SERVICE>().swap(p_srvc_cb->pending_discovery);
+  bta_gattc_clear_handle_index(p_srvc_cb);
   return GATT_SUCCESS;
 }
 
+/* Returns the position in attr_refs of the attributes of |service| at
+ * |handle|, or 0 if |handle| belongs to another service */
+static uint32_t bta_gattc_attr_ref_for(tBTA_GATTC_SERV* p_srcb,
+                                       tBTA_GATTC_SERVICE* service,
+                                       uint16_t handle,
+                                       uint32_t num_service_refs) {
+  uint32_t pos = p_srcb->handle_index[handle];
+  if (p_srcb->attr_refs[pos].service != service) return 0;
+
+  /* the handle still refers to the service: give it its own attributes */
+  if (pos < num_service_refs) {
+    pos = p_srcb->attr_refs.size();
+    p_srcb->attr_refs.push_back(tBTA_GATTC_ATTR_REF{.service = service});
+    p_srcb->handle_index[handle] = pos;
+  }
+  return pos;
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_gattc_build_handle_index
+ *
+ * Description      Index the attributes of the server cache by handle, so that
+ *                  they are found in constant time. The index gives the same
+ *                  attributes as searching the cache: a handle belongs to the
+ *                  first service whose range covers it.
+ *
+ * Returns          None.
+ *
+ ******************************************************************************/
+void bta_gattc_build_handle_index(tBTA_GATTC_SERV* p_srcb) {
+  bta_gattc_clear_handle_index(p_srcb);
+  if (p_srcb->srvc_cache.empty()) return;
+
+  /* service ranges often end at 0xFFFF: only index up to the last attribute */
+  uint16_t max_handle = 0;
+  for (const tBTA_GATTC_SERVICE& service : p_srcb->srvc_cache) {
+    max_handle = std::max(max_handle, service.s_handle);
+    for (const tBTA_GATTC_CHARACTERISTIC& charac : service.characteristics) {
+      max_handle = std::max(max_handle, charac.value_handle);
+      for (const tBTA_GATTC_DESCRIPTOR& desc : charac.descriptors)
+        max_handle = std::max(max_handle, desc.handle);
+    }
+    for (const tBTA_GATTC_INCLUDED_SVC& incl : service.included_svc)
+      max_handle = std::max(max_handle, incl.handle);
+  }
+
+  /* position 0 has no attributes */
+  p_srcb->handle_index.assign(max_handle + 1, 0);
+  p_srcb->attr_refs.assign(1, tBTA_GATTC_ATTR_REF{});
+
+  for (tBTA_GATTC_SERVICE& service : p_srcb->srvc_cache) {
+    if (service.s_handle > service.e_handle || service.s_handle > max_handle)
+      continue;
+
+    uint32_t pos = p_srcb->attr_refs.size();
+    p_srcb->attr_refs.push_back(tBTA_GATTC_ATTR_REF{.service = &service});
+    uint32_t e_handle = std::min(service.e_handle, max_handle);
+    for (uint32_t handle = service.s_handle; handle <= e_handle; handle++) {
+      if (p_srcb->handle_index[handle] == 0)
+        p_srcb->handle_index[handle] = pos;
+    }
+  }
+
+  uint32_t num_service_refs = p_srcb->attr_refs.size();
+  for (tBTA_GATTC_SERVICE& service : p_srcb->srvc_cache) {
+    for (tBTA_GATTC_CHARACTERISTIC& charac : service.characteristics) {
+      uint32_t pos = bta_gattc_attr_ref_for(
+          p_srcb, &service, charac.value_handle, num_service_refs);
+      if (pos != 0 && p_srcb->attr_refs[pos].characteristic == NULL)
+        p_srcb->attr_refs[pos].characteristic = &charac;
+
+      for (tBTA_GATTC_DESCRIPTOR& desc : charac.descriptors) {
+        pos = bta_gattc_attr_ref_for(p_srcb, &service, desc.handle,
+                                     num_service_refs);
+        if (pos != 0 && p_srcb->attr_refs[pos].descriptor == NULL) {
+          p_srcb->attr_refs[pos].descriptor = &desc;
+          p_srcb->attr_refs[pos].owning_characteristic = &charac;
+        }
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_gattc_clear_handle_index
+ *
+ * Description      Clear the handle index, when the server cache is cleared.
+ *
+ * Returns          None.
+ *
+ ******************************************************************************/
+void bta_gattc_clear_handle_index(tBTA_GATTC_SERV* p_srcb) {
+  std::vector<uint32_t>().swap(p_srcb->handle_index);
+  std::vector<tBTA_GATTC_ATTR_REF>().swap(p_srcb->attr_refs);
+}
+
+/* Returns the attributes of the server cache at |handle|, or NULL if |handle|
+ * is after the last attribute */
+static const tBTA_GATTC_ATTR_REF* bta_gattc_find_attr_ref(
+    tBTA_GATTC_SERV* p_srcb, uint16_t handle) {
+  if (p_srcb->handle_index.empty()) bta_gattc_build_handle_index(p_srcb);
+  if (handle >= p_srcb->handle_index.size()) return NULL;
+  return &p_srcb->attr_refs[p_srcb->handle_index[handle]];
+}
+
 tBTA_GATTC_SERVICE* bta_gattc_find_matching_service(
     std::vector<tBTA_GATTC_SERVICE>& services, uint16_t handle) {
   for (tBTA_GATTC_SERVICE& service : services) {
@@ -338,6 +464,7 @@ static void bta_gattc_explore_srvc(uint16_t conn_id,
 
   p_srvc_cb->srvc_cache.swap(p_srvc_cb->pending_discovery);
   std::vector<tBTA_GATTC_SERVICE>().swap(p_srvc_cb->pending_discovery);
+  bta_gattc_build_handle_index(p_srvc_cb);
 
 #if (BTA_GATT_DEBUG == TRUE)
   bta_gattc_display_cache_server(p_srvc_cb->srvc_cache);
@@ -648,29 +775,26 @@ tBTA_GATTC_SERVICE* bta_gattc_get_service_for_handle_srcb(
   std::vector<tBTA_GATTC_SERVICE>* services =
       bta_gattc_get_services_srcb(p_srcb);
   if (services == NULL) return NULL;
+
+  const tBTA_GATTC_ATTR_REF* ref = bta_gattc_find_attr_ref(p_srcb, handle);
+  if (ref != NULL) return ref->service;
   return bta_gattc_find_matching_service(*services, handle);
 }
 
 const tBTA_GATTC_SERVICE* bta_gattc_get_service_for_handle(uint16_t conn_id,
                                                            uint16_t handle) {
-  std::vector<tBTA_GATTC_SERVICE>* services = bta_gattc_get_services(conn_id);
-  if (services == NULL) return NULL;
+  tBTA_GATTC_CLCB* p_clcb = bta_gattc_find_clcb_by_conn_id(conn_id);
+  if (p_clcb == NULL) return NULL;
 
-  return bta_gattc_find_matching_service(*services, handle);
+  return bta_gattc_get_service_for_handle_srcb(p_clcb->p_srcb, handle);
 }
 
 tBTA_GATTC_CHARACTERISTIC* bta_gattc_get_characteristic_srcb(
     tBTA_GATTC_SERV* p_srcb, uint16_t handle) {
-  tBTA_GATTC_SERVICE* service =
-      bta_gattc_get_service_for_handle_srcb(p_srcb, handle);
-
-  if (!service) return NULL;
+  if (bta_gattc_get_services_srcb(p_srcb) == NULL) return NULL;
 
-  for (tBTA_GATTC_CHARACTERISTIC& charac : service->characteristics) {
-    if (handle == charac.value_handle) return &charac;
-  }
-
-  return NULL;
+  const tBTA_GATTC_ATTR_REF* ref = bta_gattc_find_attr_ref(p_srcb, handle);
+  return ref ? ref->characteristic : NULL;
 }
 
 tBTA_GATTC_CHARACTERISTIC* bta_gattc_get_characteristic(uint16_t conn_id,
@@ -685,20 +809,10 @@ tBTA_GATTC_CHARACTERISTIC* bta_gattc_get_characteristic(uint16_t conn_id,
 
 const tBTA_GATTC_DESCRIPTOR* bta_gattc_get_descriptor_srcb(
     tBTA_GATTC_SERV* p_srcb, uint16_t handle) {
-  const tBTA_GATTC_SERVICE* service =
-      bta_gattc_get_service_for_handle_srcb(p_srcb, handle);
-
-  if (!service) {
-    return NULL;
-  }
+  if (bta_gattc_get_services_srcb(p_srcb) == NULL) return NULL;
 
-  for (const tBTA_GATTC_CHARACTERISTIC& charac : service->characteristics) {
-    for (const tBTA_GATTC_DESCRIPTOR& desc : charac.descriptors) {
-      if (handle == desc.handle) return &desc;
-    }
-  }
-
-  return NULL;
+  const tBTA_GATTC_ATTR_REF* ref = bta_gattc_find_attr_ref(p_srcb, handle);
+  return ref ? ref->descriptor : NULL;
 }
 
 const tBTA_GATTC_DESCRIPTOR* bta_gattc_get_descriptor(uint16_t conn_id,
@@ -713,18 +827,10 @@ const tBTA_GATTC_DESCRIPTOR* bta_gattc_get_descriptor(uint16_t conn_id,
 
 tBTA_GATTC_CHARACTERISTIC* bta_gattc_get_owning_characteristic_srcb(
     tBTA_GATTC_SERV* p_srcb, uint16_t handle) {
-  tBTA_GATTC_SERVICE* service =
-      bta_gattc_get_service_for_handle_srcb(p_srcb, handle);
-
-  if (!service) return NULL;
+  if (bta_gattc_get_services_srcb(p_srcb) == NULL) return NULL;
 
-  for (tBTA_GATTC_CHARACTERISTIC& charac : service->characteristics) {
-    for (const tBTA_GATTC_DESCRIPTOR& desc : charac.descriptors) {
-      if (handle == desc.handle) return &charac;
-    }
-  }
-
-  return NULL;
+  const tBTA_GATTC_ATTR_REF* ref = bta_gattc_find_attr_ref(p_srcb, handle);
+  return ref ? ref->owning_characteristic : NULL;
 }
 
 const tBTA_GATTC_CHARACTERISTIC* bta_gattc_get_owning_characteristic(
@@ -910,7 +1016,7 @@ void bta_gattc_get_gatt_db(uint16_t conn_id, uint16_t start_handle,
 
 /* rebuild server cache from NV cache */
 void bta_gattc_rebuild_cache(tBTA_GATTC_SERV* p_srvc_cb, uint16_t num_attr,
-                             tBTA_GATTC_NV_ATTR* p_attr) {
+                             const tBTA_GATTC_NV_ATTR* p_attr) {
   /* first attribute loading, initialize buffer */
   LOG(INFO) << __func__ << " " << num_attr;
 
@@ -943,6 +1049,8 @@ void bta_gattc_rebuild_cache(tBTA_GATTC_SERV* p_srvc_cb, uint16_t num_attr,
     p_attr++;
     num_attr--;
   }
+
+  bta_gattc_build_handle_index(p_srvc_cb);
 }
 
 /*******************************************************************************
@@ -1020,7 +1128,9 @@ void bta_gattc_cache_save(tBTA_GATTC_SERV* p_srvc_cb, uint16_t conn_id) {
  *
  * Function         bta_gattc_cache_load
  *
- * Description      Load GATT cache from storage for server.
+ * Description      Load GATT cache from storage for server. The cache is
+ *                  rebuilt from the mapped store without copying it; a cache
+ *                  found in a per server file is moved to the store.
  *
  * Parameter        p_clcb: pointer to server clcb, that will
  *                          be filled from storage
@@ -1028,6 +1138,46 @@ void bta_gattc_cache_save(tBTA_GATTC_SERV* p_srvc_cb, uint16_t conn_id) {
  *
  ******************************************************************************/
 bool bta_gattc_cache_load(tBTA_GATTC_CLCB* p_clcb) {
+  GattCacheStore* store = bta_gattc_cache_store();
+  if (store == NULL) return bta_gattc_cache_load_file(p_clcb);
+
+  const RawAddress& server_bda = p_clcb->p_srcb->server_bda;
+  size_t len = 0;
+  const void* attr = store->Find(server_bda, &len);
+  if (attr != NULL) {
+    size_t num_attr = len / sizeof(tBTA_GATTC_NV_ATTR);
+    if (len % sizeof(tBTA_GATTC_NV_ATTR) != 0 || num_attr > UINT16_MAX) {
+      LOG(ERROR) << __func__ << ": bad GATT cache length " << len;
+      store->Remove(server_bda);
+      return false;
+    }
+    bta_gattc_rebuild_cache(p_clcb->p_srcb, num_attr,
+                            static_cast<const tBTA_GATTC_NV_ATTR*>(attr));
+    return true;
+  }
+
+  char fname[255] = {0};
+  bta_gattc_generate_cache_file_name(fname, sizeof(fname), server_bda);
+  if (access(fname, F_OK) != 0) return false;
+
+  if (!bta_gattc_cache_load_file(p_clcb)) return false;
+  bta_gattc_cache_save(p_clcb->p_srcb, p_clcb->bta_conn_id);
+  unlink(fname);
+  return true;
+}
+
+/*******************************************************************************
+ *
+ * Function         bta_gattc_cache_load_file
+ *
+ * Description      Load GATT cache from the file of the server.
+ *
+ * Parameter        p_clcb: pointer to server clcb, that will
+ *                          be filled from storage
+ * Returns          true on success, false otherwise
+ *
+ ******************************************************************************/
+static bool bta_gattc_cache_load_file(tBTA_GATTC_CLCB* p_clcb) {
   char fname[255] = {0};
   bta_gattc_generate_cache_file_name(fname, sizeof(fname),
                                      p_clcb->p_srcb->server_bda);
@@ -1092,6 +1242,13 @@ done:
  ******************************************************************************/
 static void bta_gattc_cache_write(const RawAddress& server_bda,
                                   uint16_t num_attr, tBTA_GATTC_NV_ATTR* attr) {
+  GattCacheStore* store = bta_gattc_cache_store();
+  if (store != NULL) {
+    if (!store->Store(server_bda, attr, sizeof(tBTA_GATTC_NV_ATTR) * num_attr))
+      LOG(ERROR) << __func__ << ": can't store GATT cache for " << server_bda;
+    return;
+  }
+
   char fname[255] = {0};
   bta_gattc_generate_cache_file_name(fname, sizeof(fname), server_bda);
 
@@ -1139,6 +1296,9 @@ static void bta_gattc_cache_write(const RawAddress& server_bda,
  ******************************************************************************/
 void bta_gattc_cache_reset(const RawAddress& server_bda) {
   VLOG(1) << __func__;
+  GattCacheStore* store = bta_gattc_cache_store();
+  if (store != NULL) store->Remove(server_bda);
+
   char fname[255] = {0};
   bta_gattc_generate_cache_file_name(fname, sizeof(fname), server_bda);
   unlink(fname);
@@ -0,0 +1,484 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "bt_bta_gattc"
+
+#include "bta_gattc_cache_store.h"
+
+#include <base/logging.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+constexpr uint32_t kMagic = 0x43545447; /* "GTTC" */
+constexpr size_t kAlign = 8;
+
+constexpr uint8_t kSlotEmpty = 0;
+constexpr uint8_t kSlotUsed = 1;
+constexpr uint8_t kSlotRemoved = 2;
+
+size_t align(size_t len) { return (len + kAlign - 1) & ~(kAlign - 1); }
+}  // namespace
+
+struct GattCacheStore::Header {
+  uint32_t magic;
+  uint32_t format;
+  uint32_t capacity;
+  uint32_t index_slots;
+  uint32_t data_end;
+  uint32_t reserved[3];
+};
+
+/* Hash table entry, open addressing with linear probing */
+struct GattCacheStore::Slot {
+  uint8_t addr[6];
+  uint8_t state;
+  uint8_t reserved;
+  uint32_t offset;
+};
+
+/* Followed by |len| bytes of data */
+struct GattCacheStore::Database {
+  uint64_t hash;
+  uint32_t len;
+  uint32_t reserved;
+};
+
+GattCacheStore::Header* GattCacheStore::header() const {
+  return reinterpret_cast<Header*>(base_);
+}
+
+GattCacheStore::Slot* GattCacheStore::slots() const {
+  return reinterpret_cast<Slot*>(base_ + sizeof(Header));
+}
+
+GattCacheStore::Database* GattCacheStore::database_at(uint32_t offset) const {
+  return reinterpret_cast<Database*>(base_ + offset);
+}
+
+size_t GattCacheStore::data_start() const {
+  return align(sizeof(Header) + header()->index_slots * sizeof(Slot));
+}
+
+/* Multiply and rotate over four independent 64 bit lanes, so that hashing a
+ * database on each lookup costs little next to rebuilding it */
+uint64_t GattCacheStore::Hash(const void* data, size_t len) {
+  constexpr uint64_t kPrime1 = 0x9e3779b185ebca87ULL;
+  constexpr uint64_t kPrime2 = 0xc2b2ae3d27d4eb4fULL;
+  auto round = [](uint64_t acc, uint64_t word) {
+    acc += word * kPrime2;
+    acc = (acc << 31) | (acc >> 33);
+    return acc * kPrime1;
+  };
+
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  uint64_t lanes[4] = {kPrime1 + kPrime2, kPrime2, 0, 0 - kPrime1};
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    for (int lane = 0; lane < 4; lane++) {
+      uint64_t word;
+      memcpy(&word, p + i + lane * 8, sizeof(word));
+      lanes[lane] = round(lanes[lane], word);
+    }
+  }
+
+  uint64_t hash = len;
+  for (uint64_t lane : lanes) hash = round(hash ^ round(0, lane), kPrime1);
+  for (; i < len; i++) hash = round(hash, p[i]);
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  return hash;
+}
+
+bool GattCacheStore::Open(const std::string& path, uint32_t format,
+                          size_t capacity, size_t index_slots) {
+  CHECK(index_slots != 0 && (index_slots & (index_slots - 1)) == 0);
+  Close();
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+  if (fd < 0) {
+    LOG(ERROR) << __func__ << ": can't open " << path << ": "
+               << strerror(errno);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    LOG(ERROR) << __func__ << ": can't stat " << path << ": "
+               << strerror(errno);
+    close(fd);
+    return false;
+  }
+
+  /* An existing store keeps its size and index */
+  Header existing;
+  bool valid = (size_t)st.st_size >= sizeof(Header) &&
+               pread(fd, &existing, sizeof(existing), 0) == sizeof(existing) &&
+               existing.magic == kMagic &&
+               existing.capacity == (size_t)st.st_size &&
+               existing.index_slots != 0 &&
+               (existing.index_slots & (existing.index_slots - 1)) == 0 &&
+               align(sizeof(Header) + existing.index_slots * sizeof(Slot)) <=
+                   existing.capacity;
+  if (valid) {
+    capacity = existing.capacity;
+  } else {
+    capacity = std::max(capacity,
+                        align(sizeof(Header) + index_slots * sizeof(Slot)));
+    if (capacity > UINT32_MAX || ftruncate(fd, capacity) != 0) {
+      LOG(ERROR) << __func__ << ": can't size " << path << ": "
+                 << strerror(errno);
+      close(fd);
+      return false;
+    }
+  }
+
+  void* base =
+      mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    LOG(ERROR) << __func__ << ": can't map " << path << ": "
+               << strerror(errno);
+    close(fd);
+    return false;
+  }
+
+  path_ = path;
+  fd_ = fd;
+  base_ = static_cast<uint8_t*>(base);
+  size_ = capacity;
+
+  if (!valid || header()->format != format ||
+      header()->data_end < data_start() || header()->data_end > size_) {
+    Reset(format, valid ? header()->index_slots : index_slots);
+  }
+  LoadIndex();
+  return true;
+}
+
+void GattCacheStore::Close() {
+  if (base_ != nullptr) {
+    Sync();
+    munmap(base_, size_);
+    base_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  path_.clear();
+  size_ = 0;
+  num_servers_ = 0;
+  num_removed_ = 0;
+  databases_.clear();
+  by_hash_.clear();
+}
+
+void GattCacheStore::Reset(uint32_t format, size_t index_slots) {
+  memset(base_, 0, align(sizeof(Header) + index_slots * sizeof(Slot)));
+  header()->magic = kMagic;
+  header()->format = format;
+  header()->capacity = size_;
+  header()->index_slots = index_slots;
+  header()->data_end = data_start();
+  Sync();
+}
+
+/* Rebuilds the in memory state from the index, dropping the servers whose
+ * database is out of the data written */
+void GattCacheStore::LoadIndex() {
+  num_servers_ = 0;
+  num_removed_ = 0;
+  databases_.clear();
+  by_hash_.clear();
+
+  size_t start = data_start();
+  size_t end = header()->data_end;
+  for (uint32_t i = 0; i < header()->index_slots; i++) {
+    Slot& slot = slots()[i];
+    if (slot.state == kSlotRemoved) num_removed_++;
+    if (slot.state != kSlotUsed) continue;
+
+    uint32_t offset = slot.offset;
+    if (offset < start || offset % kAlign != 0 || offset > end ||
+        end - offset < sizeof(Database) ||
+        database_at(offset)->len > end - offset - sizeof(Database)) {
+      slot.state = kSlotRemoved;
+      num_removed_++;
+      continue;
+    }
+
+    num_servers_++;
+    auto db = databases_.find(offset);
+    if (db != databases_.end()) {
+      db->second.refs++;
+      continue;
+    }
+    uint64_t hash = database_at(offset)->hash;
+    databases_[offset] = {hash, 1};
+    by_hash_.emplace(hash, offset);
+  }
+}
+
+GattCacheStore::Slot* GattCacheStore::FindSlot(const RawAddress& addr) {
+  uint32_t mask = header()->index_slots - 1;
+  uint32_t i = Hash(addr.address, sizeof(addr.address)) & mask;
+  for (uint32_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+    Slot& slot = slots()[i];
+    if (slot.state == kSlotEmpty) return nullptr;
+    if (slot.state == kSlotUsed &&
+        memcmp(slot.addr, addr.address, sizeof(slot.addr)) == 0)
+      return &slot;
+  }
+  return nullptr;
+}
+
+/* Returns a slot for |addr|, which must not be in the index */
+GattCacheStore::Slot* GattCacheStore::FreeSlot(const RawAddress& addr) {
+  uint32_t mask = header()->index_slots - 1;
+  uint32_t i = Hash(addr.address, sizeof(addr.address)) & mask;
+  for (uint32_t n = 0; n <= mask; n++, i = (i + 1) & mask) {
+    if (slots()[i].state != kSlotUsed) return &slots()[i];
+  }
+  return nullptr;
+}
+
+void GattCacheStore::RemoveSlot(Slot* slot) {
+  ReleaseDatabase(slot->offset);
+  slot->state = kSlotRemoved;
+  num_servers_--;
+  num_removed_++;
+}
+
+/* Reinserts the servers in the index, dropping the removed slots which
+ * lengthen the probing of every lookup. A crash midway only loses servers,
+ * which then discover their database again. */
+void GattCacheStore::RebuildIndex() {
+  std::vector<Slot> used;
+  for (uint32_t i = 0; i < header()->index_slots; i++) {
+    if (slots()[i].state == kSlotUsed) used.push_back(slots()[i]);
+  }
+  memset(slots(), 0, header()->index_slots * sizeof(Slot));
+  for (const Slot& slot : used) {
+    RawAddress addr;
+    memcpy(addr.address, slot.addr, sizeof(addr.address));
+    *FreeSlot(addr) = slot;
+  }
+
+  VLOG(1) << __func__ << ": " << used.size() << " servers, " << num_removed_
+          << " removed slots dropped";
+  num_removed_ = 0;
+}
+
+/* Returns the offset of a database with |data|, shared if there is one
+ * already, or 0 if there is no room left */
+uint32_t GattCacheStore::AddDatabase(const void* data, size_t len,
+                                     uint64_t hash) {
+  auto range = by_hash_.equal_range(hash);
+  for (auto it = range.first; it != range.second; it++) {
+    Database* db = database_at(it->second);
+    if (db->len == len && memcmp(db + 1, data, len) == 0) {
+      databases_[it->second].refs++;
+      return it->second;
+    }
+  }
+
+  uint32_t offset = header()->data_end;
+  size_t needed = align(sizeof(Database) + len);
+  if (needed > size_ - offset) return 0;
+
+  Database* db = database_at(offset);
+  db->hash = hash;
+  db->len = len;
+  db->reserved = 0;
+  memcpy(db + 1, data, len);
+  header()->data_end = offset + needed;
+
+  databases_[offset] = {hash, 1};
+  by_hash_.emplace(hash, offset);
+  return offset;
+}
+
+void GattCacheStore::ReleaseDatabase(uint32_t offset) {
+  auto db = databases_.find(offset);
+  if (db == databases_.end() || --db->second.refs > 0) return;
+
+  auto range = by_hash_.equal_range(db->second.hash);
+  for (auto it = range.first; it != range.second; it++) {
+    if (it->second == offset) {
+      by_hash_.erase(it);
+      break;
+    }
+  }
+  databases_.erase(db);
+}
+
+/* Copies the databases in use into a new file, with an index without the
+ * removed servers, and renames it over the store. The databases are never
+ * moved within the store: a crash before the rename leaves it as it was, and
+ * one after leaves the new file complete. */
+void GattCacheStore::Compact() {
+  std::string tmp_path = path_ + ".tmp";
+  int fd =
+      open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0660);
+  if (fd < 0) {
+    LOG(ERROR) << __func__ << ": can't open " << tmp_path << ": "
+               << strerror(errno);
+    return;
+  }
+  void* base = MAP_FAILED;
+  if (ftruncate(fd, size_) == 0) {
+    base = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (base == MAP_FAILED) {
+    LOG(ERROR) << __func__ << ": can't map " << tmp_path << ": "
+               << strerror(errno);
+    close(fd);
+    unlink(tmp_path.c_str());
+    return;
+  }
+  uint8_t* new_base = static_cast<uint8_t*>(base);
+
+  std::vector<uint32_t> offsets;
+  for (const auto& db : databases_) offsets.push_back(db.first);
+  std::sort(offsets.begin(), offsets.end());
+
+  /* The new file is zero filled: its index starts empty */
+  memcpy(new_base, base_, sizeof(Header));
+  std::unordered_map<uint32_t, uint32_t> moved;
+  uint32_t end = data_start();
+  for (uint32_t offset : offsets) {
+    size_t len = align(sizeof(Database) + database_at(offset)->len);
+    memcpy(new_base + end, base_ + offset, len);
+    moved[offset] = end;
+    end += len;
+  }
+
+  Slot* new_slots = reinterpret_cast<Slot*>(new_base + sizeof(Header));
+  uint32_t mask = header()->index_slots - 1;
+  size_t servers = 0;
+  for (uint32_t i = 0; i < header()->index_slots; i++) {
+    const Slot& slot = slots()[i];
+    if (slot.state != kSlotUsed) continue;
+    uint32_t j = Hash(slot.addr, sizeof(slot.addr)) & mask;
+    while (new_slots[j].state != kSlotEmpty) j = (j + 1) & mask;
+    new_slots[j] = slot;
+    new_slots[j].offset = moved[slot.offset];
+    servers++;
+  }
+  reinterpret_cast<Header*>(new_base)->data_end = end;
+
+  if (msync(new_base, size_, MS_SYNC) != 0 || fsync(fd) != 0 ||
+      rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    LOG(ERROR) << __func__ << ": can't replace " << path_ << ": "
+               << strerror(errno);
+    munmap(new_base, size_);
+    close(fd);
+    unlink(tmp_path.c_str());
+    return;
+  }
+
+  munmap(base_, size_);
+  close(fd_);
+  base_ = new_base;
+  fd_ = fd;
+
+  VLOG(1) << __func__ << ": " << servers << " servers, " << offsets.size()
+          << " databases, " << (end - data_start()) << " bytes";
+  LoadIndex();
+}
+
+bool GattCacheStore::Store(const RawAddress& addr, const void* data,
+                           size_t len) {
+  if (!IsOpen() || len > size_) return false;
+
+  uint64_t hash = Hash(data, len);
+  Slot* slot = FindSlot(addr);
+  if (slot != nullptr) {
+    Database* db = database_at(slot->offset);
+    if (db->hash == hash && db->len == len && memcmp(db + 1, data, len) == 0)
+      return true;
+
+    RemoveSlot(slot);
+  }
+
+  slot = FreeSlot(addr);
+  uint32_t offset = slot ? AddDatabase(data, len, hash) : 0;
+  if (offset == 0) {
+    Compact();
+    slot = FreeSlot(addr);
+    offset = slot ? AddDatabase(data, len, hash) : 0;
+  }
+  if (offset == 0) {
+    LOG(WARNING) << __func__ << ": no room left for " << len << " bytes";
+    Sync();
+    return false;
+  }
+
+  /* The database is written before the slot refers to it */
+  if (slot->state == kSlotRemoved) num_removed_--;
+  memcpy(slot->addr, addr.address, sizeof(slot->addr));
+  slot->offset = offset;
+  slot->state = kSlotUsed;
+  num_servers_++;
+  if (num_removed_ > header()->index_slots / 4) RebuildIndex();
+  Sync();
+  return true;
+}
+
+const void* GattCacheStore::Find(const RawAddress& addr, size_t* len) {
+  if (!IsOpen()) return nullptr;
+
+  Slot* slot = FindSlot(addr);
+  if (slot == nullptr) return nullptr;
+
+  Database* db = database_at(slot->offset);
+  if (Hash(db + 1, db->len) != db->hash) {
+    LOG(ERROR) << __func__ << ": corrupted database for " << addr;
+    Remove(addr);
+    return nullptr;
+  }
+
+  *len = db->len;
+  return db + 1;
+}
+
+void GattCacheStore::Remove(const RawAddress& addr) {
+  if (!IsOpen()) return;
+
+  Slot* slot = FindSlot(addr);
+  if (slot == nullptr) return;
+
+  RemoveSlot(slot);
+  if (num_removed_ > header()->index_slots / 4) RebuildIndex();
+  Sync();
+}
+
+size_t GattCacheStore::UsedBytes() const {
+  if (!IsOpen()) return 0;
+  return header()->data_end - data_start();
+}
+
+void GattCacheStore::Sync() {
+  if (base_ != nullptr) msync(base_, size_, MS_ASYNC);
+}
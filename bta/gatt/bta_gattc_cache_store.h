@@ -0,0 +1,117 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+
+#include "types/raw_address.h"
+
+/* Store for the GATT client attribute caches of all the known servers, kept
+ * in a single memory mapped file instead of one file per server.
+ *
+ * The file holds a hash table of server addresses, followed by the databases.
+ * Each database is stored once, with the hash of its content: servers with
+ * identical databases, e.g. several devices of the same model, share it. A
+ * lookup returns a pointer into the mapping, so loading a cache on reconnection
+ * neither reads nor copies the file, and only the pages of the database used
+ * are faulted in. The hash is checked on lookup, which catches databases torn
+ * by a crash during an update.
+ *
+ * The databases are appended; the space of those no longer used is reclaimed
+ * when the file is full, by copying the ones in use to a new file which is
+ * renamed over the store, so that a crash never leaves a server pointing at
+ * the database of another. The index is rebuilt once a quarter of its slots
+ * hold removed servers. The store is not thread safe, and is meant to be used
+ * from the BTA thread. */
+class GattCacheStore {
+ public:
+  static constexpr size_t kDefaultCapacity = 8 * 1024 * 1024;
+  static constexpr size_t kDefaultIndexSlots = 8192;
+
+  GattCacheStore() = default;
+  ~GattCacheStore() { Close(); }
+
+  /* Map the store at |path|, created with room for |capacity| bytes and
+   * |index_slots| servers if it does not exist. |format| identifies the layout
+   * of the databases: a store written with another format is emptied. Returns
+   * false if the file can't be mapped. */
+  bool Open(const std::string& path, uint32_t format,
+            size_t capacity = kDefaultCapacity,
+            size_t index_slots = kDefaultIndexSlots);
+  void Close();
+  bool IsOpen() const { return base_ != nullptr; }
+
+  /* Store |len| bytes of |data| as the database of |addr|. Returns false if
+   * there is no room left for it. */
+  bool Store(const RawAddress& addr, const void* data, size_t len);
+
+  /* Return the database of |addr| and set |len| to its length, or return
+   * nullptr if there is none. The pointer is valid until the next call to
+   * Store(), Remove() or Close(). */
+  const void* Find(const RawAddress& addr, size_t* len);
+
+  void Remove(const RawAddress& addr);
+
+  /* Content hash of a database */
+  static uint64_t Hash(const void* data, size_t len);
+
+  size_t NumServers() const { return num_servers_; }
+  size_t NumDatabases() const { return databases_.size(); }
+  size_t NumRemovedSlots() const { return num_removed_; }
+  size_t UsedBytes() const;
+  size_t Capacity() const { return size_; }
+
+ private:
+  struct Header;
+  struct Slot;
+  struct Database;
+
+  Header* header() const;
+  Slot* slots() const;
+  Database* database_at(uint32_t offset) const;
+  size_t data_start() const;
+
+  void Reset(uint32_t format, size_t index_slots);
+  void LoadIndex();
+  Slot* FindSlot(const RawAddress& addr);
+  Slot* FreeSlot(const RawAddress& addr);
+  void RemoveSlot(Slot* slot);
+  void RebuildIndex();
+  uint32_t AddDatabase(const void* data, size_t len, uint64_t hash);
+  void ReleaseDatabase(uint32_t offset);
+  void Compact();
+  void Sync();
+
+  std::string path_;
+  int fd_ = -1;
+  uint8_t* base_ = nullptr;
+  size_t size_ = 0;
+  size_t num_servers_ = 0;
+  size_t num_removed_ = 0;
+
+  struct DatabaseInfo {
+    uint64_t hash;
+    uint32_t refs;
+  };
+  /* Databases in use by offset, and their offsets by content hash */
+  std::unordered_map<uint32_t, DatabaseInfo> databases_;
+  std::unordered_multimap<uint64_t, uint32_t> by_hash_;
+};
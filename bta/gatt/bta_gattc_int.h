@@ -154,6 +154,8 @@ typedef struct {
   tGATT_AUTH_REQ auth_req;
   uint8_t num_attr;
   uint16_t handles[GATT_MAX_READ_MULTI_HANDLES];
+  GATT_READ_OP_CB read_cb;
+  void* read_cb_data;
 } tBTA_GATTC_API_READ_MULTI;
 
 typedef struct {
@@ -193,6 +195,14 @@ enum {
 };
 typedef uint8_t tBTA_GATTC_STATE;
 
+/* Attributes of the server cache at a handle */
+typedef struct {
+  tBTA_GATTC_SERVICE* service;
+  tBTA_GATTC_CHARACTERISTIC* characteristic; /* with this value handle */
+  tBTA_GATTC_DESCRIPTOR* descriptor;
+  tBTA_GATTC_CHARACTERISTIC* owning_characteristic; /* of the descriptor */
+} tBTA_GATTC_ATTR_REF;
+
 typedef struct {
   bool in_use;
   RawAddress server_bda;
@@ -207,6 +217,10 @@ typedef struct {
   uint8_t state;
 
   std::vector<tBTA_GATTC_SERVICE> srvc_cache;
+  /* attr_refs[handle_index[handle]] are the attributes of srvc_cache at
+   * handle, up to the last attribute handle */
+  std::vector<uint32_t> handle_index;
+  std::vector<tBTA_GATTC_ATTR_REF> attr_refs;
   uint8_t update_count; /* indication received */
   uint8_t num_clcb;     /* number of associated CLCB */
 
@@ -435,6 +449,10 @@ tBTA_GATTC_CHARACTERISTIC* bta_gattc_get_characteristic_srcb(
     tBTA_GATTC_SERV* p_srcb, uint16_t handle);
 extern tBTA_GATTC_SERVICE* bta_gattc_get_service_for_handle_srcb(
     tBTA_GATTC_SERV* p_srcb, uint16_t handle);
+extern const tBTA_GATTC_DESCRIPTOR* bta_gattc_get_descriptor_srcb(
+    tBTA_GATTC_SERV* p_srcb, uint16_t handle);
+extern tBTA_GATTC_CHARACTERISTIC* bta_gattc_get_owning_characteristic_srcb(
+    tBTA_GATTC_SERV* p_srcb, uint16_t handle);
 extern tBTA_GATTC_CHARACTERISTIC* bta_gattc_get_characteristic(uint16_t conn_id,
                                                                uint16_t handle);
 extern const tBTA_GATTC_DESCRIPTOR* bta_gattc_get_descriptor(uint16_t conn_id,
@@ -445,8 +463,10 @@ extern void bta_gattc_get_gatt_db(uint16_t conn_id, uint16_t start_handle,
                                   uint16_t end_handle, btgatt_db_element_t** db,
                                   int* count);
 extern tGATT_STATUS bta_gattc_init_cache(tBTA_GATTC_SERV* p_srvc_cb);
+extern void bta_gattc_build_handle_index(tBTA_GATTC_SERV* p_srcb);
+extern void bta_gattc_clear_handle_index(tBTA_GATTC_SERV* p_srcb);
 extern void bta_gattc_rebuild_cache(tBTA_GATTC_SERV* p_srcv, uint16_t num_attr,
-                                    tBTA_GATTC_NV_ATTR* attr);
+                                    const tBTA_GATTC_NV_ATTR* attr);
 extern void bta_gattc_cache_save(tBTA_GATTC_SERV* p_srvc_cb, uint16_t conn_id);
 extern void bta_gattc_reset_discover_st(tBTA_GATTC_SERV* p_srcb,
                                         tGATT_STATUS status);
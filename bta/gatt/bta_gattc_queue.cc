@@ -16,6 +16,8 @@
 
 #include "bta_gatt_queue.h"
 
+#include <stdio.h>
+
 #include <list>
 #include <unordered_map>
 #include <unordered_set>
@@ -32,9 +34,25 @@ struct gatt_read_op_data {
   void* cb_data;
 };
 
+/* Reads coalesced in one Read Multiple request */
+struct gatt_read_multi_op_data {
+  uint8_t num_ops;
+  struct {
+    uint8_t type;
+    uint16_t handle;
+    uint16_t value_len;
+    GATT_READ_OP_CB cb;
+    void* cb_data;
+  } ops[GATT_MAX_READ_MULTI_HANDLES];
+};
+
 std::unordered_map<uint16_t, std::list<gatt_operation>>
     BtaGattQueue::gatt_op_queue;
 std::unordered_set<uint16_t> BtaGattQueue::gatt_op_queue_executing;
+std::unordered_map<uint16_t, uint16_t> BtaGattQueue::gatt_read_coalescing_mtu;
+uint64_t BtaGattQueue::read_multi_requests = 0;
+uint64_t BtaGattQueue::read_multi_saved = 0;
+uint64_t BtaGattQueue::read_multi_fallbacks = 0;
 
 void BtaGattQueue::mark_as_not_executing(uint16_t conn_id) {
   gatt_op_queue_executing.erase(conn_id);
@@ -58,6 +76,61 @@ void BtaGattQueue::gatt_read_op_finished(uint16_t conn_id, tGATT_STATUS status,
   }
 }
 
+void BtaGattQueue::gatt_read_multi_op_finished(uint16_t conn_id,
+                                               tGATT_STATUS status,
+                                               uint16_t handle, uint16_t len,
+                                               uint8_t* value, void* data) {
+  gatt_read_multi_op_data tmp = *(gatt_read_multi_op_data*)data;
+  osi_free(data);
+
+  size_t expected_len = 0;
+  for (uint8_t i = 0; i < tmp.num_ops; i++)
+    expected_len += tmp.ops[i].value_len;
+
+  mark_as_not_executing(conn_id);
+
+  if (status != GATT_SUCCESS || len != expected_len) {
+    read_multi_fallbacks++;
+    APPL_TRACE_WARNING(
+        "%s: read multiple of %d values failed, status=%d len=%d expected=%zu",
+        __func__, tmp.num_ops, status, len, expected_len);
+
+    auto map_ptr = gatt_op_queue.find(conn_id);
+    if (map_ptr == gatt_op_queue.end()) {
+      /* Queue cleaned, report the failure of each read */
+      if (status == GATT_SUCCESS) status = GATT_INVALID_ATTR_LEN;
+      for (uint8_t i = 0; i < tmp.num_ops; i++) {
+        if (tmp.ops[i].cb)
+          tmp.ops[i].cb(conn_id, status, tmp.ops[i].handle, 0, nullptr,
+                        tmp.ops[i].cb_data);
+      }
+      return;
+    }
+
+    /* Read the values one by one instead, to get the status of each */
+    for (int i = tmp.num_ops - 1; i >= 0; i--) {
+      map_ptr->second.push_front({.type = tmp.ops[i].type,
+                                  .handle = tmp.ops[i].handle,
+                                  .read_cb = tmp.ops[i].cb,
+                                  .read_cb_data = tmp.ops[i].cb_data,
+                                  .value_len = 0});
+    }
+    gatt_execute_next_op(conn_id);
+    return;
+  }
+
+  read_multi_saved += tmp.num_ops - 1;
+  gatt_execute_next_op(conn_id);
+
+  uint16_t offset = 0;
+  for (uint8_t i = 0; i < tmp.num_ops; i++) {
+    if (tmp.ops[i].cb)
+      tmp.ops[i].cb(conn_id, status, tmp.ops[i].handle, tmp.ops[i].value_len,
+                    value + offset, tmp.ops[i].cb_data);
+    offset += tmp.ops[i].value_len;
+  }
+}
+
 struct gatt_write_op_data {
   GATT_WRITE_OP_CB cb;
   void* cb_data;
@@ -80,6 +153,51 @@ void BtaGattQueue::gatt_write_op_finished(uint16_t conn_id, tGATT_STATUS status,
   }
 }
 
+/* Sends the fixed length reads at the head of |gatt_ops| in one Read Multiple
+ * request, if coalescing is enabled and there are at least two of them.
+ * Returns false if no request was sent. */
+bool BtaGattQueue::gatt_execute_read_multi(
+    uint16_t conn_id, std::list<gatt_operation>& gatt_ops) {
+  auto mtu_ptr = gatt_read_coalescing_mtu.find(conn_id);
+  if (mtu_ptr == gatt_read_coalescing_mtu.end()) return false;
+
+  /* The values follow the opcode in the response */
+  size_t room = mtu_ptr->second - 1;
+  size_t total_len = 0;
+  uint8_t num_ops = 0;
+  for (const gatt_operation& op : gatt_ops) {
+    if (op.type != GATT_READ_CHAR && op.type != GATT_READ_DESC) break;
+    if (op.value_len == 0 || total_len + op.value_len > room) break;
+    if (num_ops == GATT_MAX_READ_MULTI_HANDLES) break;
+    total_len += op.value_len;
+    num_ops++;
+  }
+  if (num_ops < 2) return false;
+
+  gatt_read_multi_op_data* data =
+      (gatt_read_multi_op_data*)osi_malloc(sizeof(gatt_read_multi_op_data));
+  tBTA_GATTC_MULTI read_multi;
+  data->num_ops = num_ops;
+  read_multi.num_attr = num_ops;
+  for (uint8_t i = 0; i < num_ops; i++) {
+    gatt_operation& op = gatt_ops.front();
+    data->ops[i].type = op.type;
+    data->ops[i].handle = op.handle;
+    data->ops[i].value_len = op.value_len;
+    data->ops[i].cb = op.read_cb;
+    data->ops[i].cb_data = op.read_cb_data;
+    read_multi.handles[i] = op.handle;
+    gatt_ops.pop_front();
+  }
+
+  read_multi_requests++;
+  APPL_TRACE_DEBUG("%s: conn_id=%d coalesced %d reads", __func__, conn_id,
+                   num_ops);
+  BTA_GATTC_ReadMultiple(conn_id, &read_multi, GATT_AUTH_REQ_NONE,
+                         gatt_read_multi_op_finished, data);
+  return true;
+}
+
 void BtaGattQueue::gatt_execute_next_op(uint16_t conn_id) {
   APPL_TRACE_DEBUG("%s:", __func__, conn_id);
   if (gatt_op_queue.empty()) {
@@ -103,6 +221,8 @@ void BtaGattQueue::gatt_execute_next_op(uint16_t conn_id) {
 
   std::list<gatt_operation>& gatt_ops = map_ptr->second;
 
+  if (gatt_execute_read_multi(conn_id, gatt_ops)) return;
+
   gatt_operation& op = gatt_ops.front();
 
   if (op.type == GATT_READ_CHAR) {
@@ -145,6 +265,27 @@ void BtaGattQueue::gatt_execute_next_op(uint16_t conn_id) {
 void BtaGattQueue::Clean(uint16_t conn_id) {
   gatt_op_queue.erase(conn_id);
   gatt_op_queue_executing.erase(conn_id);
+  gatt_read_coalescing_mtu.erase(conn_id);
+}
+
+void BtaGattQueue::SetReadCoalescing(uint16_t conn_id, uint16_t mtu) {
+  if (mtu == 0) {
+    gatt_read_coalescing_mtu.erase(conn_id);
+    return;
+  }
+  gatt_read_coalescing_mtu[conn_id] = mtu;
+}
+
+void BtaGattQueue::DebugDump(int fd) {
+  dprintf(fd, "\nGATT Client Queue:\n");
+  dprintf(fd, "  Connections coalescing reads      : %zu\n",
+          gatt_read_coalescing_mtu.size());
+  dprintf(fd, "  Read multiple requests            : %llu\n",
+          (unsigned long long)read_multi_requests);
+  dprintf(fd, "  Round trips saved                 : %llu\n",
+          (unsigned long long)read_multi_saved);
+  dprintf(fd, "  Read multiple fallbacks           : %llu\n",
+          (unsigned long long)read_multi_fallbacks);
 }
 
 void BtaGattQueue::ReadCharacteristic(uint16_t conn_id, uint16_t handle,
@@ -165,6 +306,19 @@ void BtaGattQueue::ReadDescriptor(uint16_t conn_id, uint16_t handle,
   gatt_execute_next_op(conn_id);
 }
 
+void BtaGattQueue::ReadFixedLengthCharacteristic(uint16_t conn_id,
+                                                 uint16_t handle,
+                                                 uint16_t value_len,
+                                                 GATT_READ_OP_CB cb,
+                                                 void* cb_data) {
+  gatt_op_queue[conn_id].push_back({.type = GATT_READ_CHAR,
+                                    .handle = handle,
+                                    .read_cb = cb,
+                                    .read_cb_data = cb_data,
+                                    .value_len = value_len});
+  gatt_execute_next_op(conn_id);
+}
+
 void BtaGattQueue::WriteCharacteristic(uint16_t conn_id, uint16_t handle,
                                        std::vector<uint8_t> value,
                                        tGATT_WRITE_TYPE write_type,
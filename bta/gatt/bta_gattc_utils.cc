@@ -205,6 +205,7 @@ void bta_gattc_clcb_dealloc(tBTA_GATTC_CLCB* p_clcb) {
 
     // clear reallocating
     std::vector<tBTA_GATTC_SERVICE>().swap(p_srcb->srvc_cache);
+    bta_gattc_clear_handle_index(p_srcb);
   }
 
   osi_free_and_reset((void**)&p_clcb->p_q_cmd);
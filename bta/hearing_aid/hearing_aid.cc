@@ -70,6 +70,12 @@ constexpr int8_t VOLUME_MIN = -127;
 // audio type
 constexpr uint8_t AUDIOTYPE_UNKNOWN = 0x00;
 
+// Length of the values read after connecting. They are fixed, so the reads can
+// be coalesced in a Read Multiple request
+constexpr uint16_t READ_ONLY_PROPERTIES_LEN = 17;
+constexpr uint16_t AUDIO_STATUS_LEN = 1;
+constexpr uint16_t LE_PSM_LEN = 2;
+
 namespace {
 
 // clang-format off
@@ -409,6 +415,7 @@ class HearingAidImpl : public HearingAid {
 
     hearingDevice->connecting_actively = false;
     hearingDevice->conn_id = conn_id;
+    BtaGattQueue::SetReadCoalescing(conn_id, mtu);
 
     /* We must update connection parameters one at a time, otherwise anchor
      * point (start of connection event) for two devices can be too close to
@@ -577,17 +584,17 @@ class HearingAidImpl : public HearingAid {
       if (charac.uuid == READ_ONLY_PROPERTIES_UUID) {
         DVLOG(2) << "Reading read only properties "
                  << loghex(charac.value_handle);
-        BtaGattQueue::ReadCharacteristic(
-            conn_id, charac.value_handle,
+        BtaGattQueue::ReadFixedLengthCharacteristic(
+            conn_id, charac.value_handle, READ_ONLY_PROPERTIES_LEN,
             HearingAidImpl::OnReadOnlyPropertiesReadStatic, nullptr);
       } else if (charac.uuid == AUDIO_CONTROL_POINT_UUID) {
         hearingDevice->audio_control_point_handle = charac.value_handle;
         // store audio control point!
       } else if (charac.uuid == AUDIO_STATUS_UUID) {
         DVLOG(2) << "Reading Audio status " << loghex(charac.value_handle);
-        BtaGattQueue::ReadCharacteristic(conn_id, charac.value_handle,
-                                         HearingAidImpl::OnAudioStatusStatic,
-                                         nullptr);
+        BtaGattQueue::ReadFixedLengthCharacteristic(
+            conn_id, charac.value_handle, AUDIO_STATUS_LEN,
+            HearingAidImpl::OnAudioStatusStatic, nullptr);
       } else if (charac.uuid == VOLUME_UUID) {
         hearingDevice->volume_handle = charac.value_handle;
       } else if (charac.uuid == LE_PSM_UUID) {
@@ -599,8 +606,9 @@ class HearingAidImpl : public HearingAid {
 
     if (psm_handle) {
       DVLOG(2) << "Reading PSM " << loghex(psm_handle);
-      BtaGattQueue::ReadCharacteristic(
-          conn_id, psm_handle, HearingAidImpl::OnPsmReadStatic, nullptr);
+      BtaGattQueue::ReadFixedLengthCharacteristic(
+          conn_id, psm_handle, LE_PSM_LEN, HearingAidImpl::OnPsmReadStatic,
+          nullptr);
     }
   }
 
@@ -626,7 +634,7 @@ class HearingAidImpl : public HearingAid {
     }
 
     // version 0x01 of read only properties:
-    if (len < 17) {
+    if (len < READ_ONLY_PROPERTIES_LEN) {
       LOG(WARNING) << "Read only properties too short: " << loghex(len);
       return;
     }
@@ -728,7 +736,7 @@ class HearingAidImpl : public HearingAid {
       return;
     }
 
-    if (len > 2) {
+    if (len > LE_PSM_LEN) {
       LOG(ERROR) << "Bad PSM length";
       return;
     }
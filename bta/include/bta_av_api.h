@@ -361,6 +361,11 @@ typedef union {
   tBTA_AVK_CONFIG avk_config;
 } tBTA_AV_MEDIA;
 
+/* The media packets of BTA_AV_SINK_MEDIA_DATA_EVT carry the AVDTP sequence
+ * number in |layer_specific| and the AVDTP timestamp (host byte order) in the
+ * BTA_AV_SINK_MEDIA_TS_SIZE octets right before the payload. */
+#define BTA_AV_SINK_MEDIA_TS_SIZE 4
+
 #define BTA_GROUP_NAVI_MSG_OP_DATA_LEN 5
 
 /* AV callback */
@@ -781,13 +781,16 @@ extern void BTA_GATTC_ExecuteWrite(uint16_t conn_id, bool is_execute);
  *
  * Parameters       conn_id - connectino ID.
  *                    p_read_multi - read multiple parameters.
+ *                    callback - called with the concatenated values, and the
+ *                               first handle read.
  *
  * Returns          None
  *
  ******************************************************************************/
 extern void BTA_GATTC_ReadMultiple(uint16_t conn_id,
                                    tBTA_GATTC_MULTI* p_read_multi,
-                                   tGATT_AUTH_REQ auth_req);
+                                   tGATT_AUTH_REQ auth_req,
+                                   GATT_READ_OP_CB callback, void* cb_data);
 
 /*******************************************************************************
  *
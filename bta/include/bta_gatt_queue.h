@@ -31,6 +31,12 @@
  *
  * If you decide to use those methods in your app, make sure to not mix it with
  * existing BTA_GATTC_* API.
+ *
+ * With read coalescing enabled for a connection, consecutive queued reads of
+ * values with a known fixed length are sent in one Read Multiple request, as
+ * long as the values fit in the response. The response is split back into
+ * the value of each read. If the request fails, or a value does not have the
+ * expected length, the reads are sent again one by one.
  */
 class BtaGattQueue {
  public:
@@ -39,6 +45,11 @@ class BtaGattQueue {
                                  GATT_READ_OP_CB cb, void* cb_data);
   static void ReadDescriptor(uint16_t conn_id, uint16_t handle,
                              GATT_READ_OP_CB cb, void* cb_data);
+  /* Read a characteristic whose value is always |value_len| long, which can
+   * be coalesced with other reads */
+  static void ReadFixedLengthCharacteristic(uint16_t conn_id, uint16_t handle,
+                                            uint16_t value_len,
+                                            GATT_READ_OP_CB cb, void* cb_data);
   static void WriteCharacteristic(uint16_t conn_id, uint16_t handle,
                                   std::vector<uint8_t> value,
                                   tGATT_WRITE_TYPE write_type,
@@ -48,6 +59,15 @@ class BtaGattQueue {
                               tGATT_WRITE_TYPE write_type, GATT_WRITE_OP_CB cb,
                               void* cb_data);
 
+  /* Coalesce the fixed length reads on |conn_id| into Read Multiple requests
+   * whose response fits in |mtu|, or stop if |mtu| is 0 */
+  static void SetReadCoalescing(uint16_t conn_id, uint16_t mtu);
+
+  /* Number of ATT round trips saved by coalescing reads */
+  static uint64_t RoundTripsSaved() { return read_multi_saved; }
+
+  static void DebugDump(int fd);
+
   /* Holds pending GATT operations */
   struct gatt_operation {
     uint8_t type;
@@ -57,6 +77,9 @@ class BtaGattQueue {
     GATT_WRITE_OP_CB write_cb;
     void* write_cb_data;
 
+    /* read-specific fields, 0 if the value length is unknown */
+    uint16_t value_len;
+
     /* write-specific fields */
     tGATT_WRITE_TYPE write_type;
     std::vector<uint8_t> value;
@@ -70,9 +93,21 @@ class BtaGattQueue {
                                     uint8_t* value, void* data);
   static void gatt_write_op_finished(uint16_t conn_id, tGATT_STATUS status,
                                      uint16_t handle, void* data);
+  static bool gatt_execute_read_multi(uint16_t conn_id,
+                                      std::list<gatt_operation>& gatt_ops);
+  static void gatt_read_multi_op_finished(uint16_t conn_id,
+                                          tGATT_STATUS status, uint16_t handle,
+                                          uint16_t len, uint8_t* value,
+                                          void* data);
 
   // maps connection id to operations waiting for execution
   static std::unordered_map<uint16_t, std::list<gatt_operation>> gatt_op_queue;
   // contain connection ids that currently execute operations
   static std::unordered_set<uint16_t> gatt_op_queue_executing;
+  // maps connection id to the MTU used to coalesce reads
+  static std::unordered_map<uint16_t, uint16_t> gatt_read_coalescing_mtu;
+
+  static uint64_t read_multi_requests;
+  static uint64_t read_multi_saved;
+  static uint64_t read_multi_fallbacks;
 };
\ No newline at end of file
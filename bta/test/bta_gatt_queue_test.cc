@@ -0,0 +1,186 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "bta/include/bta_gatt_queue.h"
+
+namespace {
+
+constexpr uint16_t kConnId = 1;
+
+// The request sent to the stack, waiting for its response
+struct PendingRead {
+  std::vector<uint16_t> handles;
+  GATT_READ_OP_CB cb;
+  void* cb_data;
+};
+
+std::vector<PendingRead> requests;
+
+struct ReadResult {
+  tGATT_STATUS status;
+  uint16_t handle;
+  std::vector<uint8_t> value;
+};
+
+std::vector<ReadResult> results;
+
+void read_cb(uint16_t conn_id, tGATT_STATUS status, uint16_t handle,
+             uint16_t len, uint8_t* value, void* data) {
+  results.push_back({status, handle, std::vector<uint8_t>(value, value + len)});
+}
+
+// Completes the oldest request, with |value|
+void respond(tGATT_STATUS status, std::vector<uint8_t> value) {
+  ASSERT_FALSE(requests.empty());
+  PendingRead request = requests.front();
+  requests.erase(requests.begin());
+  request.cb(kConnId, status, request.handles[0], value.size(), value.data(),
+             request.cb_data);
+}
+
+}  // namespace
+
+uint8_t appl_trace_level = 0;
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+void BTA_GATTC_ReadCharacteristic(uint16_t conn_id, uint16_t handle,
+                                  tGATT_AUTH_REQ auth_req,
+                                  GATT_READ_OP_CB callback, void* cb_data) {
+  requests.push_back({{handle}, callback, cb_data});
+}
+
+void BTA_GATTC_ReadCharDescr(uint16_t conn_id, uint16_t handle,
+                             tGATT_AUTH_REQ auth_req, GATT_READ_OP_CB callback,
+                             void* cb_data) {
+  requests.push_back({{handle}, callback, cb_data});
+}
+
+void BTA_GATTC_ReadMultiple(uint16_t conn_id, tBTA_GATTC_MULTI* p_read_multi,
+                            tGATT_AUTH_REQ auth_req, GATT_READ_OP_CB callback,
+                            void* cb_data) {
+  requests.push_back({std::vector<uint16_t>(
+                          p_read_multi->handles,
+                          p_read_multi->handles + p_read_multi->num_attr),
+                      callback, cb_data});
+}
+
+void BTA_GATTC_WriteCharValue(uint16_t conn_id, uint16_t handle,
+                              tGATT_WRITE_TYPE write_type,
+                              std::vector<uint8_t> value,
+                              tGATT_AUTH_REQ auth_req,
+                              GATT_WRITE_OP_CB callback, void* cb_data) {}
+
+void BTA_GATTC_WriteCharDescr(uint16_t conn_id, uint16_t handle,
+                              std::vector<uint8_t> value,
+                              tGATT_AUTH_REQ auth_req,
+                              GATT_WRITE_OP_CB callback, void* cb_data) {}
+
+class BtaGattQueueTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    requests.clear();
+    results.clear();
+    BtaGattQueue::Clean(kConnId);
+  }
+
+  void TearDown() override { BtaGattQueue::Clean(kConnId); }
+};
+
+TEST_F(BtaGattQueueTest, test_reads_not_coalesced_by_default) {
+  BtaGattQueue::ReadFixedLengthCharacteristic(kConnId, 0x10, 1, read_cb,
+                                              nullptr);
+  BtaGattQueue::ReadFixedLengthCharacteristic(kConnId, 0x20, 1, read_cb,
+                                              nullptr);
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].handles.size(), 1u);
+  respond(GATT_SUCCESS, {0x01});
+  ASSERT_EQ(requests.size(), 1u);
+  respond(GATT_SUCCESS, {0x02});
+  EXPECT_EQ(results.size(), 2u);
+}
+
+TEST_F(BtaGattQueueTest, test_fixed_length_reads_coalesced) {
+  BtaGattQueue::SetReadCoalescing(kConnId, 23);
+  uint64_t saved = BtaGattQueue::RoundTripsSaved();
+
+  // The first read is sent alone, the next ones are queued behind it
+  BtaGattQueue::ReadFixedLengthCharacteristic(kConnId, 0x10, 1, read_cb,
+                                              nullptr);
+  BtaGattQueue::ReadFixedLengthCharacteristic(kConnId, 0x20, 2, read_cb,
+                                              nullptr);
+  BtaGattQueue::ReadFixedLengthCharacteristic(kConnId, 0x30, 4, read_cb,
+                                              nullptr);
+  BtaGattQueue::ReadCharacteristic(kConnId, 0x40, read_cb, nullptr);
+  respond(GATT_SUCCESS, {0x01});
+
+  // The fixed length reads are coalesced, up to the variable length one
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].handles, std::vector<uint16_t>({0x20, 0x30}));
+  respond(GATT_SUCCESS, {0x02, 0x02, 0x03, 0x03, 0x03, 0x03});
+
+  ASSERT_EQ(results.size(), 3u);
+  EXPECT_EQ(results[1].handle, 0x20);
+  EXPECT_EQ(results[1].value, std::vector<uint8_t>({0x02, 0x02}));
+  EXPECT_EQ(results[2].handle, 0x30);
+  EXPECT_EQ(results[2].value, std::vector<uint8_t>({0x03, 0x03, 0x03, 0x03}));
+  EXPECT_EQ(BtaGattQueue::RoundTripsSaved(), saved + 1);
+
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].handles, std::vector<uint16_t>({0x40}));
+}
+
+TEST_F(BtaGattQueueTest, test_coalesced_reads_fit_in_mtu) {
+  BtaGattQueue::SetReadCoalescing(kConnId, 23);
+  BtaGattQueue::ReadCharacteristic(kConnId, 0x01, read_cb, nullptr);
+  for (uint16_t handle = 0x10; handle < 0x15; handle++)
+    BtaGattQueue::ReadFixedLengthCharacteristic(kConnId, handle, 8, read_cb,
+                                                nullptr);
+  respond(GATT_SUCCESS, {});
+
+  // 22 octets of values fit in the response
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].handles, std::vector<uint16_t>({0x10, 0x11}));
+}
+
+TEST_F(BtaGattQueueTest, test_failed_read_multiple_falls_back) {
+  BtaGattQueue::SetReadCoalescing(kConnId, 23);
+  BtaGattQueue::ReadCharacteristic(kConnId, 0x01, read_cb, nullptr);
+  BtaGattQueue::ReadFixedLengthCharacteristic(kConnId, 0x10, 1, read_cb,
+                                              nullptr);
+  BtaGattQueue::ReadFixedLengthCharacteristic(kConnId, 0x20, 1, read_cb,
+                                              nullptr);
+  respond(GATT_SUCCESS, {});
+  ASSERT_EQ(requests[0].handles.size(), 2u);
+
+  // A value with an unexpected length
+  respond(GATT_SUCCESS, {0x01, 0x02, 0x03});
+  EXPECT_EQ(results.size(), 1u);
+
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].handles, std::vector<uint16_t>({0x10}));
+  respond(GATT_READ_NOT_PERMIT, {});
+  ASSERT_EQ(requests.size(), 1u);
+  EXPECT_EQ(requests[0].handles, std::vector<uint16_t>({0x20}));
+  respond(GATT_SUCCESS, {0x02});
+
+  ASSERT_EQ(results.size(), 3u);
+  EXPECT_EQ(results[1].status, GATT_READ_NOT_PERMIT);
+  EXPECT_EQ(results[2].value, std::vector<uint8_t>({0x02}));
+}
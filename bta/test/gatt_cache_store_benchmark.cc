@@ -0,0 +1,190 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "bta/gatt/bta_gattc_cache_store.h"
+#include "bta/include/bta_gatt_api.h"
+
+using bluetooth::Uuid;
+
+namespace {
+
+constexpr uint16_t kCacheVersion = 4;
+constexpr size_t kNumAttributes = 60;
+
+RawAddress address(size_t i) {
+  return RawAddress({0x40, 0x22, 0x33, (uint8_t)(i >> 16), (uint8_t)(i >> 8),
+                     (uint8_t)i});
+}
+
+// A database of |kNumAttributes| attributes, one of |num_models| depending on
+// the server
+std::vector<tBTA_GATTC_NV_ATTR> database(size_t server, size_t num_models) {
+  std::vector<tBTA_GATTC_NV_ATTR> db(kNumAttributes);
+  for (size_t i = 0; i < db.size(); i++) {
+    db[i] = {};
+    db[i].uuid = Uuid::From16Bit(0x2a00 + (server % num_models) + i);
+    db[i].s_handle = i + 1;
+    db[i].attr_type = (i % 10 == 0) ? 0 : 2;
+    db[i].prop = 0x12;
+  }
+  return db;
+}
+
+// What bta_gattc_rebuild_cache() reads from the records
+uint32_t use(const tBTA_GATTC_NV_ATTR* attr, size_t num_attr) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < num_attr; i++)
+    sum += attr[i].s_handle + attr[i].attr_type + attr[i].uuid.As16Bit();
+  return sum;
+}
+
+// Known servers, stored in both the per server files and the store
+class Caches {
+ public:
+  explicit Caches(size_t num_servers, size_t num_models) {
+#if defined(OS_GENERIC)
+    char dir[] = "/tmp/gatt_cache_bench_XXXXXX";
+#else
+    char dir[] = "/data/local/tmp/gatt_cache_bench_XXXXXX";
+#endif  // !defined(OS_GENERIC)
+    dir_ = mkdtemp(dir);
+    store_path_ = dir_ + "/gatt_cache_store";
+
+    GattCacheStore store;
+    store.Open(store_path_, kCacheVersion);
+    for (size_t i = 0; i < num_servers; i++) {
+      std::vector<tBTA_GATTC_NV_ATTR> db = database(i, num_models);
+      store.Store(address(i), db.data(), db.size() * sizeof(db[0]));
+
+      // Same as bta_gattc_cache_write()
+      FILE* fd = fopen(FileName(i).c_str(), "wb");
+      uint16_t num_attr = db.size();
+      fwrite(&kCacheVersion, sizeof(uint16_t), 1, fd);
+      fwrite(&num_attr, sizeof(uint16_t), 1, fd);
+      fwrite(db.data(), sizeof(tBTA_GATTC_NV_ATTR), num_attr, fd);
+      fclose(fd);
+    }
+    num_servers_ = num_servers;
+  }
+
+  ~Caches() {
+    for (size_t i = 0; i < num_servers_; i++) unlink(FileName(i).c_str());
+    unlink(store_path_.c_str());
+    rmdir(dir_.c_str());
+  }
+
+  std::string FileName(size_t i) const {
+    char name[16];
+    snprintf(name, sizeof(name), "/gatt_cache_%zu", i);
+    return dir_ + name;
+  }
+
+  const std::string& StorePath() const { return store_path_; }
+
+ private:
+  std::string dir_;
+  std::string store_path_;
+  size_t num_servers_;
+};
+
+// Same as the former bta_gattc_cache_load()
+uint32_t load_file(const std::string& fname) {
+  FILE* fd = fopen(fname.c_str(), "rb");
+  if (!fd) return 0;
+  uint16_t cache_ver = 0;
+  uint16_t num_attr = 0;
+  uint32_t sum = 0;
+  if (fread(&cache_ver, sizeof(uint16_t), 1, fd) == 1 &&
+      cache_ver == kCacheVersion &&
+      fread(&num_attr, sizeof(uint16_t), 1, fd) == 1) {
+    tBTA_GATTC_NV_ATTR* attr =
+        (tBTA_GATTC_NV_ATTR*)malloc(sizeof(tBTA_GATTC_NV_ATTR) * num_attr);
+    if (fread(attr, sizeof(tBTA_GATTC_NV_ATTR), num_attr, fd) == num_attr)
+      sum = use(attr, num_attr);
+    free(attr);
+  }
+  fclose(fd);
+  return sum;
+}
+
+uint32_t load_store(GattCacheStore& store, const RawAddress& addr) {
+  size_t len = 0;
+  const void* attr = store.Find(addr, &len);
+  if (attr == nullptr) return 0;
+  return use(static_cast<const tBTA_GATTC_NV_ATTR*>(attr),
+             len / sizeof(tBTA_GATTC_NV_ATTR));
+}
+
+// Reconnections to the known servers in turn: cache load until the database
+// can be rebuilt
+void BM_FileCacheLoad(benchmark::State& state) {
+  Caches caches(state.range(0), 16);
+  size_t server = 0;
+  uint32_t sum = 0;
+  for (auto _ : state) {
+    sum += load_file(caches.FileName(server));
+    server = (server + 997) % state.range(0);
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FileCacheLoad)->Arg(100)->Arg(1000)->Arg(5000);
+
+void BM_StoreCacheLoad(benchmark::State& state) {
+  Caches caches(state.range(0), 16);
+  GattCacheStore store;
+  store.Open(caches.StorePath(), kCacheVersion);
+  size_t server = 0;
+  uint32_t sum = 0;
+  for (auto _ : state) {
+    sum += load_store(store, address(server));
+    server = (server + 997) % state.range(0);
+  }
+  benchmark::DoNotOptimize(sum);
+  state.counters["databases"] = store.NumDatabases();
+  state.counters["bytes"] = store.UsedBytes();
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StoreCacheLoad)->Arg(100)->Arg(1000)->Arg(5000);
+
+// First reconnection after the stack starts: the store is mapped first
+void BM_StoreOpenAndLoad(benchmark::State& state) {
+  Caches caches(state.range(0), 16);
+  uint32_t sum = 0;
+  for (auto _ : state) {
+    GattCacheStore store;
+    store.Open(caches.StorePath(), kCacheVersion);
+    sum += load_store(store, address(state.iterations() % state.range(0)));
+  }
+  benchmark::DoNotOptimize(sum);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StoreOpenAndLoad)->Arg(100)->Arg(1000)->Arg(5000);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,248 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "bta/gatt/bta_gattc_cache_store.h"
+
+namespace {
+constexpr uint32_t kFormat = 4;
+
+RawAddress address(uint16_t i) {
+  return RawAddress({0x11, 0x22, 0x33, 0x44, (uint8_t)(i >> 8), (uint8_t)i});
+}
+
+std::vector<uint8_t> database(uint8_t seed, size_t len) {
+  std::vector<uint8_t> db(len);
+  for (size_t i = 0; i < len; i++) db[i] = seed + i;
+  return db;
+}
+
+bool has_database(GattCacheStore& store, const RawAddress& addr,
+                  const std::vector<uint8_t>& expected) {
+  size_t len = 0;
+  const void* data = store.Find(addr, &len);
+  return data != nullptr && len == expected.size() &&
+         memcmp(data, expected.data(), len) == 0;
+}
+
+class GattCacheStoreTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+#if defined(OS_GENERIC)
+    char path[] = "/tmp/gatt_cache_store_XXXXXX";
+#else
+    char path[] = "/data/local/tmp/gatt_cache_store_XXXXXX";
+#endif  // !defined(OS_GENERIC)
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    unlink(path);
+    path_ = path;
+  }
+
+  void TearDown() override { unlink(path_.c_str()); }
+
+  std::string path_;
+};
+}  // namespace
+
+TEST_F(GattCacheStoreTest, test_store_find_remove) {
+  GattCacheStore store;
+  ASSERT_TRUE(store.Open(path_, kFormat));
+
+  size_t len;
+  EXPECT_EQ(store.Find(address(1), &len), nullptr);
+
+  std::vector<uint8_t> db1 = database(1, 260);
+  std::vector<uint8_t> db2 = database(2, 520);
+  EXPECT_TRUE(store.Store(address(1), db1.data(), db1.size()));
+  EXPECT_TRUE(store.Store(address(2), db2.data(), db2.size()));
+  EXPECT_TRUE(has_database(store, address(1), db1));
+  EXPECT_TRUE(has_database(store, address(2), db2));
+
+  // Replaced
+  EXPECT_TRUE(store.Store(address(1), db2.data(), db2.size()));
+  EXPECT_TRUE(has_database(store, address(1), db2));
+
+  store.Remove(address(1));
+  EXPECT_EQ(store.Find(address(1), &len), nullptr);
+  EXPECT_TRUE(has_database(store, address(2), db2));
+  EXPECT_EQ(store.NumServers(), 1u);
+}
+
+TEST_F(GattCacheStoreTest, test_persistent) {
+  std::vector<uint8_t> db = database(3, 104);
+  {
+    GattCacheStore store;
+    ASSERT_TRUE(store.Open(path_, kFormat));
+    EXPECT_TRUE(store.Store(address(3), db.data(), db.size()));
+  }
+
+  GattCacheStore store;
+  ASSERT_TRUE(store.Open(path_, kFormat));
+  EXPECT_TRUE(has_database(store, address(3), db));
+  EXPECT_EQ(store.NumServers(), 1u);
+  store.Close();
+
+  // Another format empties the store
+  ASSERT_TRUE(store.Open(path_, kFormat + 1));
+  EXPECT_EQ(store.NumServers(), 0u);
+  size_t len;
+  EXPECT_EQ(store.Find(address(3), &len), nullptr);
+}
+
+TEST_F(GattCacheStoreTest, test_identical_databases_shared) {
+  GattCacheStore store;
+  ASSERT_TRUE(store.Open(path_, kFormat));
+
+  std::vector<uint8_t> db = database(4, 1300);
+  for (uint16_t i = 0; i < 100; i++)
+    EXPECT_TRUE(store.Store(address(i), db.data(), db.size()));
+  EXPECT_EQ(store.NumServers(), 100u);
+  EXPECT_EQ(store.NumDatabases(), 1u);
+  EXPECT_LT(store.UsedBytes(), 2 * db.size());
+  EXPECT_TRUE(has_database(store, address(99), db));
+
+  // Still shared after the other servers are gone
+  for (uint16_t i = 0; i < 99; i++) store.Remove(address(i));
+  EXPECT_EQ(store.NumDatabases(), 1u);
+  EXPECT_TRUE(has_database(store, address(99), db));
+}
+
+TEST_F(GattCacheStoreTest, test_corrupted_database_dropped) {
+  std::vector<uint8_t> db = database(5, 260);
+  {
+    GattCacheStore store;
+    ASSERT_TRUE(store.Open(path_, kFormat));
+    EXPECT_TRUE(store.Store(address(5), db.data(), db.size()));
+  }
+
+  // Flip the last byte of the database, at the end of the file data
+  FILE* file = fopen(path_.c_str(), "r+b");
+  ASSERT_NE(file, nullptr);
+  std::vector<uint8_t> content(GattCacheStore::kDefaultCapacity);
+  ASSERT_EQ(fread(content.data(), 1, content.size(), file), content.size());
+  size_t last = content.size() - 1;
+  while (content[last] != db.back()) last--;
+  content[last] ^= 0xff;
+  fseek(file, last, SEEK_SET);
+  fwrite(&content[last], 1, 1, file);
+  fclose(file);
+
+  GattCacheStore store;
+  ASSERT_TRUE(store.Open(path_, kFormat));
+  size_t len;
+  EXPECT_EQ(store.Find(address(5), &len), nullptr);
+  EXPECT_EQ(store.NumServers(), 0u);
+}
+
+TEST_F(GattCacheStoreTest, test_compaction) {
+  GattCacheStore store;
+  ASSERT_TRUE(store.Open(path_, kFormat, 64 * 1024, 64));
+
+  // Room for about 12 of them: replacing them requires compaction
+  for (uint8_t round = 0; round < 10; round++) {
+    for (uint16_t i = 0; i < 8; i++) {
+      std::vector<uint8_t> db = database(round * 8 + i, 5000);
+      ASSERT_TRUE(store.Store(address(i), db.data(), db.size()));
+    }
+  }
+  EXPECT_EQ(store.NumServers(), 8u);
+  EXPECT_EQ(store.NumDatabases(), 8u);
+  for (uint16_t i = 0; i < 8; i++)
+    EXPECT_TRUE(has_database(store, address(i), database(9 * 8 + i, 5000)));
+
+  // Full
+  std::vector<uint8_t> large = database(0, 64 * 1024);
+  EXPECT_FALSE(store.Store(address(100), large.data(), large.size()));
+  EXPECT_TRUE(has_database(store, address(7), database(9 * 8 + 7, 5000)));
+
+  // The index is full, but removed servers free their slots
+  for (uint16_t i = 8; i < 64; i++) {
+    std::vector<uint8_t> db = database(0, 16);
+    ASSERT_TRUE(store.Store(address(i), db.data(), db.size()));
+  }
+  std::vector<uint8_t> db = database(1, 16);
+  EXPECT_FALSE(store.Store(address(64), db.data(), db.size()));
+  store.Remove(address(0));
+  EXPECT_TRUE(store.Store(address(64), db.data(), db.size()));
+  EXPECT_TRUE(has_database(store, address(64), db));
+}
+
+TEST_F(GattCacheStoreTest, test_compaction_replaces_file) {
+  // Left over by a crash during a previous compaction
+  std::string tmp_path = path_ + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  fputs("garbage", file);
+  fclose(file);
+
+  {
+    GattCacheStore store;
+    ASSERT_TRUE(store.Open(path_, kFormat, 64 * 1024, 64));
+    for (uint8_t round = 0; round < 10; round++) {
+      for (uint16_t i = 0; i < 8; i++) {
+        std::vector<uint8_t> db = database(round * 8 + i, 5000);
+        ASSERT_TRUE(store.Store(address(i), db.data(), db.size()));
+      }
+    }
+    EXPECT_NE(access(path_.c_str(), F_OK), -1);
+    EXPECT_EQ(access(tmp_path.c_str(), F_OK), -1);
+  }
+
+  GattCacheStore store;
+  ASSERT_TRUE(store.Open(path_, kFormat));
+  EXPECT_EQ(store.Capacity(), 64u * 1024);
+  EXPECT_EQ(store.NumServers(), 8u);
+  for (uint16_t i = 0; i < 8; i++)
+    EXPECT_TRUE(has_database(store, address(i), database(9 * 8 + i, 5000)));
+}
+
+TEST_F(GattCacheStoreTest, test_removed_slots_reclaimed) {
+  GattCacheStore store;
+  ASSERT_TRUE(store.Open(path_, kFormat, 64 * 1024, 64));
+
+  std::vector<uint8_t> db = database(6, 100);
+  for (uint16_t i = 0; i < 8; i++)
+    ASSERT_TRUE(store.Store(address(i), db.data(), db.size()));
+
+  // The data never fills up, yet the removed slots don't pile up
+  for (uint16_t i = 100; i < 1000; i++) {
+    ASSERT_TRUE(store.Store(address(i), db.data(), db.size()));
+    if (i > 100) store.Remove(address(i - 1));
+    EXPECT_LE(store.NumRemovedSlots(), 16u);
+  }
+  for (uint16_t i = 0; i < 8; i++)
+    EXPECT_TRUE(has_database(store, address(i), db));
+  EXPECT_TRUE(has_database(store, address(999), db));
+  EXPECT_EQ(store.NumDatabases(), 1u);
+  store.Close();
+
+  ASSERT_TRUE(store.Open(path_, kFormat));
+  EXPECT_LE(store.NumRemovedSlots(), 16u);
+  for (uint16_t i = 0; i < 8; i++)
+    EXPECT_TRUE(has_database(store, address(i), db));
+}
@@ -0,0 +1,163 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "bta/gatt/bta_gattc_int.h"
+
+using bluetooth::Uuid;
+
+namespace {
+
+tBTA_GATTC_NV_ATTR attr(uint8_t type, uint16_t s_handle, uint16_t e_handle,
+                        uint16_t uuid) {
+  tBTA_GATTC_NV_ATTR attr = {};
+  attr.uuid = Uuid::From16Bit(uuid);
+  attr.s_handle = s_handle;
+  attr.e_handle = e_handle;
+  attr.attr_type = type;
+  attr.is_primary = true;
+  return attr;
+}
+
+// Same as the attribute searches without the index
+const tBTA_GATTC_SERVICE* find_service(tBTA_GATTC_SERV& srcb,
+                                       uint16_t handle) {
+  for (const tBTA_GATTC_SERVICE& service : srcb.srvc_cache) {
+    if (handle >= service.s_handle && handle <= service.e_handle)
+      return &service;
+  }
+  return nullptr;
+}
+
+const tBTA_GATTC_CHARACTERISTIC* find_characteristic(tBTA_GATTC_SERV& srcb,
+                                                     uint16_t handle) {
+  const tBTA_GATTC_SERVICE* service = find_service(srcb, handle);
+  if (!service) return nullptr;
+  for (const tBTA_GATTC_CHARACTERISTIC& charac : service->characteristics) {
+    if (handle == charac.value_handle) return &charac;
+  }
+  return nullptr;
+}
+
+const tBTA_GATTC_DESCRIPTOR* find_descriptor(tBTA_GATTC_SERV& srcb,
+                                             uint16_t handle) {
+  const tBTA_GATTC_SERVICE* service = find_service(srcb, handle);
+  if (!service) return nullptr;
+  for (const tBTA_GATTC_CHARACTERISTIC& charac : service->characteristics) {
+    for (const tBTA_GATTC_DESCRIPTOR& desc : charac.descriptors) {
+      if (handle == desc.handle) return &desc;
+    }
+  }
+  return nullptr;
+}
+
+const tBTA_GATTC_CHARACTERISTIC* find_owning_characteristic(
+    tBTA_GATTC_SERV& srcb, uint16_t handle) {
+  const tBTA_GATTC_SERVICE* service = find_service(srcb, handle);
+  if (!service) return nullptr;
+  for (const tBTA_GATTC_CHARACTERISTIC& charac : service->characteristics) {
+    for (const tBTA_GATTC_DESCRIPTOR& desc : charac.descriptors) {
+      if (handle == desc.handle) return &charac;
+    }
+  }
+  return nullptr;
+}
+
+void expect_same_as_search(tBTA_GATTC_SERV& srcb) {
+  for (uint32_t handle = 0; handle <= 0xFFFF; handle++) {
+    EXPECT_EQ(bta_gattc_get_service_for_handle_srcb(&srcb, handle),
+              find_service(srcb, handle))
+        << "handle " << handle;
+    EXPECT_EQ(bta_gattc_get_characteristic_srcb(&srcb, handle),
+              find_characteristic(srcb, handle))
+        << "handle " << handle;
+    EXPECT_EQ(bta_gattc_get_descriptor_srcb(&srcb, handle),
+              find_descriptor(srcb, handle))
+        << "handle " << handle;
+    EXPECT_EQ(bta_gattc_get_owning_characteristic_srcb(&srcb, handle),
+              find_owning_characteristic(srcb, handle))
+        << "handle " << handle;
+  }
+}
+
+}  // namespace
+
+TEST(GattHandleIndexTest, test_same_as_search) {
+  std::vector<tBTA_GATTC_NV_ATTR> db = {
+      attr(BTA_GATTC_ATTR_TYPE_SRVC, 0x0001, 0x0007, 0x1800),
+      attr(BTA_GATTC_ATTR_TYPE_SRVC, 0x0010, 0x0020, 0x180d),
+      attr(BTA_GATTC_ATTR_TYPE_SRVC, 0x0030, 0xFFFF, 0x180f),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR, 0x0003, 0, 0x2a00),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR, 0x0005, 0, 0x2a01),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR_DESCR, 0x0006, 0, 0x2902),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR_DESCR, 0x0007, 0, 0x2901),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR, 0x0012, 0, 0x2a37),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR_DESCR, 0x0013, 0, 0x2902),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR, 0x0015, 0, 0x2a38),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR, 0x0032, 0, 0x2a19),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR_DESCR, 0x0033, 0, 0x2902),
+  };
+
+  tBTA_GATTC_SERV srcb = {};
+  bta_gattc_rebuild_cache(&srcb, db.size(), db.data());
+  ASSERT_EQ(srcb.srvc_cache.size(), 3u);
+  expect_same_as_search(srcb);
+
+  const tBTA_GATTC_CHARACTERISTIC* charac =
+      bta_gattc_get_characteristic_srcb(&srcb, 0x0012);
+  ASSERT_NE(charac, nullptr);
+  EXPECT_EQ(charac->uuid, Uuid::From16Bit(0x2a37));
+  EXPECT_EQ(bta_gattc_get_owning_characteristic_srcb(&srcb, 0x0013), charac);
+
+  // Only up to the last attribute is indexed
+  EXPECT_EQ(srcb.handle_index.size(), 0x0034u);
+}
+
+TEST(GattHandleIndexTest, test_overlapping_services) {
+  // The handles of the second service are in the first one
+  std::vector<tBTA_GATTC_NV_ATTR> db = {
+      attr(BTA_GATTC_ATTR_TYPE_SRVC, 0x0001, 0x0010, 0x1800),
+      attr(BTA_GATTC_ATTR_TYPE_SRVC, 0x0008, 0x0020, 0x1801),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR, 0x0003, 0, 0x2a00),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR, 0x0009, 0, 0x2a05),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR_DESCR, 0x000a, 0, 0x2902),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR, 0x0015, 0, 0x2a05),
+  };
+
+  tBTA_GATTC_SERV srcb = {};
+  bta_gattc_rebuild_cache(&srcb, db.size(), db.data());
+  expect_same_as_search(srcb);
+}
+
+TEST(GattHandleIndexTest, test_cleared_with_cache) {
+  std::vector<tBTA_GATTC_NV_ATTR> db = {
+      attr(BTA_GATTC_ATTR_TYPE_SRVC, 0x0001, 0x0005, 0x1800),
+      attr(BTA_GATTC_ATTR_TYPE_CHAR, 0x0003, 0, 0x2a00),
+  };
+
+  tBTA_GATTC_SERV srcb = {};
+  bta_gattc_rebuild_cache(&srcb, db.size(), db.data());
+  EXPECT_NE(bta_gattc_get_characteristic_srcb(&srcb, 0x0003), nullptr);
+
+  bta_gattc_init_cache(&srcb);
+  EXPECT_TRUE(srcb.handle_index.empty());
+  EXPECT_EQ(bta_gattc_get_characteristic_srcb(&srcb, 0x0003), nullptr);
+}
@@ -47,4 +47,20 @@ void btif_a2dp_control_set_audio_delay(uint16_t delay);
 // track of the number of audio bytes sent
 void btif_a2dp_control_reset_audio_delay(void);
 
+// Read up to |len| bytes of audio data from the audio HAL into |p_buf|.
+// The data is read from the shared memory ring if the audio HAL has attached
+// one, otherwise from the audio data socket.
+// Returns the number of bytes read.
+uint32_t btif_a2dp_control_read_audio_data(uint8_t* p_buf, uint32_t len);
+
+// Get the number of audio data bytes written by the audio HAL and not read
+// yet.
+uint32_t btif_a2dp_control_audio_queued_bytes(void);
+
+// Discard any audio data queued by the audio HAL.
+void btif_a2dp_control_flush_audio_data(void);
+
+// Dump the audio transport statistics to the |fd| file descriptor.
+void btif_a2dp_control_debug_dump(int fd);
+
 #endif /* BTIF_A2DP_CONTROL_H */
@@ -0,0 +1,192 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef BTIF_A2DP_SINK_JITTER_BUFFER_H
+#define BTIF_A2DP_SINK_JITTER_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+#include "bt_types.h"
+
+// Adaptive jitter buffer for the A2DP Sink media packets.
+//
+// The media packets are ordered by their AVDTP sequence number and played out
+// following the AVDTP timestamps: once enough media is buffered to cover the
+// target latency, the buffer starts a playout clock and releases each packet
+// when its timestamp becomes due. A packet that is still missing when its
+// timestamp is due is concealed, and a packet that arrives after its
+// timestamp was due is dropped.
+//
+// With adaptive latency, the target latency follows the measured interarrival
+// jitter (RFC 3550) and the underrun history, bounded by the configured target
+// latency. Media in excess of the target latency is discarded one packet at a
+// time, so the steady-state latency tracks the current link conditions.
+class BtifA2dpSinkJitterBuffer {
+ public:
+  enum Action {
+    kNone,     // Nothing to play yet
+    kPlay,     // Decode and play the returned packet
+    kConceal,  // Conceal one lost packet
+  };
+
+  // Maximum number of buffered packets.
+  static constexpr size_t kMaxPackets = 64;
+  // Lower bound of the adaptive target latency.
+  static constexpr uint64_t kMinTargetLatencyUs = 40 * 1000;
+  // Period without underrun after which the latency can be reduced.
+  static constexpr uint64_t kStableWindowUs = 1000 * 1000;
+
+  BtifA2dpSinkJitterBuffer();
+  ~BtifA2dpSinkJitterBuffer();
+
+  // Configures the buffer for a stream at |sample_rate| (the AVDTP timestamp
+  // clock rate). |target_latency_ms| is the target latency, or the upper
+  // bound of the target latency if |adaptive| is true. |lookahead_us| is how
+  // far ahead of the playout clock packets are released, normally the decode
+  // tick period. Flushes the buffered packets and resets the statistics.
+  void Configure(uint32_t sample_rate, uint64_t target_latency_ms,
+                 bool adaptive, uint64_t lookahead_us);
+
+  // Drops all the buffered packets. The next packet restarts buffering.
+  void Flush();
+
+  // Adds the media packet |p_buf| with AVDTP sequence number |seq| and AVDTP
+  // timestamp |timestamp|, received at |now_us|. The buffer takes ownership
+  // of |p_buf|. Returns false if the packet was dropped.
+  bool Enqueue(BT_HDR* p_buf, uint16_t seq, uint32_t timestamp,
+               uint64_t now_us);
+
+  // Returns the next playout action due at |now_us|. For |kPlay|, |*pp_buf|
+  // is set to the packet to decode and the caller takes ownership of it.
+  // Should be called until it returns |kNone|.
+  Action Dequeue(uint64_t now_us, BT_HDR** pp_buf);
+
+  // Returns the number of buffered packets.
+  size_t Length() const { return packets_.size(); }
+
+  // Returns true while buffering up to the target latency.
+  bool IsBuffering() const { return buffering_; }
+
+  // Returns the current target latency in microseconds.
+  uint64_t TargetLatencyUs() const;
+
+  // Returns the interarrival jitter estimate in microseconds.
+  uint64_t JitterUs() const { return jitter_us_x16_ >> 4; }
+
+  uint64_t LatePackets() const { return late_packets_; }
+  uint64_t DuplicatePackets() const { return duplicate_packets_; }
+  uint64_t OverflowPackets() const { return overflow_packets_; }
+  uint64_t ConcealedPackets() const { return concealed_packets_; }
+  uint64_t PlayedPackets() const { return played_packets_; }
+  uint64_t Underruns() const { return underruns_; }
+  uint64_t LatencyDrops() const { return latency_drops_; }
+
+  // Dumps the jitter buffer state and statistics to the |fd| file descriptor.
+  void DebugDump(int fd) const;
+
+ private:
+  struct Packet {
+    BT_HDR* p_buf;
+    int64_t timestamp;  // Extended AVDTP timestamp
+  };
+
+  void ResetStats();
+  int64_t SamplesToUs(int64_t samples) const;
+  int64_t UsToSamples(int64_t us) const;
+  // Returns the buffered media duration in microseconds, starting at
+  // |from_timestamp|.
+  int64_t BufferedUs(int64_t from_timestamp) const;
+  void StartPlayout(uint64_t now_us);
+  // Skips the packet at the head of the playout sequence, shifting the
+  // playout clock so the next packet is due immediately.
+  void SkipHead();
+
+  uint32_t sample_rate_;
+  uint64_t configured_latency_us_;
+  bool adaptive_;
+  uint64_t lookahead_us_;
+
+  // Packets ordered by extended AVDTP sequence number
+  std::map<int64_t, Packet> packets_;
+  bool have_reference_;
+  int64_t highest_seq_;
+  int64_t highest_timestamp_;
+  int64_t packet_duration_;  // In AVDTP timestamp units, 0 if unknown
+  int64_t last_transit_us_;
+  uint64_t jitter_us_x16_;
+  uint64_t underrun_margin_us_;
+
+  // Playout state
+  bool buffering_;
+  int64_t next_seq_;
+  int64_t play_timestamp_;
+  int64_t anchor_timestamp_;
+  uint64_t anchor_us_;
+  uint64_t stable_since_us_;
+
+  // Statistics
+  uint64_t received_packets_;
+  uint64_t late_packets_;
+  uint64_t duplicate_packets_;
+  uint64_t overflow_packets_;
+  uint64_t played_packets_;
+  uint64_t concealed_packets_;
+  uint64_t underruns_;
+  uint64_t latency_drops_;
+  uint64_t latency_samples_;
+  uint64_t total_latency_us_;
+  uint64_t min_latency_us_;
+  uint64_t max_latency_us_;
+};
+
+// Frame-level packet loss concealment for the decoded A2DP Sink audio.
+//
+// Keeps the PCM decoded from the last packet and, for each lost packet,
+// replays it attenuated by 6 dB per consecutive loss, fading to silence.
+// The decoded audio is 16 bits per sample.
+class BtifA2dpSinkConcealer {
+ public:
+  // Number of consecutive concealed packets after which only silence is
+  // generated.
+  static constexpr size_t kMaxFadePackets = 3;
+
+  BtifA2dpSinkConcealer() { Reset(); }
+  void Reset();
+
+  // Starts capturing the PCM decoded from a new packet.
+  void BeginPacket();
+
+  // Appends |len| octets of PCM decoded from the current packet.
+  void Append(const uint8_t* data, size_t len);
+
+  // Generates the PCM concealing one lost packet. Returns the number of
+  // octets pointed to by |*p_data|, or 0 if nothing was decoded yet.
+  size_t Conceal(const uint8_t** p_data);
+
+ private:
+  std::vector<uint8_t> last_pcm_;
+  std::vector<uint8_t> concealed_pcm_;
+  bool capturing_;
+  size_t consecutive_losses_;
+};
+
+#endif  // BTIF_A2DP_SINK_JITTER_BUFFER_H
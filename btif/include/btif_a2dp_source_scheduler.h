@@ -0,0 +1,208 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef BTIF_A2DP_SOURCE_SCHEDULER_H
+#define BTIF_A2DP_SOURCE_SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "a2dp_codec_api.h"
+
+// Histogram of durations (in us) with power-of-two bucket boundaries. Bucket
+// i counts the values in [kFirstBucketUs * 2^(i-1), kFirstBucketUs * 2^i); the
+// first bucket counts everything below |kFirstBucketUs| and the last bucket
+// everything above the second to last boundary.
+class A2dpDurationHistogram {
+ public:
+  static constexpr size_t kNumBuckets = 10;
+  static constexpr uint64_t kFirstBucketUs = 125;
+
+  A2dpDurationHistogram() { Reset(); }
+  void Reset();
+
+  // Adds |value_us| to the histogram.
+  void Add(uint64_t value_us);
+
+  // Adds all the samples of |other| to this histogram.
+  void Accumulate(const A2dpDurationHistogram& other);
+
+  uint64_t Count(size_t bucket) const { return buckets_[bucket]; }
+  uint64_t TotalCount() const { return total_count_; }
+  uint64_t MaxUs() const { return max_us_; }
+
+  // Returns the exclusive upper bound (in us) of |bucket|, or UINT64_MAX for
+  // the last bucket.
+  static uint64_t BucketUpperBoundUs(size_t bucket);
+
+  // Returns an upper bound (in us) of the |percent| percentile, i.e. the upper
+  // bound of the first bucket at which the cumulative count reaches
+  // |percent|% of all samples. Returns 0 if the histogram is empty.
+  uint64_t PercentileUpperBoundUs(unsigned percent) const;
+
+  // Dumps the histogram to the |fd| file descriptor, one line per non-empty
+  // bucket, prefixed by |title|.
+  void DebugDump(int fd, const char* title) const;
+
+ private:
+  uint64_t buckets_[kNumBuckets];
+  uint64_t total_count_;
+  uint64_t max_us_;
+};
+
+// Feedback-controlled scheduler for the A2DP source media tick.
+//
+// The scheduler is driven by the media tick handler: |BeginTick()| is called
+// when a tick fires, |OnFeedRead()| for each read of PCM data from the audio
+// HAL during the tick, and |EndTick()| once the encoder produced the frames
+// for the tick.
+//
+// It provides:
+//  - Drift compensation: the rate at which the audio HAL feeds PCM data is
+//    compared with the rate at which the encoder consumes it. The estimated
+//    clock drift is applied to the media timestamp passed to the encoder, so
+//    the encoder consumes PCM data at the rate it is produced.
+//  - Tick coalescing: when the system is lightly loaded (no underflow, an
+//    empty transmit queue and punctual ticks) the tick period is stretched,
+//    which reduces the number of wakeups. The stretched period stays below
+//    the audio the encoder can send in one tick, so a late tick does not
+//    drop frames. Any sign of load switches back to the nominal period
+//    immediately.
+//  - Jitter histograms for the tick wakeup deviation and the tick service
+//    time.
+class BtifA2dpSourceScheduler {
+ public:
+  // Maximum absolute clock drift compensated, in parts per million.
+  static constexpr int32_t kMaxDriftPpm = 1000;
+  // Duration of a drift estimation window.
+  static constexpr uint64_t kDriftWindowUs = 1000 * 1000;
+  // Number of consecutive quiet ticks before the ticks are coalesced.
+  static constexpr size_t kCoalesceAfterTicks = 100;
+  // Maximum quiet tick requirement reached by the coalescing backoff.
+  static constexpr size_t kMaxCoalesceAfterTicks = 16 * kCoalesceAfterTicks;
+
+  BtifA2dpSourceScheduler() { Reset(); }
+
+  // Resets the scheduler state and all the statistics.
+  void Reset();
+
+  // Returns true if the ticks of |encoder_interface| can be coalesced. Only
+  // the encoders sending the audio for the time elapsed since their last tick
+  // can be ticked less often; the others send a fixed amount of audio per
+  // tick, and would fall behind the audio HAL.
+  static bool CanCoalesceTicks(
+      const tA2DP_ENCODER_INTERFACE* encoder_interface);
+
+  // Starts a new streaming session at |now_us| with a nominal tick period of
+  // |interval_ms|. |max_interval_us| is the longest time the encoder sends
+  // the audio for in one tick without dropping frames, or 0 to disable tick
+  // coalescing.
+  void Start(uint64_t now_us, uint64_t interval_ms, uint64_t max_interval_us);
+
+  // Stops the streaming session.
+  void Stop();
+
+  // Called when a media tick fires at |now_us|. |tx_queue_length| is the
+  // number of encoded packets waiting for transmission and |feed_queued_bytes|
+  // is the number of PCM bytes written by the audio HAL and not read yet.
+  // Returns the drift-compensated media timestamp (in us) to pass to the
+  // encoder.
+  uint64_t BeginTick(uint64_t now_us, size_t tx_queue_length,
+                     size_t feed_queued_bytes);
+
+  // Called for each PCM read made by the encoder during the tick.
+  // |bytes_requested| is the number of bytes the encoder asked for and
+  // |bytes_read| the number of bytes it got.
+  void OnFeedRead(uint32_t bytes_requested, uint32_t bytes_read);
+
+  // Called once the tick has been serviced at |now_us|.
+  // Returns true if the tick period changed and the media tick must be
+  // rescheduled with |TickPeriodMs()|.
+  bool EndTick(uint64_t now_us);
+
+  // Returns the current tick period in milliseconds.
+  uint64_t TickPeriodMs() const { return tick_period_ms_; }
+
+  // Returns the nominal tick period in milliseconds.
+  uint64_t NominalPeriodMs() const { return nominal_period_ms_; }
+
+  // Returns true if the ticks are currently coalesced.
+  bool IsCoalescing() const { return tick_period_ms_ != nominal_period_ms_; }
+
+  // Returns the current clock drift estimate in parts per million. A positive
+  // value means the audio HAL feeds data faster than the nominal rate.
+  int32_t DriftPpm() const { return drift_ppm_; }
+
+  const A2dpDurationHistogram& TickJitterHistogram() const {
+    return tick_jitter_histogram_;
+  }
+  const A2dpDurationHistogram& TickServiceHistogram() const {
+    return tick_service_histogram_;
+  }
+
+  // Dumps the scheduler state and statistics to the |fd| file descriptor.
+  void DebugDump(int fd) const;
+
+ private:
+  // Returns the coalesced tick period for a nominal period of
+  // |nominal_period_ms|, when the encoder sends at most |max_interval_us| of
+  // audio per tick.
+  static uint64_t CoalescedPeriodMs(uint64_t nominal_period_ms,
+                                    uint64_t max_interval_us);
+
+  void UpdateDriftEstimate(uint64_t now_us, size_t feed_queued_bytes);
+  void SetTickPeriod(uint64_t period_ms);
+
+  bool running_;
+  bool coalescing_enabled_;
+  uint64_t nominal_period_ms_;
+  uint64_t coalesced_period_ms_;
+  uint64_t tick_period_ms_;
+  bool tick_period_changed_;
+
+  // Tick state
+  uint64_t last_tick_us_;
+  uint64_t next_deadline_us_;
+  uint64_t tick_begin_us_;
+  uint64_t media_timestamp_us_;
+  bool tick_underflow_;
+  bool tick_quiet_;
+  size_t quiet_tick_count_;
+  size_t coalesce_after_ticks_;
+
+  // Drift estimation state for the current window
+  int32_t drift_ppm_;
+  uint64_t window_start_us_;
+  size_t window_start_queued_bytes_;
+  uint64_t window_bytes_requested_;
+  uint64_t window_bytes_read_;
+
+  // Statistics
+  uint64_t total_ticks_;
+  uint64_t coalesced_ticks_;
+  uint64_t coalesced_time_us_;
+  uint64_t coalesce_enter_count_;
+  uint64_t coalesce_exit_count_;
+  uint64_t drift_window_count_;
+  int32_t min_drift_ppm_;
+  int32_t max_drift_ppm_;
+  A2dpDurationHistogram tick_jitter_histogram_;
+  A2dpDurationHistogram tick_service_histogram_;
+};
+
+#endif  // BTIF_A2DP_SOURCE_SCHEDULER_H
@@ -32,9 +32,17 @@
 #define SOCK_THREAD_FD_WR (1 << 1)        /* BT socket write signal */
 #define SOCK_THREAD_FD_EXCEPTION (1 << 2) /* BT socket exception singal */
 
-/* Add BT socket fd in current socket poll thread context immediately */
+/* Add BT socket fd in current socket poll thread context immediately. Fds are
+ * always added synchronously, the flag is kept for the existing callers. */
 #define SOCK_THREAD_ADD_FD_SYNC (1 << 3)
 
+/* Number of times each signal was reported for a monitored fd */
+typedef struct {
+  uint32_t rd_count;
+  uint32_t wr_count;
+  uint32_t exception_count;
+} btsock_fd_stats_t;
+
 /*******************************************************************************
  *  Functions
  ******************************************************************************/
@@ -55,4 +63,10 @@ int btsock_thread_create(btsock_signaled_cb callback,
                          btsock_cmd_cb cmd_callback);
 int btsock_thread_exit(int handle);
 
+/* Get the signal counters of |fd|, kept from its first add until it is
+ * removed with btsock_thread_remove_fd_and_close() or closed. Returns false if
+ * |fd| is not known by the thread. */
+bool btsock_thread_get_fd_stats(int handle, int fd, btsock_fd_stats_t* stats);
+void btsock_thread_debug_dump(int fd);
+
 #endif
@@ -49,6 +49,7 @@
 
 #include "avrcp_service.h"
 #include "bt_utils.h"
+#include "bta/include/bta_gatt_queue.h"
 #include "bta/include/bta_hearing_aid_api.h"
 #include "bta/include/bta_hf_client_api.h"
 #include "btif_a2dp.h"
@@ -59,16 +60,22 @@
 #include "btif_debug_btsnoop.h"
 #include "btif_debug_conn.h"
 #include "btif_hf.h"
+#include "btif_sock_thread.h"
 #include "btif_storage.h"
+#include "btm_ble_api.h"
 #include "btsnoop.h"
 #include "btsnoop_mem.h"
+#include "hci_layer.h"
 #include "device/include/interop.h"
 #include "osi/include/alarm.h"
 #include "osi/include/allocation_tracker.h"
+#include "osi/include/latency_trace.h"
 #include "osi/include/log.h"
 #include "osi/include/metrics.h"
 #include "osi/include/osi.h"
 #include "osi/include/wakelock.h"
+#include "port_api.h"
+#include "smp_api.h"
 #include "stack_manager.h"
 
 /* Test interface includes */
@@ -310,6 +317,16 @@ static int read_energy_info() {
 }
 
 static void dump(int fd, const char** arguments) {
+#if (BT_LATENCY_TRACE == TRUE)
+  // Only the latency trace, to be loaded in a trace viewer
+  for (const char** arg = arguments; arg && *arg; arg++) {
+    if (!strcmp(*arg, "--latency-trace")) {
+      latency_trace_dump_events(fd);
+      return;
+    }
+  }
+#endif
+
   btif_debug_conn_dump(fd);
   btif_debug_bond_event_dump(fd);
   btif_debug_a2dp_dump(fd);
@@ -323,6 +340,15 @@ static void dump(int fd, const char** arguments) {
   osi_allocator_debug_dump(fd);
   alarm_debug_dump(fd);
   HearingAid::DebugDump(fd);
+  hci_layer_debug_dump(fd);
+  btm_ble_rpa_resolver_debug_dump(fd);
+  smp_debug_dump(fd);
+  rfcomm_debug_dump(fd);
+  BtaGattQueue::DebugDump(fd);
+  btsock_thread_debug_dump(fd);
+#if (BT_LATENCY_TRACE == TRUE)
+  latency_trace_debug_dump(fd);
+#endif
 #if (BTSNOOP_MEM == TRUE)
   btif_debug_btsnoop_dump(fd);
 #endif
@@ -177,6 +177,7 @@ void btif_a2dp_on_offload_started(const RawAddress& peer_addr,
 
 void btif_debug_a2dp_dump(int fd) {
   btif_a2dp_source_debug_dump(fd);
+  btif_a2dp_control_debug_dump(fd);
   btif_a2dp_sink_debug_dump(fd);
   btif_a2dp_codec_debug_dump(fd);
 }
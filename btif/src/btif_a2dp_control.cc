@@ -20,10 +20,18 @@
 #define LOG_TAG "bt_btif_a2dp_control"
 
 #include <base/logging.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
 
 #include "audio_a2dp_hw/include/audio_a2dp_hw.h"
+#include "audio_a2dp_hw/include/audio_a2dp_hw_shm.h"
 #include "bt_common.h"
 #include "btif_a2dp.h"
 #include "btif_a2dp_control.h"
@@ -50,6 +58,60 @@ static void btif_a2dp_ctrl_cb(tUIPC_CH_ID ch_id, tUIPC_EVENT event);
 static tA2DP_CTRL_CMD a2dp_cmd_pending = A2DP_CTRL_CMD_NONE;
 std::unique_ptr<tUIPC_STATE> a2dp_uipc;
 
+/* Shared memory audio transport, attached by the audio HAL on demand.
+ * A read waits up to A2DP_DATA_READ_POLL_MS for data: readers take a reference
+ * to the ring under audio_shm_mutex and read outside of it, so that attaching
+ * or detaching on the UIPC thread doesn't wait for them. The ring is closed
+ * when its last reference is dropped, which must not happen with
+ * audio_shm_mutex held. */
+struct AudioShmRing {
+  AudioShmRing() { a2dp_shm_ring_init(&ring); }
+  ~AudioShmRing();
+
+  struct a2dp_shm_ring ring;
+  std::mutex read_mutex; /* serializes the reads, flushes and stats dumps */
+};
+
+static std::mutex audio_shm_mutex;
+static std::shared_ptr<AudioShmRing> audio_shm_ring;
+static struct a2dp_shm_stats audio_shm_accumulated_stats;
+
+static void btif_a2dp_control_shm_attach(void);
+static void btif_a2dp_control_shm_detach(void);
+
+/* Adds the stats of the ring to the totals, and closes it */
+AudioShmRing::~AudioShmRing() {
+  if (!a2dp_shm_ring_is_attached(&ring)) return;
+
+  const a2dp_shm_stats& stats = ring.stats;
+  {
+    std::lock_guard<std::mutex> lock(audio_shm_mutex);
+    a2dp_shm_stats* acc = &audio_shm_accumulated_stats;
+    if (stats.total_chunks > 0) {
+      if (acc->total_chunks == 0 || stats.latency_min_us < acc->latency_min_us)
+        acc->latency_min_us = stats.latency_min_us;
+      acc->latency_max_us =
+          std::max(acc->latency_max_us, stats.latency_max_us);
+      acc->jitter_us = stats.jitter_us;
+      acc->last_latency_us = stats.last_latency_us;
+    }
+    acc->total_bytes += stats.total_bytes;
+    acc->total_chunks += stats.total_chunks;
+    acc->total_reads += stats.total_reads;
+    acc->total_wakeups += stats.total_wakeups;
+    acc->underflow_count += stats.underflow_count;
+    acc->overrun_count += stats.overrun_count;
+    acc->latency_total_us += stats.latency_total_us;
+  }
+
+  a2dp_shm_ring_close(&ring);
+}
+
+static std::shared_ptr<AudioShmRing> btif_a2dp_control_shm_ring(void) {
+  std::lock_guard<std::mutex> lock(audio_shm_mutex);
+  return audio_shm_ring;
+}
+
 void btif_a2dp_control_init(void) {
   a2dp_uipc = UIPC_Init();
   UIPC_Open(*a2dp_uipc, UIPC_CH_ID_AV_CTRL, btif_a2dp_ctrl_cb, A2DP_CTRL_PATH);
@@ -58,6 +120,7 @@ void btif_a2dp_control_init(void) {
 void btif_a2dp_control_cleanup(void) {
   /* This calls blocks until UIPC is fully closed */
   UIPC_Close(*a2dp_uipc, UIPC_CH_ID_ALL);
+  btif_a2dp_control_shm_detach();
 }
 
 static void btif_a2dp_recv_ctrl_data(void) {
@@ -282,6 +345,10 @@ static void btif_a2dp_recv_ctrl_data(void) {
       btif_av_stream_start_offload();
       break;
 
+    case A2DP_CTRL_CMD_SETUP_SHM:
+      btif_a2dp_control_shm_attach();
+      break;
+
     case A2DP_CTRL_GET_PRESENTATION_POSITION: {
       btif_a2dp_command_ack(A2DP_CTRL_ACK_SUCCESS);
 
@@ -377,6 +444,7 @@ static void btif_a2dp_data_cb(UNUSED_ATTR tUIPC_CH_ID ch_id,
 
     case UIPC_CLOSE_EVT:
       APPL_TRACE_EVENT("%s: ## AUDIO PATH DETACHED ##", __func__);
+      btif_a2dp_control_shm_detach();
       btif_a2dp_command_ack(A2DP_CTRL_ACK_SUCCESS);
       /*
        * Send stop request only if we are actively streaming and haven't
@@ -438,3 +506,135 @@ void btif_a2dp_control_reset_audio_delay(void) {
   delay_report_stats.total_bytes_read = 0;
   delay_report_stats.timestamp = {};
 }
+
+static void btif_a2dp_control_shm_attach(void) {
+  int fds[A2DP_SHM_NUM_FDS];
+
+  // Always consume the descriptors so the control channel stays in sync.
+  size_t n_fds = UIPC_ReadFds(*a2dp_uipc, UIPC_CH_ID_AV_CTRL, fds,
+                              A2DP_SHM_NUM_FDS);
+  if (n_fds != A2DP_SHM_NUM_FDS) {
+    APPL_TRACE_ERROR("%s: expected %d file descriptors, received %zu",
+                     __func__, A2DP_SHM_NUM_FDS, n_fds);
+    for (size_t i = 0; i < n_fds; i++) close(fds[i]);
+    btif_a2dp_command_ack(A2DP_CTRL_ACK_FAILURE);
+    return;
+  }
+
+  std::shared_ptr<AudioShmRing> ring = std::make_shared<AudioShmRing>();
+  bool attached = (a2dp_shm_ring_attach(&ring->ring, fds) == 0);
+  if (!attached) ring.reset();
+  {
+    std::lock_guard<std::mutex> lock(audio_shm_mutex);
+    audio_shm_ring.swap(ring);
+  }
+  // The previous ring is closed once its readers are done
+  ring.reset();
+
+  if (!attached) {
+    APPL_TRACE_ERROR("%s: unable to map the audio ring", __func__);
+    btif_a2dp_command_ack(A2DP_CTRL_ACK_FAILURE);
+    return;
+  }
+
+  APPL_TRACE_EVENT("%s: shared memory audio transport attached", __func__);
+  btif_a2dp_command_ack(A2DP_CTRL_ACK_SUCCESS);
+}
+
+static void btif_a2dp_control_shm_detach(void) {
+  std::shared_ptr<AudioShmRing> ring;
+  {
+    std::lock_guard<std::mutex> lock(audio_shm_mutex);
+    audio_shm_ring.swap(ring);
+  }
+  if (!ring) return;
+
+  // Closed once its readers are done
+  ring.reset();
+  APPL_TRACE_EVENT("%s: shared memory audio transport detached", __func__);
+}
+
+uint32_t btif_a2dp_control_read_audio_data(uint8_t* p_buf, uint32_t len) {
+  std::shared_ptr<AudioShmRing> ring = btif_a2dp_control_shm_ring();
+  if (ring) {
+    std::lock_guard<std::mutex> lock(ring->read_mutex);
+    return a2dp_shm_ring_read(&ring->ring, p_buf, len, A2DP_DATA_READ_POLL_MS);
+  }
+
+  uint16_t event;
+  return UIPC_Read(*a2dp_uipc, UIPC_CH_ID_AV_AUDIO, &event, p_buf, len);
+}
+
+uint32_t btif_a2dp_control_audio_queued_bytes(void) {
+  std::shared_ptr<AudioShmRing> ring = btif_a2dp_control_shm_ring();
+  if (ring) return a2dp_shm_ring_queued_bytes(&ring->ring);
+
+  uint32_t queued_bytes = 0;
+  if (!UIPC_Ioctl(*a2dp_uipc, UIPC_CH_ID_AV_AUDIO, UIPC_REQ_RX_QUEUED_BYTES,
+                  &queued_bytes)) {
+    return 0;
+  }
+  return queued_bytes;
+}
+
+void btif_a2dp_control_flush_audio_data(void) {
+  std::shared_ptr<AudioShmRing> ring = btif_a2dp_control_shm_ring();
+  if (ring) {
+    std::lock_guard<std::mutex> lock(ring->read_mutex);
+    a2dp_shm_ring_flush(&ring->ring);
+  }
+  UIPC_Ioctl(*a2dp_uipc, UIPC_CH_ID_AV_AUDIO, UIPC_REQ_RX_FLUSH, nullptr);
+}
+
+void btif_a2dp_control_debug_dump(int fd) {
+  std::shared_ptr<AudioShmRing> ring = btif_a2dp_control_shm_ring();
+  bool attached = (ring != nullptr);
+  a2dp_shm_stats cur = {};
+  size_t queued_bytes = 0;
+  if (ring) {
+    std::lock_guard<std::mutex> lock(ring->read_mutex);
+    cur = ring->ring.stats;
+    queued_bytes = a2dp_shm_ring_queued_bytes(&ring->ring);
+  }
+  a2dp_shm_stats acc;
+  {
+    std::lock_guard<std::mutex> lock(audio_shm_mutex);
+    acc = audio_shm_accumulated_stats;
+  }
+
+  uint64_t total_chunks = acc.total_chunks + cur.total_chunks;
+  uint64_t latency_total_us = acc.latency_total_us + cur.latency_total_us;
+  uint64_t latency_min_us = acc.latency_min_us;
+  if (cur.total_chunks > 0 &&
+      (acc.total_chunks == 0 || cur.latency_min_us < latency_min_us))
+    latency_min_us = cur.latency_min_us;
+  uint64_t latency_max_us = std::max(acc.latency_max_us, cur.latency_max_us);
+  uint64_t jitter_us = (cur.total_chunks > 0) ? cur.jitter_us : acc.jitter_us;
+
+  dprintf(fd, "\nA2DP Audio Transport:\n");
+  dprintf(fd, "  Transport                                               : %s\n",
+          attached ? "shared memory" : "socket");
+  if (attached) {
+    dprintf(fd,
+            "  Queued bytes                                            : %zu\n",
+            queued_bytes);
+  }
+  dprintf(fd,
+          "  Counts (bytes/chunks/reads/wakeups/underflows/overruns) : "
+          "%" PRIu64 " / %" PRIu64 " / %" PRIu64 " / %" PRIu64 " / %" PRIu64
+          " / %" PRIu64 "\n",
+          acc.total_bytes + cur.total_bytes, total_chunks,
+          acc.total_reads + cur.total_reads,
+          acc.total_wakeups + cur.total_wakeups,
+          acc.underflow_count + cur.underflow_count,
+          acc.overrun_count + cur.overrun_count);
+  dprintf(fd,
+          "  Latency in us (min/max/ave)                             : "
+          "%" PRIu64 " / %" PRIu64 " / %" PRIu64 "\n",
+          latency_min_us, latency_max_us,
+          (total_chunks > 0) ? latency_total_us / total_chunks : 0);
+  dprintf(fd,
+          "  Jitter in us                                            : "
+          "%" PRIu64 "\n",
+          jitter_us);
+}
@@ -19,6 +19,8 @@
 
 #define LOG_TAG "bt_btif_a2dp_sink"
 
+#include <inttypes.h>
+#include <stdlib.h>
 #include <atomic>
 #include <cstring>
 #include <mutex>
@@ -26,6 +28,7 @@
 #include "bt_common.h"
 #include "btif_a2dp.h"
 #include "btif_a2dp_sink.h"
+#include "btif_a2dp_sink_jitter_buffer.h"
 #include "btif_av.h"
 #include "btif_av_co.h"
 #include "btif_avrcp_audio_track.h"
@@ -33,19 +36,16 @@
 #include "osi/include/fixed_queue.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
+#include "osi/include/properties.h"
 #include "osi/include/thread.h"
+#include "osi/include/time.h"
 
 using LockGuard = std::lock_guard<std::mutex>;
 
-/**
- * The receiving queue buffer size.
- */
-#define MAX_INPUT_A2DP_FRAME_QUEUE_SZ (MAX_PCM_FRAME_NUM_PER_TICK * 2)
-
 #define BTIF_SINK_MEDIA_TIME_TICK_MS 20
 
-/* In case of A2DP Sink, we will delay start by 5 AVDTP Packets */
-#define MAX_A2DP_DELAYED_START_FRAME_COUNT 5
+/* Default (maximum, if adaptive) latency of the receive jitter buffer */
+#define BTIF_SINK_DEFAULT_TARGET_LATENCY_MS 100
 
 enum {
   BTIF_A2DP_SINK_STATE_OFF,
@@ -76,7 +76,6 @@ typedef struct {
 typedef struct {
   thread_t* worker_thread;
   fixed_queue_t* cmd_msg_queue;
-  fixed_queue_t* rx_audio_queue;
   bool rx_flush; /* discards any incoming data when true */
   alarm_t* decode_alarm;
   tA2DP_SAMPLE_RATE sample_rate;
@@ -91,6 +90,11 @@ static std::mutex g_mutex;
 
 static tBTIF_A2DP_SINK_CB btif_a2dp_sink_cb;
 
+// Receive jitter buffer and concealment of the lost packets.
+// Protected by g_mutex.
+static BtifA2dpSinkJitterBuffer btif_a2dp_sink_jitter_buffer;
+static BtifA2dpSinkConcealer btif_a2dp_sink_concealer;
+
 static std::atomic<int> btif_a2dp_sink_state{BTIF_A2DP_SINK_STATE_OFF};
 
 static void btif_a2dp_sink_init_delayed(void* context);
@@ -149,7 +153,7 @@ bool btif_a2dp_sink_init(void) {
 
   btif_a2dp_sink_cb.rx_focus_state = BTIF_A2DP_SINK_FOCUS_NOT_GRANTED;
   btif_a2dp_sink_cb.audio_track = NULL;
-  btif_a2dp_sink_cb.rx_audio_queue = fixed_queue_new(SIZE_MAX);
+  btif_a2dp_sink_jitter_buffer.Flush();
 
   btif_a2dp_sink_cb.cmd_msg_queue = fixed_queue_new(SIZE_MAX);
   fixed_queue_register_dequeue(
@@ -291,8 +295,8 @@ static void btif_a2dp_sink_cleanup_delayed(UNUSED_ATTR void* context) {
   LOG_INFO(LOG_TAG, "%s", __func__);
   LockGuard lock(g_mutex);
 
-  fixed_queue_free(btif_a2dp_sink_cb.rx_audio_queue, NULL);
-  btif_a2dp_sink_cb.rx_audio_queue = NULL;
+  btif_a2dp_sink_jitter_buffer.Flush();
+  btif_a2dp_sink_concealer.Reset();
   btif_a2dp_sink_state = BTIF_A2DP_SINK_STATE_OFF;
 }
 
@@ -438,6 +442,7 @@ static void btif_a2dp_sink_audio_handle_start_decoding(void) {
 }
 
 static void btif_a2dp_sink_on_decode_complete(uint8_t* data, uint32_t len) {
+  btif_a2dp_sink_concealer.Append(data, len);
 #ifndef OS_GENERIC
   BtifAvrcpAudioTrackWriteData(btif_a2dp_sink_cb.audio_track,
                                reinterpret_cast<void*>(data), len);
@@ -453,16 +458,31 @@ static void btif_a2dp_sink_handle_inc_media(BT_HDR* p_msg) {
   }
 
   CHECK(btif_a2dp_sink_cb.decoder_interface);
+  btif_a2dp_sink_concealer.BeginPacket();
   if (!btif_a2dp_sink_cb.decoder_interface->decode_packet(p_msg)) {
     LOG_ERROR(LOG_TAG, "%s: decoding failed", __func__);
   }
 }
 
+// Must be called while locked.
+static void btif_a2dp_sink_conceal_lost_media(void) {
+  const uint8_t* data;
+  size_t len = btif_a2dp_sink_concealer.Conceal(&data);
+  if (len == 0) return;
+
+  APPL_TRACE_DEBUG("%s: concealing %zu bytes", __func__, len);
+#ifndef OS_GENERIC
+  BtifAvrcpAudioTrackWriteData(btif_a2dp_sink_cb.audio_track,
+                               const_cast<uint8_t*>(data), len);
+#endif
+}
+
 static void btif_a2dp_sink_avk_handle_timer(UNUSED_ATTR void* context) {
   LockGuard lock(g_mutex);
 
   BT_HDR* p_msg;
-  if (fixed_queue_is_empty(btif_a2dp_sink_cb.rx_audio_queue)) {
+  if (btif_a2dp_sink_jitter_buffer.Length() == 0 &&
+      btif_a2dp_sink_jitter_buffer.IsBuffering()) {
     APPL_TRACE_DEBUG("%s: empty queue", __func__);
     return;
   }
@@ -475,20 +495,23 @@ static void btif_a2dp_sink_avk_handle_timer(UNUSED_ATTR void* context) {
   }
   /* Play only in BTIF_A2DP_SINK_FOCUS_GRANTED case */
   if (btif_a2dp_sink_cb.rx_flush) {
-    fixed_queue_flush(btif_a2dp_sink_cb.rx_audio_queue, osi_free);
+    btif_a2dp_sink_jitter_buffer.Flush();
     return;
   }
 
   APPL_TRACE_DEBUG("%s: process frames begin", __func__);
+  uint64_t now_us = time_get_os_boottime_us();
   while (true) {
-    p_msg = (BT_HDR*)fixed_queue_try_dequeue(btif_a2dp_sink_cb.rx_audio_queue);
-    if (p_msg == NULL) {
-      break;
-    }
+    BtifA2dpSinkJitterBuffer::Action action =
+        btif_a2dp_sink_jitter_buffer.Dequeue(now_us, &p_msg);
+    if (action == BtifA2dpSinkJitterBuffer::kNone) break;
     APPL_TRACE_DEBUG("%s: number of packets in queue %zu", __func__,
-                     fixed_queue_length(btif_a2dp_sink_cb.rx_audio_queue));
+                     btif_a2dp_sink_jitter_buffer.Length());
 
-    /* Queue packet has less frames */
+    if (action == BtifA2dpSinkJitterBuffer::kConceal) {
+      btif_a2dp_sink_conceal_lost_media();
+      continue;
+    }
     btif_a2dp_sink_handle_inc_media(p_msg);
     osi_free(p_msg);
   }
@@ -507,7 +530,7 @@ static void btif_a2dp_sink_audio_rx_flush_event(void) {
   LOG_INFO(LOG_TAG, "%s", __func__);
   LockGuard lock(g_mutex);
   // Flush all received encoded audio buffers
-  fixed_queue_flush(btif_a2dp_sink_cb.rx_audio_queue, osi_free);
+  btif_a2dp_sink_jitter_buffer.Flush();
 }
 
 static void btif_a2dp_sink_decoder_update_event(
@@ -540,6 +563,19 @@ static void btif_a2dp_sink_decoder_update_event(
   btif_a2dp_sink_cb.rx_flush = false;
   APPL_TRACE_DEBUG("%s: reset to Sink role", __func__);
 
+  char value[PROPERTY_VALUE_MAX] = {'\0'};
+  osi_property_get("persist.bluetooth.a2dp.sink_latency_ms", value, "");
+  uint64_t target_latency_ms = strtoul(value, NULL, 10);
+  if (target_latency_ms == 0)
+    target_latency_ms = BTIF_SINK_DEFAULT_TARGET_LATENCY_MS;
+  osi_property_get("persist.bluetooth.a2dp.sink_adaptive_latency", value,
+                   "true");
+  bool adaptive = (strcmp(value, "true") == 0);
+  btif_a2dp_sink_jitter_buffer.Configure(sample_rate, target_latency_ms,
+                                         adaptive,
+                                         BTIF_SINK_MEDIA_TIME_TICK_MS * 1000);
+  btif_a2dp_sink_concealer.Reset();
+
   btif_a2dp_sink_cb.decoder_interface = bta_av_co_get_decoder_interface();
   if (btif_a2dp_sink_cb.decoder_interface == NULL) {
     LOG_ERROR(LOG_TAG, "%s: cannot stream audio: no source decoder interface",
@@ -569,37 +605,43 @@ static void btif_a2dp_sink_decoder_update_event(
 uint8_t btif_a2dp_sink_enqueue_buf(BT_HDR* p_pkt) {
   LockGuard lock(g_mutex);
   if (btif_a2dp_sink_cb.rx_flush) /* Flush enabled, do not enqueue */
-    return fixed_queue_length(btif_a2dp_sink_cb.rx_audio_queue);
+    return btif_a2dp_sink_jitter_buffer.Length();
 
-  if (fixed_queue_length(btif_a2dp_sink_cb.rx_audio_queue) ==
-      MAX_INPUT_A2DP_FRAME_QUEUE_SZ) {
-    uint8_t ret = fixed_queue_length(btif_a2dp_sink_cb.rx_audio_queue);
-    osi_free(fixed_queue_try_dequeue(btif_a2dp_sink_cb.rx_audio_queue));
-    return ret;
+  BTIF_TRACE_VERBOSE("%s +", __func__);
+  /* The AVDTP timestamp is stored right before the payload */
+  uint32_t timestamp = 0;
+  if (p_pkt->offset >= BTA_AV_SINK_MEDIA_TS_SIZE) {
+    memcpy(&timestamp,
+           p_pkt->data + p_pkt->offset - BTA_AV_SINK_MEDIA_TS_SIZE,
+           sizeof(timestamp));
   }
 
-  BTIF_TRACE_VERBOSE("%s +", __func__);
   /* Allocate and queue this buffer */
   BT_HDR* p_msg =
       reinterpret_cast<BT_HDR*>(osi_malloc(sizeof(*p_msg) + p_pkt->len));
   memcpy(p_msg, p_pkt, sizeof(*p_msg));
   p_msg->offset = 0;
   memcpy(p_msg->data, p_pkt->data + p_pkt->offset, p_pkt->len);
-  fixed_queue_enqueue(btif_a2dp_sink_cb.rx_audio_queue, p_msg);
-  if (fixed_queue_length(btif_a2dp_sink_cb.rx_audio_queue) ==
-      MAX_A2DP_DELAYED_START_FRAME_COUNT) {
+  btif_a2dp_sink_jitter_buffer.Enqueue(p_msg, p_pkt->layer_specific, timestamp,
+                                       time_get_os_boottime_us());
+
+  // The jitter buffer holds the playout until it covers the target latency
+  if (btif_a2dp_sink_cb.decode_alarm == NULL) {
     BTIF_TRACE_DEBUG("%s: Initiate decoding", __func__);
     btif_a2dp_sink_audio_handle_start_decoding();
   }
 
-  return fixed_queue_length(btif_a2dp_sink_cb.rx_audio_queue);
+  return btif_a2dp_sink_jitter_buffer.Length();
 }
 
 void btif_a2dp_sink_audio_rx_flush_req(void) {
   LOG_INFO(LOG_TAG, "%s", __func__);
-  if (fixed_queue_is_empty(btif_a2dp_sink_cb.rx_audio_queue)) {
-    /* Queue is already empty */
-    return;
+  {
+    LockGuard lock(g_mutex);
+    if (btif_a2dp_sink_jitter_buffer.Length() == 0) {
+      /* Queue is already empty */
+      return;
+    }
   }
 
   BT_HDR* p_buf = reinterpret_cast<BT_HDR*>(osi_malloc(sizeof(BT_HDR)));
@@ -607,8 +649,17 @@ void btif_a2dp_sink_audio_rx_flush_req(void) {
   fixed_queue_enqueue(btif_a2dp_sink_cb.cmd_msg_queue, p_buf);
 }
 
-void btif_a2dp_sink_debug_dump(UNUSED_ATTR int fd) {
-  // Nothing to do
+void btif_a2dp_sink_debug_dump(int fd) {
+  LockGuard lock(g_mutex);
+  if (btif_a2dp_sink_state == BTIF_A2DP_SINK_STATE_OFF) return;
+
+  dprintf(fd, "\nA2DP Sink State:\n");
+  dprintf(fd,
+          "  Audio focus                                             : %s\n",
+          (btif_a2dp_sink_cb.rx_focus_state == BTIF_A2DP_SINK_FOCUS_GRANTED)
+              ? "granted"
+              : "not granted");
+  btif_a2dp_sink_jitter_buffer.DebugDump(fd);
 }
 
 void btif_a2dp_sink_set_focus_state_req(btif_a2dp_sink_focus_state_t state) {
@@ -630,7 +681,7 @@ static void btif_a2dp_sink_set_focus_state_event(
   APPL_TRACE_DEBUG("%s: setting focus state to %d", __func__, state);
   btif_a2dp_sink_cb.rx_focus_state = state;
   if (btif_a2dp_sink_cb.rx_focus_state == BTIF_A2DP_SINK_FOCUS_NOT_GRANTED) {
-    fixed_queue_flush(btif_a2dp_sink_cb.rx_audio_queue, osi_free);
+    btif_a2dp_sink_jitter_buffer.Flush();
     btif_a2dp_sink_cb.rx_flush = true;
   } else if (btif_a2dp_sink_cb.rx_focus_state == BTIF_A2DP_SINK_FOCUS_GRANTED) {
     btif_a2dp_sink_cb.rx_flush = false;
@@ -0,0 +1,357 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_btif_a2dp_sink_jitter_buffer"
+
+#include "btif_a2dp_sink_jitter_buffer.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "osi/include/allocator.h"
+#include "osi/include/log.h"
+
+constexpr size_t BtifA2dpSinkJitterBuffer::kMaxPackets;
+constexpr uint64_t BtifA2dpSinkJitterBuffer::kMinTargetLatencyUs;
+constexpr uint64_t BtifA2dpSinkJitterBuffer::kStableWindowUs;
+constexpr size_t BtifA2dpSinkConcealer::kMaxFadePackets;
+
+// Default AVDTP timestamp clock rate until the buffer is configured
+#define JITTER_BUFFER_DEFAULT_SAMPLE_RATE 44100
+
+// The adaptive target latency covers N times the interarrival jitter
+#define JITTER_BUFFER_JITTER_MULTIPLIER 4
+
+// A timestamp jump larger than this restarts the playout clock
+#define JITTER_BUFFER_MAX_TIMESTAMP_JUMP_US (1000 * 1000)
+
+BtifA2dpSinkJitterBuffer::BtifA2dpSinkJitterBuffer()
+    : sample_rate_(JITTER_BUFFER_DEFAULT_SAMPLE_RATE),
+      configured_latency_us_(kMinTargetLatencyUs),
+      adaptive_(false),
+      lookahead_us_(0) {
+  Flush();
+  ResetStats();
+}
+
+BtifA2dpSinkJitterBuffer::~BtifA2dpSinkJitterBuffer() { Flush(); }
+
+void BtifA2dpSinkJitterBuffer::Configure(uint32_t sample_rate,
+                                         uint64_t target_latency_ms,
+                                         bool adaptive,
+                                         uint64_t lookahead_us) {
+  sample_rate_ =
+      (sample_rate != 0) ? sample_rate : JITTER_BUFFER_DEFAULT_SAMPLE_RATE;
+  configured_latency_us_ =
+      std::max<uint64_t>(target_latency_ms * 1000, kMinTargetLatencyUs);
+  adaptive_ = adaptive;
+  lookahead_us_ = lookahead_us;
+  Flush();
+  ResetStats();
+}
+
+void BtifA2dpSinkJitterBuffer::Flush() {
+  for (auto& entry : packets_) osi_free(entry.second.p_buf);
+  packets_.clear();
+  have_reference_ = false;
+  highest_seq_ = 0;
+  highest_timestamp_ = 0;
+  packet_duration_ = 0;
+  last_transit_us_ = 0;
+  buffering_ = true;
+  next_seq_ = INT64_MIN;
+  play_timestamp_ = 0;
+  anchor_timestamp_ = 0;
+  anchor_us_ = 0;
+  stable_since_us_ = 0;
+}
+
+void BtifA2dpSinkJitterBuffer::ResetStats() {
+  jitter_us_x16_ = 0;
+  underrun_margin_us_ = 0;
+  received_packets_ = 0;
+  late_packets_ = 0;
+  duplicate_packets_ = 0;
+  overflow_packets_ = 0;
+  played_packets_ = 0;
+  concealed_packets_ = 0;
+  underruns_ = 0;
+  latency_drops_ = 0;
+  latency_samples_ = 0;
+  total_latency_us_ = 0;
+  min_latency_us_ = 0;
+  max_latency_us_ = 0;
+}
+
+uint64_t BtifA2dpSinkJitterBuffer::TargetLatencyUs() const {
+  if (!adaptive_) return configured_latency_us_;
+
+  uint64_t target_us = 2 * SamplesToUs(packet_duration_) +
+                       JITTER_BUFFER_JITTER_MULTIPLIER * JitterUs() +
+                       underrun_margin_us_;
+  return std::min(std::max(target_us, kMinTargetLatencyUs),
+                  configured_latency_us_);
+}
+
+int64_t BtifA2dpSinkJitterBuffer::SamplesToUs(int64_t samples) const {
+  return samples * 1000 * 1000 / sample_rate_;
+}
+
+int64_t BtifA2dpSinkJitterBuffer::UsToSamples(int64_t us) const {
+  return us * sample_rate_ / (1000 * 1000);
+}
+
+int64_t BtifA2dpSinkJitterBuffer::BufferedUs(int64_t from_timestamp) const {
+  if (packets_.empty()) return 0;
+  int64_t end = packets_.rbegin()->second.timestamp + packet_duration_;
+  return std::max<int64_t>(SamplesToUs(end - from_timestamp), 0);
+}
+
+bool BtifA2dpSinkJitterBuffer::Enqueue(BT_HDR* p_buf, uint16_t seq,
+                                       uint32_t timestamp, uint64_t now_us) {
+  received_packets_++;
+
+  // Extend the sequence number and timestamp to 64 bits, relative to the
+  // highest sequence number received
+  int64_t ext_seq = seq;
+  int64_t ext_timestamp = timestamp;
+  if (have_reference_) {
+    ext_seq = highest_seq_ + (int16_t)(seq - (uint16_t)highest_seq_);
+    ext_timestamp = highest_timestamp_ +
+                    (int32_t)(timestamp - (uint32_t)highest_timestamp_);
+  }
+
+  if (ext_seq < next_seq_) {
+    // The playout already went past this packet
+    late_packets_++;
+    osi_free(p_buf);
+    return false;
+  }
+  if (packets_.count(ext_seq) != 0) {
+    duplicate_packets_++;
+    osi_free(p_buf);
+    return false;
+  }
+
+  // Update the interarrival jitter estimate (RFC 3550 A.8)
+  int64_t transit_us = (int64_t)now_us - SamplesToUs(ext_timestamp);
+  if (have_reference_) {
+    uint64_t d = llabs(transit_us - last_transit_us_);
+    jitter_us_x16_ += d - ((jitter_us_x16_ + 8) >> 4);
+  }
+  last_transit_us_ = transit_us;
+
+  if (!have_reference_ || ext_seq > highest_seq_) {
+    if (have_reference_ && ext_seq == highest_seq_ + 1 &&
+        ext_timestamp > highest_timestamp_) {
+      packet_duration_ = ext_timestamp - highest_timestamp_;
+    }
+    have_reference_ = true;
+    highest_seq_ = ext_seq;
+    highest_timestamp_ = ext_timestamp;
+  }
+
+  if (packets_.size() >= kMaxPackets) {
+    overflow_packets_++;
+    if (!buffering_ && packets_.begin()->first == next_seq_) {
+      SkipHead();
+    } else {
+      osi_free(packets_.begin()->second.p_buf);
+      packets_.erase(packets_.begin());
+    }
+  }
+
+  packets_[ext_seq] = {p_buf, ext_timestamp};
+  return true;
+}
+
+void BtifA2dpSinkJitterBuffer::StartPlayout(uint64_t now_us) {
+  const Packet& head = packets_.begin()->second;
+  buffering_ = false;
+  next_seq_ = packets_.begin()->first;
+  play_timestamp_ = head.timestamp;
+  anchor_timestamp_ = head.timestamp;
+  anchor_us_ = now_us;
+  stable_since_us_ = now_us;
+}
+
+void BtifA2dpSinkJitterBuffer::SkipHead() {
+  auto it = packets_.begin();
+  int64_t duration = packet_duration_;
+  osi_free(it->second.p_buf);
+  play_timestamp_ = it->second.timestamp + duration;
+  anchor_timestamp_ += duration;
+  next_seq_ = it->first + 1;
+  packets_.erase(it);
+}
+
+BtifA2dpSinkJitterBuffer::Action BtifA2dpSinkJitterBuffer::Dequeue(
+    uint64_t now_us, BT_HDR** pp_buf) {
+  *pp_buf = nullptr;
+
+  if (buffering_) {
+    if (packets_.empty()) return kNone;
+    if (BufferedUs(packets_.begin()->second.timestamp) <
+        (int64_t)TargetLatencyUs())
+      return kNone;
+    StartPlayout(now_us);
+  }
+
+  // Reduce the latency when it stayed above the target for a while
+  if (now_us - stable_since_us_ >= kStableWindowUs) {
+    stable_since_us_ = now_us;
+    underrun_margin_us_ -=
+        std::min<uint64_t>(underrun_margin_us_, SamplesToUs(packet_duration_));
+    if (!packets_.empty() && packets_.begin()->first == next_seq_ &&
+        BufferedUs(play_timestamp_) >
+            (int64_t)(TargetLatencyUs() + SamplesToUs(packet_duration_))) {
+      latency_drops_++;
+      SkipHead();
+    }
+  }
+
+  int64_t due_timestamp =
+      anchor_timestamp_ + UsToSamples(now_us - anchor_us_ + lookahead_us_);
+  if (play_timestamp_ > due_timestamp) return kNone;
+
+  if (packets_.empty()) {
+    // Out of media: buffer again up to the (increased) target latency
+    underruns_++;
+    underrun_margin_us_ += std::max<uint64_t>(SamplesToUs(packet_duration_),
+                                              kMinTargetLatencyUs / 4);
+    buffering_ = true;
+    LOG_VERBOSE(LOG_TAG, "%s: underrun, target latency %" PRIu64 " us",
+                __func__, TargetLatencyUs());
+    return kNone;
+  }
+
+  auto it = packets_.begin();
+  if (it->first == next_seq_) {
+    if (llabs(it->second.timestamp - play_timestamp_) >
+        UsToSamples(JITTER_BUFFER_MAX_TIMESTAMP_JUMP_US)) {
+      // Timestamp discontinuity: restart the playout clock on this packet
+      anchor_timestamp_ = it->second.timestamp;
+      anchor_us_ = now_us;
+    }
+
+    uint64_t latency_us = BufferedUs(play_timestamp_);
+    latency_samples_++;
+    total_latency_us_ += latency_us;
+    if (latency_samples_ == 1 || latency_us < min_latency_us_)
+      min_latency_us_ = latency_us;
+    max_latency_us_ = std::max(max_latency_us_, latency_us);
+
+    *pp_buf = it->second.p_buf;
+    play_timestamp_ = it->second.timestamp + packet_duration_;
+    next_seq_ = it->first + 1;
+    packets_.erase(it);
+    played_packets_++;
+    return kPlay;
+  }
+
+  // The next packet is missing and its playout time is due: conceal it,
+  // spreading the timestamp gap over the missing packets
+  int64_t missing = it->first - next_seq_;
+  int64_t duration = (it->second.timestamp - play_timestamp_) / missing;
+  if (duration <= 0) duration = packet_duration_;
+  play_timestamp_ += duration;
+  next_seq_++;
+  concealed_packets_++;
+  return kConceal;
+}
+
+void BtifA2dpSinkJitterBuffer::DebugDump(int fd) const {
+  dprintf(fd, "  Jitter Buffer:\n");
+  dprintf(fd,
+          "  Target latency in ms (current/configured)               : "
+          "%" PRIu64 " / %" PRIu64 "%s\n",
+          TargetLatencyUs() / 1000, configured_latency_us_ / 1000,
+          adaptive_ ? " (adaptive)" : "");
+  dprintf(fd,
+          "  Buffered packets                                        : "
+          "%zu%s\n",
+          packets_.size(), buffering_ ? " (buffering)" : "");
+  dprintf(fd,
+          "  Interarrival jitter in ms                               : "
+          "%" PRIu64 ".%03" PRIu64 "\n",
+          JitterUs() / 1000, JitterUs() % 1000);
+  dprintf(fd,
+          "  Buffer latency in ms (min/avg/max)                      : "
+          "%" PRIu64 " / %" PRIu64 " / %" PRIu64 "\n",
+          min_latency_us_ / 1000,
+          (latency_samples_ != 0)
+              ? total_latency_us_ / latency_samples_ / 1000
+              : 0,
+          max_latency_us_ / 1000);
+  dprintf(fd,
+          "  Packets (received/played/concealed)                     : "
+          "%" PRIu64 " / %" PRIu64 " / %" PRIu64 "\n",
+          received_packets_, played_packets_, concealed_packets_);
+  dprintf(fd,
+          "  Dropped packets (late/duplicate/overflow/latency)       : "
+          "%" PRIu64 " / %" PRIu64 " / %" PRIu64 " / %" PRIu64 "\n",
+          late_packets_, duplicate_packets_, overflow_packets_,
+          latency_drops_);
+  dprintf(fd,
+          "  Underruns                                               : "
+          "%" PRIu64 "\n",
+          underruns_);
+}
+
+void BtifA2dpSinkConcealer::Reset() {
+  last_pcm_.clear();
+  concealed_pcm_.clear();
+  capturing_ = false;
+  consecutive_losses_ = 0;
+}
+
+void BtifA2dpSinkConcealer::BeginPacket() {
+  capturing_ = true;
+  consecutive_losses_ = 0;
+}
+
+void BtifA2dpSinkConcealer::Append(const uint8_t* data, size_t len) {
+  if (capturing_) {
+    // Keep the previous PCM if the new packet does not decode
+    last_pcm_.clear();
+    capturing_ = false;
+  }
+  last_pcm_.insert(last_pcm_.end(), data, data + len);
+}
+
+size_t BtifA2dpSinkConcealer::Conceal(const uint8_t** p_data) {
+  capturing_ = false;
+  if (last_pcm_.empty()) return 0;
+
+  consecutive_losses_++;
+  concealed_pcm_.resize(last_pcm_.size());
+  if (consecutive_losses_ > kMaxFadePackets) {
+    std::fill(concealed_pcm_.begin(), concealed_pcm_.end(), 0);
+  } else {
+    size_t num_samples = last_pcm_.size() / sizeof(int16_t);
+    const int16_t* in = reinterpret_cast<const int16_t*>(last_pcm_.data());
+    int16_t* out = reinterpret_cast<int16_t*>(concealed_pcm_.data());
+    for (size_t i = 0; i < num_samples; i++)
+      out[i] = in[i] >> consecutive_losses_;
+  }
+  *p_data = concealed_pcm_.data();
+  return concealed_pcm_.size();
+}
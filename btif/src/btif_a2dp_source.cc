@@ -36,6 +36,7 @@
 #include "btif_a2dp_audio_interface.h"
 #include "btif_a2dp_control.h"
 #include "btif_a2dp_source.h"
+#include "btif_a2dp_source_scheduler.h"
 #include "btif_av.h"
 #include "btif_av_co.h"
 #include "btif_util.h"
@@ -43,6 +44,7 @@
 #include "osi/include/log.h"
 #include "osi/include/metrics.h"
 #include "osi/include/osi.h"
+#include "osi/include/properties.h"
 #include "osi/include/thread.h"
 #include "osi/include/time.h"
 #include "uipc.h"
@@ -279,6 +281,7 @@ class BtifA2dpSource {
     media_alarm = nullptr;
     encoder_interface = nullptr;
     encoder_interval_ms = 0;
+    scheduler.Reset();
     stats.Reset();
     accumulated_stats.Reset();
     state_ = kStateOff;
@@ -305,6 +308,7 @@ class BtifA2dpSource {
   alarm_t* media_alarm;
   const tA2DP_ENCODER_INTERFACE* encoder_interface;
   period_ms_t encoder_interval_ms; /* Local copy of the encoder interval */
+  BtifA2dpSourceScheduler scheduler;
   BtifMediaStats stats;
   BtifMediaStats accumulated_stats;
 
@@ -812,6 +816,20 @@ static void btif_a2dp_source_audio_tx_start_event(void) {
             btif_a2dp_source_cb.encoder_interface->get_encoder_interval_ms(),
             btif_a2dp_source_alarm_cb, nullptr);
 
+  char value[PROPERTY_VALUE_MAX] = {'\0'};
+  osi_property_get("persist.bluetooth.a2dp.tick_coalescing", value, "true");
+  uint64_t max_interval_us = 0;
+  if (strcmp(value, "true") == 0 &&
+      BtifA2dpSourceScheduler::CanCoalesceTicks(
+          btif_a2dp_source_cb.encoder_interface)) {
+    max_interval_us =
+        btif_a2dp_source_cb.encoder_interface->get_max_send_interval_us();
+  }
+  btif_a2dp_source_cb.scheduler.Start(
+      time_get_os_boottime_us(),
+      btif_a2dp_source_cb.encoder_interface->get_encoder_interval_ms(),
+      max_interval_us);
+
   btif_a2dp_source_cb.stats.Reset();
   // Assign session_start_us to 1 when time_get_os_boottime_us() is 0 to
   // indicate btif_a2dp_source_start_audio_req() has been called
@@ -841,15 +859,15 @@ static void btif_a2dp_source_audio_tx_stop_event(void) {
                                     &btif_a2dp_source_cb.accumulated_stats);
 
   uint8_t p_buf[AUDIO_STREAM_OUTPUT_BUFFER_SZ * 2];
-  uint16_t event;
 
   // Keep track of audio data still left in the pipe
   btif_a2dp_control_log_bytes_read(
-      UIPC_Read(*a2dp_uipc, UIPC_CH_ID_AV_AUDIO, &event, p_buf, sizeof(p_buf)));
+      btif_a2dp_control_read_audio_data(p_buf, sizeof(p_buf)));
 
   /* Stop the timer first */
   alarm_free(btif_a2dp_source_cb.media_alarm);
   btif_a2dp_source_cb.media_alarm = nullptr;
+  btif_a2dp_source_cb.scheduler.Stop();
 
   UIPC_Close(*a2dp_uipc, UIPC_CH_ID_AV_AUDIO);
 
@@ -903,17 +921,26 @@ static void btif_a2dp_source_audio_handle_timer(void) {
     btif_a2dp_source_cb.encoder_interface->set_transmit_queue_length(
         transmit_queue_length);
   }
-  btif_a2dp_source_cb.encoder_interface->send_frames(timestamp_us);
+  uint64_t media_timestamp_us = btif_a2dp_source_cb.scheduler.BeginTick(
+      timestamp_us, transmit_queue_length,
+      btif_a2dp_control_audio_queued_bytes());
+  btif_a2dp_source_cb.encoder_interface->send_frames(media_timestamp_us);
   bta_av_ci_src_data_ready(BTA_AV_CHNL_AUDIO);
   update_scheduling_stats(&btif_a2dp_source_cb.stats.tx_queue_enqueue_stats,
                           timestamp_us,
-                          btif_a2dp_source_cb.encoder_interval_ms * 1000);
+                          btif_a2dp_source_cb.scheduler.TickPeriodMs() * 1000);
+
+  if (btif_a2dp_source_cb.scheduler.EndTick(time_get_os_boottime_us())) {
+    // Coalesce the ticks or go back to the nominal period
+    alarm_set(btif_a2dp_source_cb.media_alarm,
+              btif_a2dp_source_cb.scheduler.TickPeriodMs(),
+              btif_a2dp_source_alarm_cb, nullptr);
+  }
 }
 
 static uint32_t btif_a2dp_source_read_callback(uint8_t* p_buf, uint32_t len) {
-  uint16_t event;
-  uint32_t bytes_read =
-      UIPC_Read(*a2dp_uipc, UIPC_CH_ID_AV_AUDIO, &event, p_buf, len);
+  uint32_t bytes_read = btif_a2dp_control_read_audio_data(p_buf, len);
+  btif_a2dp_source_cb.scheduler.OnFeedRead(len, bytes_read);
 
   if (bytes_read < len) {
     LOG_WARN(LOG_TAG, "%s: UNDERFLOW: ONLY READ %d BYTES OUT OF %d", __func__,
@@ -1025,7 +1052,7 @@ static void btif_a2dp_source_audio_tx_flush_event(void) {
       time_get_os_boottime_us();
   fixed_queue_flush(btif_a2dp_source_cb.tx_audio_queue, osi_free);
 
-  UIPC_Ioctl(*a2dp_uipc, UIPC_CH_ID_AV_AUDIO, UIPC_REQ_RX_FLUSH, nullptr);
+  btif_a2dp_control_flush_audio_data();
 }
 
 static bool btif_a2dp_source_audio_tx_flush_req(void) {
@@ -1265,6 +1292,8 @@ void btif_a2dp_source_debug_dump(int fd) {
       (unsigned long long)dequeue_stats->max_premature_scheduling_delta_us /
           1000,
       (unsigned long long)ave_time_us / 1000);
+
+  btif_a2dp_source_cb.scheduler.DebugDump(fd);
 }
 
 static void btif_a2dp_source_update_metrics(void) {
@@ -0,0 +1,354 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_btif_a2dp_source_scheduler"
+
+#include "btif_a2dp_source_scheduler.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "osi/include/log.h"
+
+constexpr size_t A2dpDurationHistogram::kNumBuckets;
+constexpr uint64_t A2dpDurationHistogram::kFirstBucketUs;
+constexpr int32_t BtifA2dpSourceScheduler::kMaxDriftPpm;
+constexpr uint64_t BtifA2dpSourceScheduler::kDriftWindowUs;
+constexpr size_t BtifA2dpSourceScheduler::kCoalesceAfterTicks;
+constexpr size_t BtifA2dpSourceScheduler::kMaxCoalesceAfterTicks;
+
+// Weight of a new drift sample in the drift estimate is 1 / 2^N
+#define DRIFT_ESTIMATE_SMOOTHING_SHIFT 3
+
+// Drift windows in which the audio HAL could not provide more than
+// 1 / N of the requested data are caused by stalls, not by clock drift.
+#define DRIFT_WINDOW_MAX_UNDERFLOW_RATIO 10
+
+void A2dpDurationHistogram::Reset() {
+  memset(buckets_, 0, sizeof(buckets_));
+  total_count_ = 0;
+  max_us_ = 0;
+}
+
+void A2dpDurationHistogram::Add(uint64_t value_us) {
+  size_t bucket = 0;
+  uint64_t bound_us = kFirstBucketUs;
+  while (bucket < kNumBuckets - 1 && value_us >= bound_us) {
+    bucket++;
+    bound_us <<= 1;
+  }
+  buckets_[bucket]++;
+  total_count_++;
+  max_us_ = std::max(max_us_, value_us);
+}
+
+void A2dpDurationHistogram::Accumulate(const A2dpDurationHistogram& other) {
+  for (size_t i = 0; i < kNumBuckets; i++) buckets_[i] += other.buckets_[i];
+  total_count_ += other.total_count_;
+  max_us_ = std::max(max_us_, other.max_us_);
+}
+
+uint64_t A2dpDurationHistogram::BucketUpperBoundUs(size_t bucket) {
+  if (bucket >= kNumBuckets - 1) return UINT64_MAX;
+  return kFirstBucketUs << bucket;
+}
+
+uint64_t A2dpDurationHistogram::PercentileUpperBoundUs(
+    unsigned percent) const {
+  if (total_count_ == 0) return 0;
+
+  uint64_t target = (total_count_ * std::min(percent, 100u) + 99) / 100;
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < kNumBuckets; i++) {
+    cumulative += buckets_[i];
+    if (cumulative >= target && cumulative > 0) {
+      return std::min(BucketUpperBoundUs(i), max_us_);
+    }
+  }
+  return max_us_;
+}
+
+void A2dpDurationHistogram::DebugDump(int fd, const char* title) const {
+  dprintf(fd,
+          "  %s (count/p50/p99/max in us)%*s: %" PRIu64 " / %" PRIu64
+          " / %" PRIu64 " / %" PRIu64 "\n",
+          title, std::max(0, 27 - (int)strlen(title)), "", total_count_,
+          PercentileUpperBoundUs(50), PercentileUpperBoundUs(99), max_us_);
+  if (total_count_ == 0) return;
+
+  uint64_t lower_us = 0;
+  for (size_t i = 0; i < kNumBuckets; i++) {
+    uint64_t upper_us = BucketUpperBoundUs(i);
+    if (buckets_[i] != 0) {
+      if (upper_us == UINT64_MAX) {
+        dprintf(fd, "    [%6" PRIu64 " us, ...      ) : %" PRIu64 "\n",
+                lower_us, buckets_[i]);
+      } else {
+        dprintf(fd, "    [%6" PRIu64 " us, %6" PRIu64 " us) : %" PRIu64 "\n",
+                lower_us, upper_us, buckets_[i]);
+      }
+    }
+    lower_us = upper_us;
+  }
+}
+
+void BtifA2dpSourceScheduler::Reset() {
+  running_ = false;
+  coalescing_enabled_ = false;
+  nominal_period_ms_ = 0;
+  coalesced_period_ms_ = 0;
+  tick_period_ms_ = 0;
+  tick_period_changed_ = false;
+
+  last_tick_us_ = 0;
+  next_deadline_us_ = 0;
+  tick_begin_us_ = 0;
+  media_timestamp_us_ = 0;
+  tick_underflow_ = false;
+  tick_quiet_ = false;
+  quiet_tick_count_ = 0;
+  coalesce_after_ticks_ = kCoalesceAfterTicks;
+
+  drift_ppm_ = 0;
+  window_start_us_ = 0;
+  window_start_queued_bytes_ = 0;
+  window_bytes_requested_ = 0;
+  window_bytes_read_ = 0;
+
+  total_ticks_ = 0;
+  coalesced_ticks_ = 0;
+  coalesced_time_us_ = 0;
+  coalesce_enter_count_ = 0;
+  coalesce_exit_count_ = 0;
+  drift_window_count_ = 0;
+  min_drift_ppm_ = 0;
+  max_drift_ppm_ = 0;
+  tick_jitter_histogram_.Reset();
+  tick_service_histogram_.Reset();
+}
+
+bool BtifA2dpSourceScheduler::CanCoalesceTicks(
+    const tA2DP_ENCODER_INTERFACE* encoder_interface) {
+  return encoder_interface != nullptr &&
+         encoder_interface->send_frames_uses_timestamp &&
+         encoder_interface->get_max_send_interval_us != nullptr;
+}
+
+void BtifA2dpSourceScheduler::Start(uint64_t now_us, uint64_t interval_ms,
+                                    uint64_t max_interval_us) {
+  running_ = true;
+  nominal_period_ms_ = interval_ms;
+  coalesced_period_ms_ = CoalescedPeriodMs(interval_ms, max_interval_us);
+  tick_period_ms_ = interval_ms;
+  tick_period_changed_ = false;
+  coalescing_enabled_ = coalesced_period_ms_ > interval_ms;
+
+  last_tick_us_ = now_us;
+  next_deadline_us_ = now_us + interval_ms * 1000;
+  media_timestamp_us_ = now_us;
+  quiet_tick_count_ = 0;
+  coalesce_after_ticks_ = kCoalesceAfterTicks;
+
+  // The drift estimate is kept from the previous session: the clocks
+  // involved do not change between sessions.
+  window_start_us_ = 0;
+}
+
+void BtifA2dpSourceScheduler::Stop() {
+  running_ = false;
+  tick_period_ms_ = nominal_period_ms_;
+  tick_period_changed_ = false;
+}
+
+uint64_t BtifA2dpSourceScheduler::BeginTick(uint64_t now_us,
+                                            size_t tx_queue_length,
+                                            size_t feed_queued_bytes) {
+  uint64_t period_us = tick_period_ms_ * 1000;
+  uint64_t jitter_us = (now_us > next_deadline_us_)
+                           ? now_us - next_deadline_us_
+                           : next_deadline_us_ - now_us;
+  // The periodic alarm stays on its grid: late ticks do not shift the
+  // following deadlines.
+  next_deadline_us_ += period_us;
+  while (period_us != 0 && next_deadline_us_ <= now_us)
+    next_deadline_us_ += period_us;
+
+  total_ticks_++;
+  tick_begin_us_ = now_us;
+  tick_jitter_histogram_.Add(jitter_us);
+
+  uint64_t elapsed_us = (now_us > last_tick_us_) ? now_us - last_tick_us_ : 0;
+  last_tick_us_ = now_us;
+  if (IsCoalescing()) {
+    coalesced_ticks_++;
+    coalesced_time_us_ += elapsed_us;
+  }
+
+  // Advance the media clock by the elapsed time corrected by the drift
+  int64_t correction_us = (int64_t)elapsed_us * drift_ppm_ / 1000000;
+  media_timestamp_us_ += elapsed_us + correction_us;
+
+  tick_underflow_ = false;
+  tick_quiet_ = (tx_queue_length <= 1) && (jitter_us < period_us / 4);
+
+  UpdateDriftEstimate(now_us, feed_queued_bytes);
+
+  return media_timestamp_us_;
+}
+
+void BtifA2dpSourceScheduler::OnFeedRead(uint32_t bytes_requested,
+                                         uint32_t bytes_read) {
+  window_bytes_requested_ += bytes_requested;
+  window_bytes_read_ += bytes_read;
+  if (bytes_read < bytes_requested) tick_underflow_ = true;
+}
+
+bool BtifA2dpSourceScheduler::EndTick(uint64_t now_us) {
+  tick_service_histogram_.Add(
+      (now_us > tick_begin_us_) ? now_us - tick_begin_us_ : 0);
+
+  if (running_ && coalescing_enabled_) {
+    if (tick_quiet_ && !tick_underflow_) {
+      quiet_tick_count_++;
+    } else {
+      quiet_tick_count_ = 0;
+    }
+
+    if (IsCoalescing()) {
+      if (quiet_tick_count_ == 0) {
+        // Back to the nominal period, and wait longer before coalescing
+        // again so a marginal system does not keep switching.
+        SetTickPeriod(nominal_period_ms_);
+        coalesce_exit_count_++;
+        coalesce_after_ticks_ =
+            std::min(coalesce_after_ticks_ * 2, kMaxCoalesceAfterTicks);
+      } else if (quiet_tick_count_ >= kMaxCoalesceAfterTicks) {
+        coalesce_after_ticks_ = kCoalesceAfterTicks;
+      }
+    } else if (quiet_tick_count_ >= coalesce_after_ticks_) {
+      SetTickPeriod(coalesced_period_ms_);
+      coalesce_enter_count_++;
+      quiet_tick_count_ = 0;
+    }
+  }
+
+  if (!tick_period_changed_) return false;
+
+  // Rescheduling the alarm restarts its period from now
+  tick_period_changed_ = false;
+  next_deadline_us_ = now_us + tick_period_ms_ * 1000;
+  return true;
+}
+
+void BtifA2dpSourceScheduler::DebugDump(int fd) const {
+  uint64_t saved_wakeups = 0;
+  if (nominal_period_ms_ != 0) {
+    uint64_t nominal_ticks = coalesced_time_us_ / (nominal_period_ms_ * 1000);
+    if (nominal_ticks > coalesced_ticks_)
+      saved_wakeups = nominal_ticks - coalesced_ticks_;
+  }
+
+  dprintf(fd, "  Media Tick Scheduler:\n");
+  dprintf(fd,
+          "  Tick period in ms (current/nominal)                     : "
+          "%" PRIu64 " / %" PRIu64 "\n",
+          tick_period_ms_, nominal_period_ms_);
+  dprintf(fd,
+          "  Tick coalescing                                         : "
+          "%s%s\n",
+          coalescing_enabled_ ? "enabled" : "disabled",
+          IsCoalescing() ? " (active)" : "");
+  dprintf(fd,
+          "  Ticks (total/coalesced/saved wakeups)                   : "
+          "%" PRIu64 " / %" PRIu64 " / %" PRIu64 "\n",
+          total_ticks_, coalesced_ticks_, saved_wakeups);
+  dprintf(fd,
+          "  Coalescing counts (enter/exit)                          : "
+          "%" PRIu64 " / %" PRIu64 "\n",
+          coalesce_enter_count_, coalesce_exit_count_);
+  dprintf(fd,
+          "  Clock drift in ppm (current/min/max)                    : "
+          "%" PRId32 " / %" PRId32 " / %" PRId32 "\n",
+          drift_ppm_, min_drift_ppm_, max_drift_ppm_);
+  dprintf(fd,
+          "  Drift estimation windows                                : "
+          "%" PRIu64 "\n",
+          drift_window_count_);
+  tick_jitter_histogram_.DebugDump(fd, "Tick jitter");
+  tick_service_histogram_.DebugDump(fd, "Tick service time");
+}
+
+uint64_t BtifA2dpSourceScheduler::CoalescedPeriodMs(
+    uint64_t nominal_period_ms, uint64_t max_interval_us) {
+  // Keep half a nominal period of margin below what the encoder can send in
+  // one tick: a coalesced tick that fires late must not drop frames.
+  uint64_t margin_us = nominal_period_ms * 1000 / 2;
+  if (max_interval_us <= margin_us) return nominal_period_ms;
+  uint64_t period_ms = (max_interval_us - margin_us) / 1000;
+
+  // Stretch the period by half at most
+  period_ms = std::min(period_ms, nominal_period_ms + nominal_period_ms / 2);
+  return std::max(period_ms, nominal_period_ms);
+}
+
+void BtifA2dpSourceScheduler::UpdateDriftEstimate(uint64_t now_us,
+                                                  size_t feed_queued_bytes) {
+  if (window_start_us_ != 0 && now_us - window_start_us_ < kDriftWindowUs)
+    return;
+
+  if (window_start_us_ != 0 && window_bytes_requested_ != 0 &&
+      window_bytes_requested_ - window_bytes_read_ <=
+          window_bytes_requested_ / DRIFT_WINDOW_MAX_UNDERFLOW_RATIO) {
+    // Data produced by the audio HAL during the window
+    int64_t feed_bytes = (int64_t)window_bytes_read_ +
+                         (int64_t)feed_queued_bytes -
+                         (int64_t)window_start_queued_bytes_;
+    // Data the encoder would have consumed without drift compensation
+    int64_t nominal_bytes = (int64_t)window_bytes_requested_ * 1000000 /
+                            (1000000 + drift_ppm_);
+    if (nominal_bytes > 0) {
+      int64_t sample_ppm =
+          (feed_bytes - nominal_bytes) * 1000000 / nominal_bytes;
+      sample_ppm = std::max<int64_t>(
+          -kMaxDriftPpm, std::min<int64_t>(kMaxDriftPpm, sample_ppm));
+
+      drift_ppm_ += (int32_t)(sample_ppm - drift_ppm_) /
+                    (1 << DRIFT_ESTIMATE_SMOOTHING_SHIFT);
+      drift_window_count_++;
+      min_drift_ppm_ = std::min(min_drift_ppm_, drift_ppm_);
+      max_drift_ppm_ = std::max(max_drift_ppm_, drift_ppm_);
+      LOG_VERBOSE(LOG_TAG, "%s: drift sample %" PRId64 " ppm, estimate %d ppm",
+                  __func__, sample_ppm, drift_ppm_);
+    }
+  }
+
+  window_start_us_ = now_us;
+  window_start_queued_bytes_ = feed_queued_bytes;
+  window_bytes_requested_ = 0;
+  window_bytes_read_ = 0;
+}
+
+void BtifA2dpSourceScheduler::SetTickPeriod(uint64_t period_ms) {
+  if (period_ms == tick_period_ms_) return;
+  LOG_INFO(LOG_TAG, "%s: media tick period %" PRIu64 " ms -> %" PRIu64 " ms",
+           __func__, tick_period_ms_, period_ms);
+  tick_period_ms_ = period_ms;
+  tick_period_changed_ = true;
+}
@@ -26,8 +26,10 @@
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <mutex>
 
 #include <hardware/bluetooth.h>
@@ -67,6 +69,9 @@ using bluetooth::Uuid;
 // Maximum number of devices we can have an RFCOMM connection with.
 #define MAX_RFC_SESSION 7
 
+// Maximum number of buffers passed to the app or read from it in one call.
+#define MAX_RFC_IOV 16
+
 typedef struct {
   int outgoing_congest : 1;
   int pending_sdp_request : 1;
@@ -770,10 +775,55 @@ static sent_status_t send_data_to_app(int fd, BT_HDR* p_buf) {
   return SENT_PARTIAL;
 }
 
+// Sends the buffers at the front of |queue| to the app with one sendmsg(), and
+// removes those sent in full from the queue.
+static sent_status_t send_queue_to_app(int fd, list_t* queue) {
+  struct iovec iov[MAX_RFC_IOV];
+  size_t count = 0;
+  size_t total = 0;
+  for (const list_node_t* node = list_begin(queue);
+       node != list_end(queue) && count < ARRAY_SIZE(iov);
+       node = list_next(node)) {
+    BT_HDR* p_buf = (BT_HDR*)list_node(node);
+    iov[count].iov_base = p_buf->data + p_buf->offset;
+    iov[count].iov_len = p_buf->len;
+    total += p_buf->len;
+    count++;
+  }
+
+  ssize_t sent = 0;
+  if (total > 0) {
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    OSI_NO_INTR(sent = sendmsg(fd, &msg, MSG_DONTWAIT));
+
+    if (sent == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return SENT_NONE;
+      LOG_ERROR(LOG_TAG, "%s error writing RFCOMM data back to app: %s",
+                __func__, strerror(errno));
+      return SENT_FAILED;
+    }
+
+    if (sent == 0) return SENT_FAILED;
+  }
+
+  for (; count > 0; count--) {
+    BT_HDR* p_buf = (BT_HDR*)list_front(queue);
+    if ((size_t)sent < p_buf->len) {
+      p_buf->offset += sent;
+      p_buf->len -= sent;
+      return SENT_PARTIAL;
+    }
+    sent -= p_buf->len;
+    list_remove(queue, p_buf);
+  }
+  return SENT_ALL;
+}
+
 static bool flush_incoming_que_on_wr_signal(rfc_slot_t* slot) {
   while (!list_is_empty(slot->incoming_queue)) {
-    BT_HDR* p_buf = (BT_HDR*)list_front(slot->incoming_queue);
-    switch (send_data_to_app(slot->fd, p_buf)) {
+    switch (send_queue_to_app(slot->fd, slot->incoming_queue)) {
       case SENT_NONE:
       case SENT_PARTIAL:
         // monitor the fd to get callback when app is ready to receive data
@@ -782,11 +832,9 @@ static bool flush_incoming_que_on_wr_signal(rfc_slot_t* slot) {
         return true;
 
       case SENT_ALL:
-        list_remove(slot->incoming_queue, p_buf);
         break;
 
       case SENT_FAILED:
-        list_remove(slot->incoming_queue, p_buf);
         return false;
     }
   }
@@ -916,3 +964,36 @@ int bta_co_rfc_data_outgoing(uint32_t id, uint8_t* buf, uint16_t size) {
 
   return true;
 }
+
+int bta_co_rfc_data_outgoing_bufs(uint32_t id, BT_HDR** pp_bufs,
+                                  uint16_t count) {
+  std::unique_lock<std::recursive_mutex> lock(slot_lock);
+  rfc_slot_t* slot = find_rfc_slot_by_id(id);
+  if (!slot) return false;
+
+  // Read straight into the stack buffers, with one readv() per MAX_RFC_IOV.
+  struct iovec iov[MAX_RFC_IOV];
+  size_t n;
+  for (size_t i = 0; i < count; i += n) {
+    size_t size = 0;
+    n = std::min(count - i, ARRAY_SIZE(iov));
+    for (size_t j = 0; j < n; j++) {
+      BT_HDR* p_buf = pp_bufs[i + j];
+      iov[j].iov_base = p_buf->data + p_buf->offset;
+      iov[j].iov_len = p_buf->len;
+      size += p_buf->len;
+    }
+
+    ssize_t received;
+    OSI_NO_INTR(received = readv(slot->fd, iov, n));
+
+    if (received != (ssize_t)size) {
+      LOG_ERROR(LOG_TAG, "%s error receiving RFCOMM data from app: %s",
+                __func__, strerror(errno));
+      cleanup_rfc_slot(slot);
+      return false;
+    }
+  }
+
+  return true;
+}
@@ -38,9 +38,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/poll.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <time.h>
@@ -48,6 +48,7 @@
 
 #include <mutex>
 #include <string>
+#include <unordered_map>
 
 #include "bta_api.h"
 #include "btif_common.h"
@@ -64,29 +65,39 @@
   } while (0)
 
 #define MAX_THREAD 8
-#define MAX_POLL 64
-#define POLL_EXCEPTION_EVENTS (POLLHUP | POLLRDHUP | POLLERR | POLLNVAL)
-#define IS_EXCEPTION(e) ((e)&POLL_EXCEPTION_EVENTS)
-#define IS_READ(e) ((e)&POLLIN)
-#define IS_WRITE(e) ((e)&POLLOUT)
+/* Events handled per epoll_wait, there is no limit on the number of fds */
+#define MAX_EVENTS 64
+#define EPOLL_EXCEPTION_EVENTS (EPOLLHUP | EPOLLRDHUP | EPOLLERR)
+#define IS_EXCEPTION(e) ((e)&EPOLL_EXCEPTION_EVENTS)
+#define IS_READ(e) ((e)&EPOLLIN)
+#define IS_WRITE(e) ((e)&EPOLLOUT)
+/* epoll data of the cmd fd, the data fds have a non zero generation */
+#define CMD_FD_KEY 0
 /*cmd executes in socket poll thread */
 #define CMD_WAKEUP 1
 #define CMD_EXIT 2
-#define CMD_ADD_FD 3
 #define CMD_REMOVE_FD 4
 #define CMD_USER_PRIVATE 5
 
+/* A monitored fd. Slots stay in the epoll set with no flags after their
+ * events are signaled, so the counters last until the fd is removed. An fd
+ * closed without being removed is told apart from a new fd with the same
+ * number by the file it refers to. */
 typedef struct {
-  struct pollfd pfd;
   uint32_t user_id;
   int type;
-  int flags;
+  int flags; /* monitored events */
+  uint32_t generation; /* tells events of a former registration apart */
+  dev_t dev;           /* file of the fd when it was added */
+  ino_t ino;
+  btsock_fd_stats_t stats;
 } poll_slot_t;
 typedef struct {
   int cmd_fdr, cmd_fdw;
-  int poll_count;
-  poll_slot_t ps[MAX_POLL];
-  int psi[MAX_POLL];  // index of poll slot
+  int epoll_fd;
+  std::mutex poll_lock; /* protects poll_slots and generation */
+  std::unordered_map<int, poll_slot_t> poll_slots;
+  uint32_t generation;
   pthread_t thread_id;
   btsock_signaled_cb callback;
   btsock_cmd_cb cmd_callback;
@@ -97,8 +108,9 @@ static thread_slot_t ts[MAX_THREAD];
 static void* sock_poll_thread(void* arg);
 static inline void close_cmd_fd(int h);
 
-static inline void add_poll(int h, int fd, int type, int flags,
+static inline bool add_poll(int h, int fd, int type, int flags,
                             uint32_t user_id);
+static inline bool poll_slot_closed(int fd, const poll_slot_t& ps);
 
 static std::recursive_mutex thread_slot_lock;
 
@@ -128,6 +140,7 @@ static inline int create_thread(void* (*start_routine)(void*), void* arg,
   return ret;
 }
 static void init_poll(int cmd_fd);
+static void close_poll(int h);
 static int alloc_thread_slot() {
   std::unique_lock<std::recursive_mutex> lock(thread_slot_lock);
   int i;
@@ -145,6 +158,7 @@ static int alloc_thread_slot() {
 static void free_thread_slot(int h) {
   if (0 <= h && h < MAX_THREAD) {
     close_cmd_fd(h);
+    close_poll(h);
     ts[h].used = 0;
   } else
     APPL_TRACE_ERROR("invalid thread handle:%d", h);
@@ -157,9 +171,10 @@ int btsock_thread_init() {
     int h;
     for (h = 0; h < MAX_THREAD; h++) {
       ts[h].cmd_fdr = ts[h].cmd_fdw = -1;
+      ts[h].epoll_fd = -1;
       ts[h].used = 0;
       ts[h].thread_id = -1;
-      ts[h].poll_count = 0;
+      ts[h].generation = 0;
       ts[h].callback = NULL;
       ts[h].cmd_callback = NULL;
     }
@@ -189,7 +204,7 @@ int btsock_thread_create(btsock_signaled_cb callback,
   return h;
 }
 
-/* create dummy socket pair used to wake up select loop */
+/* create dummy socket pair used to wake up the epoll loop */
 static inline void init_cmd_fd(int h) {
   asrt(ts[h].cmd_fdr == -1 && ts[h].cmd_fdw == -1);
   if (socketpair(AF_UNIX, SOCK_STREAM, 0, &ts[h].cmd_fdr) < 0) {
@@ -198,8 +213,13 @@ static inline void init_cmd_fd(int h) {
   }
   APPL_TRACE_DEBUG("h:%d, cmd_fdr:%d, cmd_fdw:%d", h, ts[h].cmd_fdr,
                    ts[h].cmd_fdw);
-  // add the cmd fd for read & write
-  add_poll(h, ts[h].cmd_fdr, 0, SOCK_THREAD_FD_RD, 0);
+  // the cmd fd is level triggered, one cmd is read per wakeup
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = CMD_FD_KEY;
+  if (epoll_ctl(ts[h].epoll_fd, EPOLL_CTL_ADD, ts[h].cmd_fdr, &event) == -1)
+    APPL_TRACE_ERROR("unable to register cmd fd: %s", strerror(errno));
 }
 static inline void close_cmd_fd(int h) {
   if (ts[h].cmd_fdr != -1) {
@@ -228,24 +248,10 @@ int btsock_thread_add_fd(int h, int fd, int type, int flags, uint32_t user_id) {
         "cmd socket is not created. socket thread may not initialized");
     return false;
   }
-  if (flags & SOCK_THREAD_ADD_FD_SYNC) {
-    // must executed in socket poll thread
-    if (ts[h].thread_id == pthread_self()) {
-      // cleanup one-time flags
-      flags &= ~SOCK_THREAD_ADD_FD_SYNC;
-      add_poll(h, fd, type, flags, user_id);
-      return true;
-    }
-    APPL_TRACE_DEBUG(
-        "THREAD_ADD_FD_SYNC is not called in poll thread, fallback to async");
-  }
-  sock_cmd_t cmd = {CMD_ADD_FD, fd, type, flags, user_id};
+  // the epoll set can be changed from any thread, adding is always synchronous
+  flags &= ~SOCK_THREAD_ADD_FD_SYNC;
   APPL_TRACE_DEBUG("adding fd:%d, flags:0x%x", fd, flags);
-
-  ssize_t ret;
-  OSI_NO_INTR(ret = send(ts[h].cmd_fdw, &cmd, sizeof(cmd), 0));
-
-  return ret == sizeof(cmd);
+  return add_poll(h, fd, type, flags, user_id);
 }
 
 bool btsock_thread_remove_fd_and_close(int thread_handle, int fd) {
@@ -339,75 +345,149 @@ int btsock_thread_exit(int h) {
   }
   return false;
 }
+bool btsock_thread_get_fd_stats(int h, int fd, btsock_fd_stats_t* stats) {
+  if (h < 0 || h >= MAX_THREAD) {
+    APPL_TRACE_ERROR("invalid bt thread handle:%d", h);
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(ts[h].poll_lock);
+  auto it = ts[h].poll_slots.find(fd);
+  if (it == ts[h].poll_slots.end()) return false;
+  if (poll_slot_closed(fd, it->second)) {
+    ts[h].poll_slots.erase(it);
+    return false;
+  }
+  *stats = it->second.stats;
+  return true;
+}
+void btsock_thread_debug_dump(int fd) {
+  std::unique_lock<std::recursive_mutex> slot_lock(thread_slot_lock);
+  dprintf(fd, "\nBT socket threads:\n");
+  for (int h = 0; h < MAX_THREAD; h++) {
+    if (!ts[h].used) continue;
+    std::lock_guard<std::mutex> lock(ts[h].poll_lock);
+    for (auto it = ts[h].poll_slots.begin(); it != ts[h].poll_slots.end();) {
+      if (poll_slot_closed(it->first, it->second))
+        it = ts[h].poll_slots.erase(it);
+      else
+        ++it;
+    }
+    dprintf(fd, "  thread %d: %zu fds\n", h, ts[h].poll_slots.size());
+    for (const auto& slot : ts[h].poll_slots) {
+      const poll_slot_t& ps = slot.second;
+      dprintf(fd,
+              "    fd %d: type %d, id %u, flags 0x%x, read %u, write %u, "
+              "exception %u\n",
+              slot.first, ps.type, ps.user_id, ps.flags, ps.stats.rd_count,
+              ps.stats.wr_count, ps.stats.exception_count);
+    }
+  }
+}
 static void init_poll(int h) {
-  int i;
-  ts[h].poll_count = 0;
   ts[h].thread_id = -1;
   ts[h].callback = NULL;
   ts[h].cmd_callback = NULL;
-  for (i = 0; i < MAX_POLL; i++) {
-    ts[h].ps[i].pfd.fd = -1;
-    ts[h].psi[i] = -1;
+  {
+    std::lock_guard<std::mutex> lock(ts[h].poll_lock);
+    ts[h].poll_slots.clear();
+    ts[h].epoll_fd = epoll_create(MAX_EVENTS);
+    if (ts[h].epoll_fd == -1) {
+      APPL_TRACE_ERROR("unable to create epoll instance: %s", strerror(errno));
+      return;
+    }
   }
   init_cmd_fd(h);
 }
-static inline unsigned int flags2pevents(int flags) {
-  unsigned int pevents = 0;
-  if (flags & SOCK_THREAD_FD_WR) pevents |= POLLOUT;
-  if (flags & SOCK_THREAD_FD_RD) pevents |= POLLIN;
-  pevents |= POLL_EXCEPTION_EVENTS;
-  return pevents;
+static void close_poll(int h) {
+  std::lock_guard<std::mutex> lock(ts[h].poll_lock);
+  ts[h].poll_slots.clear();
+  if (ts[h].epoll_fd != -1) {
+    close(ts[h].epoll_fd);
+    ts[h].epoll_fd = -1;
+  }
 }
-
-static inline void set_poll(poll_slot_t* ps, int fd, int type, int flags,
-                            uint32_t user_id) {
-  ps->pfd.fd = fd;
-  ps->user_id = user_id;
-  if (ps->type != 0 && ps->type != type)
-    APPL_TRACE_ERROR(
-        "poll socket type should not changed! type was:%d, type now:%d",
-        ps->type, type);
-  ps->type = type;
-  ps->flags = flags;
-  ps->pfd.events = flags2pevents(flags);
-  ps->pfd.revents = 0;
+static inline uint32_t flags2epevents(int flags) {
+  /* Edge triggered: a signaled flag is removed until it is added again, which
+   * modifies the registration and reports the fd again if it is still ready */
+  uint32_t events = EPOLLET | EPOLLRDHUP;
+  if (flags & SOCK_THREAD_FD_WR) events |= EPOLLOUT;
+  if (flags & SOCK_THREAD_FD_RD) events |= EPOLLIN;
+  return events;
+}
+static inline uint64_t event_key(uint32_t generation, int fd) {
+  return ((uint64_t)generation << 32) | (uint32_t)fd;
+}
+static inline bool ctl_poll(int h, int op, int fd, const poll_slot_t& ps) {
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = flags2epevents(ps.flags);
+  event.data.u64 = event_key(ps.generation, fd);
+  return epoll_ctl(ts[h].epoll_fd, op, fd, &event) == 0;
+}
+/* Returns true if |fd| was closed without being removed: it left the epoll
+ * set, and its number may be used by another fd since. The registration is
+ * left as is, so that a dump does not report an edge triggered fd again.
+ * Must be called with poll_lock held. */
+static inline bool poll_slot_closed(int fd, const poll_slot_t& ps) {
+  struct stat st;
+  if (fstat(fd, &st) == -1) return errno == EBADF;
+  return st.st_dev != ps.dev || st.st_ino != ps.ino;
 }
-static inline void add_poll(int h, int fd, int type, int flags,
+static inline bool add_poll(int h, int fd, int type, int flags,
                             uint32_t user_id) {
   asrt(fd != -1);
-  int i;
-  int empty = -1;
-  poll_slot_t* ps = ts[h].ps;
+  std::lock_guard<std::mutex> lock(ts[h].poll_lock);
+  if (ts[h].epoll_fd == -1) return false;
 
-  for (i = 0; i < MAX_POLL; i++) {
-    if (ps[i].pfd.fd == fd) {
-      asrt(ts[h].poll_count < MAX_POLL);
+  auto it = ts[h].poll_slots.find(fd);
+  if (it != ts[h].poll_slots.end()) {
+    poll_slot_t& ps = it->second;
+    if (ps.type != 0 && ps.type != type)
+      APPL_TRACE_ERROR(
+          "poll socket type should not changed! type was:%d, type now:%d",
+          ps.type, type);
+    int old_flags = ps.flags;
+    ps.flags |= flags;
+    if (ctl_poll(h, EPOLL_CTL_MOD, fd, ps)) {
+      ps.type = type;
+      ps.user_id = user_id;
+      return true;
+    }
+    ps.flags = old_flags;
+    if (errno != ENOENT) {
+      APPL_TRACE_ERROR("unable to modify fd:%d, %s", fd, strerror(errno));
+      return false;
+    }
+    // closed without being removed, the fd number was reused since: the
+    // counters start again
+    ps = poll_slot_t();
+  }
 
-      set_poll(&ps[i], fd, type, flags | ps[i].flags, user_id);
-      return;
-    } else if (empty < 0 && ps[i].pfd.fd == -1)
-      empty = i;
+  poll_slot_t& ps = ts[h].poll_slots[fd];
+  ps.type = type;
+  ps.user_id = user_id;
+  ps.flags = flags;
+  if (++ts[h].generation == 0) ++ts[h].generation;
+  ps.generation = ts[h].generation;
+  struct stat st;
+  if (fstat(fd, &st) == 0) {
+    ps.dev = st.st_dev;
+    ps.ino = st.st_ino;
   }
-  if (empty >= 0) {
-    asrt(ts[h].poll_count < MAX_POLL);
-    set_poll(&ps[empty], fd, type, flags, user_id);
-    ++ts[h].poll_count;
-    return;
+  if (!ctl_poll(h, EPOLL_CTL_ADD, fd, ps)) {
+    APPL_TRACE_ERROR("unable to add fd:%d, %s", fd, strerror(errno));
+    ps.flags = 0;
+    return false;
   }
-  APPL_TRACE_ERROR("exceeded max poll slot:%d!", MAX_POLL);
+  return true;
 }
-static inline void remove_poll(int h, poll_slot_t* ps, int flags) {
-  if (flags == ps->flags) {
-    // all monitored events signaled. To remove it, just clear the slot
-    --ts[h].poll_count;
-    memset(ps, 0, sizeof(*ps));
-    ps->pfd.fd = -1;
-  } else {
-    // one read or one write monitor event signaled, removed the accordding bit
-    ps->flags &= ~flags;
-    // update the poll events mask
-    ps->pfd.events = flags2pevents(ps->flags);
-  }
+/* Removes the signaled |flags| from the events mask. The fd stays in the
+ * epoll set once none is left, as edge triggered it is not reported again
+ * until flags are added. Must be called with poll_lock held. */
+static inline void remove_poll(int h, int fd, poll_slot_t* ps, int flags) {
+  ps->flags &= ~flags;
+  // the fd may be closed already
+  ctl_poll(h, EPOLL_CTL_MOD, fd, *ps);
 }
 static int process_cmd_sock(int h) {
   sock_cmd_t cmd = {-1, 0, 0, 0, 0};
@@ -422,19 +502,16 @@ static int process_cmd_sock(int h) {
   }
   APPL_TRACE_DEBUG("cmd.id:%d", cmd.id);
   switch (cmd.id) {
-    case CMD_ADD_FD:
-      add_poll(h, cmd.fd, cmd.type, cmd.flags, cmd.user_id);
-      break;
-    case CMD_REMOVE_FD:
-      for (int i = 1; i < MAX_POLL; ++i) {
-        poll_slot_t* poll_slot = &ts[h].ps[i];
-        if (poll_slot->pfd.fd == cmd.fd) {
-          remove_poll(h, poll_slot, poll_slot->flags);
-          break;
-        }
+    case CMD_REMOVE_FD: {
+      std::lock_guard<std::mutex> lock(ts[h].poll_lock);
+      auto it = ts[h].poll_slots.find(cmd.fd);
+      if (it != ts[h].poll_slots.end()) {
+        epoll_ctl(ts[h].epoll_fd, EPOLL_CTL_DEL, cmd.fd, NULL);
+        ts[h].poll_slots.erase(it);
       }
       close(cmd.fd);
       break;
+    }
     case CMD_WAKEUP:
       break;
     case CMD_USER_PRIVATE:
@@ -451,101 +528,77 @@ static int process_cmd_sock(int h) {
   return true;
 }
 
-static void print_events(short events) {
+static void print_events(uint32_t events) {
   std::string flags("");
-  if ((events)&POLLIN) flags += " POLLIN";
-  if ((events)&POLLPRI) flags += " POLLPRI";
-  if ((events)&POLLOUT) flags += " POLLOUT";
-  if ((events)&POLLERR) flags += " POLLERR";
-  if ((events)&POLLHUP) flags += " POLLHUP ";
-  if ((events)&POLLNVAL) flags += " POLLNVAL";
-  if ((events)&POLLRDHUP) flags += " POLLRDHUP";
-  APPL_TRACE_DEBUG("print poll event:%x = %s", (events), flags.c_str());
-}
-
-static void process_data_sock(int h, struct pollfd* pfds, int count) {
-  asrt(count <= ts[h].poll_count);
-  int i;
-  for (i = 1; i < ts[h].poll_count; i++) {
-    if (pfds[i].revents) {
-      int ps_i = ts[h].psi[i];
-      asrt(pfds[i].fd == ts[h].ps[ps_i].pfd.fd);
-      uint32_t user_id = ts[h].ps[ps_i].user_id;
-      int type = ts[h].ps[ps_i].type;
-      int flags = 0;
-      print_events(pfds[i].revents);
-      if (IS_READ(pfds[i].revents)) {
-        flags |= SOCK_THREAD_FD_RD;
-      }
-      if (IS_WRITE(pfds[i].revents)) {
-        flags |= SOCK_THREAD_FD_WR;
-      }
-      if (IS_EXCEPTION(pfds[i].revents)) {
-        flags |= SOCK_THREAD_FD_EXCEPTION;
-        // remove the whole slot not flags
-        remove_poll(h, &ts[h].ps[ps_i], ts[h].ps[ps_i].flags);
-      } else if (flags)
-        remove_poll(h, &ts[h].ps[ps_i],
-                    flags);  // remove the monitor flags that already processed
-      if (flags) ts[h].callback(pfds[i].fd, type, flags, user_id);
-    }
-  }
+  if ((events)&EPOLLIN) flags += " EPOLLIN";
+  if ((events)&EPOLLPRI) flags += " EPOLLPRI";
+  if ((events)&EPOLLOUT) flags += " EPOLLOUT";
+  if ((events)&EPOLLERR) flags += " EPOLLERR";
+  if ((events)&EPOLLHUP) flags += " EPOLLHUP";
+  if ((events)&EPOLLRDHUP) flags += " EPOLLRDHUP";
+  APPL_TRACE_DEBUG("print epoll event:%x = %s", (events), flags.c_str());
 }
 
-static void prepare_poll_fds(int h, struct pollfd* pfds) {
-  int count = 0;
-  int ps_i = 0;
-  int pfd_i = 0;
-  asrt(ts[h].poll_count <= MAX_POLL);
-  memset(pfds, 0, sizeof(pfds[0]) * ts[h].poll_count);
-  while (count < ts[h].poll_count) {
-    if (ps_i >= MAX_POLL) {
-      APPL_TRACE_ERROR(
-          "exceed max poll range, ps_i:%d, MAX_POLL:%d, count:%d, "
-          "ts[h].poll_count:%d",
-          ps_i, MAX_POLL, count, ts[h].poll_count);
-      return;
+static void process_data_sock(int h, const struct epoll_event& event) {
+  int fd = (int)(uint32_t)event.data.u64;
+  uint32_t generation = event.data.u64 >> 32;
+  uint32_t user_id;
+  int type;
+  int flags = 0;
+  {
+    std::lock_guard<std::mutex> lock(ts[h].poll_lock);
+    auto it = ts[h].poll_slots.find(fd);
+    // removed, or removed and added again since the event was queued
+    if (it == ts[h].poll_slots.end()) return;
+    poll_slot_t* ps = &it->second;
+    if (ps->generation != generation || ps->flags == 0) return;
+
+    print_events(event.events);
+    if (IS_READ(event.events) && (ps->flags & SOCK_THREAD_FD_RD)) {
+      flags |= SOCK_THREAD_FD_RD;
+      ps->stats.rd_count++;
     }
-    if (ts[h].ps[ps_i].pfd.fd >= 0) {
-      pfds[pfd_i] = ts[h].ps[ps_i].pfd;
-      ts[h].psi[pfd_i] = ps_i;
-      count++;
-      pfd_i++;
+    if (IS_WRITE(event.events) && (ps->flags & SOCK_THREAD_FD_WR)) {
+      flags |= SOCK_THREAD_FD_WR;
+      ps->stats.wr_count++;
     }
-    ps_i++;
+    if (IS_EXCEPTION(event.events)) {
+      flags |= SOCK_THREAD_FD_EXCEPTION;
+      ps->stats.exception_count++;
+      // remove the whole slot not flags
+      remove_poll(h, fd, ps, ps->flags);
+    } else if (flags)
+      remove_poll(h, fd, ps,
+                  flags);  // remove the monitor flags that already processed
+    user_id = ps->user_id;
+    type = ps->type;
   }
+  if (flags) ts[h].callback(fd, type, flags, user_id);
 }
+
 static void* sock_poll_thread(void* arg) {
-  struct pollfd pfds[MAX_POLL];
-  memset(pfds, 0, sizeof(pfds));
+  struct epoll_event events[MAX_EVENTS];
   int h = (intptr_t)arg;
   for (;;) {
-    prepare_poll_fds(h, pfds);
     int ret;
-    OSI_NO_INTR(ret = poll(pfds, ts[h].poll_count, -1));
+    OSI_NO_INTR(ret = epoll_wait(ts[h].epoll_fd, events, MAX_EVENTS, -1));
     if (ret == -1) {
-      APPL_TRACE_ERROR("poll ret -1, exit the thread, errno:%d, err:%s", errno,
-                       strerror(errno));
+      APPL_TRACE_ERROR("epoll_wait ret -1, exit the thread, errno:%d, err:%s",
+                       errno, strerror(errno));
       break;
     }
-    if (ret != 0) {
-      int need_process_data_fd = true;
-      if (pfds[0].revents)  // cmd fd always is the first one
-      {
-        asrt(pfds[0].fd == ts[h].cmd_fdr);
+    int i;
+    for (i = 0; i < ret; i++) {
+      if (events[i].data.u64 == CMD_FD_KEY) {
         if (!process_cmd_sock(h)) {
           APPL_TRACE_DEBUG("h:%d, process_cmd_sock return false, exit...", h);
           break;
         }
-        if (ret == 1)
-          need_process_data_fd = false;
-        else
-          ret--;  // exclude the cmd fd
+      } else {
+        process_data_sock(h, events[i]);
       }
-      if (need_process_data_fd) process_data_sock(h, pfds, ret);
-    } else {
-      APPL_TRACE_DEBUG("no data, select ret: %d", ret)
-    };
+    }
+    if (i < ret) break;
   }
   APPL_TRACE_DEBUG("socket poll thread exiting, h:%d", h);
   return 0;
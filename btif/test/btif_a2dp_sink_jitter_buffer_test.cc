@@ -0,0 +1,252 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "btif/include/btif_a2dp_sink_jitter_buffer.h"
+#include "osi/include/allocator.h"
+
+namespace {
+constexpr uint32_t kSampleRate = 48000;
+// 20 ms of audio per packet
+constexpr uint32_t kPacketSamples = 960;
+constexpr uint64_t kPacketUs = 20 * 1000;
+constexpr uint64_t kTickUs = 20 * 1000;
+constexpr uint64_t kTargetLatencyMs = 100;
+constexpr uint64_t kStartUs = 1000 * 1000;
+constexpr int kPlayedSeqNone = -1;
+}  // namespace
+
+class BtifA2dpSinkJitterBufferTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    now_us_ = kStartUs;
+    jitter_buffer_.Configure(kSampleRate, kTargetLatencyMs, false, kTickUs);
+  }
+
+  // Delivers the packet with sequence number |seq| at the current time.
+  bool Deliver(uint16_t seq) {
+    BT_HDR* p_buf = reinterpret_cast<BT_HDR*>(osi_malloc(sizeof(BT_HDR)));
+    p_buf->layer_specific = seq;
+    return jitter_buffer_.Enqueue(
+        p_buf, seq, kBaseTimestamp + seq * kPacketSamples, now_us_);
+  }
+
+  // Runs the playout until nothing is due, recording the played sequence
+  // numbers and kPlayedSeqNone for each concealed packet.
+  void Playout() {
+    BT_HDR* p_buf;
+    while (true) {
+      BtifA2dpSinkJitterBuffer::Action action =
+          jitter_buffer_.Dequeue(now_us_, &p_buf);
+      if (action == BtifA2dpSinkJitterBuffer::kNone) break;
+      if (action == BtifA2dpSinkJitterBuffer::kPlay) {
+        played_.push_back(p_buf->layer_specific);
+        osi_free(p_buf);
+      } else {
+        played_.push_back(kPlayedSeqNone);
+      }
+    }
+  }
+
+  // Advances the time by one packet period, delivering |seq| and running
+  // the playout.
+  void Step(int seq) {
+    now_us_ += kPacketUs;
+    if (seq >= 0) Deliver(seq);
+    Playout();
+  }
+
+  static constexpr uint32_t kBaseTimestamp = 0xfffff000;
+  BtifA2dpSinkJitterBuffer jitter_buffer_;
+  uint64_t now_us_;
+  std::vector<int> played_;
+};
+
+constexpr uint32_t BtifA2dpSinkJitterBufferTest::kBaseTimestamp;
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_buffers_up_to_target_latency) {
+  // 100 ms of media are 5 packets of 20 ms
+  for (int seq = 0; seq < 4; seq++) Step(seq);
+  EXPECT_TRUE(jitter_buffer_.IsBuffering());
+  EXPECT_TRUE(played_.empty());
+
+  Step(4);
+  EXPECT_FALSE(jitter_buffer_.IsBuffering());
+  // The first packet plus the lookahead of one tick
+  EXPECT_EQ(played_, std::vector<int>({0, 1}));
+}
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_in_order_playout) {
+  for (int seq = 0; seq < 500; seq++) Step(seq & 0xffff);
+  EXPECT_EQ(jitter_buffer_.ConcealedPackets(), 0u);
+  EXPECT_EQ(jitter_buffer_.LatePackets(), 0u);
+  EXPECT_EQ(jitter_buffer_.Underruns(), 0u);
+  for (size_t i = 0; i < played_.size(); i++) EXPECT_EQ(played_[i], (int)i);
+  // The playout runs the buffered latency behind the reception
+  EXPECT_EQ(played_.size(), 500u - 3);
+}
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_sequence_number_wraparound) {
+  for (int i = 0; i < 100; i++) Step((0xffc0 + i) & 0xffff);
+  EXPECT_EQ(jitter_buffer_.ConcealedPackets(), 0u);
+  EXPECT_EQ(jitter_buffer_.LatePackets(), 0u);
+  for (size_t i = 1; i < played_.size(); i++)
+    EXPECT_EQ(played_[i], (played_[i - 1] + 1) & 0xffff);
+}
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_reordered_packets) {
+  for (int seq = 0; seq < 10; seq++) Step(seq);
+  Step(11);
+  Step(10);
+  for (int seq = 12; seq < 20; seq++) Step(seq);
+  EXPECT_EQ(jitter_buffer_.ConcealedPackets(), 0u);
+  for (size_t i = 0; i < played_.size(); i++) EXPECT_EQ(played_[i], (int)i);
+}
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_lost_packet_is_concealed) {
+  for (int seq = 0; seq < 10; seq++) Step(seq);
+  Step(kPlayedSeqNone);  // Packet 10 is lost
+  for (int seq = 11; seq < 20; seq++) Step(seq);
+
+  EXPECT_EQ(jitter_buffer_.ConcealedPackets(), 1u);
+  ASSERT_GT(played_.size(), 12u);
+  for (size_t i = 0; i < played_.size(); i++)
+    EXPECT_EQ(played_[i], (i == 10) ? kPlayedSeqNone : (int)i);
+}
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_late_packet_is_dropped) {
+  for (int seq = 0; seq < 10; seq++) Step(seq);
+  Step(kPlayedSeqNone);
+  for (int seq = 11; seq < 16; seq++) Step(seq);
+  ASSERT_EQ(jitter_buffer_.ConcealedPackets(), 1u);
+
+  // Packet 10 arrives after it was concealed
+  EXPECT_FALSE(Deliver(10));
+  EXPECT_EQ(jitter_buffer_.LatePackets(), 1u);
+}
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_duplicate_packet_is_dropped) {
+  Step(0);
+  Step(1);
+  EXPECT_FALSE(Deliver(1));
+  EXPECT_EQ(jitter_buffer_.DuplicatePackets(), 1u);
+  EXPECT_EQ(jitter_buffer_.Length(), 2u);
+}
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_underrun_rebuffers) {
+  for (int seq = 0; seq < 10; seq++) Step(seq);
+  for (int i = 0; i < 10; i++) Step(kPlayedSeqNone);
+  EXPECT_EQ(jitter_buffer_.Underruns(), 1u);
+  EXPECT_TRUE(jitter_buffer_.IsBuffering());
+  EXPECT_EQ(jitter_buffer_.ConcealedPackets(), 0u);
+
+  // The stream resumes after buffering again
+  size_t played = played_.size();
+  for (int seq = 20; seq < 30; seq++) Step(seq);
+  EXPECT_FALSE(jitter_buffer_.IsBuffering());
+  EXPECT_GT(played_.size(), played);
+  EXPECT_EQ(played_[played], 20);
+}
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_overflow_drops_oldest) {
+  for (size_t seq = 0; seq < BtifA2dpSinkJitterBuffer::kMaxPackets + 2; seq++)
+    Deliver(seq);
+  EXPECT_EQ(jitter_buffer_.Length(), BtifA2dpSinkJitterBuffer::kMaxPackets);
+  EXPECT_EQ(jitter_buffer_.OverflowPackets(), 2u);
+}
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_adaptive_latency_follows_jitter) {
+  jitter_buffer_.Configure(kSampleRate, 300, true, kTickUs);
+
+  // Regular arrivals: the latency settles at the minimum
+  for (int seq = 0; seq < 200; seq++) Step(seq);
+  EXPECT_EQ(jitter_buffer_.TargetLatencyUs(),
+            BtifA2dpSinkJitterBuffer::kMinTargetLatencyUs);
+  EXPECT_EQ(jitter_buffer_.Underruns(), 0u);
+
+  // Bursty arrivals: two packets every 40 ms
+  for (int seq = 200; seq < 400; seq += 2) {
+    now_us_ += 2 * kPacketUs;
+    Deliver(seq);
+    Deliver(seq + 1);
+    Playout();
+  }
+  EXPECT_GT(jitter_buffer_.JitterUs(), 5000u);
+  EXPECT_GT(jitter_buffer_.TargetLatencyUs(),
+            BtifA2dpSinkJitterBuffer::kMinTargetLatencyUs);
+  EXPECT_LE(jitter_buffer_.TargetLatencyUs(), 300u * 1000);
+  EXPECT_EQ(jitter_buffer_.ConcealedPackets(), 0u);
+}
+
+TEST_F(BtifA2dpSinkJitterBufferTest, test_adaptive_latency_is_reduced) {
+  jitter_buffer_.Configure(kSampleRate, 300, true, kTickUs);
+
+  // A burst of 10 packets fills the buffer well above the target latency
+  for (int seq = 0; seq < 10; seq++) Deliver(seq);
+  int seq = 10;
+  for (int i = 0; i < 500; i++) Step(seq++);
+
+  EXPECT_GT(jitter_buffer_.LatencyDrops(), 0u);
+  // Within the target latency, give or take the packets in flight
+  EXPECT_LE(jitter_buffer_.Length() * kPacketUs,
+            jitter_buffer_.TargetLatencyUs() + 2 * kPacketUs);
+  EXPECT_EQ(jitter_buffer_.ConcealedPackets(), 0u);
+}
+
+TEST(BtifA2dpSinkConcealerTest, test_fade_to_silence) {
+  BtifA2dpSinkConcealer concealer;
+  const uint8_t* p_data = nullptr;
+  EXPECT_EQ(concealer.Conceal(&p_data), 0u);
+
+  int16_t pcm[4] = {1000, -1000, 400, -400};
+  concealer.BeginPacket();
+  concealer.Append(reinterpret_cast<uint8_t*>(pcm), sizeof(pcm));
+
+  for (size_t loss = 1; loss <= BtifA2dpSinkConcealer::kMaxFadePackets;
+       loss++) {
+    ASSERT_EQ(concealer.Conceal(&p_data), sizeof(pcm));
+    const int16_t* out = reinterpret_cast<const int16_t*>(p_data);
+    EXPECT_EQ(out[0], 1000 >> loss);
+    EXPECT_EQ(out[1], -1000 >> loss);
+  }
+  ASSERT_EQ(concealer.Conceal(&p_data), sizeof(pcm));
+  const int16_t* out = reinterpret_cast<const int16_t*>(p_data);
+  for (size_t i = 0; i < 4; i++) EXPECT_EQ(out[i], 0);
+
+  // A decoded packet restarts the fade
+  concealer.BeginPacket();
+  concealer.Append(reinterpret_cast<uint8_t*>(pcm), sizeof(pcm));
+  ASSERT_EQ(concealer.Conceal(&p_data), sizeof(pcm));
+  EXPECT_EQ(reinterpret_cast<const int16_t*>(p_data)[0], 500);
+}
+
+TEST(BtifA2dpSinkConcealerTest, test_keeps_pcm_of_undecodable_packet) {
+  BtifA2dpSinkConcealer concealer;
+  int16_t pcm[2] = {800, 800};
+  concealer.BeginPacket();
+  concealer.Append(reinterpret_cast<uint8_t*>(pcm), sizeof(pcm));
+  // The next packet fails to decode
+  concealer.BeginPacket();
+
+  const uint8_t* p_data = nullptr;
+  ASSERT_EQ(concealer.Conceal(&p_data), sizeof(pcm));
+  EXPECT_EQ(reinterpret_cast<const int16_t*>(p_data)[0], 400);
+}
@@ -0,0 +1,261 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "btif/include/btif_a2dp_source_scheduler.h"
+
+namespace {
+constexpr uint64_t kIntervalMs = 20;
+constexpr uint64_t kStartUs = 1000000;
+// 48kHz, 16 bits per sample, stereo
+constexpr uint64_t kPcmBytesPerSec = 48000 * 2 * 2;
+// An encoder that can send one second of audio per tick
+constexpr uint64_t kMaxIntervalUs = 1000000;
+}  // namespace
+
+class BtifA2dpSourceSchedulerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    now_us_ = kStartUs;
+    feed_credit_ = 0;
+    // The audio HAL prefills one tick worth of data
+    queued_bytes_ = kPcmBytesPerSec * kIntervalMs / 1000;
+    requested_bytes_ = 0;
+    fixed_per_tick_ = false;
+  }
+
+  // Runs one tick at the current tick period. The audio HAL feeds data at
+  // |feed_ppm| from the nominal rate, and the encoder consumes the data
+  // covered by the media timestamp returned by the scheduler, or one nominal
+  // tick of data if |fixed_per_tick_| is set.
+  bool RunTick(int64_t feed_ppm, size_t tx_queue_length = 0,
+               uint64_t lateness_us = 0) {
+    uint64_t period_us = scheduler_.TickPeriodMs() * 1000;
+    now_us_ += period_us;
+    uint64_t tick_us = now_us_ + lateness_us;
+
+    // Data written by the audio HAL since the last tick
+    feed_credit_ += (int64_t)(period_us * kPcmBytesPerSec) *
+                    (1000000 + feed_ppm) / 1000000;
+    queued_bytes_ += feed_credit_ / 1000000;
+    feed_credit_ %= 1000000;
+
+    uint64_t media_us = scheduler_.BeginTick(tick_us, tx_queue_length,
+                                             queued_bytes_);
+    // The encoder carries the fractional bytes over to the next tick
+    uint64_t media_bytes = (media_us - kStartUs) * kPcmBytesPerSec / 1000000;
+    uint64_t wanted = media_bytes - requested_bytes_;
+    if (fixed_per_tick_) wanted = kPcmBytesPerSec * kIntervalMs / 1000;
+    uint64_t got = std::min<uint64_t>(wanted, queued_bytes_);
+    requested_bytes_ += wanted;
+    queued_bytes_ -= got;
+    scheduler_.OnFeedRead(wanted, got);
+    return scheduler_.EndTick(tick_us + 500);
+  }
+
+  BtifA2dpSourceScheduler scheduler_;
+  uint64_t now_us_;
+  int64_t feed_credit_;
+  uint64_t queued_bytes_;
+  uint64_t requested_bytes_;
+  bool fixed_per_tick_;
+};
+
+TEST(A2dpDurationHistogramTest, test_buckets) {
+  A2dpDurationHistogram histogram;
+  EXPECT_EQ(histogram.TotalCount(), 0u);
+  EXPECT_EQ(histogram.PercentileUpperBoundUs(50), 0u);
+
+  histogram.Add(0);
+  histogram.Add(124);
+  histogram.Add(125);
+  histogram.Add(300);
+  histogram.Add(100000000);
+
+  EXPECT_EQ(histogram.TotalCount(), 5u);
+  EXPECT_EQ(histogram.Count(0), 2u);
+  EXPECT_EQ(histogram.Count(1), 1u);
+  EXPECT_EQ(histogram.Count(2), 1u);
+  EXPECT_EQ(histogram.Count(A2dpDurationHistogram::kNumBuckets - 1), 1u);
+  EXPECT_EQ(histogram.MaxUs(), 100000000u);
+  EXPECT_EQ(histogram.PercentileUpperBoundUs(40), 125u);
+  EXPECT_EQ(histogram.PercentileUpperBoundUs(80), 500u);
+  EXPECT_EQ(histogram.PercentileUpperBoundUs(100), 100000000u);
+
+  A2dpDurationHistogram other;
+  other.Add(200);
+  histogram.Accumulate(other);
+  EXPECT_EQ(histogram.TotalCount(), 6u);
+  EXPECT_EQ(histogram.Count(1), 2u);
+
+  histogram.Reset();
+  EXPECT_EQ(histogram.TotalCount(), 0u);
+  EXPECT_EQ(histogram.MaxUs(), 0u);
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_no_drift) {
+  scheduler_.Start(kStartUs, kIntervalMs, 0);
+  for (int i = 0; i < 500; i++) EXPECT_FALSE(RunTick(0));
+  EXPECT_EQ(scheduler_.DriftPpm(), 0);
+  EXPECT_EQ(scheduler_.TickPeriodMs(), kIntervalMs);
+  EXPECT_EQ(scheduler_.TickJitterHistogram().TotalCount(), 500u);
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_fast_feed_drift_is_compensated) {
+  scheduler_.Start(kStartUs, kIntervalMs, 0);
+  for (int i = 0; i < 3000; i++) RunTick(400);
+  EXPECT_NEAR(scheduler_.DriftPpm(), 400, 50);
+
+  // Once compensated, the backlog stops growing
+  uint64_t queued_bytes = queued_bytes_;
+  for (int i = 0; i < 500; i++) RunTick(400);
+  EXPECT_LT(queued_bytes_, queued_bytes + kPcmBytesPerSec / 1000);
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_slow_feed_drift_is_compensated) {
+  scheduler_.Start(kStartUs, kIntervalMs, 0);
+  for (int i = 0; i < 3000; i++) RunTick(-300);
+  EXPECT_NEAR(scheduler_.DriftPpm(), -300, 50);
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_drift_is_bounded) {
+  scheduler_.Start(kStartUs, kIntervalMs, 0);
+  for (int i = 0; i < 5000; i++) RunTick(5000);
+  EXPECT_LE(scheduler_.DriftPpm(), BtifA2dpSourceScheduler::kMaxDriftPpm);
+  EXPECT_GT(scheduler_.DriftPpm(), 0);
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_coalescing_when_quiet) {
+  scheduler_.Start(kStartUs, kIntervalMs, kMaxIntervalUs);
+
+  bool changed = false;
+  size_t ticks = 0;
+  while (!changed && ticks < 1000) {
+    changed = RunTick(0);
+    ticks++;
+  }
+  EXPECT_TRUE(changed);
+  EXPECT_EQ(ticks, BtifA2dpSourceScheduler::kCoalesceAfterTicks);
+  EXPECT_TRUE(scheduler_.IsCoalescing());
+  EXPECT_EQ(scheduler_.TickPeriodMs(), kIntervalMs * 3 / 2);
+
+  // Stays coalesced while the system is quiet
+  for (int i = 0; i < 200; i++) EXPECT_FALSE(RunTick(0));
+  EXPECT_TRUE(scheduler_.IsCoalescing());
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_coalescing_exit_on_load) {
+  scheduler_.Start(kStartUs, kIntervalMs, kMaxIntervalUs);
+  for (size_t i = 0; i < BtifA2dpSourceScheduler::kCoalesceAfterTicks; i++)
+    RunTick(0);
+  ASSERT_TRUE(scheduler_.IsCoalescing());
+
+  // A growing transmit queue switches back to the nominal period
+  EXPECT_TRUE(RunTick(0, 3));
+  EXPECT_FALSE(scheduler_.IsCoalescing());
+  EXPECT_EQ(scheduler_.TickPeriodMs(), kIntervalMs);
+
+  // The next attempt to coalesce needs twice as many quiet ticks
+  for (size_t i = 0; i < BtifA2dpSourceScheduler::kCoalesceAfterTicks; i++)
+    EXPECT_FALSE(RunTick(0));
+  for (size_t i = 0; i < BtifA2dpSourceScheduler::kCoalesceAfterTicks - 1; i++)
+    EXPECT_FALSE(RunTick(0));
+  EXPECT_TRUE(RunTick(0));
+  EXPECT_TRUE(scheduler_.IsCoalescing());
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_coalescing_exit_on_late_tick) {
+  scheduler_.Start(kStartUs, kIntervalMs, kMaxIntervalUs);
+  for (size_t i = 0; i < BtifA2dpSourceScheduler::kCoalesceAfterTicks; i++)
+    RunTick(0);
+  ASSERT_TRUE(scheduler_.IsCoalescing());
+
+  EXPECT_TRUE(RunTick(0, 0, kIntervalMs * 1000));
+  EXPECT_FALSE(scheduler_.IsCoalescing());
+  EXPECT_GT(scheduler_.TickJitterHistogram().MaxUs(), kIntervalMs * 1000 / 2);
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_coalescing_disabled) {
+  scheduler_.Start(kStartUs, kIntervalMs, 0);
+  for (int i = 0; i < 1000; i++) EXPECT_FALSE(RunTick(0));
+  EXPECT_FALSE(scheduler_.IsCoalescing());
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_coalesced_period_bounded_by_encoder) {
+  // SBC at 48 kHz: 14 frames of 128 samples per tick at most
+  scheduler_.Start(kStartUs, kIntervalMs, 14 * 128 * 1000000 / 48000);
+  for (size_t i = 0; i < BtifA2dpSourceScheduler::kCoalesceAfterTicks; i++)
+    RunTick(0);
+  ASSERT_TRUE(scheduler_.IsCoalescing());
+  // Half a nominal tick of margin left below the 37.3 ms limit
+  EXPECT_EQ(scheduler_.TickPeriodMs(), 27u);
+
+  // Too little room for a margin: not coalesced at all
+  scheduler_.Reset();
+  scheduler_.Start(now_us_, kIntervalMs, 9 * 128 * 1000000 / 48000);
+  for (int i = 0; i < 1000; i++) EXPECT_FALSE(RunTick(0));
+  EXPECT_FALSE(scheduler_.IsCoalescing());
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_can_coalesce_ticks) {
+  tA2DP_ENCODER_INTERFACE encoder_interface = {};
+  encoder_interface.send_frames_uses_timestamp = true;
+  EXPECT_FALSE(BtifA2dpSourceScheduler::CanCoalesceTicks(&encoder_interface));
+  encoder_interface.get_max_send_interval_us = [] { return kMaxIntervalUs; };
+  EXPECT_TRUE(BtifA2dpSourceScheduler::CanCoalesceTicks(&encoder_interface));
+  encoder_interface.send_frames_uses_timestamp = false;
+  EXPECT_FALSE(BtifA2dpSourceScheduler::CanCoalesceTicks(&encoder_interface));
+  EXPECT_FALSE(BtifA2dpSourceScheduler::CanCoalesceTicks(nullptr));
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_fixed_per_tick_encoder) {
+  // Like the aptX encoders, send_frames() ignores the timestamp
+  tA2DP_ENCODER_INTERFACE encoder_interface = {};
+  encoder_interface.send_frames_uses_timestamp = false;
+  fixed_per_tick_ = true;
+
+  scheduler_.Start(
+      kStartUs, kIntervalMs,
+      BtifA2dpSourceScheduler::CanCoalesceTicks(&encoder_interface)
+          ? kMaxIntervalUs
+          : 0);
+  uint64_t queued_bytes = queued_bytes_;
+  for (int i = 0; i < 1000; i++) EXPECT_FALSE(RunTick(0));
+  EXPECT_FALSE(scheduler_.IsCoalescing());
+
+  // The encoder keeps up with the audio HAL
+  EXPECT_EQ(queued_bytes_, queued_bytes);
+}
+
+TEST_F(BtifA2dpSourceSchedulerTest, test_fixed_per_tick_encoder_coalesced) {
+  fixed_per_tick_ = true;
+  scheduler_.Start(kStartUs, kIntervalMs, kMaxIntervalUs);
+  for (size_t i = 0; i < BtifA2dpSourceScheduler::kCoalesceAfterTicks; i++)
+    RunTick(0);
+  ASSERT_TRUE(scheduler_.IsCoalescing());
+
+  // Each coalesced tick leaves half a nominal tick of audio behind, which
+  // the sink never gets
+  uint64_t queued_bytes = queued_bytes_;
+  for (int i = 0; i < 100; i++) RunTick(0);
+  EXPECT_EQ(queued_bytes_ - queued_bytes,
+            100 * kPcmBytesPerSec * kIntervalMs / 1000 / 2);
+}
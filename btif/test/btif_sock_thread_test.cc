@@ -0,0 +1,248 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "btif/include/btif_sock_thread.h"
+#include "bt_trace.h"
+
+uint8_t appl_trace_level = 0;
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+constexpr int kType = 1;
+constexpr auto kTimeout = std::chrono::seconds(5);
+
+// Signals received by the poll thread callbacks
+std::mutex signals_lock;
+std::condition_variable signals_cv;
+std::map<int, int> signaled_flags;
+int num_signals;
+std::vector<int> commands;
+
+void signaled_cb(int fd, int type, int flags, uint32_t user_id) {
+  std::lock_guard<std::mutex> lock(signals_lock);
+  EXPECT_EQ(type, kType);
+  EXPECT_EQ(user_id, (uint32_t)fd);
+  signaled_flags[fd] |= flags;
+  num_signals++;
+  signals_cv.notify_all();
+}
+
+void cmd_cb(int cmd_fd, int type, int size, uint32_t user_id) {
+  std::vector<char> data(size);
+  EXPECT_EQ(recv(cmd_fd, data.data(), size, MSG_WAITALL), size);
+  std::lock_guard<std::mutex> lock(signals_lock);
+  commands.push_back(type);
+  signals_cv.notify_all();
+}
+
+bool wait_for_signals(int count) {
+  std::unique_lock<std::mutex> lock(signals_lock);
+  return signals_cv.wait_for(lock, kTimeout,
+                             [count] { return num_signals >= count; });
+}
+
+class BtifSockThreadTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    signaled_flags.clear();
+    num_signals = 0;
+    commands.clear();
+    btsock_thread_init();
+    handle_ = btsock_thread_create(signaled_cb, cmd_cb);
+    ASSERT_GE(handle_, 0);
+  }
+
+  void TearDown() override {
+    EXPECT_TRUE(btsock_thread_exit(handle_));
+    for (int fd : fds_) close(fd);
+  }
+
+  // Returns the end monitored by the thread, |peer| is set to the other one
+  int create_socket(int* peer) {
+    int fds[2];
+    EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    fds_.push_back(fds[1]);
+    *peer = fds[1];
+    return fds[0];
+  }
+
+  void add_fd(int fd, int flags) {
+    ASSERT_TRUE(btsock_thread_add_fd(handle_, fd, kType, flags, fd));
+  }
+
+  int signaled(int fd) {
+    std::lock_guard<std::mutex> lock(signals_lock);
+    return signaled_flags[fd];
+  }
+
+  btsock_fd_stats_t stats(int fd) {
+    btsock_fd_stats_t stats = {};
+    EXPECT_TRUE(btsock_thread_get_fd_stats(handle_, fd, &stats));
+    return stats;
+  }
+
+  int handle_;
+  std::vector<int> fds_;
+};
+
+}  // namespace
+
+TEST_F(BtifSockThreadTest, test_more_fds_than_poll_slots) {
+  std::vector<int> fds(200);
+  for (int& fd : fds) {
+    int peer;
+    fd = create_socket(&peer);
+    fds_.push_back(fd);
+    add_fd(fd, SOCK_THREAD_FD_RD);
+    ASSERT_EQ(write(peer, "x", 1), 1);
+  }
+  ASSERT_TRUE(wait_for_signals(fds.size()));
+  for (int fd : fds) {
+    EXPECT_EQ(signaled(fd), SOCK_THREAD_FD_RD);
+    EXPECT_EQ(stats(fd).rd_count, 1u);
+  }
+}
+
+TEST_F(BtifSockThreadTest, test_read_signaled_once_until_added) {
+  int peer;
+  int fd = create_socket(&peer);
+  fds_.push_back(fd);
+  add_fd(fd, SOCK_THREAD_FD_RD);
+  ASSERT_EQ(write(peer, "x", 1), 1);
+  ASSERT_TRUE(wait_for_signals(1));
+
+  // Not signaled again for more data until it is added again
+  ASSERT_EQ(write(peer, "y", 1), 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(stats(fd).rd_count, 1u);
+
+  // The data left is reported once added again
+  add_fd(fd, SOCK_THREAD_FD_RD | SOCK_THREAD_ADD_FD_SYNC);
+  ASSERT_TRUE(wait_for_signals(2));
+  EXPECT_EQ(stats(fd).rd_count, 2u);
+}
+
+TEST_F(BtifSockThreadTest, test_write_and_exception) {
+  int peer;
+  int fd = create_socket(&peer);
+  fds_.push_back(fd);
+
+  // Writable right away, the read flag stays monitored
+  add_fd(fd, SOCK_THREAD_FD_RD | SOCK_THREAD_FD_WR);
+  ASSERT_TRUE(wait_for_signals(1));
+  EXPECT_EQ(signaled(fd), SOCK_THREAD_FD_WR);
+
+  ASSERT_EQ(write(peer, "x", 1), 1);
+  ASSERT_TRUE(wait_for_signals(2));
+  EXPECT_EQ(signaled(fd), SOCK_THREAD_FD_WR | SOCK_THREAD_FD_RD);
+
+  // The peer closing is reported to the exception only monitor
+  add_fd(fd, SOCK_THREAD_FD_EXCEPTION);
+  fds_.erase(std::find(fds_.begin(), fds_.end(), peer));
+  close(peer);
+  ASSERT_TRUE(wait_for_signals(3));
+  EXPECT_TRUE(signaled(fd) & SOCK_THREAD_FD_EXCEPTION);
+
+  btsock_fd_stats_t fd_stats = stats(fd);
+  EXPECT_EQ(fd_stats.rd_count, 1u);
+  EXPECT_EQ(fd_stats.wr_count, 1u);
+  EXPECT_EQ(fd_stats.exception_count, 1u);
+}
+
+TEST_F(BtifSockThreadTest, test_remove_fd_and_close) {
+  int peer;
+  int fd = create_socket(&peer);
+  add_fd(fd, SOCK_THREAD_FD_RD);
+  ASSERT_TRUE(btsock_thread_remove_fd_and_close(handle_, fd));
+
+  // Commands are run in order: the fd is closed once the user command is run
+  const unsigned char data[] = {1, 2, 3};
+  ASSERT_TRUE(btsock_thread_post_cmd(handle_, 7, data, sizeof(data), 0));
+  {
+    std::unique_lock<std::mutex> lock(signals_lock);
+    ASSERT_TRUE(signals_cv.wait_for(lock, kTimeout,
+                                    [] { return !commands.empty(); }));
+    EXPECT_EQ(commands[0], 7);
+  }
+  btsock_fd_stats_t fd_stats;
+  EXPECT_FALSE(btsock_thread_get_fd_stats(handle_, fd, &fd_stats));
+  EXPECT_EQ(send(peer, "x", 1, MSG_NOSIGNAL), -1);
+  EXPECT_EQ(num_signals, 0);
+}
+
+TEST_F(BtifSockThreadTest, test_closed_fd_number_reused) {
+  int peer;
+  int fd = create_socket(&peer);
+  add_fd(fd, SOCK_THREAD_FD_RD);
+  ASSERT_EQ(write(peer, "x", 1), 1);
+  ASSERT_TRUE(wait_for_signals(1));
+  EXPECT_EQ(stats(fd).rd_count, 1u);
+
+  // Closed by the caller without being removed
+  fds_.erase(std::find(fds_.begin(), fds_.end(), peer));
+  close(peer);
+  close(fd);
+  btsock_fd_stats_t fd_stats;
+  EXPECT_FALSE(btsock_thread_get_fd_stats(handle_, fd, &fd_stats));
+
+  // A new socket with the same fd number does not get the old counters
+  int old_fd = fd;
+  fd = create_socket(&peer);
+  fds_.push_back(fd);
+  ASSERT_EQ(fd, old_fd);
+  add_fd(fd, SOCK_THREAD_FD_RD);
+  EXPECT_EQ(stats(fd).rd_count, 0u);
+  ASSERT_EQ(write(peer, "x", 1), 1);
+  ASSERT_TRUE(wait_for_signals(2));
+  EXPECT_EQ(stats(fd).rd_count, 1u);
+}
+
+TEST_F(BtifSockThreadTest, test_closed_fd_reused_before_stats) {
+  int peer;
+  int fd = create_socket(&peer);
+  add_fd(fd, SOCK_THREAD_FD_RD);
+  ASSERT_EQ(write(peer, "x", 1), 1);
+  ASSERT_TRUE(wait_for_signals(1));
+
+  // The number is reused before the slot is looked at again
+  fds_.erase(std::find(fds_.begin(), fds_.end(), peer));
+  close(peer);
+  close(fd);
+  int old_fd = fd;
+  fd = create_socket(&peer);
+  fds_.push_back(fd);
+  ASSERT_EQ(fd, old_fd);
+  add_fd(fd, SOCK_THREAD_FD_RD);
+  ASSERT_EQ(write(peer, "x", 1), 1);
+  ASSERT_TRUE(wait_for_signals(2));
+  EXPECT_EQ(stats(fd).rd_count, 1u);
+}
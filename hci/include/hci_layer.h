@@ -95,3 +95,6 @@ void post_to_hci_message_loop(const tracked_objects::Location& from_here,
                               BT_HDR* p_msg);
 
 void hci_layer_cleanup_interface();
+
+// Dumps the HCI layer statistics to the |fd| file descriptor.
+void hci_layer_debug_dump(int fd);
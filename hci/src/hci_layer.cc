@@ -26,13 +26,16 @@
 #include <base/sequenced_task_runner.h>
 #include <base/threading/thread.h>
 
+#include <inttypes.h>
 #include <signal.h>
 #include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <chrono>
+#include <map>
 #include <mutex>
+#include <unordered_map>
 
 #include "btcore/include/module.h"
 #include "btsnoop.h"
@@ -42,7 +45,7 @@
 #include "hcidefs.h"
 #include "hcimsgs.h"
 #include "osi/include/alarm.h"
-#include "osi/include/list.h"
+#include "osi/include/latency_trace.h"
 #include "osi/include/log.h"
 #include "osi/include/properties.h"
 #include "osi/include/reactor.h"
@@ -56,10 +59,11 @@ extern void hci_close();
 extern int hci_open_firmware_log_file();
 extern void hci_close_firmware_log_file(int fd);
 extern void hci_log_firmware_debug_packet(int fd, BT_HDR* packet);
+extern void hci_transport_debug_dump(int fd);
 
 static int hci_firmware_log_fd = INVALID_FD;
 
-typedef struct {
+typedef struct waiting_command_t {
   uint16_t opcode;
   future_t* complete_future;
   command_complete_cb complete_callback;
@@ -67,8 +71,32 @@ typedef struct {
   void* context;
   BT_HDR* command;
   std::chrono::time_point<std::chrono::steady_clock> timestamp;
+  // Links of the pending command list, in send order
+  struct waiting_command_t* prev;
+  struct waiting_command_t* next;
+  // Next pending command with the same opcode, in send order
+  struct waiting_command_t* next_same_opcode;
+  uint64_t sequence;
 } waiting_command_t;
 
+// Pending commands with the same opcode, oldest first
+typedef struct {
+  waiting_command_t* head;
+  waiting_command_t* tail;
+} pending_opcode_t;
+
+// Buckets of the command latency histograms: below 250 us, then doubling
+#define COMMAND_LATENCY_BUCKETS 10
+#define COMMAND_LATENCY_FIRST_BUCKET_US 250
+
+// Latency from sending a command to its Command Complete or Command Status
+typedef struct {
+  uint64_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+  uint64_t buckets[COMMAND_LATENCY_BUCKETS];
+} command_latency_t;
+
 // Using a define here, because it can be stringified for the property lookup
 #define DEFAULT_STARTUP_TIMEOUT_MS 8000
 #define STRING_VALUE_OF(x) #x
@@ -101,12 +129,25 @@ static alarm_t* startup_timer;
 
 // Outbound-related
 static int command_credits = 1;
+// Commands posted to the message loop, not yet pending response
+static int commands_in_transit;
 static std::mutex command_credits_mutex;
 static std::queue<base::Closure> command_queue;
 
 // Inbound-related
 static alarm_t* command_response_timer;
-static list_t* commands_pending_response;
+// Commands pending response in send order, and indexed by opcode
+static waiting_command_t* commands_pending_head;
+static waiting_command_t* commands_pending_tail;
+static size_t num_commands_pending;
+static size_t num_vendor_commands_pending;
+static std::unordered_map<command_opcode_t, pending_opcode_t>
+    commands_pending_by_opcode;
+static uint64_t next_command_sequence;
+// Sequence number of the command the response timer is set for, 0 if none
+static uint64_t command_response_timer_sequence;
+static std::unordered_map<command_opcode_t, command_latency_t>
+    command_latencies;
 static std::recursive_timed_mutex commands_pending_response_mutex;
 static alarm_t* hci_timeout_abort_timer;
 
@@ -115,8 +156,11 @@ static base::Callback<void(const tracked_objects::Location&, BT_HDR*)>
     send_data_upwards;
 
 static bool filter_incoming_event(BT_HDR* packet);
+static void add_waiting_command(waiting_command_t* wait_entry);
 static waiting_command_t* get_waiting_command(command_opcode_t opcode);
 static int get_num_waiting_commands();
+static void clear_waiting_commands();
+static void record_command_latency(const waiting_command_t* wait_entry);
 
 static void event_finish_startup(void* context);
 static void startup_timer_expired(void* context);
@@ -154,6 +198,7 @@ void hci_event_received(const tracked_objects::Location& from_here,
 
 void acl_event_received(BT_HDR* packet) {
   btsnoop->capture(packet, true);
+  LATENCY_TRACE_MARK(packet, LATENCY_HCI_RX);
   packet_fragmenter->reassemble_and_dispatch(packet);
 }
 
@@ -194,6 +239,7 @@ static future_t* hci_module_start_up(void) {
   // This value can change when you get a command complete or command status
   // event.
   command_credits = 1;
+  commands_in_transit = 0;
 
   // For now, always use the default timeout on non-Android builds.
   period_ms_t startup_timeout_ms = DEFAULT_STARTUP_TIMEOUT_MS;
@@ -226,12 +272,11 @@ static future_t* hci_module_start_up(void) {
     LOG_ERROR(LOG_TAG, "%s unable to make thread RT.", __func__);
   }
 
-  commands_pending_response = list_new(NULL);
-  if (!commands_pending_response) {
-    LOG_ERROR(LOG_TAG,
-              "%s unable to create list for commands pending response.",
-              __func__);
-    goto error;
+  {
+    std::lock_guard<std::recursive_timed_mutex> lock(
+        commands_pending_response_mutex);
+    clear_waiting_commands();
+    command_latencies.clear();
   }
 
   // Make sure we run in a bounded amount of time
@@ -282,8 +327,7 @@ static future_t* hci_module_shut_down() {
   {
     std::lock_guard<std::recursive_timed_mutex> lock(
         commands_pending_response_mutex);
-    list_free(commands_pending_response);
-    commands_pending_response = NULL;
+    clear_waiting_commands();
   }
 
   packet_fragmenter->cleanup();
@@ -414,6 +458,7 @@ static void enqueue_command(waiting_command_t* wait_entry) {
     }
     message_loop_->task_runner()->PostTask(FROM_HERE, std::move(callback));
     command_credits--;
+    commands_in_transit++;
   } else {
     command_queue.push(std::move(callback));
   }
@@ -425,7 +470,11 @@ static void event_command_ready(waiting_command_t* wait_entry) {
     std::lock_guard<std::recursive_timed_mutex> lock(
         commands_pending_response_mutex);
     wait_entry->timestamp = std::chrono::steady_clock::now();
-    list_append(commands_pending_response, wait_entry);
+    add_waiting_command(wait_entry);
+  }
+  {
+    std::lock_guard<std::mutex> command_credits_lock(command_credits_mutex);
+    commands_in_transit--;
   }
   // Send it off
   packet_fragmenter->fragment_and_dispatch(wait_entry->command);
@@ -494,11 +543,8 @@ static void command_timed_out_log_info(void* original_wait_entry) {
   LOG_ERROR(LOG_TAG, "%s: %d commands pending response", __func__,
             get_num_waiting_commands());
 
-  for (const list_node_t* node = list_begin(commands_pending_response);
-       node != list_end(commands_pending_response); node = list_next(node)) {
-    waiting_command_t* wait_entry =
-        reinterpret_cast<waiting_command_t*>(list_node(node));
-
+  for (waiting_command_t* wait_entry = commands_pending_head;
+       wait_entry != NULL; wait_entry = wait_entry->next) {
     int wait_time_ms =
         std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::steady_clock::now() - wait_entry->timestamp)
@@ -583,14 +629,17 @@ void process_command_credits(int credits) {
     return;
   }
 
-  // Subtract commands in flight.
-  command_credits = credits - get_num_waiting_commands();
+  // Subtract commands in flight, including the ones already granted a
+  // credit but not sent yet.
+  command_credits =
+      credits - get_num_waiting_commands() - commands_in_transit;
 
   while (command_credits > 0 && command_queue.size() > 0) {
     message_loop_->task_runner()->PostTask(FROM_HERE,
                                            std::move(command_queue.front()));
     command_queue.pop();
     command_credits--;
+    commands_in_transit++;
   }
 }
 
@@ -612,6 +661,7 @@ static bool filter_incoming_event(BT_HDR* packet) {
     STREAM_TO_UINT16(opcode, stream);
 
     wait_entry = get_waiting_command(opcode);
+    if (wait_entry) record_command_latency(wait_entry);
 
     process_command_credits(credits);
 
@@ -641,6 +691,7 @@ static bool filter_incoming_event(BT_HDR* packet) {
     // If a command generates a command status event, it won't be getting a
     // command complete event
     wait_entry = get_waiting_command(opcode);
+    if (wait_entry) record_command_latency(wait_entry);
 
     process_command_credits(credits);
 
@@ -695,53 +746,133 @@ static void dispatch_reassembled(BT_HDR* packet) {
   CHECK((packet->event & MSG_EVT_MASK) != MSG_HC_TO_STACK_HCI_EVT);
   CHECK(!send_data_upwards.is_null());
 
+  LATENCY_TRACE_MARK(packet, LATENCY_REASSEMBLED);
   send_data_upwards.Run(FROM_HERE, packet);
 }
 
 // Misc internal functions
 
+static bool is_vendor_specific(command_opcode_t opcode) {
+  return (opcode & HCI_GRP_VENDOR_SPECIFIC) == HCI_GRP_VENDOR_SPECIFIC;
+}
+
+// Must be called with commands_pending_response_mutex held.
+static void add_waiting_command(waiting_command_t* wait_entry) {
+  wait_entry->sequence = ++next_command_sequence;
+  wait_entry->next = NULL;
+  wait_entry->next_same_opcode = NULL;
+  wait_entry->prev = commands_pending_tail;
+  if (commands_pending_tail != NULL)
+    commands_pending_tail->next = wait_entry;
+  else
+    commands_pending_head = wait_entry;
+  commands_pending_tail = wait_entry;
+
+  pending_opcode_t& pending = commands_pending_by_opcode[wait_entry->opcode];
+  if (pending.tail != NULL)
+    pending.tail->next_same_opcode = wait_entry;
+  else
+    pending.head = wait_entry;
+  pending.tail = wait_entry;
+
+  num_commands_pending++;
+  if (is_vendor_specific(wait_entry->opcode)) num_vendor_commands_pending++;
+}
+
+// Removes |wait_entry|, the oldest pending command with its opcode.
+// Must be called with commands_pending_response_mutex held.
+static void remove_waiting_command(waiting_command_t* wait_entry) {
+  auto it = commands_pending_by_opcode.find(wait_entry->opcode);
+  CHECK(it != commands_pending_by_opcode.end() &&
+        it->second.head == wait_entry);
+  it->second.head = wait_entry->next_same_opcode;
+  if (it->second.head == NULL) commands_pending_by_opcode.erase(it);
+
+  if (wait_entry->prev != NULL)
+    wait_entry->prev->next = wait_entry->next;
+  else
+    commands_pending_head = wait_entry->next;
+  if (wait_entry->next != NULL)
+    wait_entry->next->prev = wait_entry->prev;
+  else
+    commands_pending_tail = wait_entry->prev;
+
+  num_commands_pending--;
+  if (is_vendor_specific(wait_entry->opcode)) num_vendor_commands_pending--;
+}
+
 static waiting_command_t* get_waiting_command(command_opcode_t opcode) {
   std::lock_guard<std::recursive_timed_mutex> lock(
       commands_pending_response_mutex);
 
-  for (const list_node_t* node = list_begin(commands_pending_response);
-       node != list_end(commands_pending_response); node = list_next(node)) {
-    waiting_command_t* wait_entry =
-        reinterpret_cast<waiting_command_t*>(list_node(node));
-
-    if (!wait_entry || wait_entry->opcode != opcode) continue;
-
-    list_remove(commands_pending_response, wait_entry);
-
-    return wait_entry;
+  waiting_command_t* wait_entry = NULL;
+  auto it = commands_pending_by_opcode.find(opcode);
+  if (it != commands_pending_by_opcode.end()) {
+    wait_entry = it->second.head;
+  } else if (is_vendor_specific(opcode) && num_vendor_commands_pending > 0) {
+    // look for any command complete with improper VS Opcode
+    for (wait_entry = commands_pending_head; wait_entry != NULL;
+         wait_entry = wait_entry->next) {
+      if (is_vendor_specific(wait_entry->opcode)) break;
+    }
+    LOG_DEBUG(LOG_TAG, "%s VS event found treat it as valid 0x%x", __func__,
+              opcode);
   }
-  // look for any command complete with improper VS Opcode
-  for (const list_node_t *node = list_begin(commands_pending_response);
-      node != list_end(commands_pending_response);
-      node = list_next(node)) {
-    waiting_command_t *wait_entry =
-        reinterpret_cast<waiting_command_t*> (list_node(node));
 
-    if (wait_entry && (wait_entry->opcode != opcode) &&
-        (((wait_entry->opcode & HCI_GRP_VENDOR_SPECIFIC) == HCI_GRP_VENDOR_SPECIFIC) &&
-        ((opcode & HCI_GRP_VENDOR_SPECIFIC) == HCI_GRP_VENDOR_SPECIFIC))) {
-        LOG_DEBUG(LOG_TAG,"%s VS event found treat it as valid 0x%x", __func__, opcode);
-    }
-    else {
-        continue;
-    }
+  if (wait_entry != NULL) remove_waiting_command(wait_entry);
+  return wait_entry;
+}
 
-    list_remove(commands_pending_response, wait_entry);
+static int get_num_waiting_commands() {
+  std::lock_guard<std::recursive_timed_mutex> lock(
+      commands_pending_response_mutex);
+  return num_commands_pending;
+}
 
-    return wait_entry;
-  }
-  return NULL;
+// Forgets all the pending commands, without freeing them.
+// Must be called with commands_pending_response_mutex held.
+static void clear_waiting_commands() {
+  commands_pending_head = NULL;
+  commands_pending_tail = NULL;
+  num_commands_pending = 0;
+  num_vendor_commands_pending = 0;
+  commands_pending_by_opcode.clear();
+  command_response_timer_sequence = 0;
 }
 
-static int get_num_waiting_commands() {
+static void record_command_latency(const waiting_command_t* wait_entry) {
+  uint64_t latency_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - wait_entry->timestamp)
+          .count();
+
+  size_t bucket = 0;
+  for (uint64_t bound_us = COMMAND_LATENCY_FIRST_BUCKET_US;
+       bucket < COMMAND_LATENCY_BUCKETS - 1 && latency_us >= bound_us;
+       bound_us <<= 1)
+    bucket++;
+
   std::lock_guard<std::recursive_timed_mutex> lock(
       commands_pending_response_mutex);
-  return list_length(commands_pending_response);
+  command_latency_t& latency = command_latencies[wait_entry->opcode];
+  latency.count++;
+  latency.total_us += latency_us;
+  latency.max_us = std::max(latency.max_us, latency_us);
+  latency.buckets[bucket]++;
+}
+
+// Returns the upper bound in us of the bucket reaching |percent|% of the
+// samples of |latency|.
+static uint64_t command_latency_percentile_us(const command_latency_t& latency,
+                                              unsigned percent) {
+  uint64_t threshold = (latency.count * percent + 99) / 100;
+  uint64_t cumulative = 0;
+  uint64_t bound_us = COMMAND_LATENCY_FIRST_BUCKET_US;
+  for (size_t i = 0; i < COMMAND_LATENCY_BUCKETS - 1; i++, bound_us <<= 1) {
+    cumulative += latency.buckets[i];
+    if (cumulative >= threshold) return bound_us;
+  }
+  return latency.max_us;
 }
 
 static void update_command_response_timer(void) {
@@ -749,11 +880,15 @@ static void update_command_response_timer(void) {
       commands_pending_response_mutex);
 
   if (command_response_timer == NULL) return;
-  if (list_is_empty(commands_pending_response)) {
+  if (commands_pending_head == NULL) {
     alarm_cancel(command_response_timer);
-  } else {
+    command_response_timer_sequence = 0;
+  } else if (commands_pending_head->sequence !=
+             command_response_timer_sequence) {
+    // Only re-arm when the oldest command changed
     alarm_set(command_response_timer, COMMAND_PENDING_TIMEOUT_MS,
-              command_timed_out, list_front(commands_pending_response));
+              command_timed_out, commands_pending_head);
+    command_response_timer_sequence = commands_pending_head->sequence;
   }
 }
 
@@ -782,6 +917,35 @@ void hci_layer_cleanup_interface() {
   }
 }
 
+void hci_layer_debug_dump(int fd) {
+  {
+    std::lock_guard<std::recursive_timed_mutex> lock(
+        commands_pending_response_mutex);
+    // Sorted by opcode
+    std::map<command_opcode_t, command_latency_t> latencies(
+        command_latencies.begin(), command_latencies.end());
+
+    dprintf(fd, "\nHCI Commands:\n");
+    dprintf(fd,
+            "  Commands pending response                               : "
+            "%zu\n",
+            num_commands_pending);
+    dprintf(fd, "  Latency in us per opcode (count/avg/p50/p99/max)\n");
+    for (const auto& entry : latencies) {
+      const command_latency_t& latency = entry.second;
+      dprintf(fd,
+              "    0x%04x                                              : "
+              "%" PRIu64 " / %" PRIu64 " / %" PRIu64 " / %" PRIu64
+              " / %" PRIu64 "\n",
+              entry.first, latency.count, latency.total_us / latency.count,
+              command_latency_percentile_us(latency, 50),
+              command_latency_percentile_us(latency, 99), latency.max_us);
+    }
+  }
+
+  hci_transport_debug_dump(fd);
+}
+
 const hci_t* hci_layer_get_interface() {
   buffer_allocator = buffer_allocator_get_interface();
   btsnoop = btsnoop_get_interface();
@@ -168,3 +168,5 @@ void hci_close_firmware_log_file(int fd) {
 void hci_log_firmware_debug_packet(int fd, BT_HDR* packet) {
   TEMP_FAILURE_RETRY(write(fd, packet->data, packet->len));
 }
+
+void hci_transport_debug_dump(int fd) {}
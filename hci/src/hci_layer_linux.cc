@@ -23,15 +23,19 @@
 #include <base/threading/thread.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <poll.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <algorithm>
+#include <atomic>
 
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "buffer_allocator.h"
 #include "hci_internals.h"
@@ -57,6 +61,16 @@ using base::Thread;
 #define MGMT_EV_SIZE_MAX 1024
 #define MGMT_EV_POLL_TIMEOUT 3000 /* 3000ms */
 
+/* Default size of the reader slots, the size of the buffer packets were read
+ * into one at a time: larger than any frame the kernel delivers */
+#define HCI_READ_SLOT_SIZE 2000
+/* Largest HCI packet: an ACL packet with a 16 bits data length */
+#define HCI_MAX_PACKET_SIZE (0xFFFF + HCI_ACL_PREAMBLE_SIZE)
+/* Number of packets read per recvmmsg() call */
+#define HCI_READ_BATCH_SIZE 16
+/* Number of buckets of the packets per wakeup histogram: 0-1, 2, 3-4, ... */
+#define HCI_READ_HISTOGRAM_BUCKETS 6
+
 struct sockaddr_hci {
   sa_family_t hci_family;
   unsigned short hci_dev;
@@ -107,62 +121,213 @@ static int rfkill(int block);
 int reader_thread_ctrl_fd = -1;
 Thread* reader_thread = NULL;
 
+/* Reader statistics, updated by the reader thread only and read by the dump */
+typedef struct {
+  std::atomic<uint64_t> wakeups;
+  std::atomic<uint64_t> read_calls;
+  std::atomic<uint64_t> packets;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> copied_packets;
+  std::atomic<uint64_t> truncated_packets;
+  std::atomic<uint64_t> max_packets_per_wakeup;
+  std::atomic<uint64_t> packets_per_wakeup[HCI_READ_HISTOGRAM_BUCKETS];
+} hci_reader_stats_t;
+
+static hci_reader_stats_t reader_stats;
+
+/* There is a single writer, the counters don't need atomic increments */
+static inline void reader_stats_add(std::atomic<uint64_t>& counter,
+                                    uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+/* A reader slot: one packet type octet and a BT_HDR receiving the packet */
+typedef struct {
+  uint8_t type;
+  BT_HDR* packet;
+  size_t capacity;
+} hci_read_slot_t;
+
+static void dispatch_packet(uint8_t type, BT_HDR* packet) {
+  switch (type) {
+    case HCI_PACKET_TYPE_COMMAND:
+      packet->event = MSG_HC_TO_STACK_HCI_EVT;
+      hci_event_received(FROM_HERE, packet);
+      break;
+    case HCI_PACKET_TYPE_ACL_DATA:
+      packet->event = MSG_HC_TO_STACK_HCI_ACL;
+      acl_event_received(packet);
+      break;
+    case HCI_PACKET_TYPE_SCO_DATA:
+      packet->event = MSG_HC_TO_STACK_HCI_SCO;
+      sco_data_received(packet);
+      break;
+    case HCI_PACKET_TYPE_EVENT:
+      packet->event = MSG_HC_TO_STACK_HCI_EVT;
+      hci_event_received(FROM_HERE, packet);
+      break;
+    default:
+      LOG(FATAL) << "Unexpected event type: " << +type;
+      break;
+  }
+}
+
+static const char* histogram_labels[HCI_READ_HISTOGRAM_BUCKETS] = {
+    "0-1 packets", "2 packets",    "3-4 packets",
+    "5-8 packets", "9-16 packets", "17+ packets"};
+
+static void add_packets_per_wakeup(uint64_t count) {
+  size_t bucket = 0;
+  for (uint64_t bound = 1;
+       bucket < HCI_READ_HISTOGRAM_BUCKETS - 1 && count > bound; bound <<= 1)
+    bucket++;
+  reader_stats_add(reader_stats.packets_per_wakeup[bucket], 1);
+  if (count > reader_stats.max_packets_per_wakeup.load(
+                  std::memory_order_relaxed))
+    reader_stats.max_packets_per_wakeup.store(count,
+                                              std::memory_order_relaxed);
+}
+
+/* Returns the size of the reader slots: the largest packet the controller may
+ * send, which can be raised for controllers with a large LE data length. */
+static size_t get_read_slot_size() {
+  char prop_value[PROPERTY_VALUE_MAX];
+  osi_property_get("bluetooth.hci.max_packet_size", prop_value, "0");
+  size_t size = strtoul(prop_value, NULL, 10);
+  return std::min(std::max(size, (size_t)HCI_READ_SLOT_SIZE),
+                  (size_t)HCI_MAX_PACKET_SIZE);
+}
+
+/* Reads all the packets available on |fd| in batches, and sends them up.
+ * Small packets are copied into buffers sized to the packet, the slot buffers
+ * are reused. Large packets are sent up in their slot buffer.
+ * Returns the number of packets read, or -1 if |fd| failed. */
+static ssize_t read_packets(int fd, hci_read_slot_t* slots, size_t* slot_size) {
+  const allocator_t* buffer_allocator = buffer_allocator_get_interface();
+  struct mmsghdr msgs[HCI_READ_BATCH_SIZE];
+  struct iovec iovs[HCI_READ_BATCH_SIZE][2];
+  ssize_t total = 0;
+
+  while (true) {
+    for (size_t i = 0; i < HCI_READ_BATCH_SIZE; i++) {
+      hci_read_slot_t* slot = &slots[i];
+      if (slot->packet == NULL || slot->capacity < *slot_size) {
+        if (slot->packet != NULL) buffer_allocator->free(slot->packet);
+        slot->packet = reinterpret_cast<BT_HDR*>(
+            buffer_allocator->alloc(BT_HDR_SIZE + *slot_size));
+        slot->capacity = *slot_size;
+      }
+      iovs[i][0].iov_base = &slot->type;
+      iovs[i][0].iov_len = 1;
+      iovs[i][1].iov_base = slot->packet->data;
+      iovs[i][1].iov_len = slot->capacity;
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_iov = iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    int n;
+    OSI_NO_INTR(n = recvmmsg(fd, msgs, HCI_READ_BATCH_SIZE, MSG_DONTWAIT,
+                             NULL));
+    reader_stats_add(reader_stats.read_calls, 1);
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return total;
+      LOG(ERROR) << __func__ << ": unable to read: " << strerror(errno);
+      return -1;
+    }
+    if (n == 0) return -1;
+
+    for (int i = 0; i < n; i++) {
+      hci_read_slot_t* slot = &slots[i];
+      size_t len = msgs[i].msg_len;
+      if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        reader_stats_add(reader_stats.truncated_packets, 1);
+        *slot_size = std::max(
+            *slot_size,
+            std::min(slot->capacity * 2, (size_t)HCI_MAX_PACKET_SIZE));
+        LOG(ERROR) << __func__ << ": dropped packet larger than "
+                   << slot->capacity << " bytes, using " << *slot_size
+                   << " bytes from now on";
+        continue;
+      }
+      if (len < 1) continue;
+      len--;
+
+      BT_HDR* packet;
+      if (len >= slot->capacity / 2) {
+        /* Hand the slot buffer over, it is replaced on the next read */
+        packet = slot->packet;
+        slot->packet = NULL;
+      } else {
+        packet = reinterpret_cast<BT_HDR*>(
+            buffer_allocator->alloc(BT_HDR_SIZE + len));
+        memcpy(packet->data, slot->packet->data, len);
+        reader_stats_add(reader_stats.copied_packets, 1);
+      }
+      packet->offset = 0;
+      packet->layer_specific = 0;
+      packet->len = len;
+
+      reader_stats_add(reader_stats.packets, 1);
+      reader_stats_add(reader_stats.bytes, len);
+      total++;
+      dispatch_packet(slot->type, packet);
+    }
+
+    if (n < HCI_READ_BATCH_SIZE) return total;
+  }
+}
+
 void monitor_socket(int ctrl_fd, int fd) {
   const allocator_t* buffer_allocator = buffer_allocator_get_interface();
-  const size_t buf_size = 2000;
-  uint8_t buf[buf_size];
-  ssize_t len = read(fd, buf, buf_size);
-
-  while (len > 0) {
-    if (len == buf_size)
-      LOG(FATAL) << "This packet filled buffer, if it have continuation we "
-                    "don't know how to merge it, increase buffer size!";
-
-    uint8_t type = buf[0];
-
-    size_t packet_size = buf_size + BT_HDR_SIZE;
-    BT_HDR* packet =
-        reinterpret_cast<BT_HDR*>(buffer_allocator->alloc(packet_size));
-    packet->offset = 0;
-    packet->layer_specific = 0;
-    packet->len = len - 1;
-    memcpy(packet->data, buf + 1, len - 1);
-
-    switch (type) {
-      case HCI_PACKET_TYPE_COMMAND:
-        packet->event = MSG_HC_TO_STACK_HCI_EVT;
-        hci_event_received(FROM_HERE, packet);
-        break;
-      case HCI_PACKET_TYPE_ACL_DATA:
-        packet->event = MSG_HC_TO_STACK_HCI_ACL;
-        acl_event_received(packet);
-        break;
-      case HCI_PACKET_TYPE_SCO_DATA:
-        packet->event = MSG_HC_TO_STACK_HCI_SCO;
-        sco_data_received(packet);
-        break;
-      case HCI_PACKET_TYPE_EVENT:
-        packet->event = MSG_HC_TO_STACK_HCI_EVT;
-        hci_event_received(FROM_HERE, packet);
-        break;
-      default:
-        LOG(FATAL) << "Unexpected event type: " << +type;
-        break;
+  hci_read_slot_t slots[HCI_READ_BATCH_SIZE];
+  memset(slots, 0, sizeof(slots));
+  size_t slot_size = get_read_slot_size();
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  CHECK(epoll_fd >= 0) << "epoll_create1 failed: " << strerror(errno);
+
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.fd = ctrl_fd;
+  CHECK(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ctrl_fd, &event) == 0);
+  event.data.fd = fd;
+  CHECK(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0);
+
+  bool running = true;
+  while (running) {
+    struct epoll_event events[2];
+    int n;
+    OSI_NO_INTR(n = epoll_wait(epoll_fd, events, 2, -1));
+    if (n < 0) {
+      LOG(ERROR) << __func__ << ": epoll_wait failed: " << strerror(errno);
+      break;
     }
 
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(ctrl_fd, &fds);
-    FD_SET(fd, &fds);
-    int res = select(std::max(fd, ctrl_fd) + 1, &fds, NULL, NULL, NULL);
-    if (res <= 0) LOG(INFO) << "Nothing more to read";
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.fd == ctrl_fd) {
+        LOG(INFO) << "exitting";
+        running = false;
+        break;
+      }
 
-    if (FD_ISSET(ctrl_fd, &fds)) {
-      LOG(INFO) << "exitting";
-      return;
+      reader_stats_add(reader_stats.wakeups, 1);
+      ssize_t count = read_packets(fd, slots, &slot_size);
+      if (count < 0) {
+        running = false;
+        break;
+      }
+      add_packets_per_wakeup(count);
     }
+  }
 
-    len = read(fd, buf, buf_size);
+  LOG(INFO) << __func__ << ": read " << reader_stats.packets.load()
+            << " packets in " << reader_stats.wakeups.load() << " wakeups";
+  close(epoll_fd);
+  for (size_t i = 0; i < HCI_READ_BATCH_SIZE; i++) {
+    if (slots[i].packet != NULL) buffer_allocator->free(slots[i].packet);
   }
 }
 
@@ -393,6 +558,37 @@ static int rfkill(int block) {
   return 0;
 }
 
+void hci_transport_debug_dump(int fd) {
+  /* The counters are updated by the reader thread while they are read, the
+   * values may be slightly out of sync with each other */
+  uint64_t wakeups = reader_stats.wakeups.load(std::memory_order_relaxed);
+  uint64_t packets = reader_stats.packets.load(std::memory_order_relaxed);
+
+  dprintf(fd, "\nHCI Socket Reader:\n");
+  dprintf(fd,
+          "  Wakeups / read calls                                    : "
+          "%" PRIu64 " / %" PRIu64 "\n",
+          wakeups, reader_stats.read_calls.load(std::memory_order_relaxed));
+  dprintf(fd,
+          "  Packets (total/copied/truncated)                        : "
+          "%" PRIu64 " / %" PRIu64 " / %" PRIu64 "\n",
+          packets, reader_stats.copied_packets.load(std::memory_order_relaxed),
+          reader_stats.truncated_packets.load(std::memory_order_relaxed));
+  dprintf(fd,
+          "  Total bytes                                             : "
+          "%" PRIu64 "\n",
+          reader_stats.bytes.load(std::memory_order_relaxed));
+  dprintf(fd,
+          "  Packets per wakeup (avg/max)                            : "
+          "%.2f / %" PRIu64 "\n",
+          (wakeups != 0) ? (double)packets / wakeups : 0.0,
+          reader_stats.max_packets_per_wakeup.load(std::memory_order_relaxed));
+  for (size_t i = 0; i < HCI_READ_HISTOGRAM_BUCKETS; i++) {
+    dprintf(fd, "    %-52s: %" PRIu64 "\n", histogram_labels[i],
+            reader_stats.packets_per_wakeup[i].load(std::memory_order_relaxed));
+  }
+}
+
 int hci_open_firmware_log_file() { return INVALID_FD; }
 
 void hci_close_firmware_log_file(int fd) {}
@@ -28,6 +28,7 @@
 #include "buffer_allocator.h"
 #include "device/include/controller.h"
 #include "hci_internals.h"
+#include "osi/include/latency_trace.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
 
@@ -193,6 +194,7 @@ static void reassemble_and_dispatch(UNUSED_ATTR BT_HDR* packet) {
       UINT16_TO_STREAM(stream, full_length - HCI_ACL_PREAMBLE_SIZE);
 
       partial_packets[handle] = partial_packet;
+      LATENCY_TRACE_MOVE(packet, partial_packet);
 
       // Free the old packet buffer, since we don't need it anymore
       buffer_allocator->free(packet);
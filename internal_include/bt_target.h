@@ -837,6 +837,14 @@
 #define PORT_RX_BUF_CRITICAL_WM 15
 #endif
 
+/* The max number of credits granted to the peer at a time, when the received
+ * data is delivered to a data callback. The credits granted grow from the
+ * receive queue high watermark with the rate the data is consumed at and the
+ * credit round trip, up to this level. */
+#ifndef PORT_RX_BUF_CREDIT_MAX
+#define PORT_RX_BUF_CREDIT_MAX 40
+#endif
+
 /* The port transmit queue high watermark level, in bytes. */
 #ifndef PORT_TX_HIGH_WM
 #define PORT_TX_HIGH_WM (BTA_RFC_MTU_SIZE * PORT_TX_BUF_HIGH_WM)
@@ -1393,6 +1401,12 @@ single PDU.
 #define BTSNOOP_MEM TRUE
 #endif
 
+/* Enable/disable the latency trace points of the incoming ACL data, from the
+ * HCI layer to the profiles */
+#ifndef BT_LATENCY_TRACE
+#define BT_LATENCY_TRACE FALSE
+#endif
+
 #include "bt_trace.h"
 
 #endif /* BT_TARGET_H */
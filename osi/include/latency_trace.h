@@ -0,0 +1,58 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "bt_target.h"
+#include "bt_types.h"
+
+// Stages of an incoming ACL packet, from the HCI layer to the profiles
+typedef enum {
+  LATENCY_HCI_RX,       // Received from the HAL, before reassembly
+  LATENCY_REASSEMBLED,  // L2CAP PDU reassembled by the fragmenter
+  LATENCY_BTU,          // Taken from the BTU message queue
+  LATENCY_L2CAP,        // Dispatched to its channel by L2CAP
+  LATENCY_PROFILE,      // Received by the profile
+  LATENCY_NUM_STAGES
+} latency_stage_t;
+
+// Records the time |p_buf| reaches |stage|. A trace starts when the packet
+// is received, and ends when it reaches the profile.
+void latency_trace_mark(const BT_HDR* p_buf, latency_stage_t stage);
+
+// Continues the trace of |from| on |to|, when the packet is copied into
+// another buffer.
+void latency_trace_move(const BT_HDR* from, const BT_HDR* to);
+
+// Writes the latency histogram of each stage to |fd|
+void latency_trace_debug_dump(int fd);
+
+// Writes the most recent traces to |fd|, in the Chrome trace event JSON
+// format that can be loaded in chrome://tracing or Perfetto
+void latency_trace_dump_events(int fd);
+
+// Trace points, compiled in when BT_LATENCY_TRACE is TRUE
+#if (BT_LATENCY_TRACE == TRUE)
+#define LATENCY_TRACE_MARK(p_buf, stage) latency_trace_mark(p_buf, stage)
+#define LATENCY_TRACE_MOVE(from, to) latency_trace_move(from, to)
+#else
+#define LATENCY_TRACE_MARK(p_buf, stage)
+#define LATENCY_TRACE_MOVE(from, to)
+#endif
@@ -0,0 +1,208 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include <mutex>
+
+#include "osi/include/latency_trace.h"
+#include "osi/include/time.h"
+
+// Packets being traced, indexed by a hash of their buffer. A trace is
+// overwritten when another packet hashes to the same entry, so that the
+// packets that never reach a profile do not need to be removed.
+#define NUM_ACTIVE_TRACES 512
+
+// Completed traces kept for the trace event export
+#define NUM_RECENT_TRACES 256
+
+// Histogram buckets: bucket i counts the intervals in [2^(i-1), 2^i) us
+#define NUM_LATENCY_BUCKETS 22
+
+typedef struct {
+  const BT_HDR* p_buf;
+  uint16_t handle;
+  uint64_t ts_us[LATENCY_NUM_STAGES];
+} latency_trace_t;
+
+typedef struct {
+  uint64_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+  uint64_t buckets[NUM_LATENCY_BUCKETS];
+} latency_histogram_t;
+
+// The intervals between consecutive stages, and the total
+#define NUM_LATENCY_INTERVALS LATENCY_NUM_STAGES
+
+static const char* interval_names[NUM_LATENCY_INTERVALS] = {
+    "HCI -> reassembled", "Reassembled -> BTU", "BTU -> L2CAP",
+    "L2CAP -> profile", "HCI -> profile"};
+
+static std::mutex latency_mutex;
+static latency_trace_t active_traces[NUM_ACTIVE_TRACES];
+static latency_trace_t recent_traces[NUM_RECENT_TRACES];
+static size_t recent_count = 0;
+static latency_histogram_t histograms[NUM_LATENCY_INTERVALS];
+
+static latency_trace_t* trace_entry(const BT_HDR* p_buf) {
+  uintptr_t key = (uintptr_t)p_buf;
+  key ^= key >> 17;
+  key *= 0x9E3779B1u;
+  return &active_traces[(key >> 8) % NUM_ACTIVE_TRACES];
+}
+
+static size_t bucket_of(uint64_t us) {
+  size_t bucket = 0;
+  while (us && bucket < NUM_LATENCY_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+static void histogram_add(latency_histogram_t* histogram, uint64_t us) {
+  histogram->count++;
+  histogram->total_us += us;
+  if (us > histogram->max_us) histogram->max_us = us;
+  histogram->buckets[bucket_of(us)]++;
+}
+
+// Returns the upper bound of the bucket holding the |percent| percentile
+static uint64_t histogram_percentile(const latency_histogram_t* histogram,
+                                     uint64_t percent) {
+  uint64_t target = (histogram->count * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < NUM_LATENCY_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= target) return 1ULL << i;
+  }
+  return histogram->max_us;
+}
+
+// Must be called with |latency_mutex| held
+static void trace_complete(latency_trace_t* trace) {
+  const uint64_t* ts = trace->ts_us;
+  uint64_t last = ts[LATENCY_HCI_RX];
+  for (size_t stage = LATENCY_HCI_RX + 1;
+       stage < LATENCY_NUM_STAGES; stage++) {
+    // Stages the packet went through without a trace point are skipped
+    if (ts[stage] == 0) continue;
+    histogram_add(&histograms[stage - 1], ts[stage] - last);
+    last = ts[stage];
+  }
+  histogram_add(&histograms[NUM_LATENCY_INTERVALS - 1],
+                ts[LATENCY_PROFILE] - ts[LATENCY_HCI_RX]);
+
+  recent_traces[recent_count % NUM_RECENT_TRACES] = *trace;
+  recent_count++;
+  trace->p_buf = NULL;
+}
+
+void latency_trace_mark(const BT_HDR* p_buf, latency_stage_t stage) {
+  uint64_t now = time_get_os_boottime_us();
+  std::lock_guard<std::mutex> lock(latency_mutex);
+  latency_trace_t* trace = trace_entry(p_buf);
+
+  if (stage == LATENCY_HCI_RX) {
+    const uint8_t* p = (const uint8_t*)(p_buf + 1) + p_buf->offset;
+    memset(trace, 0, sizeof(*trace));
+    trace->p_buf = p_buf;
+    trace->handle = p_buf->len >= 2 ? ((p[0] | (p[1] << 8)) & 0x0FFF) : 0;
+    trace->ts_us[stage] = now;
+    return;
+  }
+
+  if (trace->p_buf != p_buf) return;
+  trace->ts_us[stage] = now;
+  if (stage == LATENCY_PROFILE) trace_complete(trace);
+}
+
+void latency_trace_move(const BT_HDR* from, const BT_HDR* to) {
+  std::lock_guard<std::mutex> lock(latency_mutex);
+  latency_trace_t* trace = trace_entry(from);
+  if (trace->p_buf != from) return;
+
+  latency_trace_t* moved = trace_entry(to);
+  if (moved != trace) *moved = *trace;
+  moved->p_buf = to;
+  if (moved != trace) trace->p_buf = NULL;
+}
+
+void latency_trace_debug_dump(int fd) {
+  std::lock_guard<std::mutex> lock(latency_mutex);
+
+  dprintf(fd, "\nIncoming ACL Latency:\n");
+  dprintf(fd, "  Traces completed                  : %llu\n",
+          (unsigned long long)recent_count);
+  dprintf(fd, "  %-20s %10s %10s %10s %10s %10s\n", "Interval (us)", "count",
+          "avg", "p50", "p99", "max");
+  for (size_t i = 0; i < NUM_LATENCY_INTERVALS; i++) {
+    const latency_histogram_t* histogram = &histograms[i];
+    if (histogram->count == 0) {
+      dprintf(fd, "  %-20s %10d\n", interval_names[i], 0);
+      continue;
+    }
+    dprintf(fd, "  %-20s %10llu %10llu %10llu %10llu %10llu\n",
+            interval_names[i], (unsigned long long)histogram->count,
+            (unsigned long long)(histogram->total_us / histogram->count),
+            (unsigned long long)histogram_percentile(histogram, 50),
+            (unsigned long long)histogram_percentile(histogram, 99),
+            (unsigned long long)histogram->max_us);
+  }
+
+  for (size_t i = 0; i < NUM_LATENCY_INTERVALS; i++) {
+    const latency_histogram_t* histogram = &histograms[i];
+    if (histogram->count == 0) continue;
+    dprintf(fd, "  %s:\n", interval_names[i]);
+    for (size_t bucket = 0; bucket < NUM_LATENCY_BUCKETS; bucket++) {
+      if (histogram->buckets[bucket] == 0) continue;
+      dprintf(fd, "    < %8llu us : %llu\n", 1ULL << bucket,
+              (unsigned long long)histogram->buckets[bucket]);
+    }
+  }
+}
+
+void latency_trace_dump_events(int fd) {
+  std::lock_guard<std::mutex> lock(latency_mutex);
+
+  size_t count = recent_count < NUM_RECENT_TRACES ? recent_count
+                                                  : NUM_RECENT_TRACES;
+  const char* separator = "";
+  dprintf(fd, "{\"traceEvents\":[");
+  for (size_t i = 0; i < count; i++) {
+    const latency_trace_t* trace =
+        &recent_traces[(recent_count - count + i) % NUM_RECENT_TRACES];
+    uint64_t last = trace->ts_us[LATENCY_HCI_RX];
+    for (size_t stage = LATENCY_HCI_RX + 1;
+         stage < LATENCY_NUM_STAGES; stage++) {
+      if (trace->ts_us[stage] == 0) continue;
+      // One row per connection handle
+      dprintf(fd,
+              "%s\n{\"name\":\"%s\",\"cat\":\"acl\",\"ph\":\"X\","
+              "\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":%u}",
+              separator, interval_names[stage - 1], (unsigned long long)last,
+              (unsigned long long)(trace->ts_us[stage] - last),
+              trace->handle);
+      separator = ",";
+      last = trace->ts_us[stage];
+    }
+  }
+  dprintf(fd, "\n],\"displayTimeUnit\":\"ms\"}\n");
+}
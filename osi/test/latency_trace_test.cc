@@ -0,0 +1,89 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "osi/include/latency_trace.h"
+
+namespace {
+
+constexpr uint16_t kHandle = 0x0041;
+
+struct Packet {
+  BT_HDR hdr;
+  uint8_t data[16];
+};
+
+void init_packet(Packet* packet) {
+  memset(packet, 0, sizeof(*packet));
+  packet->hdr.len = sizeof(packet->data);
+  packet->data[0] = kHandle & 0xff;
+  packet->data[1] = 0x20 | (kHandle >> 8);
+}
+
+// Returns what |dump| writes
+std::string dump_to_string(void (*dump)(int)) {
+  FILE* file = tmpfile();
+  dump(fileno(file));
+  fflush(file);
+  rewind(file);
+  std::string output;
+  char buffer[512];
+  size_t len;
+  while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    output.append(buffer, len);
+  fclose(file);
+  return output;
+}
+
+}  // namespace
+
+TEST(LatencyTraceTest, test_trace_through_reassembly) {
+  Packet fragment, reassembled, other;
+  init_packet(&fragment);
+  init_packet(&reassembled);
+  init_packet(&other);
+
+  latency_trace_mark(&fragment.hdr, LATENCY_HCI_RX);
+  latency_trace_move(&fragment.hdr, &reassembled.hdr);
+  latency_trace_mark(&reassembled.hdr, LATENCY_REASSEMBLED);
+  latency_trace_mark(&reassembled.hdr, LATENCY_BTU);
+  usleep(1000);
+  latency_trace_mark(&reassembled.hdr, LATENCY_L2CAP);
+  latency_trace_mark(&reassembled.hdr, LATENCY_PROFILE);
+
+  // Not traced from the HCI layer
+  latency_trace_mark(&other.hdr, LATENCY_PROFILE);
+
+  std::string dump = dump_to_string(latency_trace_debug_dump);
+  EXPECT_NE(dump.find("Traces completed                  : 1\n"),
+            std::string::npos);
+  EXPECT_NE(dump.find("BTU -> L2CAP"), std::string::npos);
+
+  std::string trace = dump_to_string(latency_trace_dump_events);
+  EXPECT_EQ(trace.find("{\"traceEvents\":["), 0u);
+  EXPECT_NE(trace.find("\"name\":\"HCI -> reassembled\""), std::string::npos);
+  EXPECT_NE(trace.find("\"name\":\"L2CAP -> profile\""), std::string::npos);
+  EXPECT_NE(trace.find("\"tid\":65"), std::string::npos);
+  EXPECT_EQ(trace.find("HCI -> profile"), std::string::npos);
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "avrcp.h"
+
+namespace bluetooth {
+namespace avrcp {
+
+// A helper class holding the lists fetched from the AVRCP Media Interface
+// layer for a connected device, so that paged browsing requests are served
+// from one fetch of the list instead of fetching the whole list for every
+// page.
+//
+// Lists are keyed by scope and folder. The players are database unaware and
+// always report a UID counter of 0, so rather than being part of the key the
+// UID counter changing clears the cache. Only the most recently used VFS
+// folders are kept.
+//
+// A list fetched while the cache is cleared is stale and is not stored. The
+// generation of the cache at the time the list was requested tells these
+// apart.
+class BrowseCache {
+ public:
+  using FolderItems = std::shared_ptr<const std::vector<ListItem>>;
+  using NowPlayingList = std::shared_ptr<const std::vector<SongInfo>>;
+
+  static constexpr size_t kMaxFolders = 4;
+
+  uint32_t folders_generation() const { return folders_generation_; }
+  uint32_t now_playing_generation() const { return now_playing_generation_; }
+
+  FolderItems GetFolderItems(const std::string& folder) {
+    for (auto it = folders_.begin(); it != folders_.end(); it++) {
+      if (it->first != folder) continue;
+      folders_.splice(folders_.begin(), folders_, it);
+      hits_++;
+      return folders_.front().second;
+    }
+    misses_++;
+    return nullptr;
+  }
+
+  FolderItems StoreFolderItems(const std::string& folder, uint32_t generation,
+                               std::vector<ListItem> items) {
+    auto list = std::make_shared<const std::vector<ListItem>>(std::move(items));
+    if (generation != folders_generation_) return list;
+
+    folders_.remove_if(
+        [&folder](const Folder& entry) { return entry.first == folder; });
+    folders_.emplace_front(folder, list);
+    if (folders_.size() > kMaxFolders) folders_.pop_back();
+    return list;
+  }
+
+  NowPlayingList GetNowPlayingList() {
+    if (now_playing_ == nullptr) {
+      misses_++;
+      return nullptr;
+    }
+    hits_++;
+    return now_playing_;
+  }
+
+  NowPlayingList StoreNowPlayingList(uint32_t generation,
+                                     std::vector<SongInfo> song_list) {
+    auto list =
+        std::make_shared<const std::vector<SongInfo>>(std::move(song_list));
+    if (generation == now_playing_generation_) now_playing_ = list;
+    return list;
+  }
+
+  // The now playing list changed
+  void InvalidateNowPlayingList() {
+    now_playing_.reset();
+    now_playing_generation_++;
+  }
+
+  // The UIDs changed, or the browsed player
+  void Clear() {
+    folders_.clear();
+    folders_generation_++;
+    InvalidateNowPlayingList();
+  }
+
+  size_t NumFolders() const { return folders_.size(); }
+  uint32_t Hits() const { return hits_; }
+  uint32_t Misses() const { return misses_; }
+
+ private:
+  using Folder = std::pair<std::string, FolderItems>;
+
+  // Most recently used first
+  std::list<Folder> folders_;
+  NowPlayingList now_playing_;
+  uint32_t folders_generation_ = 0;
+  uint32_t now_playing_generation_ = 0;
+  uint32_t hits_ = 0;
+  uint32_t misses_ = 0;
+};
+
+}  // namespace avrcp
+}  // namespace bluetooth
@@ -29,6 +29,37 @@ namespace avrcp {
 #define VOL_NOT_SUPPORTED -1
 #define VOL_REGISTRATION_FAILED -2
 
+namespace {
+
+const std::string& item_media_id(const SongInfo& song) {
+  return song.media_id;
+}
+
+const std::string& item_media_id(const ListItem& item) {
+  return item.type == ListItem::FOLDER ? item.folder.media_id
+                                       : item.song.media_id;
+}
+
+// Find the item with |media_id| in |items|. The item is looked up at the
+// position it had when its UID was mapped, and the list is only searched if
+// it changed since then.
+template <typename T>
+const T* find_item(const std::vector<T>& items, const MediaIdMap& ids,
+                   const std::string& media_id) {
+  size_t index;
+  if (ids.get_index(ids.get_uid(media_id), &index) && index < items.size() &&
+      item_media_id(items[index]) == media_id) {
+    return &items[index];
+  }
+
+  for (auto it = items.rbegin(); it != items.rend(); it++) {
+    if (item_media_id(*it) == media_id) return &*it;
+  }
+  return nullptr;
+}
+
+}  // namespace
+
 Device::Device(
     const RawAddress& bdaddr, bool avrcp13_compatibility,
     base::Callback<void(uint8_t label, bool browse,
@@ -196,9 +227,10 @@ void Device::HandleNotification(
 
   switch (pkt->GetEventRegistered()) {
     case Event::TRACK_CHANGED: {
-      media_interface_->GetNowPlayingList(
-          base::Bind(&Device::TrackChangedNotificationResponse,
-                     weak_ptr_factory_.GetWeakPtr(), label, true));
+      media_interface_->GetNowPlayingList(base::Bind(
+          &Device::TrackChangedNotificationResponse,
+          weak_ptr_factory_.GetWeakPtr(), label, true,
+          browse_cache_.now_playing_generation()));
     } break;
 
     case Event::PLAYBACK_STATUS_CHANGED: {
@@ -215,9 +247,10 @@ void Device::HandleNotification(
     } break;
 
     case Event::NOW_PLAYING_CONTENT_CHANGED: {
-      media_interface_->GetNowPlayingList(
-          base::Bind(&Device::HandleNowPlayingNotificationResponse,
-                     weak_ptr_factory_.GetWeakPtr(), label, true));
+      media_interface_->GetNowPlayingList(base::Bind(
+          &Device::HandleNowPlayingNotificationResponse,
+          weak_ptr_factory_.GetWeakPtr(), label, true,
+          browse_cache_.now_playing_generation()));
     } break;
 
     case Event::AVAILABLE_PLAYERS_CHANGED: {
@@ -349,6 +382,7 @@ void Device::SetVolume(int8_t volume) {
 }
 
 void Device::TrackChangedNotificationResponse(uint8_t label, bool interim,
+                                              uint32_t generation,
                                               std::string curr_song_id,
                                               std::vector<SongInfo> song_list) {
   DEVICE_VLOG(1) << __func__;
@@ -363,15 +397,13 @@ void Device::TrackChangedNotificationResponse(uint8_t label, bool interim,
 
   // Anytime we use the now playing list, update our map so that its always
   // current
-  now_playing_ids_.clear();
-  for (const SongInfo& song : song_list) {
-    now_playing_ids_.insert(song.media_id);
-    if (curr_song_id == song.media_id) {
-      DEVICE_VLOG(3) << __func__ << ": Found media ID match for "
-                     << song.media_id;
-      uid = now_playing_ids_.get_uid(curr_song_id);
-    }
+  UpdateNowPlayingIds(song_list);
+  uid = now_playing_ids_.get_uid(curr_song_id);
+  if (uid != 0) {
+    DEVICE_VLOG(3) << __func__ << ": Found media ID match for "
+                   << curr_song_id;
   }
+  browse_cache_.StoreNowPlayingList(generation, std::move(song_list));
 
   if (curr_song_id == "") {
     DEVICE_LOG(WARNING) << "Empty media ID";
@@ -705,17 +737,33 @@ void Device::HandleGetFolderItems(uint8_t label,
           base::Bind(&Device::GetMediaPlayerListResponse,
                      weak_ptr_factory_.GetWeakPtr(), label, pkt));
       break;
-    case Scope::VFS:
+    case Scope::VFS: {
+      // The first page of a list is always fetched, since most players
+      // never report a UIDs change, and the following pages are served from
+      // the cache
+      if (pkt->GetStartItem() != 0) {
+        auto items = browse_cache_.GetFolderItems(CurrentFolder());
+        if (items != nullptr) {
+          GetVFSListResponse(label, pkt, *items);
+          break;
+        }
+      }
       media_interface_->GetFolderItems(
           curr_browsed_player_id_, CurrentFolder(),
-          base::Bind(&Device::GetVFSListResponse,
-                     weak_ptr_factory_.GetWeakPtr(), label, pkt));
-      break;
-    case Scope::NOW_PLAYING:
-      media_interface_->GetNowPlayingList(
-          base::Bind(&Device::GetNowPlayingListResponse,
-                     weak_ptr_factory_.GetWeakPtr(), label, pkt));
-      break;
+          base::Bind(&Device::GetVFSListFetched, weak_ptr_factory_.GetWeakPtr(),
+                     label, pkt, CurrentFolder(),
+                     browse_cache_.folders_generation()));
+    } break;
+    case Scope::NOW_PLAYING: {
+      auto song_list = browse_cache_.GetNowPlayingList();
+      if (song_list != nullptr) {
+        GetNowPlayingListResponse(label, pkt, *song_list);
+        break;
+      }
+      media_interface_->GetNowPlayingList(base::Bind(
+          &Device::GetNowPlayingListFetched, weak_ptr_factory_.GetWeakPtr(),
+          label, pkt, browse_cache_.now_playing_generation()));
+    } break;
     default:
       DEVICE_LOG(ERROR) << __func__ << ": " << pkt->GetScope();
       break;
@@ -876,11 +924,8 @@ void Device::GetItemAttributesNowPlayingResponse(
   DEVICE_VLOG(2) << __func__ << ": media_id=\"" << media_id << "\"";
 
   SongInfo info;
-  for (const auto& temp : song_list) {
-    if (temp.media_id == media_id) {
-      info = temp;
-    }
-  }
+  const SongInfo* song = find_item(song_list, now_playing_ids_, media_id);
+  if (song != nullptr) info = *song;
 
   auto attributes_requested = pkt->GetAttributesRequested();
   if (attributes_requested.size() != 0) {
@@ -918,12 +963,8 @@ void Device::GetItemAttributesVFSResponse(
                                                                browse_mtu_);
 
   ListItem item_requested;
-  for (const auto& temp : item_list) {
-    if ((temp.type == ListItem::FOLDER && temp.folder.media_id == media_id) ||
-        (temp.type == ListItem::SONG && temp.song.media_id == media_id)) {
-      item_requested = temp;
-    }
-  }
+  const ListItem* item = find_item(item_list, vfs_ids_, media_id);
+  if (item != nullptr) item_requested = *item;
 
   // TODO (apanicke): Add a helper function or allow adding a map
   // of attributes to GetItemAttributesResponseBuilder
@@ -1009,9 +1050,31 @@ std::set<AttributeEntry> filter_attributes_requested(
   return result;
 }
 
+void Device::GetVFSListFetched(uint8_t label,
+                               std::shared_ptr<GetFolderItemsRequest> pkt,
+                               std::string folder, uint32_t generation,
+                               std::vector<ListItem> items) {
+  DEVICE_VLOG(2) << __func__ << ": folder=\"" << folder
+                 << "\" num_items=" << items.size();
+
+  // TODO (apanicke): Add test that checks if vfs_ids_ is the correct size after
+  // an operation.
+  for (size_t i = 0; i < items.size(); i++) {
+    if (items[i].type == ListItem::FOLDER) {
+      vfs_ids_.insert(items[i].folder.media_id, i);
+    } else if (items[i].type == ListItem::SONG) {
+      vfs_ids_.insert(items[i].song.media_id, i);
+    }
+  }
+
+  auto list =
+      browse_cache_.StoreFolderItems(folder, generation, std::move(items));
+  GetVFSListResponse(label, pkt, *list);
+}
+
 void Device::GetVFSListResponse(uint8_t label,
                                 std::shared_ptr<GetFolderItemsRequest> pkt,
-                                std::vector<ListItem> items) {
+                                const std::vector<ListItem>& items) {
   DEVICE_VLOG(2) << __func__ << ": start_item=" << pkt->GetStartItem()
                  << " end_item=" << pkt->GetEndItem();
 
@@ -1019,16 +1082,6 @@ void Device::GetVFSListResponse(uint8_t label,
   auto builder = GetFolderItemsResponseBuilder::MakeVFSBuilder(
       Status::NO_ERROR, 0x0000, browse_mtu_);
 
-  // TODO (apanicke): Add test that checks if vfs_ids_ is the correct size after
-  // an operation.
-  for (const auto& item : items) {
-    if (item.type == ListItem::FOLDER) {
-      vfs_ids_.insert(item.folder.media_id);
-    } else if (item.type == ListItem::SONG) {
-      vfs_ids_.insert(item.song.media_id);
-    }
-  }
-
   // Add the elements retrieved in the last get folder items request and map
   // them to UIDs The maps will be cleared every time a directory change
   // happens. These items do not need to correspond with the now playing list as
@@ -1065,18 +1118,25 @@ void Device::GetVFSListResponse(uint8_t label,
   send_message(label, true, std::move(builder));
 }
 
+void Device::GetNowPlayingListFetched(
+    uint8_t label, std::shared_ptr<GetFolderItemsRequest> pkt,
+    uint32_t generation, std::string /* unused curr_song_id */,
+    std::vector<SongInfo> song_list) {
+  DEVICE_VLOG(2) << __func__ << ": num_items=" << song_list.size();
+
+  UpdateNowPlayingIds(song_list);
+  auto list =
+      browse_cache_.StoreNowPlayingList(generation, std::move(song_list));
+  GetNowPlayingListResponse(label, pkt, *list);
+}
+
 void Device::GetNowPlayingListResponse(
     uint8_t label, std::shared_ptr<GetFolderItemsRequest> pkt,
-    std::string /* unused curr_song_id */, std::vector<SongInfo> song_list) {
+    const std::vector<SongInfo>& song_list) {
   DEVICE_VLOG(2) << __func__;
   auto builder = GetFolderItemsResponseBuilder::MakeNowPlayingBuilder(
       Status::NO_ERROR, 0x0000, browse_mtu_);
 
-  now_playing_ids_.clear();
-  for (const SongInfo& song : song_list) {
-    now_playing_ids_.insert(song.media_id);
-  }
-
   for (size_t i = pkt->GetStartItem();
        i <= pkt->GetEndItem() && i < song_list.size(); i++) {
     auto song = song_list[i];
@@ -1124,6 +1184,7 @@ void Device::SetBrowsedPlayerResponse(
   // Clear the path and push the new root.
   current_path_ = std::stack<std::string>();
   current_path_.push(root_id);
+  browse_cache_.Clear();
 
   auto response = SetBrowsedPlayerResponseBuilder::MakeBuilder(
       Status::NO_ERROR, 0x0000, num_items, 0, "");
@@ -1136,6 +1197,7 @@ void Device::SendMediaUpdate(bool metadata, bool play_status, bool queue) {
                  << " : play_status= " << play_status << " : queue=" << queue;
 
   if (queue) {
+    browse_cache_.InvalidateNowPlayingList();
     HandleNowPlayingUpdate();
   }
 
@@ -1159,6 +1221,10 @@ void Device::SendFolderUpdate(bool available_players, bool addressed_player,
   if (addressed_player) {
     HandleAddressedPlayerUpdate();
   }
+
+  if (uids) {
+    browse_cache_.Clear();
+  }
 }
 
 void Device::HandleTrackUpdate() {
@@ -1170,7 +1236,8 @@ void Device::HandleTrackUpdate() {
 
   media_interface_->GetNowPlayingList(
       base::Bind(&Device::TrackChangedNotificationResponse,
-                 weak_ptr_factory_.GetWeakPtr(), track_changed_.second, false));
+                 weak_ptr_factory_.GetWeakPtr(), track_changed_.second, false,
+                 browse_cache_.now_playing_generation()));
 }
 
 void Device::HandlePlayStatusUpdate() {
@@ -1195,11 +1262,12 @@ void Device::HandleNowPlayingUpdate() {
 
   media_interface_->GetNowPlayingList(base::Bind(
       &Device::HandleNowPlayingNotificationResponse,
-      weak_ptr_factory_.GetWeakPtr(), now_playing_changed_.second, false));
+      weak_ptr_factory_.GetWeakPtr(), now_playing_changed_.second, false,
+      browse_cache_.now_playing_generation()));
 }
 
 void Device::HandleNowPlayingNotificationResponse(
-    uint8_t label, bool interim, std::string curr_song_id,
+    uint8_t label, bool interim, uint32_t generation, std::string curr_song_id,
     std::vector<SongInfo> song_list) {
   if (interim) {
     now_playing_changed_ = Notification(true, label);
@@ -1208,10 +1276,8 @@ void Device::HandleNowPlayingNotificationResponse(
     return;
   }
 
-  now_playing_ids_.clear();
-  for (const SongInfo& song : song_list) {
-    now_playing_ids_.insert(song.media_id);
-  }
+  UpdateNowPlayingIds(song_list);
+  browse_cache_.StoreNowPlayingList(generation, std::move(song_list));
 
   auto response =
       RegisterNotificationResponseBuilder::MakeNowPlayingBuilder(interim);
@@ -1223,6 +1289,13 @@ void Device::HandleNowPlayingNotificationResponse(
   }
 }
 
+void Device::UpdateNowPlayingIds(const std::vector<SongInfo>& song_list) {
+  now_playing_ids_.clear();
+  for (size_t i = 0; i < song_list.size(); i++) {
+    now_playing_ids_.insert(song_list[i].media_id, i);
+  }
+}
+
 void Device::HandlePlayPosUpdate() {
   DEVICE_VLOG(0) << __func__;
   if (!play_pos_changed_.first) {
@@ -1319,6 +1392,9 @@ std::ostream& operator<<(std::ostream& out, const Device& d) {
   out << "    Current Folder: \"" << d.CurrentFolder() << "\"" << std::endl;
   out << "    MTU Sizes: CTRL=" << d.ctrl_mtu_ << " BROWSE=" << d.browse_mtu_
       << std::endl;
+  out << "    Browse Cache: folders=" << d.browse_cache_.NumFolders()
+      << " hits=" << d.browse_cache_.Hits()
+      << " misses=" << d.browse_cache_.Misses() << std::endl;
   // TODO (apanicke): Add supported features as well as media keys
   return out;
 }
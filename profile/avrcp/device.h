@@ -26,6 +26,7 @@
 #include "avrcp.h"
 #include "avrcp_internal.h"
 #include "avrcp_packet.h"
+#include "browse_cache.h"
 #include "media_id_map.h"
 #include "raw_address.h"
 
@@ -117,8 +118,8 @@ class Device {
   // CURRENT TRACK CHANGED
   virtual void HandleTrackUpdate();
   virtual void TrackChangedNotificationResponse(
-      uint8_t label, bool interim, std::string curr_song_id,
-      std::vector<SongInfo> song_list);
+      uint8_t label, bool interim, uint32_t generation,
+      std::string curr_song_id, std::vector<SongInfo> song_list);
 
   // GET CAPABILITY
   virtual void HandleGetCapabilities(
@@ -134,8 +135,8 @@ class Device {
   // NOW PLAYING LIST CHANGED
   virtual void HandleNowPlayingUpdate();
   virtual void HandleNowPlayingNotificationResponse(
-      uint8_t label, bool interim, std::string curr_song_id,
-      std::vector<SongInfo> song_list);
+      uint8_t label, bool interim, uint32_t generation,
+      std::string curr_song_id, std::vector<SongInfo> song_list);
 
   // PLAY POSITION CHANGED
   virtual void HandlePlayPosUpdate();
@@ -171,12 +172,20 @@ class Device {
   virtual void GetMediaPlayerListResponse(
       uint8_t label, std::shared_ptr<GetFolderItemsRequest> pkt,
       uint16_t curr_player, std::vector<MediaPlayerInfo> players);
+  virtual void GetVFSListFetched(uint8_t label,
+                                 std::shared_ptr<GetFolderItemsRequest> pkt,
+                                 std::string folder, uint32_t generation,
+                                 std::vector<ListItem> items);
   virtual void GetVFSListResponse(uint8_t label,
                                   std::shared_ptr<GetFolderItemsRequest> pkt,
-                                  std::vector<ListItem> items);
+                                  const std::vector<ListItem>& items);
+  virtual void GetNowPlayingListFetched(
+      uint8_t label, std::shared_ptr<GetFolderItemsRequest> pkt,
+      uint32_t generation, std::string curr_song_id,
+      std::vector<SongInfo> song_list);
   virtual void GetNowPlayingListResponse(
       uint8_t label, std::shared_ptr<GetFolderItemsRequest> pkt,
-      std::string curr_song_id, std::vector<SongInfo> song_list);
+      const std::vector<SongInfo>& song_list);
 
   // GET TOTAL NUMBER OF ITEMS
   virtual void HandleGetTotalNumberOfItems(
@@ -259,6 +268,11 @@ class Device {
     active_labels_.erase(label);
     send_message_cb_.Run(label, browse, std::move(message));
   }
+
+  // Maps the media ids of the now playing list to UIDs, along with the
+  // position of each song in the list.
+  void UpdateNowPlayingIds(const std::vector<SongInfo>& song_list);
+
   base::WeakPtrFactory<Device> weak_ptr_factory_;
 
   // TODO (apanicke): Initialize all the variables in the constructor.
@@ -290,6 +304,9 @@ class Device {
   MediaIdMap vfs_ids_;
   MediaIdMap now_playing_ids_;
 
+  // Lists fetched for the paged browsing requests
+  BrowseCache browse_cache_;
+
   uint32_t play_pos_interval_ = 0;
 
   SongInfo last_song_info_;
@@ -16,7 +16,9 @@
 
 #pragma once
 
-#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace bluetooth {
 namespace avrcp {
@@ -24,39 +26,65 @@ namespace avrcp {
 // A helper class to convert Media ID's (represented as strings) that are
 // received from the AVRCP Media Interface layer into UID's to be used
 // with connected devices.
+//
+// UID's are handed out in order starting from 1, so the reverse lookup is an
+// index into a vector. Each Media ID is only stored once, as the key of the
+// hashed map, and the vector points to it. Along with the UID, the position
+// of the item in the list it was last inserted from is kept, so that the item
+// can be found again in that list without searching it.
 class MediaIdMap {
  public:
+  MediaIdMap() = default;
+  // The entries point into the map, so it can't be copied
+  MediaIdMap(const MediaIdMap&) = delete;
+  MediaIdMap& operator=(const MediaIdMap&) = delete;
+
   void clear() {
     media_id_to_uid_.clear();
     uid_to_media_id_.clear();
   }
 
-  std::string get_media_id(uint64_t uid) {
-    const auto& uid_it = uid_to_media_id_.find(uid);
-    if (uid_it == uid_to_media_id_.end()) return "";
-    return uid_it->second;
+  size_t size() const { return uid_to_media_id_.size(); }
+
+  std::string get_media_id(uint64_t uid) const {
+    if (uid == 0 || uid > uid_to_media_id_.size()) return "";
+    return *uid_to_media_id_[uid - 1].media_id;
   }
 
-  uint64_t get_uid(std::string media_id) {
+  uint64_t get_uid(const std::string& media_id) const {
     const auto& media_id_it = media_id_to_uid_.find(media_id);
     if (media_id_it == media_id_to_uid_.end()) return 0;
     return media_id_it->second;
   }
 
-  uint64_t insert(std::string media_id) {
-    if (media_id_to_uid_.find(media_id) != media_id_to_uid_.end()) {
-      return media_id_to_uid_[media_id];
-    }
+  // Returns the position of the item with |uid| in the list it was inserted
+  // from, or false if the UID is unknown.
+  bool get_index(uint64_t uid, size_t* index) const {
+    if (uid == 0 || uid > uid_to_media_id_.size()) return false;
+    *index = uid_to_media_id_[uid - 1].index;
+    return true;
+  }
 
-    uint64_t uid = media_id_to_uid_.size() + 1;
-    media_id_to_uid_.insert(std::pair<std::string, uint64_t>(media_id, uid));
-    uid_to_media_id_.insert(std::pair<uint64_t, std::string>(uid, media_id));
+  uint64_t insert(const std::string& media_id, size_t index = 0) {
+    const auto& result =
+        media_id_to_uid_.emplace(media_id, uid_to_media_id_.size() + 1);
+    uint64_t uid = result.first->second;
+    if (result.second) {
+      uid_to_media_id_.push_back({&result.first->first, index});
+    } else {
+      uid_to_media_id_[uid - 1].index = index;
+    }
     return uid;
   }
 
  private:
-  std::map<std::string, uint64_t> media_id_to_uid_;
-  std::map<uint64_t, std::string> uid_to_media_id_;
+  struct Entry {
+    const std::string* media_id;  // Key in |media_id_to_uid_|
+    size_t index;
+  };
+
+  std::unordered_map<std::string, uint64_t> media_id_to_uid_;
+  std::vector<Entry> uid_to_media_id_;
 };
 
 }  // namespace avrcp
@@ -0,0 +1,159 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <base/bind.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "avrcp_packet.h"
+#include "device.h"
+#include "stack_config.h"
+#include "tests/packet_test_helper.h"
+
+namespace bluetooth {
+namespace avrcp {
+
+namespace {
+
+using TestBrowsePacket = TestPacketType<BrowsePacket>;
+
+constexpr size_t kNumItems = 10000;
+constexpr uint32_t kPageSize = 10;
+
+SongInfo song(size_t i) {
+  std::string id = std::to_string(i);
+  return {"song_" + id,
+          {AttributeEntry(Attribute::TITLE, "Title " + id),
+           AttributeEntry(Attribute::ARTIST_NAME, "Artist " + id),
+           AttributeEntry(Attribute::ALBUM_NAME, "Album " + id),
+           AttributeEntry(Attribute::PLAYING_TIME, "180000")}};
+}
+
+// A media library of |kNumItems| songs, both in the root folder and in the
+// now playing list, answering right away
+class Library : public MediaInterface {
+ public:
+  Library() {
+    for (size_t i = 0; i < kNumItems; i++) {
+      songs_.push_back(song(i));
+      items_.push_back({ListItem::SONG, FolderInfo(), songs_.back()});
+    }
+  }
+
+  void SendKeyEvent(uint8_t, KeyState) override {}
+  void GetSongInfo(SongInfoCallback info_cb) override {
+    info_cb.Run(songs_.front());
+  }
+  void GetPlayStatus(PlayStatusCallback status_cb) override {
+    status_cb.Run(PlayStatus());
+  }
+  void GetNowPlayingList(NowPlayingCallback now_playing_cb) override {
+    fetches_++;
+    now_playing_cb.Run(songs_.front().media_id, songs_);
+  }
+  void GetMediaPlayerList(MediaListCallback list_cb) override {
+    list_cb.Run(0, std::vector<MediaPlayerInfo>());
+  }
+  void GetFolderItems(uint16_t, std::string, FolderItemsCallback folder_cb)
+      override {
+    fetches_++;
+    folder_cb.Run(items_);
+  }
+  void SetBrowsedPlayer(uint16_t, SetBrowsedPlayerCallback browse_cb) override {
+    browse_cb.Run(true, "", kNumItems);
+  }
+  void PlayItem(uint16_t, bool, std::string) override {}
+  void SetActiveDevice(const RawAddress&) override {}
+  void RegisterUpdateCallback(MediaCallbacks*) override {}
+  void UnregisterUpdateCallback(MediaCallbacks*) override {}
+
+  size_t Fetches() const { return fetches_; }
+
+ private:
+  std::vector<SongInfo> songs_;
+  std::vector<ListItem> items_;
+  size_t fetches_ = 0;
+};
+
+class A2dp : public A2dpInterface {
+ public:
+  RawAddress active_peer() override { return RawAddress::kEmpty; }
+};
+
+std::vector<std::shared_ptr<TestBrowsePacket>> page_requests(Scope scope) {
+  std::vector<std::shared_ptr<TestBrowsePacket>> requests;
+  for (uint32_t start = 0; start < kNumItems; start += kPageSize) {
+    auto builder = GetFolderItemsRequestBuilder::MakeBuilder(
+        scope, start, start + kPageSize - 1, {});
+    auto request = TestBrowsePacket::Make();
+    builder->Serialize(request);
+    requests.push_back(request);
+  }
+  return requests;
+}
+
+// A head unit paging through the whole library, |kPageSize| items per
+// request. Without the cache, as before it, the whole list is fetched again
+// for each page.
+void browse(benchmark::State& state, Scope scope) {
+  Library library;
+  A2dp a2dp;
+  Device device(RawAddress::kAny, true,
+                base::Bind([](uint8_t, bool,
+                              std::unique_ptr<::bluetooth::PacketBuilder>) {}),
+                0xFFFF, 0xFFFF);
+  device.RegisterInterfaces(&library, &a2dp, nullptr);
+  auto requests = page_requests(scope);
+  bool cached = state.range(0);
+
+  size_t page = 0;
+  for (auto _ : state) {
+    if (!cached) device.SendFolderUpdate(false, false, true);
+    device.BrowseMessageReceived(page % 16, requests[page]);
+    page = (page + 1) % requests.size();
+  }
+  state.counters["fetches"] = library.Fetches();
+  state.SetItemsProcessed(state.iterations() * kPageSize);
+}
+
+void BM_BrowseFolder(benchmark::State& state) { browse(state, Scope::VFS); }
+BENCHMARK(BM_BrowseFolder)->Arg(false)->Arg(true);
+
+void BM_BrowseNowPlaying(benchmark::State& state) {
+  browse(state, Scope::NOW_PLAYING);
+}
+BENCHMARK(BM_BrowseNowPlaying)->Arg(false)->Arg(true);
+
+bool get_pts_avrcp_test(void) { return false; }
+
+const stack_config_t interface = {
+    nullptr, get_pts_avrcp_test, nullptr, nullptr, nullptr, nullptr, nullptr,
+    nullptr};
+
+}  // namespace
+
+}  // namespace avrcp
+}  // namespace bluetooth
+
+const stack_config_t* stack_config_get_interface(void) {
+  return &bluetooth::avrcp::interface;
+}
+
+BENCHMARK_MAIN();
@@ -801,6 +801,188 @@ TEST_F(AvrcpDeviceTest, getVFSFolderTest) {
   SendBrowseMessage(1, request);
 }
 
+TEST_F(AvrcpDeviceTest, getVFSFolderPagedTest) {
+  MockMediaInterface interface;
+  NiceMock<MockA2dpInterface> a2dp_interface;
+
+  test_device->RegisterInterfaces(&interface, &a2dp_interface, nullptr);
+
+  FolderInfo info0 = {"test_id0", true, "Test Folder0"};
+  FolderInfo info1 = {"test_id1", true, "Test Folder1"};
+  FolderInfo info2 = {"test_id2", true, "Test Folder2"};
+  ListItem item0 = {ListItem::FOLDER, info0, SongInfo()};
+  ListItem item1 = {ListItem::FOLDER, info1, SongInfo()};
+  ListItem item2 = {ListItem::FOLDER, info2, SongInfo()};
+  std::vector<ListItem> list = {item0, item1, item2};
+
+  // The list is fetched for the first page, and again for a following page
+  // once the UIDs changed or the first page was requested again
+  EXPECT_CALL(interface, GetFolderItems(_, "", _))
+      .Times(3)
+      .WillRepeatedly(InvokeCb<2>(list));
+
+  auto expected_response = GetFolderItemsResponseBuilder::MakeVFSBuilder(
+      Status::NO_ERROR, 0x0000, 0xFFFF);
+  expected_response->AddFolder(FolderItem(1, 0, true, "Test Folder0"));
+  expected_response->AddFolder(FolderItem(2, 0, true, "Test Folder1"));
+  EXPECT_CALL(response_cb,
+              Call(1, true, matchPacket(std::move(expected_response))))
+      .Times(1);
+  auto folder_request_builder =
+      GetFolderItemsRequestBuilder::MakeBuilder(Scope::VFS, 0, 1, {});
+  auto request = TestBrowsePacket::Make();
+  folder_request_builder->Serialize(request);
+  SendBrowseMessage(1, request);
+
+  expected_response = GetFolderItemsResponseBuilder::MakeVFSBuilder(
+      Status::NO_ERROR, 0x0000, 0xFFFF);
+  expected_response->AddFolder(FolderItem(3, 0, true, "Test Folder2"));
+  EXPECT_CALL(response_cb,
+              Call(2, true, matchPacket(std::move(expected_response))))
+      .Times(1);
+  folder_request_builder =
+      GetFolderItemsRequestBuilder::MakeBuilder(Scope::VFS, 2, 2, {});
+  request = TestBrowsePacket::Make();
+  folder_request_builder->Serialize(request);
+  SendBrowseMessage(2, request);
+
+  test_device->SendFolderUpdate(false, false, true);
+
+  expected_response = GetFolderItemsResponseBuilder::MakeVFSBuilder(
+      Status::NO_ERROR, 0x0000, 0xFFFF);
+  expected_response->AddFolder(FolderItem(3, 0, true, "Test Folder2"));
+  EXPECT_CALL(response_cb,
+              Call(3, true, matchPacket(std::move(expected_response))))
+      .Times(1);
+  request = TestBrowsePacket::Make();
+  folder_request_builder->Serialize(request);
+  SendBrowseMessage(3, request);
+
+  expected_response = GetFolderItemsResponseBuilder::MakeVFSBuilder(
+      Status::NO_ERROR, 0x0000, 0xFFFF);
+  expected_response->AddFolder(FolderItem(1, 0, true, "Test Folder0"));
+  expected_response->AddFolder(FolderItem(2, 0, true, "Test Folder1"));
+  EXPECT_CALL(response_cb,
+              Call(4, true, matchPacket(std::move(expected_response))))
+      .Times(1);
+  folder_request_builder =
+      GetFolderItemsRequestBuilder::MakeBuilder(Scope::VFS, 0, 1, {});
+  request = TestBrowsePacket::Make();
+  folder_request_builder->Serialize(request);
+  SendBrowseMessage(4, request);
+}
+
+TEST_F(AvrcpDeviceTest, getNowPlayingListPagedTest) {
+  MockMediaInterface interface;
+  NiceMock<MockA2dpInterface> a2dp_interface;
+
+  test_device->RegisterInterfaces(&interface, &a2dp_interface, nullptr);
+
+  std::vector<SongInfo> list = {
+      {"test_id0", {AttributeEntry(Attribute::TITLE, "Test Song0")}},
+      {"test_id1", {AttributeEntry(Attribute::TITLE, "Test Song1")}},
+      {"test_id2", {AttributeEntry(Attribute::TITLE, "Test Song2")}},
+  };
+  std::vector<SongInfo> new_list = {
+      {"test_id3", {AttributeEntry(Attribute::TITLE, "Test Song3")}},
+      {"test_id4", {AttributeEntry(Attribute::TITLE, "Test Song4")}},
+      {"test_id5", {AttributeEntry(Attribute::TITLE, "Test Song5")}},
+  };
+
+  // The list is fetched once for all the pages, and again once the now
+  // playing list changed
+  EXPECT_CALL(interface, GetNowPlayingList(_))
+      .Times(2)
+      .WillOnce(InvokeCb<0>("test_id0", list))
+      .WillOnce(InvokeCb<0>("test_id3", new_list));
+
+  auto expected_response = GetFolderItemsResponseBuilder::MakeNowPlayingBuilder(
+      Status::NO_ERROR, 0x0000, 0xFFFF);
+  expected_response->AddSong(
+      MediaElementItem(1, "Test Song0", list[0].attributes));
+  expected_response->AddSong(
+      MediaElementItem(2, "Test Song1", list[1].attributes));
+  EXPECT_CALL(response_cb,
+              Call(1, true, matchPacket(std::move(expected_response))))
+      .Times(1);
+  auto folder_request_builder =
+      GetFolderItemsRequestBuilder::MakeBuilder(Scope::NOW_PLAYING, 0, 1, {});
+  auto request = TestBrowsePacket::Make();
+  folder_request_builder->Serialize(request);
+  SendBrowseMessage(1, request);
+
+  expected_response = GetFolderItemsResponseBuilder::MakeNowPlayingBuilder(
+      Status::NO_ERROR, 0x0000, 0xFFFF);
+  expected_response->AddSong(
+      MediaElementItem(3, "Test Song2", list[2].attributes));
+  EXPECT_CALL(response_cb,
+              Call(2, true, matchPacket(std::move(expected_response))))
+      .Times(1);
+  folder_request_builder =
+      GetFolderItemsRequestBuilder::MakeBuilder(Scope::NOW_PLAYING, 2, 2, {});
+  request = TestBrowsePacket::Make();
+  folder_request_builder->Serialize(request);
+  SendBrowseMessage(2, request);
+
+  test_device->SendMediaUpdate(false, false, true);
+
+  expected_response = GetFolderItemsResponseBuilder::MakeNowPlayingBuilder(
+      Status::NO_ERROR, 0x0000, 0xFFFF);
+  expected_response->AddSong(
+      MediaElementItem(3, "Test Song5", new_list[2].attributes));
+  EXPECT_CALL(response_cb,
+              Call(3, true, matchPacket(std::move(expected_response))))
+      .Times(1);
+  request = TestBrowsePacket::Make();
+  folder_request_builder->Serialize(request);
+  SendBrowseMessage(3, request);
+}
+
+TEST_F(AvrcpDeviceTest, getNowPlayingListStaleTest) {
+  MockMediaInterface interface;
+  NiceMock<MockA2dpInterface> a2dp_interface;
+
+  test_device->RegisterInterfaces(&interface, &a2dp_interface, nullptr);
+
+  std::vector<SongInfo> list = {
+      {"test_id0", {AttributeEntry(Attribute::TITLE, "Test Song0")}},
+  };
+  std::vector<SongInfo> new_list = {
+      {"test_id1", {AttributeEntry(Attribute::TITLE, "Test Song1")}},
+  };
+
+  MediaInterface::NowPlayingCallback track_changed_cb;
+  EXPECT_CALL(interface, GetNowPlayingList(_))
+      .Times(2)
+      .WillOnce(SaveArg<0>(&track_changed_cb))
+      .WillOnce(InvokeCb<0>("test_id1", new_list));
+
+  auto register_request =
+      RegisterNotificationRequestBuilder::MakeBuilder(Event::TRACK_CHANGED, 0);
+  auto pkt = TestAvrcpPacket::Make();
+  register_request->Serialize(pkt);
+  SendMessage(1, pkt);
+
+  // The now playing list changes while the list for the track changed
+  // notification is being fetched: the list fetched is stale and isn't cached
+  test_device->SendMediaUpdate(false, false, true);
+  EXPECT_CALL(response_cb, Call(1, false, _)).Times(1);
+  track_changed_cb.Run("test_id0", list);
+
+  auto expected_response = GetFolderItemsResponseBuilder::MakeNowPlayingBuilder(
+      Status::NO_ERROR, 0x0000, 0xFFFF);
+  expected_response->AddSong(
+      MediaElementItem(1, "Test Song1", new_list[0].attributes));
+  EXPECT_CALL(response_cb,
+              Call(2, true, matchPacket(std::move(expected_response))))
+      .Times(1);
+  auto folder_request_builder =
+      GetFolderItemsRequestBuilder::MakeBuilder(Scope::NOW_PLAYING, 0, 0, {});
+  auto request = TestBrowsePacket::Make();
+  folder_request_builder->Serialize(request);
+  SendBrowseMessage(2, request);
+}
+
 TEST_F(AvrcpDeviceTest, getFolderItemsMtuTest) {
   auto truncated_packet = GetFolderItemsResponseBuilder::MakeVFSBuilder(
       Status::NO_ERROR, 0x0000, 0xFFFF);
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "media_id_map.h"
+
+namespace bluetooth {
+namespace avrcp {
+
+TEST(AvrcpMediaIdMapTest, insertTest) {
+  MediaIdMap ids;
+  EXPECT_EQ(ids.insert("id_a", 0), 1u);
+  EXPECT_EQ(ids.insert("id_b", 1), 2u);
+  EXPECT_EQ(ids.size(), 2u);
+
+  EXPECT_EQ(ids.get_uid("id_a"), 1u);
+  EXPECT_EQ(ids.get_uid("id_b"), 2u);
+  EXPECT_EQ(ids.get_uid("id_c"), 0u);
+  EXPECT_EQ(ids.get_media_id(1), "id_a");
+  EXPECT_EQ(ids.get_media_id(2), "id_b");
+  EXPECT_EQ(ids.get_media_id(0), "");
+  EXPECT_EQ(ids.get_media_id(3), "");
+}
+
+TEST(AvrcpMediaIdMapTest, duplicateTest) {
+  MediaIdMap ids;
+  ids.insert("id_a", 0);
+  ids.insert("id_b", 1);
+
+  // The UID is kept, the position is the last one
+  EXPECT_EQ(ids.insert("id_a", 2), 1u);
+  EXPECT_EQ(ids.size(), 2u);
+  size_t index = 0;
+  ASSERT_TRUE(ids.get_index(1, &index));
+  EXPECT_EQ(index, 2u);
+  ASSERT_TRUE(ids.get_index(2, &index));
+  EXPECT_EQ(index, 1u);
+  EXPECT_FALSE(ids.get_index(3, &index));
+}
+
+TEST(AvrcpMediaIdMapTest, clearTest) {
+  MediaIdMap ids;
+  for (int i = 0; i < 1000; i++) ids.insert("id_" + std::to_string(i), i);
+  EXPECT_EQ(ids.get_media_id(1000), "id_999");
+
+  ids.clear();
+  EXPECT_EQ(ids.size(), 0u);
+  EXPECT_EQ(ids.get_uid("id_0"), 0u);
+  EXPECT_EQ(ids.get_media_id(1), "");
+  EXPECT_EQ(ids.insert("id_1", 0), 1u);
+}
+
+}  // namespace avrcp
+}  // namespace bluetooth
@@ -98,7 +98,9 @@ static const tA2DP_ENCODER_INTERFACE a2dp_encoder_interface_aac = {
     a2dp_aac_feeding_flush,
     a2dp_aac_get_encoder_interval_ms,
     a2dp_aac_send_frames,
-    nullptr  // set_transmit_queue_length
+    nullptr,  // set_transmit_queue_length
+    true,     // send_frames_uses_timestamp
+    a2dp_aac_get_max_send_interval_us,
 };
 
 static const tA2DP_DECODER_INTERFACE a2dp_decoder_interface_aac = {
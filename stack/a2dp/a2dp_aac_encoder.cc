@@ -487,6 +487,16 @@ period_ms_t a2dp_aac_get_encoder_interval_ms(void) {
   return A2DP_AAC_ENCODER_INTERVAL_MS;
 }
 
+uint64_t a2dp_aac_get_max_send_interval_us(void) {
+  uint32_t sample_rate = a2dp_aac_encoder_cb.feeding_params.sample_rate;
+  if (sample_rate == 0) return 0;
+
+  // The number of frames per call is kept in 8 bits
+  return (uint64_t)UINT8_MAX *
+         a2dp_aac_encoder_cb.aac_encoder_params.frame_length * 1000000 /
+         sample_rate;
+}
+
 void a2dp_aac_send_frames(uint64_t timestamp_us) {
   uint8_t nb_frame = 0;
   uint8_t nb_iterations = 0;
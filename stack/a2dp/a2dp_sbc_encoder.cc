@@ -25,6 +25,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "a2dp_sbc.h"
 #include "a2dp_sbc_up_sample.h"
 #include "bt_common.h"
@@ -422,6 +424,23 @@ period_ms_t a2dp_sbc_get_encoder_interval_ms(void) {
   return A2DP_SBC_ENCODER_INTERVAL_MS;
 }
 
+uint64_t a2dp_sbc_get_max_send_interval_us(void) {
+  uint32_t sample_rate = a2dp_sbc_encoder_cb.feeding_params.sample_rate;
+  if (sample_rate == 0) return 0;
+
+  // Same limits as a2dp_sbc_get_num_frame_iteration()
+  uint32_t max_frames = MAX_PCM_FRAME_NUM_PER_TICK;
+  if (a2dp_sbc_encoder_cb.is_peer_edr && a2dp_sbc_encoder_cb.tx_sbc_frames) {
+    max_frames = std::min<uint32_t>(
+        max_frames,
+        A2DP_SBC_MAX_PCM_ITER_NUM_PER_TICK * a2dp_sbc_encoder_cb.tx_sbc_frames);
+  }
+  uint64_t samples_per_frame =
+      a2dp_sbc_encoder_cb.sbc_encoder_params.s16NumOfSubBands *
+      a2dp_sbc_encoder_cb.sbc_encoder_params.s16NumOfBlocks;
+  return max_frames * samples_per_frame * 1000000 / sample_rate;
+}
+
 void a2dp_sbc_send_frames(uint64_t timestamp_us) {
   uint8_t nb_frame = 0;
   uint8_t nb_iterations = 0;
@@ -0,0 +1,172 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "ble_advertising_cache.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+static_assert(AdvertisingCache::kMaxItems < 0xff,
+              "item indexes must fit in uint8_t, below kNone");
+
+constexpr size_t AdvertisingCache::kMaxItems;
+constexpr size_t AdvertisingCache::kMaxDataLen;
+constexpr size_t AdvertisingCache::kNumBuckets;
+constexpr uint8_t AdvertisingCache::kNone;
+
+AdvertisingCache::AdvertisingCache() : evictions_(0), truncated_bytes_(0) {
+  ClearAll();
+}
+
+void AdvertisingCache::ClearAll() {
+  memset(buckets_, kNone, sizeof(buckets_));
+  for (size_t i = 0; i < kMaxItems; i++) {
+    items_[i].lru_next = (i + 1 < kMaxItems) ? i + 1 : kNone;
+  }
+  free_head_ = 0;
+  lru_head_ = kNone;
+  lru_tail_ = kNone;
+  size_ = 0;
+}
+
+uint8_t AdvertisingCache::Bucket(uint8_t addr_type, const RawAddress& addr,
+                                 uint8_t sid) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < RawAddress::kLength; i++) {
+    hash = (hash ^ addr.address[i]) * 16777619u;
+  }
+  hash = (hash ^ addr_type) * 16777619u;
+  hash = (hash ^ sid) * 16777619u;
+  return (hash ^ (hash >> 16)) % kNumBuckets;
+}
+
+uint8_t AdvertisingCache::Find(uint8_t addr_type, const RawAddress& addr,
+                               uint8_t sid) const {
+  uint8_t index = buckets_[Bucket(addr_type, addr, sid)];
+  while (index != kNone) {
+    const Item& item = items_[index];
+    if (item.addr == addr && item.addr_type == addr_type && item.sid == sid)
+      return index;
+    index = item.next_in_bucket;
+  }
+  return kNone;
+}
+
+void AdvertisingCache::LruUnlink(uint8_t index) {
+  Item& item = items_[index];
+  if (item.lru_prev != kNone)
+    items_[item.lru_prev].lru_next = item.lru_next;
+  else
+    lru_head_ = item.lru_next;
+  if (item.lru_next != kNone)
+    items_[item.lru_next].lru_prev = item.lru_prev;
+  else
+    lru_tail_ = item.lru_prev;
+}
+
+void AdvertisingCache::LruPushFront(uint8_t index) {
+  Item& item = items_[index];
+  item.lru_prev = kNone;
+  item.lru_next = lru_head_;
+  if (lru_head_ != kNone) items_[lru_head_].lru_prev = index;
+  lru_head_ = index;
+  if (lru_tail_ == kNone) lru_tail_ = index;
+}
+
+void AdvertisingCache::Remove(uint8_t index) {
+  Item& item = items_[index];
+
+  uint8_t* link = &buckets_[item.bucket];
+  while (*link != index) link = &items_[*link].next_in_bucket;
+  *link = item.next_in_bucket;
+
+  LruUnlink(index);
+  item.lru_next = free_head_;
+  free_head_ = index;
+  size_--;
+}
+
+AdvertisingCache::Item* AdvertisingCache::Get(uint8_t addr_type,
+                                              const RawAddress& addr,
+                                              uint8_t sid) {
+  uint8_t index = Find(addr_type, addr, sid);
+  if (index != kNone) {
+    if (index != lru_head_) {
+      LruUnlink(index);
+      LruPushFront(index);
+    }
+    return &items_[index];
+  }
+
+  if (free_head_ == kNone) {
+    evictions_++;
+    Remove(lru_tail_);
+  }
+
+  index = free_head_;
+  Item& item = items_[index];
+  free_head_ = item.lru_next;
+
+  item.addr_type = addr_type;
+  item.addr = addr;
+  item.sid = sid;
+  item.len = 0;
+  item.bucket = Bucket(addr_type, addr, sid);
+  item.next_in_bucket = buckets_[item.bucket];
+  buckets_[item.bucket] = index;
+  LruPushFront(index);
+  size_++;
+  return &item;
+}
+
+const uint8_t* AdvertisingCache::Store(Item* item, size_t offset,
+                                       const uint8_t* data, size_t len,
+                                       size_t* p_len) {
+  size_t stored = std::min(len, kMaxDataLen - offset);
+  truncated_bytes_ += len - stored;
+  if (stored != 0) memcpy(item->data + offset, data, stored);
+  item->len = offset + stored;
+  *p_len = item->len;
+  return item->data;
+}
+
+const uint8_t* AdvertisingCache::Set(uint8_t addr_type, const RawAddress& addr,
+                                     uint8_t sid, const uint8_t* data,
+                                     size_t len, size_t* p_len) {
+  return Store(Get(addr_type, addr, sid), 0, data, len, p_len);
+}
+
+const uint8_t* AdvertisingCache::Append(uint8_t addr_type,
+                                        const RawAddress& addr, uint8_t sid,
+                                        const uint8_t* data, size_t len,
+                                        size_t* p_len) {
+  Item* item = Get(addr_type, addr, sid);
+  return Store(item, item->len, data, len, p_len);
+}
+
+bool AdvertisingCache::Contains(uint8_t addr_type, const RawAddress& addr,
+                                uint8_t sid) const {
+  return Find(addr_type, addr, sid) != kNone;
+}
+
+void AdvertisingCache::Clear(uint8_t addr_type, const RawAddress& addr,
+                             uint8_t sid) {
+  uint8_t index = Find(addr_type, addr, sid);
+  if (index != kNone) Remove(index);
+}
@@ -0,0 +1,107 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef BLE_ADVERTISING_CACHE_H
+#define BLE_ADVERTISING_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "types/raw_address.h"
+
+/* Reassembly cache of the advertising data of devices waiting for either a
+ * scan response, or chained packets on the secondary channel.
+ *
+ * The devices are keyed on their address type, address and advertising SID,
+ * and looked up through a hash table. The cache holds at most |kMaxItems|
+ * devices in a slab of fixed-size items allocated with the cache, so no
+ * memory is allocated per advertising report. When the cache is full, the
+ * least recently used device is evicted. */
+class AdvertisingCache {
+ public:
+  static constexpr size_t kMaxItems = 32;
+  /* Maximum length of the advertising data of an extended advertising set */
+  static constexpr size_t kMaxDataLen = 1650;
+
+  AdvertisingCache();
+
+  /* Set the data to |data| of length |len| for device |addr_type, addr, sid|.
+   * Returns the cached data, and its length in |p_len|. */
+  const uint8_t* Set(uint8_t addr_type, const RawAddress& addr, uint8_t sid,
+                     const uint8_t* data, size_t len, size_t* p_len);
+
+  /* Append |data| of length |len| for device |addr_type, addr, sid|.
+   * Returns the cached data, and its length in |p_len|. */
+  const uint8_t* Append(uint8_t addr_type, const RawAddress& addr, uint8_t sid,
+                        const uint8_t* data, size_t len, size_t* p_len);
+
+  /* Return true if data is cached for device |addr_type, addr, sid| */
+  bool Contains(uint8_t addr_type, const RawAddress& addr, uint8_t sid) const;
+
+  /* Clear data for device |addr_type, addr, sid| */
+  void Clear(uint8_t addr_type, const RawAddress& addr, uint8_t sid);
+
+  /* Clear data for all the devices */
+  void ClearAll();
+
+  /* Number of devices in the cache */
+  size_t Size() const { return size_; }
+
+  uint64_t Evictions() const { return evictions_; }
+  uint64_t TruncatedBytes() const { return truncated_bytes_; }
+
+ private:
+  static constexpr size_t kNumBuckets = 2 * kMaxItems;
+  static constexpr uint8_t kNone = 0xff;
+
+  struct Item {
+    uint8_t addr_type;
+    RawAddress addr;
+    uint8_t sid;
+    uint8_t bucket;
+    uint8_t next_in_bucket;
+    /* Least recently used order, or free list for the unused items */
+    uint8_t lru_prev;
+    uint8_t lru_next;
+    uint16_t len;
+    uint8_t data[kMaxDataLen];
+  };
+
+  static uint8_t Bucket(uint8_t addr_type, const RawAddress& addr,
+                        uint8_t sid);
+  uint8_t Find(uint8_t addr_type, const RawAddress& addr, uint8_t sid) const;
+  /* Returns the item of device |addr_type, addr, sid|, added if needed */
+  Item* Get(uint8_t addr_type, const RawAddress& addr, uint8_t sid);
+  void Remove(uint8_t index);
+  void LruUnlink(uint8_t index);
+  void LruPushFront(uint8_t index);
+  const uint8_t* Store(Item* item, size_t offset, const uint8_t* data,
+                       size_t len, size_t* p_len);
+
+  Item items_[kMaxItems];
+  uint8_t buckets_[kNumBuckets];
+  uint8_t lru_head_;
+  uint8_t lru_tail_;
+  uint8_t free_head_;
+  size_t size_;
+
+  uint64_t evictions_;
+  uint64_t truncated_bytes_;
+};
+
+#endif  // BLE_ADVERTISING_CACHE_H
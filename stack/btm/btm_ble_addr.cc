@@ -23,6 +23,7 @@
  ******************************************************************************/
 
 #include <base/bind.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "bt_types.h"
@@ -33,8 +34,18 @@
 #include "hcimsgs.h"
 
 #include "btm_ble_int.h"
+#include "btm_ble_rpa_resolver.h"
+#include "osi/include/time.h"
 #include "smp_api.h"
 
+/* Resolutions of peer RPAs are cached for the RPA rotation interval */
+static BtmBleRpaResolver btm_ble_rpa_resolver(BTM_BLE_PRIVATE_ADDR_INT_MS);
+/* Incremented when a peer IRK is stored or a security record is added or
+ * removed, since the resolver holds pointers to the security records */
+static uint32_t btm_ble_rpa_irk_generation = 1;
+/* IRK generation the resolver was built for */
+static uint32_t btm_ble_rpa_resolver_generation;
+
 /*******************************************************************************
  *
  * Function         btm_gen_resolve_paddr_cmpl
@@ -169,34 +180,6 @@ void btm_gen_non_resolvable_private_addr(tBTM_BLE_ADDR_CBACK* p_cback,
 /*******************************************************************************
  *  Utility functions for Random address resolving
  ******************************************************************************/
-/*******************************************************************************
- *
- * Function         btm_ble_proc_resolve_x
- *
- * Description      This function compares the X with random address 3 MSO bytes
- *                  to find a match.
- *
- * Returns          true on match, false otherwise
- *
- ******************************************************************************/
-static bool btm_ble_proc_resolve_x(const tSMP_ENC& encrypt_output,
-                                   const RawAddress& random_bda) {
-  BTM_TRACE_EVENT("btm_ble_proc_resolve_x");
-
-  /* compare the hash with 3 LSB of bd address */
-  uint8_t comp[3];
-  comp[0] = random_bda.address[5];
-  comp[1] = random_bda.address[4];
-  comp[2] = random_bda.address[3];
-
-  if (!memcmp(encrypt_output.param_buf, comp, 3)) {
-    BTM_TRACE_EVENT("match is found");
-    return true;
-  }
-
-  return false;
-}
-
 /*******************************************************************************
  *
  * Function         btm_ble_init_pseudo_addr
@@ -233,24 +216,10 @@ bool btm_ble_addr_resolvable(const RawAddress& rpa,
 
   if (!BTM_BLE_IS_RESOLVE_BDA(rpa)) return rt;
 
-  uint8_t rand[3];
-  tSMP_ENC output;
   if ((p_dev_rec->device_type & BT_DEVICE_TYPE_BLE) &&
       (p_dev_rec->ble.key_type & BTM_LE_KEY_PID)) {
     BTM_TRACE_DEBUG("%s try to resolve", __func__);
-    /* use the 3 MSB of bd address as prand */
-    rand[0] = rpa.address[2];
-    rand[1] = rpa.address[1];
-    rand[2] = rpa.address[0];
-
-    /* generate X = E irk(R0, R1, R2) and R is random address 3 LSO */
-    SMP_Encrypt(p_dev_rec->ble.keys.irk, BT_OCTET16_LEN, &rand[0], 3, &output);
-
-    rand[0] = rpa.address[5];
-    rand[1] = rpa.address[4];
-    rand[2] = rpa.address[3];
-
-    if (!memcmp(output.param_buf, &rand[0], 3)) {
+    if (BtmBleRpaResolver::Matches(rpa, p_dev_rec->ble.keys.irk)) {
       btm_ble_init_pseudo_addr(p_dev_rec, rpa);
       rt = true;
     }
@@ -260,41 +229,71 @@ bool btm_ble_addr_resolvable(const RawAddress& rpa,
 
 /*******************************************************************************
  *
- * Function         btm_ble_match_random_bda
+ * Function         btm_ble_rpa_irks_changed
  *
- * Description      This function match the random address to the appointed
- *                  device record, starting from calculating IRK. If the record
- *                  index exceeds the maximum record number, matching failed and
- *                  send a callback.
+ * Description      This function is called when a peer IRK is stored or a
+ *                  security record is added or removed, to rebuild the peer
+ *                  IRKs of the RPA resolver.
  *
- * Returns          None.
+ * Returns          void
  *
  ******************************************************************************/
-static bool btm_ble_match_random_bda(void* data, void* context) {
-  RawAddress* random_bda = (RawAddress*)context;
-  /* use the 3 MSB of bd address as prand */
+void btm_ble_rpa_irks_changed(void) { btm_ble_rpa_irk_generation++; }
 
-  uint8_t rand[3];
-  rand[0] = random_bda->address[2];
-  rand[1] = random_bda->address[1];
-  rand[2] = random_bda->address[0];
-
-  BTM_TRACE_EVENT("%s next iteration", __func__);
-
-  tSMP_ENC output;
+/*******************************************************************************
+ *
+ * Function         btm_ble_add_rpa_resolver_irk
+ *
+ * Description      This function adds the IRK of a security record to the RPA
+ *                  resolver.
+ *
+ * Returns          true to continue the iteration.
+ *
+ ******************************************************************************/
+static bool btm_ble_add_rpa_resolver_irk(void* data, void* context) {
   tBTM_SEC_DEV_REC* p_dev_rec = static_cast<tBTM_SEC_DEV_REC*>(data);
 
-  BTM_TRACE_DEBUG("sec_flags = %02x device_type = %d", p_dev_rec->sec_flags,
-                  p_dev_rec->device_type);
+  if ((p_dev_rec->device_type & BT_DEVICE_TYPE_BLE) &&
+      (p_dev_rec->ble.key_type & BTM_LE_KEY_PID))
+    btm_ble_rpa_resolver.AddIrk(p_dev_rec->ble.keys.irk, p_dev_rec);
+  return true;
+}
 
-  if (!(p_dev_rec->device_type & BT_DEVICE_TYPE_BLE) ||
-      !(p_dev_rec->ble.key_type & BTM_LE_KEY_PID))
-    return true;
+/*******************************************************************************
+ *
+ * Function         btm_ble_update_rpa_resolver
+ *
+ * Description      This function rebuilds the peer IRKs of the RPA resolver
+ *                  when an IRK was stored or a security record was added or
+ *                  removed since the last build.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void btm_ble_update_rpa_resolver(void) {
+  if (btm_ble_rpa_resolver_generation == btm_ble_rpa_irk_generation) return;
+
+  btm_ble_rpa_resolver.Clear();
+  list_foreach(btm_cb.sec_dev_rec, btm_ble_add_rpa_resolver_irk, NULL);
+  btm_ble_rpa_resolver_generation = btm_ble_rpa_irk_generation;
+  BTM_TRACE_DEBUG("%s: %zu peer IRKs", __func__,
+                  btm_ble_rpa_resolver.IrkCount());
+}
 
-  /* generate X = E irk(R0, R1, R2) and R is random address 3 LSO */
-  SMP_Encrypt(p_dev_rec->ble.keys.irk, BT_OCTET16_LEN, &rand[0], 3, &output);
-  // if it was match, finish iteration, otherwise continue
-  return !btm_ble_proc_resolve_x(output, *random_bda);
+/*******************************************************************************
+ *
+ * Function         btm_ble_rpa_resolver_match_valid
+ *
+ * Description      This function checks that the security record matched by
+ *                  the RPA resolver still has an IRK, in case its keys were
+ *                  cleared without removing the record.
+ *
+ * Returns          true if the match is valid, false otherwise.
+ *
+ ******************************************************************************/
+static bool btm_ble_rpa_resolver_match_valid(tBTM_SEC_DEV_REC* p_dev_rec) {
+  return (p_dev_rec->device_type & BT_DEVICE_TYPE_BLE) &&
+         (p_dev_rec->ble.key_type & BTM_LE_KEY_PID);
 }
 
 /*******************************************************************************
@@ -310,19 +309,37 @@ static bool btm_ble_match_random_bda(void* data, void* context) {
 tBTM_SEC_DEV_REC* btm_ble_resolve_random_addr(const RawAddress& random_bda) {
   BTM_TRACE_EVENT("%s", __func__);
 
-  /* start to resolve random address */
-  /* check for next security record */
+  btm_ble_update_rpa_resolver();
 
-  list_node_t* n = list_foreach(btm_cb.sec_dev_rec, btm_ble_match_random_bda,
-                                (void*)&random_bda);
-  tBTM_SEC_DEV_REC* p_dev_rec = nullptr;
-  if (n != nullptr) p_dev_rec = static_cast<tBTM_SEC_DEV_REC*>(list_node(n));
+  tBTM_SEC_DEV_REC* p_dev_rec = static_cast<tBTM_SEC_DEV_REC*>(
+      btm_ble_rpa_resolver.Resolve(random_bda, time_get_os_boottime_ms()));
+  if (p_dev_rec != nullptr && !btm_ble_rpa_resolver_match_valid(p_dev_rec)) {
+    /* The keys of the record were removed since the resolver was built */
+    btm_ble_rpa_irks_changed();
+    btm_ble_update_rpa_resolver();
+    p_dev_rec = static_cast<tBTM_SEC_DEV_REC*>(
+        btm_ble_rpa_resolver.Resolve(random_bda, time_get_os_boottime_ms()));
+  }
 
   BTM_TRACE_EVENT("%s:  %sresolved", __func__,
                   (p_dev_rec == nullptr ? "not " : ""));
   return p_dev_rec;
 }
 
+/*******************************************************************************
+ *
+ * Function         btm_ble_rpa_resolver_debug_dump
+ *
+ * Description      This function dumps the RPA resolver statistics.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void btm_ble_rpa_resolver_debug_dump(int fd) {
+  dprintf(fd, "\nLE RPA Resolver:\n");
+  btm_ble_rpa_resolver.DebugDump(fd);
+}
+
 /*******************************************************************************
  *  address mapping between pseudo address and real connection address
  ******************************************************************************/
@@ -28,6 +28,7 @@
 #include "bt_types.h"
 #include "bt_utils.h"
 #include "btm_ble_api.h"
+#include "btm_ble_host_filter.h"
 #include "btm_int.h"
 #include "btu.h"
 #include "device/include/controller.h"
@@ -56,6 +57,9 @@ using bluetooth::Uuid;
 tBTM_BLE_ADV_FILTER_CB btm_ble_adv_filt_cb;
 tBTM_BLE_VSC_CB cmn_ble_vsc_cb;
 
+/* Filters evaluated by the host when the controller does not support APCF */
+static BleHostScanFilter host_scan_filter;
+
 static uint8_t btm_ble_cs_update_pf_counter(tBTM_BLE_SCAN_COND_OP action,
                                             uint8_t cond_type,
                                             tBLE_BD_ADDR* p_bd_addr,
@@ -80,6 +84,23 @@ bool is_filtering_supported() {
   return cmn_ble_vsc_cb.filter_support != 0 && cmn_ble_vsc_cb.max_filter != 0;
 }
 
+/*******************************************************************************
+ *
+ * Function         btm_ble_host_filter_matches
+ *
+ * Description      Evaluate the adv payload filters on a complete, valid
+ *                  advertising report, when they are not offloaded to the
+ *                  controller.
+ *
+ * Returns          false if the report is to be dropped
+ *
+ ******************************************************************************/
+bool btm_ble_host_filter_matches(const RawAddress& bda, int8_t rssi,
+                                 const uint8_t* data, size_t len) {
+  if (!host_scan_filter.IsActive()) return true;
+  return host_scan_filter.Matches(bda, rssi, data, len);
+}
+
 /*******************************************************************************
  *
  * Function         btm_ble_condtype_to_ocf
@@ -600,7 +621,11 @@ void BTM_LE_PF_set(tBTM_BLE_PF_FILT_INDEX filt_index,
                    std::vector<ApcfCommand> commands,
                    tBTM_BLE_PF_CFG_CBACK cb) {
   if (!is_filtering_supported()) {
-    cb.Run(0, BTM_BLE_PF_ENABLE, 1 /* BTA_FAILURE */);
+    if (!host_scan_filter.Add(filt_index, commands)) {
+      cb.Run(0, BTM_BLE_PF_ENABLE, 1 /* BTA_FAILURE */);
+      return;
+    }
+    cb.Run(0, 0, 0);
     return;
   }
 
@@ -667,7 +692,8 @@ void BTM_LE_PF_set(tBTM_BLE_PF_FILT_INDEX filt_index,
 void BTM_LE_PF_clear(tBTM_BLE_PF_FILT_INDEX filt_index,
                      tBTM_BLE_PF_CFG_CBACK cb) {
   if (!is_filtering_supported()) {
-    cb.Run(0, BTM_BLE_PF_ENABLE, 1 /* BTA_FAILURE */);
+    host_scan_filter.Clear(filt_index);
+    cb.Run(0, BTM_BLE_SCAN_COND_CLEAR, 0);
     return;
   }
 
@@ -721,6 +747,39 @@ void BTM_LE_PF_clear(tBTM_BLE_PF_FILT_INDEX filt_index,
   memset(&btm_ble_adv_filt_cb.cur_filter_target, 0, sizeof(tBLE_BD_ADDR));
 }
 
+/*******************************************************************************
+ *
+ * Function         btm_ble_host_filter_param_setup
+ *
+ * Description      Setup the parameters of a filter evaluated by the host.
+ *                  Only the immediate delivery mode is supported, on found and
+ *                  on lost tracking needs the controller.
+ *
+ ******************************************************************************/
+static void btm_ble_host_filter_param_setup(
+    int action, tBTM_BLE_PF_FILT_INDEX filt_index,
+    const btgatt_filt_param_setup_t* p_filt_params, tBTM_BLE_PF_PARAM_CB cb) {
+  bool success = true;
+
+  if (BTM_BLE_SCAN_COND_ADD == action) {
+    if (p_filt_params == NULL || p_filt_params->dely_mode != 0x00) {
+      success = false;
+    } else {
+      success = host_scan_filter.SetParams(filt_index, *p_filt_params);
+    }
+  } else if (BTM_BLE_SCAN_COND_DELETE == action) {
+    host_scan_filter.DeleteParams(filt_index);
+  } else if (BTM_BLE_SCAN_COND_CLEAR == action) {
+    host_scan_filter.DeleteAllParams();
+  }
+
+  if (!success) {
+    cb.Run(0, BTM_BLE_PF_ENABLE, 1 /* BTA_FAILURE */);
+    return;
+  }
+  cb.Run(0, action, 0);
+}
+
 /*******************************************************************************
  *
  * Function         BTM_BleAdvFilterParamSetup
@@ -744,7 +803,8 @@ void BTM_BleAdvFilterParamSetup(
   uint8_t param[len], *p;
 
   if (!is_filtering_supported()) {
-    cb.Run(0, BTM_BLE_PF_ENABLE, 1 /* BTA_FAILURE */);
+    btm_ble_host_filter_param_setup(action, filt_index, p_filt_params.get(),
+                                    cb);
     return;
   }
 
@@ -862,7 +922,8 @@ void enable_cmpl_cback(tBTM_BLE_PF_STATUS_CBACK p_stat_cback, uint8_t* p,
 void BTM_BleEnableDisableFilterFeature(uint8_t enable,
                                        tBTM_BLE_PF_STATUS_CBACK p_stat_cback) {
   if (!is_filtering_supported()) {
-    if (p_stat_cback) p_stat_cback.Run(BTM_BLE_PF_ENABLE, 1 /* BTA_FAILURE */);
+    host_scan_filter.Enable(enable != 0);
+    if (p_stat_cback) p_stat_cback.Run(enable, 0);
     return;
   }
 
@@ -915,4 +976,5 @@ void btm_ble_adv_filter_init(void) {
  ******************************************************************************/
 void btm_ble_adv_filter_cleanup(void) {
   osi_free_and_reset((void**)&btm_ble_adv_filt_cb.p_addr_filter_count);
+  host_scan_filter = BleHostScanFilter();
 }
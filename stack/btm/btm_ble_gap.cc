@@ -30,8 +30,6 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
-#include <list>
-#include <vector>
 
 #include "bt_types.h"
 #include "bt_utils.h"
@@ -44,6 +42,7 @@
 #include "osi/include/osi.h"
 
 #include "advertise_data_parser.h"
+#include "ble_advertising_cache.h"
 #include "btm_ble_int.h"
 #include "gatt_int.h"
 #include "gattdefs.h"
@@ -62,74 +61,6 @@
 
 namespace {
 
-class AdvertisingCache {
- public:
-  /* Set the data to |data| for device |addr_type, addr| */
-  const std::vector<uint8_t>& Set(uint8_t addr_type, const RawAddress& addr,
-                                  std::vector<uint8_t> data) {
-    auto it = Find(addr_type, addr);
-    if (it != items.end()) {
-      it->data = std::move(data);
-      return it->data;
-    }
-
-    if (items.size() > cache_max) {
-      items.pop_back();
-    }
-
-    items.emplace_front(addr_type, addr, std::move(data));
-    return items.front().data;
-  }
-
-  /* Append |data| for device |addr_type, addr| */
-  const std::vector<uint8_t>& Append(uint8_t addr_type, const RawAddress& addr,
-                                     std::vector<uint8_t> data) {
-    auto it = Find(addr_type, addr);
-    if (it != items.end()) {
-      it->data.insert(it->data.end(), data.begin(), data.end());
-      return it->data;
-    }
-
-    if (items.size() > cache_max) {
-      items.pop_back();
-    }
-
-    items.emplace_front(addr_type, addr, std::move(data));
-    return items.front().data;
-  }
-
-  /* Clear data for device |addr_type, addr| */
-  void Clear(uint8_t addr_type, const RawAddress& addr) {
-    auto it = Find(addr_type, addr);
-    if (it != items.end()) {
-      items.erase(it);
-    }
-  }
-
- private:
-  struct Item {
-    uint8_t addr_type;
-    RawAddress addr;
-    std::vector<uint8_t> data;
-
-    Item(uint8_t addr_type, const RawAddress& addr, std::vector<uint8_t> data)
-        : addr_type(addr_type), addr(addr), data(data) {}
-  };
-
-  std::list<Item>::iterator Find(uint8_t addr_type, const RawAddress& addr) {
-    for (auto it = items.begin(); it != items.end(); it++) {
-      if (it->addr_type == addr_type && it->addr == addr) {
-        return it;
-      }
-    }
-    return items.end();
-  }
-
-  /* we keep maximum 7 devices in the cache */
-  const size_t cache_max = 7;
-  std::list<Item> items;
-};
-
 /* Devices in this cache are waiting for eiter scan response, or chained packets
  * on secondary channel */
 AdvertisingCache cache;
@@ -1564,8 +1495,8 @@ static void btm_ble_update_adv_flag(uint8_t flag) {
  * Check ADV flag to make sure device is discoverable and match the search
  * condition
  */
-uint8_t btm_ble_is_discoverable(const RawAddress& bda,
-                                std::vector<uint8_t> const& adv_data) {
+uint8_t btm_ble_is_discoverable(const RawAddress& bda, const uint8_t* adv_data,
+                                size_t adv_data_len) {
   uint8_t flag = 0, rt = 0;
   uint8_t data_len;
   tBTM_INQ_PARMS* p_cond = &btm_cb.btm_inq_vars.inqparms;
@@ -1581,9 +1512,9 @@ uint8_t btm_ble_is_discoverable(const RawAddress& bda,
     return rt;
   }
 
-  if (!adv_data.empty()) {
+  if (adv_data_len != 0) {
     const uint8_t* p_flag = AdvertiseDataParser::GetFieldByType(
-        adv_data, BTM_BLE_AD_TYPE_FLAG, &data_len);
+        adv_data, adv_data_len, BTM_BLE_AD_TYPE_FLAG, &data_len);
     if (p_flag != NULL) {
       flag = *p_flag;
 
@@ -1736,7 +1667,7 @@ void btm_ble_update_inq_result(tINQ_DB_ENT* p_i, uint8_t addr_type,
                                uint8_t primary_phy, uint8_t secondary_phy,
                                uint8_t advertising_sid, int8_t tx_power,
                                int8_t rssi, uint16_t periodic_adv_int,
-                               std::vector<uint8_t> const& data) {
+                               const uint8_t* data, size_t data_len) {
   tBTM_INQ_RESULTS* p_cur = &p_i->inq_info.results;
   uint8_t len;
   tBTM_INQUIRY_VAR_ST* p_inq = &btm_cb.btm_inq_vars;
@@ -1767,13 +1698,13 @@ void btm_ble_update_inq_result(tINQ_DB_ENT* p_i, uint8_t addr_type,
 
   p_i->inq_count = p_inq->inq_counter; /* Mark entry for current inquiry */
 
-  if (!data.empty()) {
-    const uint8_t* p_flag =
-        AdvertiseDataParser::GetFieldByType(data, BTM_BLE_AD_TYPE_FLAG, &len);
+  if (data_len != 0) {
+    const uint8_t* p_flag = AdvertiseDataParser::GetFieldByType(
+        data, data_len, BTM_BLE_AD_TYPE_FLAG, &len);
     if (p_flag != NULL) p_cur->flag = *p_flag;
   }
 
-  if (!data.empty()) {
+  if (data_len != 0) {
     /* Check to see the BLE device has the Appearance UUID in the advertising
      * data.  If it does
      * then try to convert the appearance value to a class of device value
@@ -1782,13 +1713,13 @@ void btm_ble_update_inq_result(tINQ_DB_ENT* p_i, uint8_t addr_type,
      * service class.
      */
     const uint8_t* p_uuid16 = AdvertiseDataParser::GetFieldByType(
-        data, BTM_BLE_AD_TYPE_APPEARANCE, &len);
+        data, data_len, BTM_BLE_AD_TYPE_APPEARANCE, &len);
     if (p_uuid16 && len == 2) {
       btm_ble_appearance_to_cod((uint16_t)p_uuid16[0] | (p_uuid16[1] << 8),
                                 p_cur->dev_class);
     } else {
       p_uuid16 = AdvertiseDataParser::GetFieldByType(
-          data, BTM_BLE_AD_TYPE_16SRV_CMPL, &len);
+          data, data_len, BTM_BLE_AD_TYPE_16SRV_CMPL, &len);
       if (p_uuid16 != NULL) {
         uint8_t i;
         for (i = 0; i + 2 <= len; i = i + 2) {
@@ -2017,44 +1948,66 @@ static void btm_ble_process_adv_pkt_cont(
   tBTM_INQUIRY_VAR_ST* p_inq = &btm_cb.btm_inq_vars;
   bool update = true;
 
-  std::vector<uint8_t> tmp;
-  if (data_len != 0) tmp.insert(tmp.begin(), data, data + data_len);
-
   bool is_scannable = ble_evt_type_is_scannable(evt_type);
   bool is_scan_resp = ble_evt_type_is_scan_resp(evt_type);
 
   bool is_start =
       ble_evt_type_is_legacy(evt_type) && is_scannable && !is_scan_resp;
 
+  const uint8_t* adv_data = data;
+  size_t adv_data_len = data_len;
   if (ble_evt_type_is_legacy(evt_type))
-    AdvertiseDataParser::RemoveTrailingZeros(tmp);
-
-  // We might have send scan request to this device before, but didn't get the
-  // response. In such case make sure data is put at start, not appended to
-  // already existing data.
-  std::vector<uint8_t> const& adv_data =
-      is_start ? cache.Set(addr_type, bda, std::move(tmp))
-               : cache.Append(addr_type, bda, std::move(tmp));
+    adv_data_len =
+        AdvertiseDataParser::LengthWithoutTrailingZeros(data, data_len);
 
   bool data_complete = (ble_evt_type_data_status(evt_type) != 0x01);
 
+  bool is_active_scan =
+      btm_cb.ble_ctr_cb.inq_var.scan_type == BTM_BLE_SCAN_MODE_ACTI;
+  bool wait_scan_rsp = is_active_scan && is_scannable && !is_scan_resp;
+
+  // The data of a report that is complete by itself is used in place. Only
+  // the data waiting for more chained packets or for a scan response goes
+  // through the cache.
+  bool reassemble = !data_complete || wait_scan_rsp;
+  if (is_start) {
+    // We might have send scan request to this device before, but didn't get
+    // the response. In such case make sure data is put at start, not appended
+    // to already existing data.
+    if (reassemble) {
+      adv_data = cache.Set(addr_type, bda, advertising_sid, data, adv_data_len,
+                           &adv_data_len);
+    } else {
+      cache.Clear(addr_type, bda, advertising_sid);
+    }
+  } else if (reassemble || cache.Contains(addr_type, bda, advertising_sid)) {
+    adv_data = cache.Append(addr_type, bda, advertising_sid, data,
+                            adv_data_len, &adv_data_len);
+  }
+
   if (!data_complete) {
     // If we didn't receive whole adv data yet, don't report the device.
     DVLOG(1) << "Data not complete yet, waiting for more " << bda;
     return;
   }
 
-  bool is_active_scan =
-      btm_cb.ble_ctr_cb.inq_var.scan_type == BTM_BLE_SCAN_MODE_ACTI;
-  if (is_active_scan && is_scannable && !is_scan_resp) {
+  if (wait_scan_rsp) {
     // If we didn't receive scan response yet, don't report the device.
     DVLOG(1) << " Waiting for scan response " << bda;
     return;
   }
 
-  if (!AdvertiseDataParser::IsValid(adv_data)) {
+  if (!AdvertiseDataParser::IsValid(adv_data, adv_data_len)) {
     DVLOG(1) << __func__ << "Dropping bad advertisement packet: "
-             << base::HexEncode(adv_data.data(), adv_data.size());
+             << base::HexEncode(adv_data, adv_data_len);
+    cache.Clear(addr_type, bda, advertising_sid);
+    return;
+  }
+
+  // Without APCF offload, drop the reports no filter is interested in before
+  // they reach the inquiry database.
+  if (!btm_ble_host_filter_matches(bda, rssi, adv_data, adv_data_len)) {
+    cache.Clear(addr_type, bda, advertising_sid);
     return;
   }
 
@@ -2071,6 +2024,7 @@ static void btm_ble_process_adv_pkt_cont(
       update = false;
     } else {
       /* if yes, skip it */
+      cache.Clear(addr_type, bda, advertising_sid);
       return; /* assumption: one result per event */
     }
   }
@@ -2091,11 +2045,11 @@ static void btm_ble_process_adv_pkt_cont(
   /* update the LE device information in inquiry database */
   btm_ble_update_inq_result(p_i, addr_type, bda, evt_type, primary_phy,
                             secondary_phy, advertising_sid, tx_power, rssi,
-                            periodic_adv_int, adv_data);
+                            periodic_adv_int, adv_data, adv_data_len);
 
-  uint8_t result = btm_ble_is_discoverable(bda, adv_data);
+  uint8_t result = btm_ble_is_discoverable(bda, adv_data, adv_data_len);
   if (result == 0) {
-    cache.Clear(addr_type, bda);
+    cache.Clear(addr_type, bda, advertising_sid);
     LOG_WARN(LOG_TAG,
              "%s device no longer discoverable, discarding advertising packet",
              __func__);
@@ -2130,16 +2084,16 @@ static void btm_ble_process_adv_pkt_cont(
   tBTM_INQ_RESULTS_CB* p_inq_results_cb = p_inq->p_inq_results_cb;
   if (p_inq_results_cb && (result & BTM_BLE_INQ_RESULT)) {
     (p_inq_results_cb)((tBTM_INQ_RESULTS*)&p_i->inq_info.results,
-                       const_cast<uint8_t*>(adv_data.data()), adv_data.size());
+                       const_cast<uint8_t*>(adv_data), adv_data_len);
   }
 
   tBTM_INQ_RESULTS_CB* p_obs_results_cb = btm_cb.ble_ctr_cb.p_obs_results_cb;
   if (p_obs_results_cb && (result & BTM_BLE_OBS_RESULT)) {
     (p_obs_results_cb)((tBTM_INQ_RESULTS*)&p_i->inq_info.results,
-                       const_cast<uint8_t*>(adv_data.data()), adv_data.size());
+                       const_cast<uint8_t*>(adv_data), adv_data_len);
   }
 
-  cache.Clear(addr_type, bda);
+  cache.Clear(addr_type, bda, advertising_sid);
 }
 
 void btm_ble_process_phy_update_pkt(uint8_t len, uint8_t* data) {
@@ -0,0 +1,382 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "btm_ble_host_filter.h"
+
+#include <base/logging.h>
+#include <string.h>
+
+#include <algorithm>
+
+using bluetooth::Uuid;
+
+static_assert(BleHostScanFilter::kMaxFilters <= 32,
+              "filters in use must fit in a uint32_t bit mask");
+static_assert(BTM_BLE_PF_TYPE_ALL <= 8,
+              "condition types in use must fit in a uint8_t bit mask");
+
+constexpr size_t BleHostScanFilter::kMaxFilters;
+constexpr size_t BleHostScanFilter::kMaxConditions;
+constexpr size_t BleHostScanFilter::kMaxPatternLen;
+
+namespace {
+constexpr uint8_t kAdTypeMore16BitUuids = 0x02;
+constexpr uint8_t kAdTypeComplete16BitUuids = 0x03;
+constexpr uint8_t kAdTypeMore32BitUuids = 0x04;
+constexpr uint8_t kAdTypeComplete32BitUuids = 0x05;
+constexpr uint8_t kAdTypeMore128BitUuids = 0x06;
+constexpr uint8_t kAdTypeComplete128BitUuids = 0x07;
+constexpr uint8_t kAdTypeShortenedName = 0x08;
+constexpr uint8_t kAdTypeCompleteName = 0x09;
+constexpr uint8_t kAdTypeSolicitation16BitUuids = 0x14;
+constexpr uint8_t kAdTypeSolicitation128BitUuids = 0x15;
+constexpr uint8_t kAdTypeServiceData16BitUuid = 0x16;
+constexpr uint8_t kAdTypeSolicitation32BitUuids = 0x1f;
+constexpr uint8_t kAdTypeServiceData32BitUuid = 0x20;
+constexpr uint8_t kAdTypeServiceData128BitUuid = 0x21;
+constexpr uint8_t kAdTypeManufacturerData = 0xff;
+
+/* Patterns of the manufacturer and service data, as sent to the controller */
+constexpr size_t kMaxDataPatternLen = BTM_BLE_PF_STR_LEN_MAX - 2;
+
+/* Bluetooth Base UUID, least significant octet first. 16 and 32 bit UUIDs
+ * are stored in octets 12 to 15. */
+constexpr uint8_t kBaseUuidLe[Uuid::kNumBytes128] = {
+    0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80,
+    0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+inline uint8_t type_bit(uint8_t type) { return 1 << type; }
+}  // namespace
+
+BleHostScanFilter::BleHostScanFilter()
+    : enabled_(false),
+      active_filters_(0),
+      num_conditions_(0),
+      types_in_use_(0),
+      evaluated_(0),
+      dropped_(0) {
+  memset(params_, 0, sizeof(params_));
+  memset(num_of_type_, 0, sizeof(num_of_type_));
+}
+
+bool BleHostScanFilter::Compile(uint8_t filter, const ApcfCommand& cmd,
+                                Condition* cond) {
+  memset(cond, 0, sizeof(*cond));
+  cond->filter = filter;
+  cond->type = cmd.type;
+
+  switch (cmd.type) {
+    case BTM_BLE_PF_ADDR_FILTER:
+      cond->addr = cmd.address;
+      return true;
+
+    case BTM_BLE_PF_SRVC_DATA:
+      /* Matches any service data */
+      return true;
+
+    case BTM_BLE_PF_SRVC_UUID:
+    case BTM_BLE_PF_SRVC_SOL_UUID: {
+      size_t uuid_len = cmd.uuid.GetShortestRepresentationSize();
+      const Uuid::UUID128Bit uuid = cmd.uuid.To128BitLE();
+      cond->len = Uuid::kNumBytes128;
+      memcpy(cond->value, uuid.data(), Uuid::kNumBytes128);
+      memset(cond->mask, 0xff, Uuid::kNumBytes128);
+      if (cmd.uuid_mask.IsEmpty()) return true;
+
+      /* The mask only applies to the octets of the shortest representation,
+       * the others have to be the ones of the Base UUID */
+      const Uuid::UUID128Bit mask = cmd.uuid_mask.To128BitLE();
+      size_t offset = (uuid_len == Uuid::kNumBytes128) ? 0 : 12;
+      memcpy(cond->mask + offset, mask.data() + offset, uuid_len);
+      return true;
+    }
+
+    case BTM_BLE_PF_LOCAL_NAME:
+      cond->len = std::min(cmd.name.size(), kMaxPatternLen);
+      memcpy(cond->value, cmd.name.data(), cond->len);
+      memset(cond->mask, 0xff, cond->len);
+      return true;
+
+    case BTM_BLE_PF_MANU_DATA:
+      cond->company = cmd.company;
+      cond->company_mask = cmd.company_mask ? cmd.company_mask : 0xffff;
+      /* As with the controller, the data is ignored without a mask */
+      if (cmd.data_mask.empty()) return true;
+      cond->len = std::min(cmd.data.size(), kMaxDataPatternLen);
+      memcpy(cond->value, cmd.data.data(), cond->len);
+      memcpy(cond->mask, cmd.data_mask.data(), cond->len);
+      return true;
+
+    case BTM_BLE_PF_SRVC_DATA_PATTERN:
+      cond->len = std::min(cmd.data.size(), kMaxDataPatternLen);
+      memcpy(cond->value, cmd.data.data(), cond->len);
+      if (cmd.data_mask.empty())
+        memset(cond->mask, 0xff, cond->len);
+      else
+        memcpy(cond->mask, cmd.data_mask.data(), cond->len);
+      return true;
+
+    default:
+      LOG(ERROR) << __func__ << ": Unknown filter type: " << +cmd.type;
+      return false;
+  }
+}
+
+bool BleHostScanFilter::Add(uint8_t filt_index,
+                            const std::vector<ApcfCommand>& commands) {
+  if (filt_index >= kMaxFilters) return false;
+
+  Condition compiled[kMaxConditions];
+  size_t count = 0;
+  for (const ApcfCommand& cmd : commands) {
+    /* If data is passed, both mask and data have to be the same length */
+    if (cmd.data.size() != cmd.data_mask.size() && cmd.data.size() != 0 &&
+        cmd.data_mask.size() != 0) {
+      LOG(ERROR) << __func__ << " data(" << cmd.data.size() << ") and mask("
+                 << cmd.data_mask.size() << ") are of different size";
+      continue;
+    }
+
+    if (num_conditions_ + count == kMaxConditions) {
+      LOG(ERROR) << __func__ << ": too many conditions";
+      return false;
+    }
+    if (Compile(filt_index, cmd, &compiled[count])) count++;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    const Condition& cond = compiled[i];
+    conditions_[num_conditions_++] = cond;
+    num_of_type_[filt_index][cond.type]++;
+    types_in_use_ |= type_bit(cond.type);
+  }
+  return true;
+}
+
+void BleHostScanFilter::Clear(uint8_t filt_index) {
+  if (filt_index >= kMaxFilters) return;
+
+  size_t kept = 0;
+  types_in_use_ = 0;
+  for (size_t i = 0; i < num_conditions_; i++) {
+    if (conditions_[i].filter == filt_index) continue;
+    if (kept != i) conditions_[kept] = conditions_[i];
+    types_in_use_ |= type_bit(conditions_[kept].type);
+    kept++;
+  }
+  num_conditions_ = kept;
+  memset(num_of_type_[filt_index], 0, sizeof(num_of_type_[filt_index]));
+}
+
+bool BleHostScanFilter::SetParams(uint8_t filt_index,
+                                  const btgatt_filt_param_setup_t& params) {
+  if (filt_index >= kMaxFilters) return false;
+
+  Params& p = params_[filt_index];
+  p.feat_seln = params.feat_seln;
+  p.list_logic_type = params.list_logic_type;
+  p.filt_logic_type = params.filt_logic_type;
+  p.rssi_high_thres = (int8_t)params.rssi_high_thres;
+  active_filters_ |= 1u << filt_index;
+  return true;
+}
+
+void BleHostScanFilter::DeleteParams(uint8_t filt_index) {
+  if (filt_index >= kMaxFilters) return;
+  active_filters_ &= ~(1u << filt_index);
+}
+
+void BleHostScanFilter::DeleteAllParams() { active_filters_ = 0; }
+
+bool BleHostScanFilter::MatchesPattern(const Condition& cond,
+                                       const uint8_t* data, size_t len) {
+  if (len < cond.len) return false;
+  for (size_t i = 0; i < cond.len; i++) {
+    if ((data[i] ^ cond.value[i]) & cond.mask[i]) return false;
+  }
+  return true;
+}
+
+void BleHostScanFilter::MatchType(uint8_t type, const uint8_t* data,
+                                  size_t len) {
+  for (size_t i = 0; i < num_conditions_; i++) {
+    const Condition& cond = conditions_[i];
+    if (cond.type != type || cond_matched_[i]) continue;
+
+    bool matched;
+    if (type == BTM_BLE_PF_MANU_DATA) {
+      if (len < 2) continue;
+      uint16_t company = data[0] | (data[1] << 8);
+      matched = ((company ^ cond.company) & cond.company_mask) == 0 &&
+                MatchesPattern(cond, data + 2, len - 2);
+    } else {
+      matched = MatchesPattern(cond, data, len);
+    }
+
+    if (matched) {
+      cond_matched_[i] = true;
+      matched_of_type_[cond.filter][type]++;
+    }
+  }
+}
+
+void BleHostScanFilter::MatchUuids(uint8_t type, const uint8_t* data,
+                                   size_t len, size_t uuid_len) {
+  uint8_t uuid[Uuid::kNumBytes128];
+  memcpy(uuid, kBaseUuidLe, sizeof(uuid));
+  size_t offset = (uuid_len == Uuid::kNumBytes128) ? 0 : 12;
+
+  for (size_t pos = 0; pos + uuid_len <= len; pos += uuid_len) {
+    memcpy(uuid + offset, data + pos, uuid_len);
+    MatchType(type, uuid, sizeof(uuid));
+  }
+}
+
+void BleHostScanFilter::MatchField(uint8_t ad_type, const uint8_t* data,
+                                   size_t len) {
+  switch (ad_type) {
+    case kAdTypeMore16BitUuids:
+    case kAdTypeComplete16BitUuids:
+      if (types_in_use_ & type_bit(BTM_BLE_PF_SRVC_UUID))
+        MatchUuids(BTM_BLE_PF_SRVC_UUID, data, len, Uuid::kNumBytes16);
+      break;
+
+    case kAdTypeMore32BitUuids:
+    case kAdTypeComplete32BitUuids:
+      if (types_in_use_ & type_bit(BTM_BLE_PF_SRVC_UUID))
+        MatchUuids(BTM_BLE_PF_SRVC_UUID, data, len, Uuid::kNumBytes32);
+      break;
+
+    case kAdTypeMore128BitUuids:
+    case kAdTypeComplete128BitUuids:
+      if (types_in_use_ & type_bit(BTM_BLE_PF_SRVC_UUID))
+        MatchUuids(BTM_BLE_PF_SRVC_UUID, data, len, Uuid::kNumBytes128);
+      break;
+
+    case kAdTypeSolicitation16BitUuids:
+      if (types_in_use_ & type_bit(BTM_BLE_PF_SRVC_SOL_UUID))
+        MatchUuids(BTM_BLE_PF_SRVC_SOL_UUID, data, len, Uuid::kNumBytes16);
+      break;
+
+    case kAdTypeSolicitation32BitUuids:
+      if (types_in_use_ & type_bit(BTM_BLE_PF_SRVC_SOL_UUID))
+        MatchUuids(BTM_BLE_PF_SRVC_SOL_UUID, data, len, Uuid::kNumBytes32);
+      break;
+
+    case kAdTypeSolicitation128BitUuids:
+      if (types_in_use_ & type_bit(BTM_BLE_PF_SRVC_SOL_UUID))
+        MatchUuids(BTM_BLE_PF_SRVC_SOL_UUID, data, len, Uuid::kNumBytes128);
+      break;
+
+    case kAdTypeShortenedName:
+    case kAdTypeCompleteName:
+      if (types_in_use_ & type_bit(BTM_BLE_PF_LOCAL_NAME))
+        MatchType(BTM_BLE_PF_LOCAL_NAME, data, len);
+      break;
+
+    case kAdTypeManufacturerData:
+      if (types_in_use_ & type_bit(BTM_BLE_PF_MANU_DATA))
+        MatchType(BTM_BLE_PF_MANU_DATA, data, len);
+      break;
+
+    case kAdTypeServiceData16BitUuid:
+    case kAdTypeServiceData32BitUuid:
+    case kAdTypeServiceData128BitUuid:
+      if (types_in_use_ & type_bit(BTM_BLE_PF_SRVC_DATA))
+        MatchType(BTM_BLE_PF_SRVC_DATA, data, len);
+      if (types_in_use_ & type_bit(BTM_BLE_PF_SRVC_DATA_PATTERN))
+        MatchType(BTM_BLE_PF_SRVC_DATA_PATTERN, data, len);
+      break;
+
+    default:
+      break;
+  }
+}
+
+bool BleHostScanFilter::FilterMatches(uint8_t filter) const {
+  const Params& p = params_[filter];
+  bool any = false;
+  bool all = true;
+  bool evaluated = false;
+
+  for (uint8_t type = 0; type < BTM_BLE_PF_TYPE_ALL; type++) {
+    /* Features without conditions are not evaluated */
+    uint8_t count = num_of_type_[filter][type];
+    if (!(p.feat_seln & (1 << type)) || count == 0) continue;
+
+    uint8_t matched = matched_of_type_[filter][type];
+    bool feature_matched =
+        (p.list_logic_type & (1 << type)) ? matched == count : matched != 0;
+
+    if (type == BTM_BLE_PF_ADDR_FILTER) {
+      if (!feature_matched) return false;
+      continue;
+    }
+    evaluated = true;
+    any |= feature_matched;
+    all &= feature_matched;
+  }
+
+  if (!evaluated) return true;
+  return (p.filt_logic_type == BTM_BLE_PF_LOGIC_AND) ? all : any;
+}
+
+bool BleHostScanFilter::Matches(const RawAddress& addr, int8_t rssi,
+                                const uint8_t* data, size_t len) {
+  if (!IsActive()) return true;
+  evaluated_++;
+
+  /* Filters the report is strong enough for */
+  uint32_t candidates = 0;
+  for (size_t filter = 0; filter < kMaxFilters; filter++) {
+    if ((active_filters_ & (1u << filter)) &&
+        rssi >= params_[filter].rssi_high_thres)
+      candidates |= 1u << filter;
+  }
+
+  if (candidates != 0) {
+    memset(cond_matched_, 0, num_conditions_ * sizeof(cond_matched_[0]));
+    memset(matched_of_type_, 0, sizeof(matched_of_type_));
+
+    if (types_in_use_ & type_bit(BTM_BLE_PF_ADDR_FILTER)) {
+      for (size_t i = 0; i < num_conditions_; i++) {
+        const Condition& cond = conditions_[i];
+        if (cond.type == BTM_BLE_PF_ADDR_FILTER && cond.addr == addr) {
+          cond_matched_[i] = true;
+          matched_of_type_[cond.filter][BTM_BLE_PF_ADDR_FILTER]++;
+        }
+      }
+    }
+
+    /* Single pass over the AD structures */
+    size_t pos = 0;
+    while (types_in_use_ != 0 && pos + 1 < len) {
+      uint8_t field_len = data[pos];
+      if (field_len == 0 || pos + 1 + field_len > len) break;
+      MatchField(data[pos + 1], data + pos + 2, field_len - 1);
+      pos += field_len + 1;
+    }
+
+    for (uint8_t filter = 0; filter < kMaxFilters; filter++) {
+      if ((candidates & (1u << filter)) && FilterMatches(filter)) return true;
+    }
+  }
+
+  dropped_++;
+  return false;
+}
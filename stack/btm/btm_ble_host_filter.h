@@ -0,0 +1,134 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef BTM_BLE_HOST_FILTER_H
+#define BTM_BLE_HOST_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <hardware/bt_common_types.h>
+
+#include "bt_types.h"
+#include "btm_api_types.h"
+#include "btm_ble_api_types.h"
+
+/* Host side evaluation of the advertising packet content filters (APCF),
+ * used when the controller does not offload them.
+ *
+ * The conditions are compiled when they are added: UUIDs are expanded to 128
+ * bits together with their mask, and the name, manufacturer data and service
+ * data patterns are stored with their mask in fixed size conditions. A report
+ * is then matched in a single pass over its AD structures, without allocating
+ * memory, before the inquiry database is updated.
+ *
+ * The semantics follow the APCF vendor command: each filter index selects the
+ * features to match in |feat_seln|; the conditions of a feature are combined
+ * per |list_logic_type|, and the features per |filt_logic_type|, except for
+ * the address which always has to match. A report is kept if it matches any
+ * filter with parameters set, and reaches |rssi_high_thres|. */
+class BleHostScanFilter {
+ public:
+  static constexpr size_t kMaxFilters = 16;
+  static constexpr size_t kMaxConditions = 64;
+  static constexpr size_t kMaxPatternLen = BTM_BLE_PF_STR_LEN_MAX;
+
+  BleHostScanFilter();
+
+  /* Add the conditions in |commands| to filter |filt_index|. Returns false,
+   * leaving the filter unchanged, if the index is out of range or there is no
+   * room left for the conditions. */
+  bool Add(uint8_t filt_index, const std::vector<ApcfCommand>& commands);
+
+  /* Remove all the conditions of filter |filt_index| */
+  void Clear(uint8_t filt_index);
+
+  /* Set the parameters of filter |filt_index|, which starts using it.
+   * Returns false if the index is out of range. */
+  bool SetParams(uint8_t filt_index, const btgatt_filt_param_setup_t& params);
+
+  /* Stop using filter |filt_index|, or all the filters */
+  void DeleteParams(uint8_t filt_index);
+  void DeleteAllParams();
+
+  void Enable(bool enable) { enabled_ = enable; }
+
+  /* Return true if reports are being filtered */
+  bool IsActive() const { return enabled_ && active_filters_ != 0; }
+
+  /* Return true if the report from |addr| with |rssi| and advertising data
+   * |data| of length |len| matches a filter in use. The data must have been
+   * validated with AdvertiseDataParser::IsValid(). */
+  bool Matches(const RawAddress& addr, int8_t rssi, const uint8_t* data,
+               size_t len);
+
+  size_t ConditionCount() const { return num_conditions_; }
+  uint64_t Evaluated() const { return evaluated_; }
+  uint64_t Dropped() const { return dropped_; }
+
+ private:
+  struct Condition {
+    uint8_t filter;
+    uint8_t type; /* BTM_BLE_PF_* */
+    uint8_t len;
+    uint16_t company;
+    uint16_t company_mask;
+    RawAddress addr;
+    uint8_t value[kMaxPatternLen];
+    uint8_t mask[kMaxPatternLen];
+  };
+
+  struct Params {
+    uint16_t feat_seln;
+    uint16_t list_logic_type;
+    uint8_t filt_logic_type;
+    int8_t rssi_high_thres;
+  };
+
+  static bool Compile(uint8_t filter, const ApcfCommand& cmd,
+                      Condition* cond);
+  static bool MatchesPattern(const Condition& cond, const uint8_t* data,
+                             size_t len);
+  void MatchUuids(uint8_t type, const uint8_t* data, size_t len,
+                  size_t uuid_len);
+  void MatchField(uint8_t ad_type, const uint8_t* data, size_t len);
+  void MatchType(uint8_t type, const uint8_t* data, size_t len);
+  bool FilterMatches(uint8_t filter) const;
+
+  bool enabled_;
+  uint32_t active_filters_;
+  Params params_[kMaxFilters];
+  /* Number of conditions of each filter, per type */
+  uint8_t num_of_type_[kMaxFilters][BTM_BLE_PF_TYPE_ALL];
+
+  Condition conditions_[kMaxConditions];
+  size_t num_conditions_;
+  /* Bit mask of the condition types in use */
+  uint8_t types_in_use_;
+
+  /* Per report state: conditions matched, and their count per filter/type */
+  bool cond_matched_[kMaxConditions];
+  uint8_t matched_of_type_[kMaxFilters][BTM_BLE_PF_TYPE_ALL];
+
+  uint64_t evaluated_;
+  uint64_t dropped_;
+};
+
+#endif  // BTM_BLE_HOST_FILTER_H
@@ -0,0 +1,203 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include "btm_ble_rpa_resolver.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+// Offset of the 24-bit prand and hash in the AES blocks of ah(), which are
+// most significant octet first and have the prand zero padded on the left.
+constexpr size_t kAhOffset = N_BLOCK - 3;
+
+// Number of IRKs encrypted together when resolving an RPA
+constexpr size_t kIrkBatch = 4;
+
+// Lays out the ah() input block for the prand of |rpa|, the 3 most
+// significant octets of the address.
+void ah_prand_block(const RawAddress& rpa, uint8_t block[N_BLOCK]) {
+  memset(block, 0, N_BLOCK);
+  memcpy(block + kAhOffset, &rpa.address[0], 3);
+}
+
+// Returns true if the ah() output |block| is the hash of |rpa|, the 3 least
+// significant octets of the address.
+bool ah_hash_matches(const RawAddress& rpa, const uint8_t block[N_BLOCK]) {
+  return memcmp(block + kAhOffset, &rpa.address[3], 3) == 0;
+}
+
+void irk_expand_key(const BT_OCTET16 irk, aes_context* ctx) {
+  uint8_t key[BT_OCTET16_LEN];
+  for (size_t i = 0; i < BT_OCTET16_LEN; i++)
+    key[i] = irk[BT_OCTET16_LEN - 1 - i];
+  aes_set_key(key, BT_OCTET16_LEN, ctx);
+}
+}  // namespace
+
+constexpr size_t BtmBleRpaResolver::kCacheSets;
+constexpr size_t BtmBleRpaResolver::kCacheWays;
+
+BtmBleRpaResolver::BtmBleRpaResolver(uint64_t expiry_ms)
+    : expiry_ms_(expiry_ms),
+      cache_hits_(0),
+      cache_misses_(0),
+      resolved_(0),
+      unresolved_(0),
+      irk_evaluations_(0) {
+  ClearCache();
+}
+
+void BtmBleRpaResolver::AddIrk(const BT_OCTET16 irk, void* identity) {
+  Irk entry;
+  irk_expand_key(irk, &entry.ctx);
+  entry.identity = identity;
+  irks_.push_back(entry);
+  // Some of the cached RPAs that matched no IRK may match this one
+  ClearCache();
+}
+
+void BtmBleRpaResolver::Clear() {
+  irks_.clear();
+  ClearCache();
+}
+
+void BtmBleRpaResolver::ClearCache() {
+  memset(cache_, 0, sizeof(cache_));
+  use_counter_ = 0;
+}
+
+size_t BtmBleRpaResolver::CacheSet(const RawAddress& rpa) {
+  // The hash and the prand are both random, use a few octets of each
+  uint32_t h = rpa.address[5] | (rpa.address[4] << 8) | (rpa.address[2] << 16);
+  h *= 0x9e3779b1;
+  return (h >> 24) & (kCacheSets - 1);
+}
+
+void* BtmBleRpaResolver::MatchIrks(const RawAddress& rpa) {
+  uint8_t prand[N_BLOCK];
+  ah_prand_block(rpa, prand);
+
+  // The IRKs are tried a batch at a time, so that their encryptions can be
+  // pipelined
+  uint8_t hashes[kIrkBatch][N_BLOCK];
+  const unsigned char* in[kIrkBatch];
+  unsigned char* out[kIrkBatch];
+  const aes_context* ctx[kIrkBatch];
+  for (size_t i = 0; i < kIrkBatch; i++) {
+    in[i] = prand;
+    out[i] = hashes[i];
+  }
+
+  for (size_t first = 0; first < irks_.size(); first += kIrkBatch) {
+    size_t count = std::min(kIrkBatch, irks_.size() - first);
+    for (size_t i = 0; i < count; i++) ctx[i] = &irks_[first + i].ctx;
+    aes_encrypt_blocks(in, out, ctx, count);
+
+    for (size_t i = 0; i < count; i++) {
+      irk_evaluations_++;
+      if (ah_hash_matches(rpa, hashes[i])) return irks_[first + i].identity;
+    }
+  }
+  return nullptr;
+}
+
+void* BtmBleRpaResolver::Resolve(const RawAddress& rpa, uint64_t now_ms) {
+  CacheEntry* set = cache_[CacheSet(rpa)];
+  CacheEntry* victim = &set[0];
+
+  for (size_t i = 0; i < kCacheWays; i++) {
+    CacheEntry* entry = &set[i];
+    if (entry->last_use != 0 && entry->expiry_ms <= now_ms)
+      entry->last_use = 0;  // Expired
+    if (entry->last_use != 0 && entry->rpa == rpa) {
+      cache_hits_++;
+      entry->last_use = ++use_counter_;
+      return entry->identity;
+    }
+    if (entry->last_use < victim->last_use) victim = entry;
+  }
+
+  cache_misses_++;
+  void* identity = MatchIrks(rpa);
+  if (identity != nullptr)
+    resolved_++;
+  else
+    unresolved_++;
+
+  // Replace the least recently used entry of the set
+  victim->rpa = rpa;
+  victim->identity = identity;
+  victim->expiry_ms = now_ms + expiry_ms_;
+  victim->last_use = ++use_counter_;
+  return identity;
+}
+
+void BtmBleRpaResolver::Invalidate(const RawAddress& rpa) {
+  CacheEntry* set = cache_[CacheSet(rpa)];
+  for (size_t i = 0; i < kCacheWays; i++) {
+    if (set[i].rpa == rpa) set[i].last_use = 0;
+  }
+}
+
+bool BtmBleRpaResolver::Matches(const RawAddress& rpa, const BT_OCTET16 irk) {
+  aes_context ctx;
+  uint8_t prand[N_BLOCK];
+  uint8_t hash[N_BLOCK];
+
+  irk_expand_key(irk, &ctx);
+  ah_prand_block(rpa, prand);
+  aes_encrypt(prand, hash, &ctx);
+  return ah_hash_matches(rpa, hash);
+}
+
+void BtmBleRpaResolver::DebugDump(int fd) const {
+  size_t cached = 0;
+  for (size_t set = 0; set < kCacheSets; set++) {
+    for (size_t way = 0; way < kCacheWays; way++) {
+      if (cache_[set][way].last_use != 0) cached++;
+    }
+  }
+
+  dprintf(fd,
+          "  Peer IRKs                                               : %zu\n",
+          irks_.size());
+  dprintf(fd,
+          "  Cached resolutions                                      : %zu / "
+          "%zu\n",
+          cached, kCacheSets * kCacheWays);
+  dprintf(fd,
+          "  Cache hits                                              : "
+          "%" PRIu64 "\n",
+          cache_hits_);
+  dprintf(fd,
+          "  Cache misses                                            : "
+          "%" PRIu64 "\n",
+          cache_misses_);
+  dprintf(fd,
+          "  Resolved / unresolved on cache miss                     : "
+          "%" PRIu64 " / %" PRIu64 "\n",
+          resolved_, unresolved_);
+  dprintf(fd,
+          "  IRK evaluations                                         : "
+          "%" PRIu64 "\n",
+          irk_evaluations_);
+}
@@ -0,0 +1,108 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef BTM_BLE_RPA_RESOLVER_H
+#define BTM_BLE_RPA_RESOLVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "aes.h"
+#include "stack/include/bt_types.h"
+
+// Resolves LE Resolvable Private Addresses (RPA) against a set of peer
+// Identity Resolving Keys (IRK).
+//
+// The AES key schedule of each IRK is expanded once, when the IRK is added,
+// and the random part of an RPA is laid out once per resolution, so matching
+// an RPA costs a single AES block encryption per IRK.
+//
+// The result of each resolution, including the RPAs that match no IRK, is
+// kept in a fixed-capacity set-associative cache keyed on the RPA. Entries
+// expire after the RPA rotation interval, and the whole cache is dropped
+// whenever the IRKs change.
+class BtmBleRpaResolver {
+ public:
+  static constexpr size_t kCacheSets = 64;
+  static constexpr size_t kCacheWays = 4;
+
+  // |expiry_ms| is how long a resolution is cached, normally the RPA
+  // rotation interval.
+  explicit BtmBleRpaResolver(uint64_t expiry_ms);
+
+  // Adds the peer |irk|, stored least significant octet first as in the
+  // security records. |identity| is returned when an RPA matches |irk|.
+  void AddIrk(const BT_OCTET16 irk, void* identity);
+
+  // Removes all the IRKs and drops the cache.
+  void Clear();
+
+  // Returns the number of IRKs.
+  size_t IrkCount() const { return irks_.size(); }
+
+  // Resolves the RPA |rpa| at time |now_ms|. Returns the identity of the
+  // matching IRK, or nullptr if no IRK matches.
+  void* Resolve(const RawAddress& rpa, uint64_t now_ms);
+
+  // Drops the cached resolution of |rpa|, if any.
+  void Invalidate(const RawAddress& rpa);
+
+  // Returns true if |rpa| matches |irk|.
+  static bool Matches(const RawAddress& rpa, const BT_OCTET16 irk);
+
+  uint64_t CacheHits() const { return cache_hits_; }
+  uint64_t CacheMisses() const { return cache_misses_; }
+  uint64_t Resolved() const { return resolved_; }
+  uint64_t Unresolved() const { return unresolved_; }
+  uint64_t IrkEvaluations() const { return irk_evaluations_; }
+
+  // Dumps the resolver statistics to the |fd| file descriptor.
+  void DebugDump(int fd) const;
+
+ private:
+  struct Irk {
+    aes_context ctx;  // Expanded from the IRK, most significant octet first
+    void* identity;
+  };
+
+  struct CacheEntry {
+    RawAddress rpa;
+    void* identity;  // nullptr if the RPA matched no IRK
+    uint64_t expiry_ms;
+    uint64_t last_use;  // 0 if the entry is unused
+  };
+
+  static size_t CacheSet(const RawAddress& rpa);
+  void* MatchIrks(const RawAddress& rpa);
+  void ClearCache();
+
+  uint64_t expiry_ms_;
+  std::vector<Irk> irks_;
+  CacheEntry cache_[kCacheSets][kCacheWays];
+  uint64_t use_counter_;
+
+  uint64_t cache_hits_;
+  uint64_t cache_misses_;
+  uint64_t resolved_;
+  uint64_t unresolved_;
+  uint64_t irk_evaluations_;
+};
+
+#endif  // BTM_BLE_RPA_RESOLVER_H
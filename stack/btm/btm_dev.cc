@@ -153,6 +153,8 @@ void wipe_secrets_and_remove(tBTM_SEC_DEV_REC* p_dev_rec) {
   memset(p_dev_rec->link_key, 0, LINK_KEY_LEN);
   memset(&p_dev_rec->ble.keys, 0, sizeof(tBTM_SEC_BLE_KEYS));
   list_remove(btm_cb.sec_dev_rec, p_dev_rec);
+  /* The RPA resolver must not keep pointing at the freed record */
+  btm_ble_rpa_irks_changed();
 }
 
 /** Free resources associated with the device associated with |bd_addr| address.
@@ -516,6 +518,7 @@ tBTM_SEC_DEV_REC* btm_sec_allocate_dev_rec(void) {
   p_dev_rec =
       static_cast<tBTM_SEC_DEV_REC*>(osi_calloc(sizeof(tBTM_SEC_DEV_REC)));
   list_append(btm_cb.sec_dev_rec, p_dev_rec);
+  btm_ble_rpa_irks_changed();
 
   // Initialize defaults
   p_dev_rec->sec_flags = BTM_SEC_IN_USE;
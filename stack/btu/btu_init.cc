@@ -93,6 +93,8 @@ void btu_free_core(void) {
 
   sdp_free();
 
+  SMP_Free();
+
   btm_free();
 }
 
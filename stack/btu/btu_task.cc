@@ -32,6 +32,7 @@
 #include "btcore/include/module.h"
 #include "bte.h"
 #include "btif/include/btif_common.h"
+#include "osi/include/latency_trace.h"
 #include "osi/include/osi.h"
 #include "osi/include/thread.h"
 #include "stack/btm/btm_int.h"
@@ -54,6 +55,7 @@ void btu_hci_msg_process(BT_HDR* p_msg) {
   switch (p_msg->event & BT_EVT_MASK) {
     case BT_EVT_TO_BTU_HCI_ACL:
       /* All Acl Data goes to L2CAP */
+      LATENCY_TRACE_MARK(p_msg, LATENCY_BTU);
       l2c_rcv_acl_data(p_msg);
       break;
 
@@ -1036,6 +1036,7 @@ void GATT_Deregister(tGATT_IF gatt_if) {
   }
 
   gatt_deregister_bgdev_list(gatt_if);
+  gatt_stream_deregister(gatt_if);
 
   memset(p_reg, 0, sizeof(tGATT_REG));
 }
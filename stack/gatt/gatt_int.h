@@ -29,6 +29,7 @@
 #include <base/strings/stringprintf.h>
 #include <string.h>
 #include <list>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -263,6 +264,16 @@ typedef struct {
   bool is_primary;
 } tGATT_SRV_LIST_ELEM;
 
+/* stream of write commands */
+typedef struct {
+  tGATT_STREAM_READY_CBACK* p_ready_cb;
+  void* context;
+  bool waiting; /* a write was refused, or congested the channel */
+  uint32_t wait_seq; /* when it started waiting, to resume in that order */
+  uint32_t num_sent;
+  uint32_t num_waits;
+} tGATT_STREAM;
+
 typedef struct {
   std::queue<tGATT_CLCB*> pending_enc_clcb; /* pending encryption channel q */
   tGATT_SEC_ACTION sec_act;
@@ -292,6 +303,9 @@ typedef struct {
   std::queue<tGATT_CMD_Q> cl_cmd_q;
   alarm_t* ind_ack_timer; /* local app confirm to indication timer */
 
+  bool congested; /* L2CAP channel congested */
+  std::unordered_map<tGATT_IF, tGATT_STREAM> streams;
+
   bool in_use;
   uint8_t tcb_idx;
 } tGATT_TCB;
@@ -430,6 +444,10 @@ extern BT_HDR* attp_build_sr_msg(tGATT_TCB& tcb, uint8_t op_code,
 extern tGATT_STATUS attp_send_sr_msg(tGATT_TCB& tcb, BT_HDR* p_msg);
 extern tGATT_STATUS attp_send_msg_to_l2cap(tGATT_TCB& tcb, BT_HDR* p_toL2CAP);
 
+/* Functions provided by gatt_stream.cc */
+extern void gatt_stream_resume(tGATT_TCB* p_tcb);
+extern void gatt_stream_deregister(tGATT_IF gatt_if);
+
 /* utility functions */
 extern uint8_t* gatt_dbg_op_name(uint8_t op_code);
 extern uint32_t gatt_add_sdp_record(const bluetooth::Uuid& uuid,
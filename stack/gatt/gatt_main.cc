@@ -32,6 +32,7 @@
 #include "device/include/interop.h"
 #include "gatt_int.h"
 #include "l2c_api.h"
+#include "osi/include/latency_trace.h"
 #include "osi/include/osi.h"
 
 using base::StringPrintf;
@@ -476,6 +477,8 @@ static void gatt_channel_congestion(tGATT_TCB* p_tcb, bool congested) {
   tGATT_REG* p_reg = NULL;
   uint16_t conn_id;
 
+  if (p_tcb != NULL) p_tcb->congested = congested;
+
   /* if uncongested, check to see if there is any more pending data */
   if (p_tcb != NULL && !congested) {
     gatt_cl_send_next_cmd_inq(*p_tcb);
@@ -489,6 +492,9 @@ static void gatt_channel_congestion(tGATT_TCB* p_tcb, bool congested) {
       }
     }
   }
+
+  /* let the write streams blocked by the congestion resume */
+  if (p_tcb != NULL && !congested) gatt_stream_resume(p_tcb);
 }
 
 void gatt_notify_phy_updated(uint8_t status, uint16_t handle, uint8_t tx_phy,
@@ -955,6 +961,8 @@ void gatt_data_process(tGATT_TCB& tcb, BT_HDR* p_buf) {
   uint8_t* p = (uint8_t*)(p_buf + 1) + p_buf->offset;
   uint8_t op_code, pseudo_op_code;
 
+  LATENCY_TRACE_MARK(p_buf, LATENCY_PROFILE);
+
   if (p_buf->len <= 0) {
     LOG(ERROR) << "invalid data length, ignore";
     return;
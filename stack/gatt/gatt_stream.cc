@@ -0,0 +1,237 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  this file contains the GATT client write command streams
+ *
+ ******************************************************************************/
+#include "bt_target.h"
+
+#include <base/logging.h>
+#include <algorithm>
+#include <vector>
+
+#include "bt_common.h"
+#include "btm_api.h"
+#include "gatt_api.h"
+#include "gatt_int.h"
+#include "l2c_api.h"
+
+static uint32_t gatt_stream_wait_seq = 0;
+
+static void gatt_stream_wait(tGATT_STREAM& stream) {
+  if (stream.waiting) return;
+  stream.waiting = true;
+  stream.wait_seq = gatt_stream_wait_seq++;
+  stream.num_waits++;
+}
+
+/*******************************************************************************
+ *
+ * Function         GATTC_StreamOpen
+ *
+ * Description      This function is called to open a stream of write commands
+ *                  on a connection.
+ *
+ * Parameters       conn_id: connection identifier.
+ *                  p_ready_cb - called when the stream can take writes again.
+ *                  context - passed to p_ready_cb.
+ *
+ * Returns          GATT_SUCCESS if the stream is open.
+ *
+ ******************************************************************************/
+tGATT_STATUS GATTC_StreamOpen(uint16_t conn_id,
+                              tGATT_STREAM_READY_CBACK* p_ready_cb,
+                              void* context) {
+  tGATT_IF gatt_if = GATT_GET_GATT_IF(conn_id);
+  tGATT_TCB* p_tcb = gatt_get_tcb_by_idx(GATT_GET_TCB_IDX(conn_id));
+  tGATT_REG* p_reg = gatt_get_regcb(gatt_if);
+
+  if (p_tcb == NULL || p_reg == NULL || p_ready_cb == NULL) {
+    LOG(ERROR) << __func__ << ": Illegal param: conn_id " << loghex(conn_id);
+    return GATT_ILLEGAL_PARAMETER;
+  }
+
+  tGATT_STREAM& stream = p_tcb->streams[gatt_if];
+  stream = tGATT_STREAM();
+  stream.p_ready_cb = p_ready_cb;
+  stream.context = context;
+  return GATT_SUCCESS;
+}
+
+/*******************************************************************************
+ *
+ * Function         GATTC_StreamWrite
+ *
+ * Description      This function is called to send a write command, or a
+ *                  signed write command, on an open stream. The command is
+ *                  sent to L2CAP directly, without going through a client
+ *                  control block.
+ *
+ * Parameters       conn_id: connection identifier.
+ *                  handle - attribute handle.
+ *                  p_value, len - value.
+ *                  sign - send a signed write command, or a write command if
+ *                         the link is encrypted.
+ *
+ * Returns          GATT_SUCCESS if the write was sent, GATT_CONGESTED if it
+ *                  was sent but the channel is now congested, or GATT_BUSY if
+ *                  the channel is congested.
+ *
+ ******************************************************************************/
+tGATT_STATUS GATTC_StreamWrite(uint16_t conn_id, uint16_t handle,
+                               const uint8_t* p_value, uint16_t len,
+                               bool sign) {
+  tGATT_IF gatt_if = GATT_GET_GATT_IF(conn_id);
+  tGATT_TCB* p_tcb = gatt_get_tcb_by_idx(GATT_GET_TCB_IDX(conn_id));
+  if (p_tcb == NULL) return GATT_ILLEGAL_PARAMETER;
+
+  auto stream = p_tcb->streams.find(gatt_if);
+  if (stream == p_tcb->streams.end()) {
+    LOG(ERROR) << __func__ << ": no stream open on conn_id " << loghex(conn_id);
+    return GATT_ILLEGAL_PARAMETER;
+  }
+
+  /* As gatt_determine_sec_act(): the data is not signed on an encrypted link,
+   * a write command is sent instead */
+  if (sign) {
+    uint8_t sec_flag = 0;
+    BTM_GetSecurityFlagsByTransport(p_tcb->peer_bda, &sec_flag,
+                                    p_tcb->transport);
+    if (sec_flag & BTM_SEC_FLAG_ENCRYPTED) sign = false;
+  }
+
+  /* 3 = 1 byte opcode + 2 byte handle */
+  uint16_t max_len = p_tcb->payload_size - 3;
+  if (sign) max_len -= GATT_AUTH_SIGN_LEN;
+  if (p_tcb->payload_size < 3 + GATT_AUTH_SIGN_LEN || len > max_len ||
+      (len > 0 && p_value == NULL)) {
+    return GATT_ILLEGAL_PARAMETER;
+  }
+
+  if (gatt_get_ch_state(p_tcb) != GATT_CH_OPEN) return GATT_WRONG_STATE;
+
+  /* Already congested: L2CAP would drop the write */
+  if (p_tcb->congested) {
+    gatt_stream_wait(stream->second);
+    return GATT_BUSY;
+  }
+
+  BT_HDR* p_buf =
+      (BT_HDR*)osi_malloc(sizeof(BT_HDR) + p_tcb->payload_size +
+                          L2CAP_MIN_OFFSET);
+  uint8_t* p_pdu = (uint8_t*)(p_buf + 1) + L2CAP_MIN_OFFSET;
+  uint8_t* p = p_pdu;
+  p_buf->offset = L2CAP_MIN_OFFSET;
+  UINT8_TO_STREAM(p, sign ? GATT_SIGN_CMD_WRITE : GATT_CMD_WRITE);
+  UINT16_TO_STREAM(p, handle);
+  ARRAY_TO_STREAM(p, p_value, len);
+  p_buf->len = 3 + len;
+
+  if (sign) {
+    if (!BTM_BleDataSignature(p_tcb->peer_bda, p_pdu, p_buf->len, p)) {
+      osi_free(p_buf);
+      return GATT_INTERNAL_ERROR;
+    }
+    p_buf->len += GATT_AUTH_SIGN_LEN;
+  }
+
+  tGATT_STATUS status = attp_send_msg_to_l2cap(*p_tcb, p_buf);
+  if (status == GATT_CONGESTED) {
+    /* The congestion callback may not have been called yet */
+    p_tcb->congested = true;
+    gatt_stream_wait(stream->second);
+  } else if (status != GATT_SUCCESS) {
+    return status;
+  }
+
+  stream->second.num_sent++;
+  return status;
+}
+
+/*******************************************************************************
+ *
+ * Function         GATTC_StreamClose
+ *
+ * Description      This function is called to close a stream of writes.
+ *
+ * Parameters       conn_id: connection identifier.
+ *
+ ******************************************************************************/
+void GATTC_StreamClose(uint16_t conn_id) {
+  tGATT_TCB* p_tcb = gatt_get_tcb_by_idx(GATT_GET_TCB_IDX(conn_id));
+  if (p_tcb == NULL) return;
+
+  auto stream = p_tcb->streams.find(GATT_GET_GATT_IF(conn_id));
+  if (stream == p_tcb->streams.end()) return;
+
+  VLOG(1) << __func__ << ": conn_id " << loghex(conn_id) << " sent "
+          << stream->second.num_sent << " writes, waited "
+          << stream->second.num_waits << " times";
+  p_tcb->streams.erase(stream);
+}
+
+/*******************************************************************************
+ *
+ * Function         gatt_stream_resume
+ *
+ * Description      This function is called when the channel of a connection
+ *                  is no longer congested, to call the ready callback of the
+ *                  streams waiting for it, longest waiting first. The
+ *                  callbacks may write, close their stream, or congest the
+ *                  channel again.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void gatt_stream_resume(tGATT_TCB* p_tcb) {
+  std::vector<std::pair<uint32_t, tGATT_IF>> waiting;
+  for (auto& stream : p_tcb->streams) {
+    if (stream.second.waiting)
+      waiting.emplace_back(stream.second.wait_seq - gatt_stream_wait_seq,
+                           stream.first);
+  }
+  std::sort(waiting.begin(), waiting.end());
+
+  for (const auto& entry : waiting) {
+    tGATT_IF gatt_if = entry.second;
+    if (p_tcb->congested) break;
+    auto stream = p_tcb->streams.find(gatt_if);
+    if (stream == p_tcb->streams.end() || !stream->second.waiting) continue;
+    stream->second.waiting = false;
+    uint16_t conn_id = GATT_CREATE_CONN_ID(p_tcb->tcb_idx, gatt_if);
+    (*stream->second.p_ready_cb)(conn_id, stream->second.context);
+  }
+}
+
+/*******************************************************************************
+ *
+ * Function         gatt_stream_deregister
+ *
+ * Description      This function is called when an application deregisters,
+ *                  to close its streams on all the connections.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void gatt_stream_deregister(tGATT_IF gatt_if) {
+  for (uint8_t i = 0; i < GATT_MAX_PHY_CHANNEL; i++) {
+    gatt_cb.tcb[i].streams.erase(gatt_if);
+  }
+}
@@ -53,6 +53,10 @@ void a2dp_aac_feeding_flush(void);
 // Get the A2DP AAC encoder interval (in milliseconds).
 period_ms_t a2dp_aac_get_encoder_interval_ms(void);
 
+// Get the longest time (in microseconds) of audio the A2DP AAC encoder sends
+// in one call to |a2dp_aac_send_frames| without dropping frames.
+uint64_t a2dp_aac_get_max_send_interval_us(void);
+
 // Prepare and send A2DP AAC encoded frames.
 // |timestamp_us| is the current timestamp (in microseconds).
 void a2dp_aac_send_frames(uint64_t timestamp_us);
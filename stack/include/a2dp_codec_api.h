@@ -535,6 +535,17 @@ typedef struct {
 
   // Set transmit queue length for the A2DP encoder.
   void (*set_transmit_queue_length)(size_t transmit_queue_length);
+
+  // True if send_frames() sends the audio for the time elapsed since its
+  // previous call, computed from |timestamp_us|. Otherwise it sends a fixed
+  // amount of audio per call, and must be called every
+  // get_encoder_interval_ms().
+  bool send_frames_uses_timestamp;
+
+  // Get the longest time (in microseconds) elapsed since the previous call
+  // for which send_frames() still sends all the audio: above it the encoder
+  // drops frames. Only set if |send_frames_uses_timestamp| is true.
+  uint64_t (*get_max_send_interval_us)(void);
 } tA2DP_ENCODER_INTERFACE;
 
 // Prototype for a callback to receive decoded audio data from a
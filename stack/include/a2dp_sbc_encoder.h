@@ -56,6 +56,10 @@ void a2dp_sbc_feeding_flush(void);
 // Get the A2DP SBC encoder interval (in milliseconds).
 period_ms_t a2dp_sbc_get_encoder_interval_ms(void);
 
+// Get the longest time (in microseconds) of audio the A2DP SBC encoder sends
+// in one call to |a2dp_sbc_send_frames| without dropping frames.
+uint64_t a2dp_sbc_get_max_send_interval_us(void);
+
 // Prepare and send A2DP SBC encoded frames.
 // |timestamp_us| is the current timestamp (in microseconds).
 void a2dp_sbc_send_frames(uint64_t timestamp_us);
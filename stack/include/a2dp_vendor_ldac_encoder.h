@@ -54,6 +54,10 @@ void a2dp_vendor_ldac_feeding_flush(void);
 // Get the A2DP LDAC encoder interval (in milliseconds).
 period_ms_t a2dp_vendor_ldac_get_encoder_interval_ms(void);
 
+// Get the longest time (in microseconds) of audio the A2DP LDAC encoder sends
+// in one call to |a2dp_vendor_ldac_send_frames| without dropping frames.
+uint64_t a2dp_vendor_ldac_get_max_send_interval_us(void);
+
 // Prepare and send A2DP LDAC encoded frames.
 // |timestamp_us| is the current timestamp (in microseconds).
 void a2dp_vendor_ldac_send_frames(uint64_t timestamp_us);
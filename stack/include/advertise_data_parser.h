@@ -29,9 +29,11 @@ static constexpr std::array<uint8_t, 18> trx_quirk{
 class AdvertiseDataParser {
   // Return true if the packet is malformed, but should be considered valid for
   // compatibility with already existing devices
-  static bool MalformedPacketQuirk(const std::vector<uint8_t>& ad,
+  static bool MalformedPacketQuirk(const uint8_t* ad, size_t ad_len,
                                    size_t position) {
-    auto data_start = ad.begin() + position;
+    if (position + trx_quirk.size() > ad_len) return false;
+
+    const uint8_t* data_start = ad + position;
 
     // Traxxas - bad name length
     if (std::equal(data_start, data_start + 3, trx_quirk.begin()) &&
@@ -44,10 +46,13 @@ class AdvertiseDataParser {
   }
 
  public:
-  static void RemoveTrailingZeros(std::vector<uint8_t>& ad) {
+  /**
+   * Return the length of the |ad| array of length |ad_len| without the zero
+   * padding some devices send at the end of the advertisement.
+   */
+  static size_t LengthWithoutTrailingZeros(const uint8_t* ad, size_t ad_len) {
     size_t position = 0;
 
-    size_t ad_len = ad.size();
     while (position != ad_len) {
       uint8_t len = ad[position];
 
@@ -56,26 +61,27 @@ class AdvertiseDataParser {
       // end of advertisement. If this is the case, cut the zero padding from
       // end of the packet. Otherwise i.e. gluing scan response to advertise
       // data will result in data with zero padding in the middle.
-      if (len == 0) {
-        ad.erase(ad.begin() + position, ad.end());
-        return;
-      }
+      if (len == 0) return position;
 
-      if (position + len >= ad_len) {
-        return;
-      }
+      if (position + len >= ad_len) return ad_len;
 
       position += len + 1;
     }
+
+    return ad_len;
+  }
+
+  static void RemoveTrailingZeros(std::vector<uint8_t>& ad) {
+    ad.resize(LengthWithoutTrailingZeros(ad.data(), ad.size()));
   }
 
   /**
-   * Return true if this |ad| represent properly formatted advertising data.
+   * Return true if the |ad| array of length |ad_len| represent properly
+   * formatted advertising data.
    */
-  static bool IsValid(const std::vector<uint8_t>& ad) {
+  static bool IsValid(const uint8_t* ad, size_t ad_len) {
     size_t position = 0;
 
-    size_t ad_len = ad.size();
     while (position != ad_len) {
       uint8_t len = ad[position];
 
@@ -92,7 +98,7 @@ class AdvertiseDataParser {
       // If the length of the current field would exceed the total data length,
       // then the data is badly formatted.
       if (position + len >= ad_len) {
-        if (MalformedPacketQuirk(ad, position)) return true;
+        if (MalformedPacketQuirk(ad, ad_len, position)) return true;
 
         return false;
       }
@@ -103,6 +109,13 @@ class AdvertiseDataParser {
     return true;
   }
 
+  /**
+   * Return true if this |ad| represent properly formatted advertising data.
+   */
+  static bool IsValid(const std::vector<uint8_t>& ad) {
+    return IsValid(ad.data(), ad.size());
+  }
+
   /**
    * This function returns a pointer inside the |ad| array of length |ad_len|
    * where a field of |type| is located, together with its length in |p_length|
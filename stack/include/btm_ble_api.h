@@ -861,4 +861,15 @@ extern void BTM_BleSetPhy(const RawAddress& bd_addr, uint8_t tx_phys,
 
 extern void btm_ble_multi_adv_cleanup(void);
 
+/*******************************************************************************
+ *
+ * Function         btm_ble_rpa_resolver_debug_dump
+ *
+ * Description      Dump the peer RPA resolution cache statistics
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+extern void btm_ble_rpa_resolver_debug_dump(int fd);
+
 #endif
@@ -575,6 +575,9 @@ typedef void(tGATT_REQ_CBACK)(uint16_t conn_id, uint32_t trans_id,
 /* channel congestion/uncongestion callback */
 typedef void(tGATT_CONGESTION_CBACK)(uint16_t conn_id, bool congested);
 
+/* write stream callback, called when the stream can take writes again */
+typedef void(tGATT_STREAM_READY_CBACK)(uint16_t conn_id, void* context);
+
 /* Define a callback function when encryption is established. */
 typedef void(tGATT_ENC_CMPL_CB)(tGATT_IF gatt_if, const RawAddress& bda);
 
@@ -866,6 +869,64 @@ extern tGATT_STATUS GATTC_Read(uint16_t conn_id, tGATT_READ_TYPE type,
 extern tGATT_STATUS GATTC_Write(uint16_t conn_id, tGATT_WRITE_TYPE type,
                                 tGATT_VALUE* p_write);
 
+/*******************************************************************************
+ *
+ * Function         GATTC_StreamOpen
+ *
+ * Description      This function is called to open a stream of write commands
+ *                  on a connection. The writes of the stream bypass the client
+ *                  operation queue, and are sent to L2CAP as long as the
+ *                  channel is not congested.
+ *
+ * Parameters       conn_id: connection identifier.
+ *                  p_ready_cb - called when the channel is no longer
+ *                               congested, after a write of the stream
+ *                               returned GATT_CONGESTED or GATT_BUSY.
+ *                  context - passed to p_ready_cb.
+ *
+ * Returns          GATT_SUCCESS if the stream is open.
+ *
+ ******************************************************************************/
+extern tGATT_STATUS GATTC_StreamOpen(uint16_t conn_id,
+                                     tGATT_STREAM_READY_CBACK* p_ready_cb,
+                                     void* context);
+
+/*******************************************************************************
+ *
+ * Function         GATTC_StreamWrite
+ *
+ * Description      This function is called to send a write command, or a
+ *                  signed write command, on an open stream. The value is
+ *                  copied.
+ *
+ * Parameters       conn_id: connection identifier.
+ *                  handle - attribute handle.
+ *                  p_value, len - value, at most MTU - 3 octets long, or
+ *                                 MTU - 15 octets if signed.
+ *                  sign - send a signed write command.
+ *
+ * Returns          GATT_SUCCESS if the write was sent.
+ *                  GATT_CONGESTED if the write was sent, but the channel is
+ *                  now congested: wait for the ready callback.
+ *                  GATT_BUSY if the write was not sent because the channel
+ *                  is congested: wait for the ready callback.
+ *
+ ******************************************************************************/
+extern tGATT_STATUS GATTC_StreamWrite(uint16_t conn_id, uint16_t handle,
+                                      const uint8_t* p_value, uint16_t len,
+                                      bool sign);
+
+/*******************************************************************************
+ *
+ * Function         GATTC_StreamClose
+ *
+ * Description      This function is called to close a stream of writes.
+ *
+ * Parameters       conn_id: connection identifier.
+ *
+ ******************************************************************************/
+extern void GATTC_StreamClose(uint16_t conn_id);
+
 /*******************************************************************************
  *
  * Function         GATTC_ExecuteWrite
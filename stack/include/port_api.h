@@ -99,6 +99,9 @@ typedef int(tPORT_DATA_CALLBACK)(uint16_t port_handle, void* p_data,
 #define DATA_CO_CALLBACK_TYPE_INCOMING 1
 #define DATA_CO_CALLBACK_TYPE_OUTGOING_SIZE 2
 #define DATA_CO_CALLBACK_TYPE_OUTGOING 3
+/* p_buf is an array of len BT_HDR pointers, to fill with the length of data
+ * set in each of them */
+#define DATA_CO_CALLBACK_TYPE_OUTGOING_BUFS 4
 typedef int(tPORT_DATA_CO_CALLBACK)(uint16_t port_handle, uint8_t* p_buf,
                                     uint16_t len, int type);
 
@@ -511,6 +514,54 @@ extern int PORT_SendError(uint16_t handle, uint8_t errors);
  ******************************************************************************/
 extern int PORT_GetQueueStatus(uint16_t handle, tPORT_STATUS* p_status);
 
+/*******************************************************************************
+ *
+ * Function         PORT_GetStats
+ *
+ * Description      This function reports the data transfer and credit based
+ *                  flow control statistics of a connection, since it was
+ *                  opened.
+ *
+ * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
+ *                  p_stats    - pointer to the tPORT_STATS structure to receive
+ *                               the statistics
+ *
+ ******************************************************************************/
+typedef struct {
+  uint32_t duration_ms; /* Time since the connection was opened */
+  uint32_t rx_bytes;
+  uint32_t rx_frames;
+  uint32_t tx_bytes;
+  uint32_t tx_frames;
+  uint32_t tx_writes;        /* Writes sent, several per frame if aggregated */
+  uint32_t credits_granted;  /* Credits sent to the peer */
+  uint32_t credit_frames;    /* Frames sent to the peer with credits only */
+  uint32_t rx_credit_stalls; /* Times the peer used all its credits */
+  uint32_t tx_credit_stalls; /* Times data waited for credits from the peer */
+  uint32_t tx_stall_ms;      /* Time data waited for credits from the peer */
+  uint16_t credit_window;    /* Credits granted to the peer at a time */
+  uint32_t credit_rate;      /* Estimated consumer rate, in frames per second */
+  uint32_t credit_rtt_ms;    /* Estimated credit round trip */
+} tPORT_STATS;
+
+extern int PORT_GetStats(uint16_t handle, tPORT_STATS* p_stats);
+
+/*******************************************************************************
+ *
+ * Function         PORT_SetTxAggregation
+ *
+ * Description      This function enables the aggregation of small writes on
+ *                  a connection.  Data written while the connection can send
+ *                  it is held up to delay_ms, as long as it is less than the
+ *                  peer MTU, so that the writes to come are sent in the same
+ *                  frame.  Disabling it sends the data held.
+ *
+ * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
+ *                  delay_ms   - Max time data is held, 0 to disable
+ *
+ ******************************************************************************/
+extern int PORT_SetTxAggregation(uint16_t handle, uint16_t delay_ms);
+
 /*******************************************************************************
  *
  * Function         PORT_Purge
@@ -561,11 +612,33 @@ extern int PORT_Read(uint16_t handle, BT_HDR** pp_buf);
 extern int PORT_ReadData(uint16_t handle, char* p_data, uint16_t max_len,
                          uint16_t* p_len);
 
+/*******************************************************************************
+ *
+ * Function         PORT_ReadBuffers
+ *
+ * Description      This function returns up to max_bufs buffers received from
+ *                  the peer device at once, without copying the data, and
+ *                  updates the flow control once for all of them.  Application
+ *                  calling this function is responsible to free the buffers
+ *                  returned.
+ *
+ * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
+ *                                callback.
+ *                  pp_bufs     - array of max_bufs buffer pointers to fill
+ *                  max_bufs    - Buffer count requested
+ *                  p_count     - Buffer count returned
+ *
+ ******************************************************************************/
+extern int PORT_ReadBuffers(uint16_t handle, BT_HDR** pp_bufs,
+                            uint16_t max_bufs, uint16_t* p_count);
+
 /*******************************************************************************
  *
  * Function         PORT_Write
  *
  * Description      This function to send BT buffer to the peer device.
+ *                  The buffer must be RFCOMM_DATA_BUF_SIZE bytes, as the data
+ *                  of later writes may be appended to it.
  *                  Application should not free the buffer.
  *
  * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
@@ -574,6 +647,48 @@ extern int PORT_ReadData(uint16_t handle, char* p_data, uint16_t max_len,
  ******************************************************************************/
 extern int PORT_Write(uint16_t handle, BT_HDR* p_buf);
 
+/*******************************************************************************
+ *
+ * Function         PORT_AllocWriteBuffers
+ *
+ * Description      This function allocates the buffers to send up to max_len
+ *                  bytes with PORT_WriteBuffers, as many as the tx queue takes
+ *                  below its high watermarks.  The len of each buffer is set
+ *                  to the room for data at its offset, up to the peer MTU.
+ *
+ * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
+ *                  max_len     - Byte count to send
+ *                  pp_bufs     - array of max_bufs buffer pointers to fill
+ *                  max_bufs    - Buffer count requested
+ *                  p_count     - Buffer count allocated
+ *
+ ******************************************************************************/
+extern int PORT_AllocWriteBuffers(uint16_t handle, uint16_t max_len,
+                                  BT_HDR** pp_bufs, uint16_t max_bufs,
+                                  uint16_t* p_count);
+
+/*******************************************************************************
+ *
+ * Function         PORT_WriteBuffers
+ *
+ * Description      This function sends a chain of buffers to the peer device
+ *                  without copying the data.  Each buffer must be
+ *                  RFCOMM_DATA_BUF_SIZE bytes, as the data of later writes
+ *                  may be appended to it, have an offset of at least
+ *                  L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET, room for the FCS
+ *                  after the data, and up to the peer MTU of data.
+ *                  Application should not free the buffers, even those not
+ *                  accepted.
+ *
+ * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
+ *                  pp_bufs     - array of count buffers with data
+ *                  count       - Buffer count to send
+ *                  p_count     - Buffer count accepted
+ *
+ ******************************************************************************/
+extern int PORT_WriteBuffers(uint16_t handle, BT_HDR** pp_bufs, uint16_t count,
+                             uint16_t* p_count);
+
 /*******************************************************************************
  *
  * Function         PORT_WriteData
@@ -649,4 +764,14 @@ extern uint8_t PORT_SetTraceLevel(uint8_t new_level);
  ******************************************************************************/
 extern const char* PORT_GetResultString(const uint8_t result_code);
 
+/*******************************************************************************
+ *
+ * Function         rfcomm_debug_dump
+ *
+ * Description      Dumps the throughput and credit statistics of the open
+ *                  ports to the |fd| file descriptor.
+ *
+ ******************************************************************************/
+extern void rfcomm_debug_dump(int fd);
+
 #endif /* PORT_API_H */
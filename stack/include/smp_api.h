@@ -43,6 +43,17 @@
  ******************************************************************************/
 extern void SMP_Init(void);
 
+/*******************************************************************************
+ *
+ * Function         SMP_Free
+ *
+ * Description      This function releases the resources of the SMP unit.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+extern void SMP_Free(void);
+
 /*******************************************************************************
  *
  * Function         SMP_SetTraceLevel
@@ -239,4 +250,29 @@ extern void smp_link_encrypted(const RawAddress& bda, uint8_t encr_enable);
 bool aes_cipher_msg_auth_code(BT_OCTET16 key, uint8_t* input, uint16_t length,
                               uint16_t tlen, uint8_t* p_signature);
 
+//
+// Dumps the pairing latency breakdown and the local key pair pool statistics
+// to the |fd| file descriptor.
+//
+extern void smp_debug_dump(int fd);
+
+// A message to sign with aes_cipher_msg_auth_code_multi(), with the parameters
+// of aes_cipher_msg_auth_code().
+typedef struct {
+  uint8_t* key;
+  uint8_t* input;
+  uint16_t length;
+  uint8_t* p_signature;
+} tSMP_CMAC_MSG;
+
+//
+// The AES-CMAC Generation Function for |num_msgs| messages, each with its own
+// key, all with a mac of |tlen| octets. The blocks of the messages are
+// encrypted together, which is faster than signing them one at a time when
+// verifying many signed writes.
+// Returns false if |tlen| is invalid, true in other cases.
+//
+bool aes_cipher_msg_auth_code_multi(tSMP_CMAC_MSG* msgs, size_t num_msgs,
+                                    uint16_t tlen);
+
 #endif /* SMP_API_H */
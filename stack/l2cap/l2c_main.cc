@@ -37,6 +37,7 @@
 #include "l2c_api.h"
 #include "l2c_int.h"
 #include "l2cdefs.h"
+#include "osi/include/latency_trace.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
 
@@ -164,6 +165,8 @@ void l2c_rcv_acl_data(BT_HDR* p_msg) {
     return;
   }
 
+  LATENCY_TRACE_MARK(p_msg, LATENCY_L2CAP);
+
   /* Send the data through the channel state machine */
   if (rcv_cid == L2CAP_SIGNALLING_CID) {
     process_l2cap_cmd(p_lcb, p, l2cap_len);
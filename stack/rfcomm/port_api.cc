@@ -25,10 +25,13 @@
 #define LOG_TAG "bt_port_api"
 
 #include <base/logging.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "osi/include/log.h"
 #include "osi/include/mutex.h"
+#include "osi/include/time.h"
 
 #include "bt_common.h"
 #include "btm_api.h"
@@ -872,7 +875,10 @@ int PORT_FlowControl_MaxCredit(uint16_t handle, bool enable) {
 
   if (p_port->rfc.p_mcb->flow == PORT_FC_CREDIT) {
     if (!p_port->rx.user_fc) {
-      port_flow_control_peer(p_port, true, p_port->credit_rx);
+      /* Grant a full window again. The outstanding credits were not used by
+       * the peer, so they do not count towards the consumer rate. */
+      p_port->credit_rx = 0;
+      port_flow_control_peer(p_port, true, 0);
     }
   } else {
     old_fc = p_port->local_ctrl.fc;
@@ -1055,6 +1061,84 @@ int PORT_GetQueueStatus(uint16_t handle, tPORT_STATUS* p_status) {
   return (PORT_SUCCESS);
 }
 
+/*******************************************************************************
+ *
+ * Function         PORT_GetStats
+ *
+ * Description      This function reports the data transfer and credit based
+ *                  flow control statistics of a connection.
+ *
+ * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
+ *                  p_stats    - pointer to the tPORT_STATS structure to receive
+ *                               the statistics
+ *
+ ******************************************************************************/
+int PORT_GetStats(uint16_t handle, tPORT_STATS* p_stats) {
+  tPORT* p_port;
+
+  if ((handle == 0) || (handle > MAX_RFC_PORTS)) {
+    return (PORT_BAD_HANDLE);
+  }
+
+  p_port = &rfc_cb.port.port[handle - 1];
+
+  if (!p_port->in_use || (p_port->state == PORT_STATE_CLOSED)) {
+    return (PORT_NOT_OPENED);
+  }
+
+  *p_stats = p_port->stats;
+  p_stats->duration_ms =
+      p_port->open_ms ? time_get_os_boottime_ms() - p_port->open_ms : 0;
+  p_stats->credit_window = p_port->credit_rx_window;
+  p_stats->credit_rate = p_port->credit_rate;
+  p_stats->credit_rtt_ms = p_port->credit_rtt_ms;
+  if (p_port->tx_stall_ms)
+    p_stats->tx_stall_ms += time_get_os_boottime_ms() - p_port->tx_stall_ms;
+
+  return (PORT_SUCCESS);
+}
+
+/*******************************************************************************
+ *
+ * Function         PORT_SetTxAggregation
+ *
+ * Description      This function enables the aggregation of small writes on
+ *                  a connection, or disables it and sends the data held.
+ *
+ * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
+ *                  delay_ms   - Max time data is held, 0 to disable
+ *
+ ******************************************************************************/
+int PORT_SetTxAggregation(uint16_t handle, uint16_t delay_ms) {
+  tPORT* p_port;
+  uint32_t events;
+
+  RFCOMM_TRACE_API("PORT_SetTxAggregation() handle:%d delay:%d", handle,
+                   delay_ms);
+
+  if ((handle == 0) || (handle > MAX_RFC_PORTS)) {
+    return (PORT_BAD_HANDLE);
+  }
+
+  p_port = &rfc_cb.port.port[handle - 1];
+
+  if (!p_port->in_use || (p_port->state == PORT_STATE_CLOSED)) {
+    return (PORT_NOT_OPENED);
+  }
+
+  p_port->tx_aggr_ms = delay_ms;
+  if (delay_ms) return (PORT_SUCCESS);
+
+  alarm_cancel(p_port->tx_aggr_timer);
+  p_port->tx_aggr_due = false;
+  events = port_rfc_send_tx_data(p_port);
+
+  /* Send event to the application */
+  if (p_port->p_callback && events) (p_port->p_callback)(events, p_port->inx);
+
+  return (PORT_SUCCESS);
+}
+
 /*******************************************************************************
  *
  * Function         PORT_Purge
@@ -1272,6 +1356,124 @@ int PORT_Read(uint16_t handle, BT_HDR** pp_buf) {
   return (PORT_SUCCESS);
 }
 
+/*******************************************************************************
+ *
+ * Function         PORT_ReadBuffers
+ *
+ * Description      This function hands out up to max_bufs buffers received
+ *                  from the peer device at once, without copying them.  The
+ *                  data of each buffer is at its offset.  Application calling
+ *                  this function is responsible to free the buffers returned.
+ *
+ * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
+ *                  pp_bufs     - array of max_bufs buffer pointers to fill
+ *                  max_bufs    - Buffer count requested
+ *                  p_count     - Buffer count returned
+ *
+ ******************************************************************************/
+int PORT_ReadBuffers(uint16_t handle, BT_HDR** pp_bufs, uint16_t max_bufs,
+                     uint16_t* p_count) {
+  tPORT* p_port;
+  BT_HDR* p_buf;
+
+  RFCOMM_TRACE_API("PORT_ReadBuffers() handle:%d max_bufs:%d", handle,
+                   max_bufs);
+
+  /* Initialize this in case of an error */
+  *p_count = 0;
+
+  /* Check if handle is valid to avoid crashing */
+  if ((handle == 0) || (handle > MAX_RFC_PORTS)) {
+    return (PORT_BAD_HANDLE);
+  }
+  p_port = &rfc_cb.port.port[handle - 1];
+
+  if (!p_port->in_use || (p_port->state == PORT_STATE_CLOSED)) {
+    return (PORT_NOT_OPENED);
+  }
+
+  if (p_port->line_status) {
+    return (PORT_LINE_ERR);
+  }
+
+  mutex_global_lock();
+
+  while (*p_count < max_bufs) {
+    p_buf = (BT_HDR*)fixed_queue_try_dequeue(p_port->rx.queue);
+    if (p_buf == NULL) break;
+
+    p_port->rx.queue_size -= p_buf->len;
+    pp_bufs[(*p_count)++] = p_buf;
+  }
+
+  mutex_global_unlock();
+
+  RFCOMM_TRACE_EVENT("PORT_ReadBuffers queue:%d returned:%d",
+                     p_port->rx.queue_size, *p_count);
+
+  /* If rfcomm suspended traffic from the peer based on the rx_queue_size */
+  /* check if it can be resumed now */
+  if (*p_count) port_flow_control_peer(p_port, true, *p_count);
+
+  return (PORT_SUCCESS);
+}
+
+/*******************************************************************************
+ *
+ * Function         port_tx_buf_room
+ *
+ * Description      Get the number of bytes of data that can be appended to a
+ *                  buffer of the tx queue.  The buffers queued are all
+ *                  RFCOMM_DATA_BUF_SIZE bytes, see PORT_WriteBuffers, and
+ *                  keep room for the FCS after the data.
+ *
+ * Returns          Byte count
+ *
+ ******************************************************************************/
+static uint16_t port_tx_buf_room(const BT_HDR* p_buf) {
+  /* Add 1 for the FCS */
+  size_t used = sizeof(BT_HDR) + p_buf->offset + p_buf->len + 1;
+  if (used >= RFCOMM_DATA_BUF_SIZE) return 0;
+  return (uint16_t)(RFCOMM_DATA_BUF_SIZE - used);
+}
+
+/*******************************************************************************
+ *
+ * Function         port_write_aggregated
+ *
+ * Description      This function sends the data of a port with aggregation
+ *                  enabled.  It is added to the data held if it fits in the
+ *                  same frame, and held in turn if it is less than the peer
+ *                  MTU.  Data held before that no longer has room is sent.
+ *
+ * Parameters:      p_port     - pointer to address of port control block
+ *                  p_buf      - pointer to address of buffer with data,
+ *
+ ******************************************************************************/
+static int port_write_aggregated(tPORT* p_port, BT_HDR* p_buf) {
+  mutex_global_lock();
+
+  BT_HDR* p_last = (BT_HDR*)fixed_queue_try_peek_last(p_port->tx.queue);
+  if ((p_last != NULL) && ((p_last->len + p_buf->len) <= p_port->peer_mtu) &&
+      (p_buf->len <= port_tx_buf_room(p_last))) {
+    memcpy((uint8_t*)(p_last + 1) + p_last->offset + p_last->len,
+           (uint8_t*)(p_buf + 1) + p_buf->offset, p_buf->len);
+    p_last->len += p_buf->len;
+    p_port->tx.queue_size += p_buf->len;
+    osi_free(p_buf);
+  } else {
+    fixed_queue_enqueue(p_port->tx.queue, p_buf);
+    p_port->tx.queue_size += p_buf->len;
+  }
+  p_port->stats.tx_writes++;
+
+  mutex_global_unlock();
+
+  port_rfc_send_tx_data(p_port);
+
+  return (p_port->tx.queue_size == 0) ? PORT_SUCCESS : PORT_CMD_PENDING;
+}
+
 /*******************************************************************************
  *
  * Function         port_write
@@ -1320,16 +1522,139 @@ static int port_write(tPORT* p_port, BT_HDR* p_buf) {
 
     fixed_queue_enqueue(p_port->tx.queue, p_buf);
     p_port->tx.queue_size += p_buf->len;
+    p_port->stats.tx_writes++;
+    port_tx_credit_wait(p_port);
 
     return (PORT_CMD_PENDING);
+  } else if (p_port->tx_aggr_ms) {
+    return port_write_aggregated(p_port, p_buf);
   } else {
     RFCOMM_TRACE_EVENT("PORT_Write : Data is being sent");
 
+    p_port->stats.tx_writes++;
     RFCOMM_DataReq(p_port->rfc.p_mcb, p_port->dlci, p_buf);
     return (PORT_SUCCESS);
   }
 }
 
+/*******************************************************************************
+ *
+ * Function         port_free_buffers
+ *
+ * Description      Free count buffers of the array pp_bufs.
+ *
+ ******************************************************************************/
+static void port_free_buffers(BT_HDR** pp_bufs, uint16_t count) {
+  for (uint16_t i = 0; i < count; i++) osi_free(pp_bufs[i]);
+}
+
+/*******************************************************************************
+ *
+ * Function         port_alloc_write_buffers
+ *
+ * Description      This function allocates the buffers to send up to len bytes
+ *                  of data on the port, each with room for the smaller of the
+ *                  buffer size or the peer MTU.  Buffers are allocated as long
+ *                  as the tx queue would stay below the high watermarks
+ *                  checked by PORT_WriteData, if they were all queued, and
+ *                  below the critical watermarks, so that port_write takes
+ *                  all of them.
+ *
+ * Parameters:      p_port     - pointer to address of port control block
+ *                  len        - Byte count to send
+ *                  pp_bufs     - array of max_bufs buffer pointers to fill
+ *                  max_bufs    - Buffer count requested
+ *
+ * Returns          Buffer count allocated
+ *
+ ******************************************************************************/
+static uint16_t port_alloc_write_buffers(tPORT* p_port, int len,
+                                         BT_HDR** pp_bufs, uint16_t max_bufs) {
+  uint32_t queue_size = p_port->tx.queue_size;
+  size_t queue_count = fixed_queue_length(p_port->tx.queue);
+  uint16_t count = 0;
+  uint16_t length;
+
+  /* Length for each buffer is the smaller of GKI buffer, peer MTU, or len */
+  length = RFCOMM_DATA_BUF_SIZE -
+           (uint16_t)(sizeof(BT_HDR) + L2CAP_MIN_OFFSET + RFCOMM_DATA_OVERHEAD);
+  if (p_port->peer_mtu < length) length = p_port->peer_mtu;
+
+  while ((len > 0) && (count < max_bufs) && (queue_size <= PORT_TX_HIGH_WM) &&
+         (queue_count <= PORT_TX_BUF_HIGH_WM)) {
+    uint16_t buf_len = (len < (int)length) ? (uint16_t)len : length;
+    if (queue_size + buf_len > PORT_TX_CRITICAL_WM) break;
+
+    BT_HDR* p_buf = (BT_HDR*)osi_malloc(RFCOMM_DATA_BUF_SIZE);
+    p_buf->offset = L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET;
+    p_buf->len = buf_len;
+    p_buf->layer_specific = p_port->inx;
+    p_buf->event = BT_EVT_TO_BTU_SP_DATA;
+
+    len -= p_buf->len;
+    queue_size += p_buf->len;
+    queue_count++;
+    pp_bufs[count++] = p_buf;
+  }
+
+  return count;
+}
+
+/*******************************************************************************
+ *
+ * Function         port_write_buffers
+ *
+ * Description      This function sends count buffers in turn, stopping at the
+ *                  first one the port does not accept.  All the buffers are
+ *                  taken: those not sent are freed.  The user flow control is
+ *                  checked once, after the buffers are queued.
+ *
+ * Parameters:      p_port     - pointer to address of port control block
+ *                  pp_bufs     - array of count buffers with data
+ *                  p_count     - Buffer count accepted
+ *                  p_len       - Byte count accepted
+ *                  p_event     - Events to send to the application
+ *
+ * Returns          Status of the last buffer written
+ *
+ ******************************************************************************/
+static int port_write_buffers(tPORT* p_port, BT_HDR** pp_bufs, uint16_t count,
+                              uint16_t* p_count, int* p_len,
+                              uint32_t* p_event) {
+  int rc = PORT_SUCCESS;
+  uint16_t i = 0;
+
+  *p_count = 0;
+  *p_len = 0;
+
+  while (i < count) {
+    BT_HDR* p_buf = pp_bufs[i++];
+    uint16_t length = p_buf->len;
+
+    p_buf->layer_specific = p_port->inx;
+    p_buf->event = BT_EVT_TO_BTU_SP_DATA;
+
+    rc = port_write(p_port, p_buf);
+
+    if (rc == PORT_SUCCESS) *p_event |= PORT_EV_TXCHAR;
+
+    if ((rc != PORT_SUCCESS) && (rc != PORT_CMD_PENDING)) break;
+
+    (*p_count)++;
+    *p_len += length;
+  }
+
+  /* port_write took the buffers up to the one it did not accept */
+  port_free_buffers(pp_bufs + i, count - i);
+
+  /* If queue went below the threashold need to send flow control */
+  *p_event |= port_flow_control_user(p_port);
+
+  RFCOMM_TRACE_EVENT("port_write_buffers %d buffers %d bytes", *p_count,
+                     *p_len);
+  return rc;
+}
+
 /*******************************************************************************
  *
  * Function         PORT_Write
@@ -1388,6 +1713,133 @@ int PORT_Write(uint16_t handle, BT_HDR* p_buf) {
 
   return (PORT_SUCCESS);
 }
+
+/*******************************************************************************
+ *
+ * Function         PORT_AllocWriteBuffers
+ *
+ * Description      This function allocates the buffers to send up to max_len
+ *                  bytes of data with PORT_WriteBuffers, as many as fit below
+ *                  the tx queue high watermarks.  The len of each buffer is
+ *                  set to the room for data at its offset.  Application can
+ *                  fill them directly, e.g. with one readv from a socket.
+ *
+ * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
+ *                  max_len     - Byte count to send
+ *                  pp_bufs     - array of max_bufs buffer pointers to fill
+ *                  max_bufs    - Buffer count requested
+ *                  p_count     - Buffer count allocated
+ *
+ ******************************************************************************/
+int PORT_AllocWriteBuffers(uint16_t handle, uint16_t max_len, BT_HDR** pp_bufs,
+                           uint16_t max_bufs, uint16_t* p_count) {
+  tPORT* p_port;
+
+  RFCOMM_TRACE_API("PORT_AllocWriteBuffers() handle:%d max_len:%d", handle,
+                   max_len);
+
+  *p_count = 0;
+
+  /* Check if handle is valid to avoid crashing */
+  if ((handle == 0) || (handle > MAX_RFC_PORTS)) {
+    return (PORT_BAD_HANDLE);
+  }
+  p_port = &rfc_cb.port.port[handle - 1];
+
+  if (!p_port->in_use || (p_port->state == PORT_STATE_CLOSED)) {
+    return (PORT_NOT_OPENED);
+  }
+
+  if (!p_port->peer_mtu) {
+    RFCOMM_TRACE_ERROR("PORT_AllocWriteBuffers() peer_mtu:%d",
+                       p_port->peer_mtu);
+    return (PORT_UNKNOWN_ERROR);
+  }
+
+  *p_count = port_alloc_write_buffers(p_port, max_len, pp_bufs, max_bufs);
+  return (PORT_SUCCESS);
+}
+
+/*******************************************************************************
+ *
+ * Function         PORT_WriteBuffers
+ *
+ * Description      This function sends a chain of buffers to the peer device
+ *                  without copying them, e.g. the buffers allocated by
+ *                  PORT_AllocWriteBuffers.  Each buffer must be
+ *                  RFCOMM_DATA_BUF_SIZE bytes, as the data of later writes may
+ *                  be appended to it, have an offset of at least
+ *                  L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET, room for the FCS
+ *                  after the data, and no more data than the peer MTU.
+ *                  Application should not free the buffers.
+ *
+ * Parameters:      handle     - Handle returned in the RFCOMM_CreateConnection
+ *                  pp_bufs     - array of count buffers with data
+ *                  count       - Buffer count to send
+ *                  p_count     - Buffer count accepted
+ *
+ ******************************************************************************/
+int PORT_WriteBuffers(uint16_t handle, BT_HDR** pp_bufs, uint16_t count,
+                      uint16_t* p_count) {
+  tPORT* p_port;
+  uint32_t event = 0;
+  int length;
+  int rc;
+
+  RFCOMM_TRACE_API("PORT_WriteBuffers() handle:%d count:%d", handle, count);
+
+  *p_count = 0;
+
+  /* Check if handle is valid to avoid crashing */
+  if ((handle == 0) || (handle > MAX_RFC_PORTS)) {
+    port_free_buffers(pp_bufs, count);
+    return (PORT_BAD_HANDLE);
+  }
+
+  p_port = &rfc_cb.port.port[handle - 1];
+
+  if (!p_port->in_use || (p_port->state == PORT_STATE_CLOSED)) {
+    port_free_buffers(pp_bufs, count);
+    return (PORT_NOT_OPENED);
+  }
+
+  if (p_port->line_status) {
+    RFCOMM_TRACE_WARNING("PORT_WriteBuffers: Data dropped line_status:0x%x",
+                         p_port->line_status);
+    port_free_buffers(pp_bufs, count);
+    return (PORT_LINE_ERR);
+  }
+
+  for (uint16_t i = 0; i < count; i++) {
+    if ((pp_bufs[i]->offset < L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET) ||
+        (pp_bufs[i]->len > p_port->peer_mtu) ||
+        (sizeof(BT_HDR) + pp_bufs[i]->offset + pp_bufs[i]->len >=
+         RFCOMM_DATA_BUF_SIZE)) {
+      RFCOMM_TRACE_ERROR(
+          "PORT_WriteBuffers() bad buffer offset:%d len:%d peer_mtu:%d",
+          pp_bufs[i]->offset, pp_bufs[i]->len, p_port->peer_mtu);
+      port_free_buffers(pp_bufs, count);
+      return (PORT_UNKNOWN_ERROR);
+    }
+  }
+
+  rc = port_write_buffers(p_port, pp_bufs, count, p_count, &length, &event);
+
+  if (rc == PORT_TX_FULL) event |= PORT_EV_ERR;
+
+  if ((*p_count == count) && (rc != PORT_CMD_PENDING) &&
+      (rc != PORT_TX_QUEUE_DISABLED))
+    event |= PORT_EV_TXEMPTY;
+
+  /* Mask out all events that are not of interest to user */
+  event &= p_port->ev_mask;
+
+  /* Send event to the application */
+  if (p_port->p_callback && event) (p_port->p_callback)(event, p_port->inx);
+
+  return (PORT_SUCCESS);
+}
+
 /*******************************************************************************
  *
  * Function         PORT_WriteDataCO
@@ -1405,7 +1857,6 @@ int PORT_WriteDataCO(uint16_t handle, int* p_len) {
   BT_HDR* p_buf;
   uint32_t event = 0;
   int rc = 0;
-  uint16_t length;
 
   RFCOMM_TRACE_API("PORT_WriteDataCO() handle:%d", handle);
   *p_len = 0;
@@ -1426,6 +1877,12 @@ int PORT_WriteDataCO(uint16_t handle, int* p_len) {
     RFCOMM_TRACE_ERROR("PORT_WriteDataByFd() peer_mtu:%d", p_port->peer_mtu);
     return (PORT_UNKNOWN_ERROR);
   }
+
+  /* Leave the data in the socket if port_write would drop it */
+  if (p_port->is_server && (p_port->rfc.state != RFC_STATE_OPENED)) {
+    return (PORT_CLOSED);
+  }
+
   int available = 0;
   // if(ioctl(fd, FIONREAD, &available) < 0)
   if (!p_port->p_data_co_callback(handle, (uint8_t*)&available,
@@ -1438,10 +1895,6 @@ int PORT_WriteDataCO(uint16_t handle, int* p_len) {
     return (PORT_UNKNOWN_ERROR);
   }
   if (available == 0) return PORT_SUCCESS;
-  /* Length for each buffer is the smaller of GKI buffer, peer MTU, or max_len
-   */
-  length = RFCOMM_DATA_BUF_SIZE -
-           (uint16_t)(sizeof(BT_HDR) + L2CAP_MIN_OFFSET + RFCOMM_DATA_OVERHEAD);
 
   /* If there are buffers scheduled for transmission check if requested */
   /* data fits into the end of the queue */
@@ -1450,7 +1903,7 @@ int PORT_WriteDataCO(uint16_t handle, int* p_len) {
   p_buf = (BT_HDR*)fixed_queue_try_peek_last(p_port->tx.queue);
   if ((p_buf != NULL) &&
       (((int)p_buf->len + available) <= (int)p_port->peer_mtu) &&
-      (((int)p_buf->len + available) <= (int)length)) {
+      (available <= (int)port_tx_buf_room(p_buf))) {
     // if(recv(fd, (uint8_t *)(p_buf + 1) + p_buf->offset + p_buf->len,
     // available, 0) != available)
     if (!p_port->p_data_co_callback(
@@ -1468,25 +1921,35 @@ int PORT_WriteDataCO(uint16_t handle, int* p_len) {
     // memcpy ((uint8_t *)(p_buf + 1) + p_buf->offset + p_buf->len, p_data,
     // max_len);
     p_port->tx.queue_size += (uint16_t)available;
+    p_port->stats.tx_writes++;
 
     *p_len = available;
     p_buf->len += (uint16_t)available;
 
     mutex_global_unlock();
 
+    /* Send the data held once it fills a frame */
+    if (p_port->tx_aggr_ms) port_rfc_send_tx_data(p_port);
+
     return (PORT_SUCCESS);
   }
 
   mutex_global_unlock();
 
-  // int max_read = length < p_port->peer_mtu ? length : p_port->peer_mtu;
-
-  // max_read = available < max_read ? available : max_read;
-
+  /* Read the data into buffers of up to the peer MTU with one callout per */
+  /* batch of buffers that fits below the high water marks, so the socket */
+  /* is read with a single readv rather than one recv per buffer.  The */
+  /* port is open and the batch stays below the critical water marks, so */
+  /* port_write takes all the data read from the socket. */
   while (available) {
+    BT_HDR* bufs[PORT_TX_BUF_HIGH_WM + 1];
+    uint16_t count = port_alloc_write_buffers(p_port, available, bufs,
+                                              PORT_TX_BUF_HIGH_WM + 1);
+    uint16_t written;
+    int written_len;
+
     /* if we're over buffer high water mark, we're done */
-    if ((p_port->tx.queue_size > PORT_TX_HIGH_WM) ||
-        (fixed_queue_length(p_port->tx.queue) > PORT_TX_BUF_HIGH_WM)) {
+    if (count == 0) {
       port_flow_control_user(p_port);
       event |= PORT_EV_FC;
       RFCOMM_TRACE_EVENT(
@@ -1496,41 +1959,23 @@ int PORT_WriteDataCO(uint16_t handle, int* p_len) {
       break;
     }
 
-    /* continue with rfcomm data write */
-    p_buf = (BT_HDR*)osi_malloc(RFCOMM_DATA_BUF_SIZE);
-    p_buf->offset = L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET;
-    p_buf->layer_specific = handle;
-
-    if (p_port->peer_mtu < length) length = p_port->peer_mtu;
-    if (available < (int)length) length = (uint16_t)available;
-    p_buf->len = length;
-    p_buf->event = BT_EVT_TO_BTU_SP_DATA;
-
-    // memcpy ((uint8_t *)(p_buf + 1) + p_buf->offset, p_data, length);
-    // if(recv(fd, (uint8_t *)(p_buf + 1) + p_buf->offset, (int)length, 0) !=
-    // (int)length)
-    if (!p_port->p_data_co_callback(handle,
-                                    (uint8_t*)(p_buf + 1) + p_buf->offset,
-                                    length, DATA_CO_CALLBACK_TYPE_OUTGOING)) {
+    if (!p_port->p_data_co_callback(handle, (uint8_t*)bufs, count,
+                                    DATA_CO_CALLBACK_TYPE_OUTGOING_BUFS)) {
       error(
-          "p_data_co_callback DATA_CO_CALLBACK_TYPE_OUTGOING failed, length:%d",
-          length);
+          "p_data_co_callback DATA_CO_CALLBACK_TYPE_OUTGOING_BUFS failed, "
+          "count:%d",
+          count);
+      port_free_buffers(bufs, count);
       return (PORT_UNKNOWN_ERROR);
     }
 
-    RFCOMM_TRACE_EVENT("PORT_WriteData %d bytes", length);
-
-    rc = port_write(p_port, p_buf);
+    rc = port_write_buffers(p_port, bufs, count, &written, &written_len,
+                            &event);
 
-    /* If queue went below the threashold need to send flow control */
-    event |= port_flow_control_user(p_port);
-
-    if (rc == PORT_SUCCESS) event |= PORT_EV_TXCHAR;
+    *p_len += written_len;
+    available -= written_len;
 
     if ((rc != PORT_SUCCESS) && (rc != PORT_CMD_PENDING)) break;
-
-    *p_len += length;
-    available -= (int)length;
   }
   if (!available && (rc != PORT_CMD_PENDING) && (rc != PORT_TX_QUEUE_DISABLED))
     event |= PORT_EV_TXEMPTY;
@@ -1596,15 +2041,19 @@ int PORT_WriteData(uint16_t handle, const char* p_data, uint16_t max_len,
 
   p_buf = (BT_HDR*)fixed_queue_try_peek_last(p_port->tx.queue);
   if ((p_buf != NULL) && ((p_buf->len + max_len) <= p_port->peer_mtu) &&
-      ((p_buf->len + max_len) <= length)) {
+      (max_len <= port_tx_buf_room(p_buf))) {
     memcpy((uint8_t*)(p_buf + 1) + p_buf->offset + p_buf->len, p_data, max_len);
     p_port->tx.queue_size += max_len;
+    p_port->stats.tx_writes++;
 
     *p_len = max_len;
     p_buf->len += max_len;
 
     mutex_global_unlock();
 
+    /* Send the data held once it fills a frame */
+    if (p_port->tx_aggr_ms) port_rfc_send_tx_data(p_port);
+
     return (PORT_SUCCESS);
   }
 
@@ -1749,3 +2198,39 @@ const char* PORT_GetResultString(const uint8_t result_code) {
 
   return result_code_strings[result_code];
 }
+
+/*******************************************************************************
+ *
+ * Function         rfcomm_debug_dump
+ *
+ * Description      Dumps the throughput and credit statistics of the open
+ *                  ports to the |fd| file descriptor.
+ *
+ ******************************************************************************/
+void rfcomm_debug_dump(int fd) {
+  dprintf(fd, "\nRFCOMM ports:\n");
+  for (uint16_t handle = 1; handle <= MAX_RFC_PORTS; handle++) {
+    tPORT_STATS stats;
+    if (PORT_GetStats(handle, &stats) != PORT_SUCCESS) continue;
+
+    uint32_t duration_ms = stats.duration_ms ? stats.duration_ms : 1;
+    dprintf(fd, "  Port %d, dlci %d:\n", handle,
+            rfc_cb.port.port[handle - 1].dlci);
+    dprintf(fd, "    Rx frames / bytes / kbps   : %u / %u / %" PRIu64 "\n",
+            stats.rx_frames, stats.rx_bytes,
+            (uint64_t)stats.rx_bytes * 8 / duration_ms);
+    dprintf(fd, "    Tx frames / bytes / kbps   : %u / %u / %" PRIu64 "\n",
+            stats.tx_frames, stats.tx_bytes,
+            (uint64_t)stats.tx_bytes * 8 / duration_ms);
+    dprintf(fd, "    Tx writes / bytes per frame: %u / %u\n",
+            stats.tx_writes,
+            stats.tx_frames ? stats.tx_bytes / stats.tx_frames : 0);
+    dprintf(fd, "    Credits granted / frames   : %u / %u\n",
+            stats.credits_granted, stats.credit_frames);
+    dprintf(fd, "    Credit window / rate / rtt : %u / %u fps / %u ms\n",
+            stats.credit_window, stats.credit_rate, stats.credit_rtt_ms);
+    dprintf(fd, "    Rx credit stalls           : %u\n", stats.rx_credit_stalls);
+    dprintf(fd, "    Tx credit stalls / ms      : %u / %u\n",
+            stats.tx_credit_stalls, stats.tx_stall_ms);
+  }
+}
@@ -203,6 +203,23 @@ typedef struct {
   bool keep_port_handle;    /* true if port is not deallocated when closing */
   /* it is set to true for server when allocating port */
   uint16_t keep_mtu; /* Max MTU that port can receive by server */
+
+  /* Adaptive credit grants, see port_flow_control_peer() */
+  uint16_t credit_rx_window; /* Number of credits granted at a time */
+  uint16_t credit_rx_peer;   /* Number of credits the peer has left */
+  uint16_t credit_rate_frames; /* Frames consumed since credit_rate_ms */
+  uint32_t credit_rate;        /* Consumer rate, in frames per second */
+  uint64_t credit_rate_ms;     /* Start of the consumer rate measurement */
+  uint32_t credit_rtt_ms;      /* Round trip from credits to peer data */
+  uint64_t credit_resume_ms;   /* Credits sent to the stalled peer, or 0 */
+  uint64_t tx_stall_ms; /* Tx data started waiting for credits, or 0 */
+  uint64_t open_ms;     /* Time the port was opened */
+  tPORT_STATS stats;
+
+  /* Aggregation of small writes, see PORT_SetTxAggregation() */
+  uint16_t tx_aggr_ms;     /* Max time data is held, 0 if disabled */
+  bool tx_aggr_due;        /* Data held is sent as soon as possible */
+  alarm_t* tx_aggr_timer;
 } tPORT;
 
 /* Define the PORT/RFCOMM control structure
@@ -227,6 +244,9 @@ extern uint32_t port_get_signal_changes(tPORT* p_port, uint8_t old_signals,
                                         uint8_t signal);
 extern uint32_t port_flow_control_user(tPORT* p_port);
 extern void port_flow_control_peer(tPORT* p_port, bool enable, uint16_t count);
+extern void port_credits_granted(tPORT* p_port, uint8_t credits);
+extern void port_credit_data_ind(tPORT* p_port);
+extern void port_tx_credit_wait(tPORT* p_port);
 
 /*
  * Functions provided by the port_rfc.cc
@@ -237,5 +257,6 @@ extern void port_start_par_neg(tPORT* p_port);
 extern void port_start_control(tPORT* p_port);
 extern void port_start_close(tPORT* p_port);
 extern void port_rfc_closed(tPORT* p_port, uint8_t res);
+extern uint32_t port_rfc_send_tx_data(tPORT* p_port);
 
 #endif
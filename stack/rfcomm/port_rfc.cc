@@ -27,6 +27,7 @@
 
 #include "osi/include/mutex.h"
 #include "osi/include/osi.h"
+#include "osi/include/time.h"
 
 #include "bt_common.h"
 #include "bt_target.h"
@@ -41,7 +42,6 @@
 /*
  * Local function definitions
 */
-uint32_t port_rfc_send_tx_data(tPORT* p_port);
 void port_rfc_closed(tPORT* p_port, uint8_t res);
 void port_get_credits(tPORT* p_port, uint8_t k);
 
@@ -341,6 +341,7 @@ void PORT_ParNegInd(tRFC_MCB* p_mcb, uint8_t dlci, uint16_t mtu, uint8_t cl,
     our_k = (p_port->credit_rx_max < RFCOMM_K_MAX) ? p_port->credit_rx_max
                                                    : RFCOMM_K_MAX;
     p_port->credit_rx = our_k;
+    p_port->credit_rx_peer = our_k;
   } else {
     /* must not be using credit based flow control; use TS 7.10 */
     our_cl = RFCOMM_PN_CONV_LAYER_TYPE_1;
@@ -456,6 +457,7 @@ void PORT_DlcEstablishInd(tRFC_MCB* p_mcb, uint8_t dlci, uint16_t mtu) {
     p_port->p_mgmt_callback(PORT_SUCCESS, p_port->inx);
 
   p_port->state = PORT_STATE_OPENED;
+  p_port->open_ms = time_get_os_boottime_ms();
 }
 
 /*******************************************************************************
@@ -496,6 +498,7 @@ void PORT_DlcEstablishCnf(tRFC_MCB* p_mcb, uint8_t dlci, uint16_t mtu,
     p_port->p_mgmt_callback(PORT_SUCCESS, p_port->inx);
 
   p_port->state = PORT_STATE_OPENED;
+  p_port->open_ms = time_get_os_boottime_ms();
 
   /* RPN is required only if we want to tell DTE how the port should be opened
    */
@@ -771,6 +774,10 @@ void PORT_DataInd(tRFC_MCB* p_mcb, uint8_t dlci, BT_HDR* p_buf) {
     osi_free(p_buf);
     return;
   }
+  p_port->stats.rx_frames++;
+  p_port->stats.rx_bytes += p_buf->len;
+  if (p_mcb->flow == PORT_FC_CREDIT) port_credit_data_ind(p_port);
+
   /* If client registered callout callback with flow control we can just deliver
    * receive data */
   if (p_port->p_data_co_callback) {
@@ -891,6 +898,52 @@ void PORT_FlowInd(tRFC_MCB* p_mcb, uint8_t dlci, bool enable_data) {
   }
 }
 
+/*******************************************************************************
+ *
+ * Function         port_tx_aggr_timeout
+ *
+ * Description      Called when data was held for the max time, to send it.
+ *
+ ******************************************************************************/
+static void port_tx_aggr_timeout(void* data) {
+  tPORT* p_port = (tPORT*)data;
+
+  if (!p_port->in_use) return;
+
+  p_port->tx_aggr_due = true;
+  uint32_t events = port_rfc_send_tx_data(p_port);
+
+  /* Send event to the application */
+  if (p_port->p_callback && events) (p_port->p_callback)(events, p_port->inx);
+}
+
+/*******************************************************************************
+ *
+ * Function         port_tx_aggr_hold
+ *
+ * Description      Check if the data at the head of the tx queue is held for
+ *                  the writes to come: aggregation is enabled, it is the last
+ *                  buffer and it is less than the peer MTU.  Starts the
+ *                  timer bounding the time it is held.  Called with the
+ *                  global mutex held.
+ *
+ * Returns          true if the data is held
+ *
+ ******************************************************************************/
+static bool port_tx_aggr_hold(tPORT* p_port) {
+  if (!p_port->tx_aggr_ms || p_port->tx_aggr_due) return false;
+
+  if (fixed_queue_length(p_port->tx.queue) != 1) return false;
+
+  BT_HDR* p_buf = (BT_HDR*)fixed_queue_try_peek_first(p_port->tx.queue);
+  if (p_buf->len >= p_port->peer_mtu) return false;
+
+  if (!alarm_is_scheduled(p_port->tx_aggr_timer))
+    alarm_set_on_mloop(p_port->tx_aggr_timer, p_port->tx_aggr_ms,
+                       port_tx_aggr_timeout, p_port);
+  return true;
+}
+
 /*******************************************************************************
  *
  * Function         port_rfc_send_tx_data
@@ -910,9 +963,16 @@ uint32_t port_rfc_send_tx_data(tPORT* p_port) {
       /* get data from tx queue and send it */
       mutex_global_lock();
 
+      /* unless it is held for the writes to come */
+      if (port_tx_aggr_hold(p_port)) {
+        mutex_global_unlock();
+        break;
+      }
+
       p_buf = (BT_HDR*)fixed_queue_try_dequeue(p_port->tx.queue);
       if (p_buf != NULL) {
         p_port->tx.queue_size -= p_buf->len;
+        p_port->tx_aggr_due = false;
 
         mutex_global_unlock();
 
@@ -936,6 +996,13 @@ uint32_t port_rfc_send_tx_data(tPORT* p_port) {
         break;
       }
     }
+    /* Data left for the credits of the peer */
+    if (p_port->tx.queue_size > 0) port_tx_credit_wait(p_port);
+
+    /* Nothing held anymore */
+    if ((p_port->tx.queue_size == 0) && p_port->tx_aggr_ms)
+      alarm_cancel(p_port->tx_aggr_timer);
+
     /* If we flow controlled user based on the queue size enable data again */
     events |= port_flow_control_user(p_port);
   }
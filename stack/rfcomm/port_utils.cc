@@ -24,7 +24,10 @@
 #include <base/logging.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include "osi/include/mutex.h"
+#include "osi/include/time.h"
 
 #include "bt_common.h"
 #include "bt_target.h"
@@ -36,6 +39,13 @@
 #include "rfc_int.h"
 #include "rfcdefs.h"
 
+/* Bounds of the consumer rate and credit round trip measurements */
+#define PORT_CREDIT_RATE_MIN_MS 10
+#define PORT_CREDIT_RATE_MAX_MS 1000
+#define PORT_CREDIT_RTT_MAX_MS 500
+
+static void port_update_credit_window(tPORT* p_port);
+
 static const tPORT_STATE default_port_pars = {
     PORT_BAUD_RATE_9600,
     PORT_8_BITS,
@@ -78,6 +88,7 @@ tPORT* port_allocate_port(uint8_t dlci, const RawAddress& bd_addr) {
       port_set_defaults(p_port);
 
       p_port->rfc.port_timer = alarm_new("rfcomm_port.port_timer");
+      p_port->tx_aggr_timer = alarm_new("rfcomm_port.tx_aggr_timer");
       rfc_cb.rfc.last_port = yy;
 
       p_port->dlci = dlci;
@@ -116,6 +127,15 @@ void port_set_defaults(tPORT* p_port) {
 
   p_port->credit_tx = 0;
   p_port->credit_rx = 0;
+  p_port->credit_rx_peer = 0;
+  p_port->credit_rate_frames = 0;
+  p_port->credit_rate = 0;
+  p_port->credit_rate_ms = 0;
+  p_port->credit_rtt_ms = 0;
+  p_port->credit_resume_ms = 0;
+  p_port->tx_stall_ms = 0;
+  p_port->open_ms = 0;
+  memset(&p_port->stats, 0, sizeof(p_port->stats));
 
   memset(&p_port->local_ctrl, 0, sizeof(p_port->local_ctrl));
   memset(&p_port->peer_ctrl, 0, sizeof(p_port->peer_ctrl));
@@ -184,6 +204,7 @@ void port_select_mtu(tPORT* p_port) {
   p_port->credit_rx_low = (PORT_RX_LOW_WM / p_port->mtu);
   if (p_port->credit_rx_low > PORT_RX_BUF_LOW_WM)
     p_port->credit_rx_low = PORT_RX_BUF_LOW_WM;
+  p_port->credit_rx_window = p_port->credit_rx_max;
   p_port->rx_buf_critical = (PORT_RX_CRITICAL_WM / p_port->mtu);
   if (p_port->rx_buf_critical > PORT_RX_BUF_CRITICAL_WM)
     p_port->rx_buf_critical = PORT_RX_BUF_CRITICAL_WM;
@@ -221,6 +242,8 @@ void port_release_port(tPORT* p_port) {
   mutex_global_unlock();
 
   alarm_cancel(p_port->rfc.port_timer);
+  alarm_cancel(p_port->tx_aggr_timer);
+  p_port->tx_aggr_due = false;
 
   p_port->state = PORT_STATE_CLOSED;
 
@@ -266,6 +289,7 @@ void port_release_port(tPORT* p_port) {
     } else {
       RFCOMM_TRACE_DEBUG("%s Clean-up handle: %d", __func__, p_port->inx);
       alarm_free(p_port->rfc.port_timer);
+      alarm_free(p_port->tx_aggr_timer);
       memset(p_port, 0, sizeof(tPORT));
     }
   }
@@ -439,6 +463,115 @@ uint32_t port_get_signal_changes(tPORT* p_port, uint8_t old_signals,
   return (p_port->ev_mask & events);
 }
 
+/*******************************************************************************
+ *
+ * Function         port_update_credit_window
+ *
+ * Description      Update the number of credits granted at a time to the
+ *                  peer. When the data is delivered to a data callback, the
+ *                  window is twice the consumer rate times the credit round
+ *                  trip, as credits are granted once half of them are used.
+ *                  Data kept in the receive queue is limited by the queue
+ *                  watermarks instead.
+ *
+ * Returns          nothing
+ *
+ ******************************************************************************/
+static void port_update_credit_window(tPORT* p_port) {
+  uint64_t now_ms = time_get_os_boottime_ms();
+  uint64_t elapsed_ms = now_ms - p_port->credit_rate_ms;
+
+  /* Measure the rate over a few frames, and skip the idle periods */
+  if (elapsed_ms >= PORT_CREDIT_RATE_MIN_MS) {
+    if (elapsed_ms <= PORT_CREDIT_RATE_MAX_MS) {
+      uint32_t rate = p_port->credit_rate_frames * 1000 / elapsed_ms;
+      p_port->credit_rate =
+          p_port->credit_rate ? (3 * p_port->credit_rate + rate) / 4 : rate;
+    }
+    p_port->credit_rate_ms = now_ms;
+    p_port->credit_rate_frames = 0;
+  }
+
+  uint16_t window = p_port->credit_rx_max;
+  if (p_port->p_data_callback || p_port->p_data_co_callback) {
+    uint32_t bdp = p_port->credit_rate * p_port->credit_rtt_ms / 1000;
+    window = (uint16_t)std::min<uint32_t>(
+        std::max<uint32_t>(2 * bdp, p_port->credit_rx_max),
+        PORT_RX_BUF_CREDIT_MAX);
+  }
+  if (window != p_port->credit_rx_window) {
+    RFCOMM_TRACE_DEBUG("%s: dlci:%d window:%d rate:%d rtt:%d", __func__,
+                       p_port->dlci, window, p_port->credit_rate,
+                       p_port->credit_rtt_ms);
+    p_port->credit_rx_window = window;
+  }
+}
+
+/*******************************************************************************
+ *
+ * Function         port_credits_granted
+ *
+ * Description      Called when credits are sent to the peer, in a credit only
+ *                  frame or with data.
+ *
+ * Returns          nothing
+ *
+ ******************************************************************************/
+void port_credits_granted(tPORT* p_port, uint8_t credits) {
+  /* The next frame received measures the credit round trip */
+  if (p_port->credit_rx_peer == 0)
+    p_port->credit_resume_ms = time_get_os_boottime_ms();
+
+  p_port->credit_rx_peer += credits;
+  p_port->stats.credits_granted += credits;
+}
+
+/*******************************************************************************
+ *
+ * Function         port_credit_data_ind
+ *
+ * Description      Called when a data frame using a credit is received from
+ *                  the peer.
+ *
+ * Returns          nothing
+ *
+ ******************************************************************************/
+void port_credit_data_ind(tPORT* p_port) {
+  if (p_port->credit_resume_ms) {
+    uint64_t rtt_ms = time_get_os_boottime_ms() - p_port->credit_resume_ms;
+    /* Longer if the peer had no data to send when the credits arrived */
+    if (rtt_ms <= PORT_CREDIT_RTT_MAX_MS) {
+      p_port->credit_rtt_ms =
+          p_port->credit_rtt_ms ? (3 * p_port->credit_rtt_ms + rtt_ms) / 4
+                                : rtt_ms;
+    }
+    p_port->credit_resume_ms = 0;
+  }
+
+  if (p_port->credit_rx_peer > 0) {
+    p_port->credit_rx_peer--;
+    if (p_port->credit_rx_peer == 0) p_port->stats.rx_credit_stalls++;
+  }
+}
+
+/*******************************************************************************
+ *
+ * Function         port_tx_credit_wait
+ *
+ * Description      Called when data is left in the tx queue.  Counts the times
+ *                  it waits for credits from the peer, until rfc_inc_credit().
+ *
+ * Returns          nothing
+ *
+ ******************************************************************************/
+void port_tx_credit_wait(tPORT* p_port) {
+  if (p_port->rfc.p_mcb && (p_port->rfc.p_mcb->flow == PORT_FC_CREDIT) &&
+      (p_port->credit_tx == 0) && (p_port->tx_stall_ms == 0)) {
+    p_port->tx_stall_ms = time_get_os_boottime_ms();
+    p_port->stats.tx_credit_stalls++;
+  }
+}
+
 /*******************************************************************************
  *
  * Function         port_flow_control_peer
@@ -463,18 +596,30 @@ void port_flow_control_peer(tPORT* p_port, bool enable, uint16_t count) {
       } else {
         p_port->credit_rx -= count;
       }
+      /* |count| frames were consumed by the user */
+      p_port->credit_rate_frames += count;
 
-      /* If credit count is less than low credit watermark, and user */
-      /* did not force flow control, send a credit update */
+      /* If the peer used a batch of the credits granted, and user did not */
+      /* force flow control, send a credit update. The batch is half the */
+      /* window once it grew, so that few credit only frames are sent. */
       /* There might be a special case when we just adjusted rx_max */
-      if ((p_port->credit_rx <= p_port->credit_rx_low) && !p_port->rx.user_fc &&
-          (p_port->credit_rx_max > p_port->credit_rx)) {
-        rfc_send_credit(p_port->rfc.p_mcb, p_port->dlci,
-                        (uint8_t)(p_port->credit_rx_max - p_port->credit_rx));
-
-        p_port->credit_rx = p_port->credit_rx_max;
-
-        p_port->rx.peer_fc = false;
+      uint16_t batch =
+          std::max(p_port->credit_rx_max - p_port->credit_rx_low,
+                   p_port->credit_rx_window / 2);
+      if ((p_port->credit_rx + batch <= p_port->credit_rx_window) &&
+          !p_port->rx.user_fc) {
+        port_update_credit_window(p_port);
+        if (p_port->credit_rx_window > p_port->credit_rx) {
+          uint8_t credits =
+              (uint8_t)(p_port->credit_rx_window - p_port->credit_rx);
+          rfc_send_credit(p_port->rfc.p_mcb, p_port->dlci, credits);
+          port_credits_granted(p_port, credits);
+          p_port->stats.credit_frames++;
+
+          p_port->credit_rx = p_port->credit_rx_window;
+
+          p_port->rx.peer_fc = false;
+        }
       }
     }
     /* else want to disable flow from peer */
@@ -482,6 +627,9 @@ void port_flow_control_peer(tPORT* p_port, bool enable, uint16_t count) {
       /* if client registered data callback, just do what they want */
       if (p_port->p_data_callback || p_port->p_data_co_callback) {
         p_port->rx.peer_fc = true;
+        /* The data is not consumed as fast as it is received */
+        p_port->credit_rx_window = std::max(
+            p_port->credit_rx_max, (uint16_t)(p_port->credit_rx_window / 2));
       }
       /* if queue count reached credit rx max, set peer fc */
       else if (fixed_queue_length(p_port->rx.queue) >= p_port->credit_rx_max) {
@@ -416,13 +416,16 @@ void rfc_port_sm_opened(tPORT* p_port, uint16_t event, void* p_data) {
       if ((p_port->rfc.p_mcb->flow == PORT_FC_CREDIT) &&
           (((BT_HDR*)p_data)->len < p_port->peer_mtu) &&
           (!p_port->rx.user_fc) &&
-          (p_port->credit_rx_max > p_port->credit_rx)) {
+          (p_port->credit_rx_window > p_port->credit_rx)) {
         ((BT_HDR*)p_data)->layer_specific =
-            (uint8_t)(p_port->credit_rx_max - p_port->credit_rx);
-        p_port->credit_rx = p_port->credit_rx_max;
+            (uint8_t)(p_port->credit_rx_window - p_port->credit_rx);
+        port_credits_granted(p_port, ((BT_HDR*)p_data)->layer_specific);
+        p_port->credit_rx = p_port->credit_rx_window;
       } else {
         ((BT_HDR*)p_data)->layer_specific = 0;
       }
+      p_port->stats.tx_frames++;
+      p_port->stats.tx_bytes += ((BT_HDR*)p_data)->len;
       rfc_send_buf_uih(p_port->rfc.p_mcb, p_port->dlci, (BT_HDR*)p_data);
       rfc_dec_credit(p_port);
       return;
@@ -151,6 +151,7 @@ void RFCOMM_ParNegReq(tRFC_MCB* p_mcb, uint8_t dlci, uint16_t mtu) {
     k = (p_port->credit_rx_max < RFCOMM_K_MAX) ? p_port->credit_rx_max
                                                : RFCOMM_K_MAX;
     p_port->credit_rx = k;
+    p_port->credit_rx_peer = k;
   } else {
     cl = RFCOMM_PN_CONV_LAYER_TYPE_1;
     k = 0;
@@ -30,6 +30,7 @@
 #include "btm_int.h"
 #include "btu.h"
 #include "osi/include/osi.h"
+#include "osi/include/time.h"
 #include "port_api.h"
 #include "port_ext.h"
 #include "port_int.h"
@@ -380,6 +381,12 @@ void rfc_inc_credit(tPORT* p_port, uint8_t credit) {
 
     RFCOMM_TRACE_EVENT("rfc_inc_credit:%d", p_port->credit_tx);
 
+    if (p_port->tx_stall_ms) {
+      p_port->stats.tx_stall_ms +=
+          time_get_os_boottime_ms() - p_port->tx_stall_ms;
+      p_port->tx_stall_ms = 0;
+    }
+
     if (p_port->tx.peer_fc) PORT_FlowInd(p_port->rfc.p_mcb, p_port->dlci, true);
   }
 }
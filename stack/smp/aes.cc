@@ -68,6 +68,12 @@
 
 #include "aes.h"
 
+/* use the AES instructions when the processor has them */
+#if defined(__x86_64__) || defined(__i386__)
+#define AES_NI
+#include <wmmintrin.h>
+#endif
+
 #if defined(HAVE_UINT_32T)
 typedef uint32_t uint_32t;
 #endif
@@ -596,10 +602,11 @@ return_type aes_set_key(const unsigned char key[], length_type keylen,
 
 #if defined(AES_ENC_PREKEYED)
 
-/*  Encrypt a single block of 16 bytes */
+/*  Encrypt a single block of 16 bytes with byte operations only */
 
-return_type aes_encrypt(const unsigned char in[N_BLOCK],
-                        unsigned char out[N_BLOCK], const aes_context ctx[1]) {
+return_type aes_encrypt_8bit(const unsigned char in[N_BLOCK],
+                             unsigned char out[N_BLOCK],
+                             const aes_context ctx[1]) {
   if (ctx->rnd) {
     uint_8t s1[N_BLOCK], r;
     copy_and_key(s1, in, ctx->ksch);
@@ -624,6 +631,214 @@ return_type aes_encrypt(const unsigned char in[N_BLOCK],
   return 0;
 }
 
+#if defined(USE_TABLES) && defined(HAVE_UINT_32T)
+
+/*  32-bit table driven encryption. Each of the four tables combines the byte
+    substitution of one row of the state with its mix columns contribution,
+    so that a round is sixteen table lookups on the state held as four big
+    endian column words. The key schedule is the byte one set up by
+    aes_set_key(), loaded a column word at a time.
+*/
+
+#define te0(x) \
+  ((uint_32t)f2(x) << 24 | (uint_32t)(x) << 16 | (uint_32t)(x) << 8 | f3(x))
+#define te1(x) \
+  ((uint_32t)f3(x) << 24 | (uint_32t)f2(x) << 16 | (uint_32t)(x) << 8 | (x))
+#define te2(x) \
+  ((uint_32t)(x) << 24 | (uint_32t)f3(x) << 16 | (uint_32t)f2(x) << 8 | (x))
+#define te3(x) \
+  ((uint_32t)(x) << 24 | (uint_32t)(x) << 16 | (uint_32t)f3(x) << 8 | f2(x))
+
+static const uint_32t t_fn0[256] = sb_data(te0);
+static const uint_32t t_fn1[256] = sb_data(te1);
+static const uint_32t t_fn2[256] = sb_data(te2);
+static const uint_32t t_fn3[256] = sb_data(te3);
+
+static uint_32t word_in(const uint_8t* p) {
+  return (uint_32t)p[0] << 24 | (uint_32t)p[1] << 16 | (uint_32t)p[2] << 8 |
+         p[3];
+}
+
+static void word_out(uint_8t* p, uint_32t w) {
+  p[0] = (uint_8t)(w >> 24);
+  p[1] = (uint_8t)(w >> 16);
+  p[2] = (uint_8t)(w >> 8);
+  p[3] = (uint_8t)w;
+}
+
+#define fwd_rnd(y0, x0, x1, x2, x3, k)                              \
+  (y0) = t_fn0[(x0) >> 24] ^ t_fn1[((x1) >> 16) & 0xff] ^           \
+         t_fn2[((x2) >> 8) & 0xff] ^ t_fn3[(x3)&0xff] ^ word_in(k)
+
+#define fwd_lrnd(y0, x0, x1, x2, x3, k)                                  \
+  (y0) = ((uint_32t)s_box((x0) >> 24) << 24 |                            \
+          (uint_32t)s_box(((x1) >> 16) & 0xff) << 16 |                   \
+          (uint_32t)s_box(((x2) >> 8) & 0xff) << 8 | s_box((x3)&0xff)) ^ \
+         word_in(k)
+
+return_type aes_encrypt_tables(const unsigned char in[N_BLOCK],
+                               unsigned char out[N_BLOCK],
+                               const aes_context ctx[1]) {
+  if (ctx->rnd) {
+    const uint_8t* k = ctx->ksch;
+    uint_32t s0, s1, s2, s3, t0, t1, t2, t3;
+    uint_8t r;
+
+    s0 = word_in(in) ^ word_in(k);
+    s1 = word_in(in + 4) ^ word_in(k + 4);
+    s2 = word_in(in + 8) ^ word_in(k + 8);
+    s3 = word_in(in + 12) ^ word_in(k + 12);
+
+    for (r = 1; r < ctx->rnd; ++r) {
+      k += N_BLOCK;
+      fwd_rnd(t0, s0, s1, s2, s3, k);
+      fwd_rnd(t1, s1, s2, s3, s0, k + 4);
+      fwd_rnd(t2, s2, s3, s0, s1, k + 8);
+      fwd_rnd(t3, s3, s0, s1, s2, k + 12);
+      s0 = t0;
+      s1 = t1;
+      s2 = t2;
+      s3 = t3;
+    }
+
+    k += N_BLOCK;
+    fwd_lrnd(t0, s0, s1, s2, s3, k);
+    fwd_lrnd(t1, s1, s2, s3, s0, k + 4);
+    fwd_lrnd(t2, s2, s3, s0, s1, k + 8);
+    fwd_lrnd(t3, s3, s0, s1, s2, k + 12);
+    word_out(out, t0);
+    word_out(out + 4, t1);
+    word_out(out + 8, t2);
+    word_out(out + 12, t3);
+  } else
+    return (return_type)-1;
+  return 0;
+}
+
+#else
+
+return_type aes_encrypt_tables(const unsigned char in[N_BLOCK],
+                               unsigned char out[N_BLOCK],
+                               const aes_context ctx[1]) {
+  return aes_encrypt_8bit(in, out, ctx);
+}
+
+#endif
+
+#if defined(AES_NI)
+
+/*  Encryption with the AES instructions, selected at run time. The round
+    keys of the byte key schedule are in the order expected by AESENC.
+*/
+
+int aes_ni_supported(void) {
+  static const int supported = __builtin_cpu_supports("aes") != 0;
+  return supported;
+}
+
+__attribute__((target("sse2,aes"))) return_type aes_encrypt_ni(
+    const unsigned char in[N_BLOCK], unsigned char out[N_BLOCK],
+    const aes_context ctx[1]) {
+  if (ctx->rnd && aes_ni_supported()) {
+    const __m128i* k = (const __m128i*)ctx->ksch;
+    __m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in),
+                              _mm_loadu_si128(k));
+    uint_8t r;
+
+    for (r = 1; r < ctx->rnd; ++r)
+      s = _mm_aesenc_si128(s, _mm_loadu_si128(k + r));
+    s = _mm_aesenclast_si128(s, _mm_loadu_si128(k + r));
+    _mm_storeu_si128((__m128i*)out, s);
+  } else
+    return (return_type)-1;
+  return 0;
+}
+
+/*  Encrypt four blocks with independent keys, interleaving their rounds so
+    that the latency of AESENC is hidden. All keys must be of the same size.
+*/
+
+__attribute__((target("sse2,aes"))) static void aes_encrypt_ni_x4(
+    const unsigned char* const in[4], unsigned char* const out[4],
+    const aes_context* const ctx[4]) {
+  const __m128i* k0 = (const __m128i*)ctx[0]->ksch;
+  const __m128i* k1 = (const __m128i*)ctx[1]->ksch;
+  const __m128i* k2 = (const __m128i*)ctx[2]->ksch;
+  const __m128i* k3 = (const __m128i*)ctx[3]->ksch;
+  __m128i s0, s1, s2, s3;
+  uint_8t r;
+
+  s0 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in[0]),
+                     _mm_loadu_si128(k0));
+  s1 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in[1]),
+                     _mm_loadu_si128(k1));
+  s2 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in[2]),
+                     _mm_loadu_si128(k2));
+  s3 = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in[3]),
+                     _mm_loadu_si128(k3));
+  for (r = 1; r < ctx[0]->rnd; ++r) {
+    s0 = _mm_aesenc_si128(s0, _mm_loadu_si128(k0 + r));
+    s1 = _mm_aesenc_si128(s1, _mm_loadu_si128(k1 + r));
+    s2 = _mm_aesenc_si128(s2, _mm_loadu_si128(k2 + r));
+    s3 = _mm_aesenc_si128(s3, _mm_loadu_si128(k3 + r));
+  }
+  _mm_storeu_si128((__m128i*)out[0],
+                   _mm_aesenclast_si128(s0, _mm_loadu_si128(k0 + r)));
+  _mm_storeu_si128((__m128i*)out[1],
+                   _mm_aesenclast_si128(s1, _mm_loadu_si128(k1 + r)));
+  _mm_storeu_si128((__m128i*)out[2],
+                   _mm_aesenclast_si128(s2, _mm_loadu_si128(k2 + r)));
+  _mm_storeu_si128((__m128i*)out[3],
+                   _mm_aesenclast_si128(s3, _mm_loadu_si128(k3 + r)));
+}
+
+#else
+
+int aes_ni_supported(void) { return 0; }
+
+return_type aes_encrypt_ni(const unsigned char in[N_BLOCK],
+                           unsigned char out[N_BLOCK],
+                           const aes_context ctx[1]) {
+  return (return_type)-1;
+}
+
+#endif
+
+/*  Encrypt a single block of 16 bytes */
+
+return_type aes_encrypt(const unsigned char in[N_BLOCK],
+                        unsigned char out[N_BLOCK], const aes_context ctx[1]) {
+#if defined(AES_NI)
+  if (aes_ni_supported()) return aes_encrypt_ni(in, out, ctx);
+#endif
+  return aes_encrypt_tables(in, out, ctx);
+}
+
+/*  Encrypt a number of independent blocks, each with its own key schedule */
+
+return_type aes_encrypt_blocks(const unsigned char* const in[],
+                               unsigned char* const out[],
+                               const aes_context* const ctx[], int n_block) {
+  int i = 0;
+
+  for (i = 0; i < n_block; ++i)
+    if (!ctx[i]->rnd) return (return_type)-1;
+
+  i = 0;
+#if defined(AES_NI)
+  if (aes_ni_supported()) {
+    for (; i + 4 <= n_block; i += 4) {
+      if (ctx[i + 1]->rnd != ctx[i]->rnd || ctx[i + 2]->rnd != ctx[i]->rnd ||
+          ctx[i + 3]->rnd != ctx[i]->rnd)
+        break;
+      aes_encrypt_ni_x4(in + i, out + i, ctx + i);
+    }
+  }
+#endif
+  for (; i < n_block; ++i) aes_encrypt(in[i], out[i], ctx[i]);
+  return 0;
+}
+
 /* CBC encrypt a number of blocks (input and return an IV) */
 
 return_type aes_cbc_encrypt(const unsigned char* in, unsigned char* out,
@@ -89,6 +89,34 @@ return_type aes_set_key(const unsigned char key[], length_type keylen,
 return_type aes_encrypt(const unsigned char in[N_BLOCK],
                         unsigned char out[N_BLOCK], const aes_context ctx[1]);
 
+/*  Encrypt n_block independent blocks: in[i] is encrypted with ctx[i] into
+    out[i]. When the processor has AES instructions, the blocks are processed
+    together to hide the latency of the rounds.
+*/
+
+return_type aes_encrypt_blocks(const unsigned char* const in[],
+                               unsigned char* const out[],
+                               const aes_context* const ctx[], int n_block);
+
+/*  The implementations aes_encrypt() selects from: byte oriented, 32-bit
+    tables, and AES instructions, which fails if aes_ni_supported() is false.
+    These are exposed for testing and benchmarking.
+*/
+
+return_type aes_encrypt_8bit(const unsigned char in[N_BLOCK],
+                             unsigned char out[N_BLOCK],
+                             const aes_context ctx[1]);
+
+return_type aes_encrypt_tables(const unsigned char in[N_BLOCK],
+                               unsigned char out[N_BLOCK],
+                               const aes_context ctx[1]);
+
+int aes_ni_supported(void);
+
+return_type aes_encrypt_ni(const unsigned char in[N_BLOCK],
+                           unsigned char out[N_BLOCK],
+                           const aes_context ctx[1]);
+
 return_type aes_cbc_encrypt(const unsigned char* in, unsigned char* out,
                             int n_block, unsigned char iv[N_BLOCK],
                             const aes_context ctx[1]);
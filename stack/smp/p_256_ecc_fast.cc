@@ -0,0 +1,492 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*******************************************************************************
+ *
+ *  P-256 point multiplication with 64-bit limbs.
+ *
+ *  Field elements are kept in Montgomery form (R = 2^256) in four 64-bit
+ *  limbs, least significant first, and points in Jacobian coordinates. The
+ *  generator is multiplied with a fixed-base comb table computed once, other
+ *  points with a width-5 NAF of the scalar. Results are the same affine points
+ *  as ECC_PointMult_Bin_NAF().
+ *
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+#include <mutex>
+
+#include "p_256_ecc_pp.h"
+
+namespace {
+
+constexpr int kLimbs = 4;
+typedef uint64_t felem[kLimbs];
+
+/* p = 2^256 - 2^224 + 2^192 + 2^96 - 1 */
+constexpr felem kP = {0xffffffffffffffffULL, 0x00000000ffffffffULL,
+                      0x0000000000000000ULL, 0xffffffff00000001ULL};
+/* R mod p, Montgomery form of 1 */
+constexpr felem kOne = {0x0000000000000001ULL, 0xffffffff00000000ULL,
+                        0xffffffffffffffffULL, 0x00000000fffffffeULL};
+/* R^2 mod p, to convert into Montgomery form */
+constexpr felem kRR = {0x0000000000000003ULL, 0xfffffffbffffffffULL,
+                       0xfffffffffffffffeULL, 0x00000004fffffffdULL};
+
+/* Returns a * b + c + d, and its upper 64 bits in |hi| */
+inline uint64_t mac(uint64_t a, uint64_t b, uint64_t c, uint64_t d,
+                    uint64_t* hi) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 t = (unsigned __int128)a * b + c + d;
+  *hi = (uint64_t)(t >> 64);
+  return (uint64_t)t;
+#else
+  uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+  uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+  uint64_t ll = a_lo * b_lo, lh = a_lo * b_hi;
+  uint64_t hl = a_hi * b_lo, hh = a_hi * b_hi;
+  uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+  uint64_t lo = (mid << 32) | (uint32_t)ll;
+  uint64_t high = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+  lo += c;
+  high += (lo < c);
+  lo += d;
+  high += (lo < d);
+  *hi = high;
+  return lo;
+#endif
+}
+
+/* Returns a + b + carry, and the carry out in |carry| */
+inline uint64_t adc(uint64_t a, uint64_t b, uint64_t* carry) {
+  uint64_t t = a + *carry;
+  uint64_t c = (t < a);
+  t += b;
+  *carry = c + (t < b);
+  return t;
+}
+
+/* Returns a - b - borrow, and the borrow out in |borrow| */
+inline uint64_t sbb(uint64_t a, uint64_t b, uint64_t* borrow) {
+  uint64_t t = a - b;
+  uint64_t br = (a < b);
+  uint64_t r = t - *borrow;
+  *borrow = br + (t < *borrow);
+  return r;
+}
+
+inline bool fe_is_zero(const felem a) {
+  return (a[0] | a[1] | a[2] | a[3]) == 0;
+}
+
+inline void fe_copy(felem r, const felem a) { memcpy(r, a, sizeof(felem)); }
+
+/* r = a - p if a (with its carry |top|) is at least p, else a */
+inline void fe_reduce_once(felem r, const felem a, uint64_t top) {
+  felem t;
+  uint64_t borrow = 0;
+  for (int i = 0; i < kLimbs; i++) t[i] = sbb(a[i], kP[i], &borrow);
+  sbb(top, 0, &borrow);
+  /* No borrow: a >= p */
+  fe_copy(r, borrow ? a : t);
+}
+
+inline void fe_add(felem r, const felem a, const felem b) {
+  felem t;
+  uint64_t carry = 0;
+  for (int i = 0; i < kLimbs; i++) t[i] = adc(a[i], b[i], &carry);
+  fe_reduce_once(r, t, carry);
+}
+
+inline void fe_sub(felem r, const felem a, const felem b) {
+  felem t;
+  uint64_t borrow = 0;
+  for (int i = 0; i < kLimbs; i++) t[i] = sbb(a[i], b[i], &borrow);
+  if (borrow) {
+    uint64_t carry = 0;
+    for (int i = 0; i < kLimbs; i++) t[i] = adc(t[i], kP[i], &carry);
+  }
+  fe_copy(r, t);
+}
+
+inline void fe_neg(felem r, const felem a) {
+  const felem zero = {0, 0, 0, 0};
+  fe_sub(r, zero, a);
+}
+
+/* r = a * b / R mod p. Since p = -1 mod 2^64, the Montgomery factor of each
+ * reduction step is the low limb itself. */
+void fe_mul(felem r, const felem a, const felem b) {
+  uint64_t t[kLimbs + 2] = {0};
+
+  for (int i = 0; i < kLimbs; i++) {
+    uint64_t c = 0;
+    for (int j = 0; j < kLimbs; j++) t[j] = mac(a[j], b[i], t[j], c, &c);
+    uint64_t carry = 0;
+    t[kLimbs] = adc(t[kLimbs], c, &carry);
+    t[kLimbs + 1] = carry;
+
+    uint64_t m = t[0];
+    mac(m, kP[0], t[0], 0, &c);
+    for (int j = 1; j < kLimbs; j++) t[j - 1] = mac(m, kP[j], t[j], c, &c);
+    carry = 0;
+    t[kLimbs - 1] = adc(t[kLimbs], c, &carry);
+    t[kLimbs] = t[kLimbs + 1] + carry;
+  }
+
+  fe_reduce_once(r, t, t[kLimbs]);
+}
+
+inline void fe_sqr(felem r, const felem a) { fe_mul(r, a, a); }
+
+/* r = a^(2^n) */
+void fe_sqr_n(felem r, const felem a, int n) {
+  fe_sqr(r, a);
+  while (--n > 0) fe_sqr(r, r);
+}
+
+/* r = a^-1 = a^(p - 2) mod p, a in Montgomery form. The addition chain
+ * follows the bit pattern of p - 2: 32 ones, 31 zeros, one, 96 zeros, 94
+ * ones, zero, one. */
+void fe_inv(felem r, const felem a) {
+  felem x2, x3, x6, x12, x15, x30, x32, t;
+
+  fe_sqr(t, a);
+  fe_mul(x2, t, a);
+  fe_sqr(t, x2);
+  fe_mul(x3, t, a);
+  fe_sqr_n(t, x3, 3);
+  fe_mul(x6, t, x3);
+  fe_sqr_n(t, x6, 6);
+  fe_mul(x12, t, x6);
+  fe_sqr_n(t, x12, 3);
+  fe_mul(x15, t, x3);
+  fe_sqr_n(t, x15, 15);
+  fe_mul(x30, t, x15);
+  fe_sqr_n(t, x30, 2);
+  fe_mul(x32, t, x2);
+
+  fe_sqr_n(t, x32, 32);
+  fe_mul(t, t, a);
+  fe_sqr_n(t, t, 128);
+  fe_mul(t, t, x32);
+  fe_sqr_n(t, t, 32);
+  fe_mul(t, t, x32);
+  fe_sqr_n(t, t, 30);
+  fe_mul(t, t, x30);
+  fe_sqr_n(t, t, 2);
+  fe_mul(r, t, a);
+}
+
+void fe_from_words(felem r, const uint32_t* words) {
+  felem t;
+  for (int i = 0; i < kLimbs; i++)
+    t[i] = (uint64_t)words[2 * i] | ((uint64_t)words[2 * i + 1] << 32);
+  fe_mul(r, t, kRR);
+}
+
+void fe_to_words(uint32_t* words, const felem a) {
+  const felem one = {1, 0, 0, 0};
+  felem t;
+  fe_mul(t, a, one);
+  for (int i = 0; i < kLimbs; i++) {
+    words[2 * i] = (uint32_t)t[i];
+    words[2 * i + 1] = (uint32_t)(t[i] >> 32);
+  }
+}
+
+/* Point in Jacobian coordinates, infinity when z is 0 */
+struct JacobianPoint {
+  felem x;
+  felem y;
+  felem z;
+};
+
+struct AffinePoint {
+  felem x;
+  felem y;
+};
+
+/* r = 2p, with a = -3 */
+void point_double(JacobianPoint* r, const JacobianPoint* p) {
+  felem delta, gamma, beta, alpha, t1, t2;
+
+  fe_sqr(delta, p->z);
+  fe_sqr(gamma, p->y);
+  fe_mul(beta, p->x, gamma);
+
+  fe_sub(t1, p->x, delta);
+  fe_add(t2, p->x, delta);
+  fe_mul(alpha, t1, t2);
+  fe_add(t1, alpha, alpha);
+  fe_add(alpha, t1, alpha);  // alpha = 3(x - delta)(x + delta)
+
+  fe_add(t1, p->y, p->z);
+  fe_sqr(t1, t1);
+  fe_sub(t1, t1, gamma);
+  fe_sub(r->z, t1, delta);  // z3 = (y + z)^2 - gamma - delta
+
+  fe_add(beta, beta, beta);
+  fe_add(beta, beta, beta);  // beta = 4 x gamma
+  fe_sqr(t1, alpha);
+  fe_add(t2, beta, beta);
+  fe_sub(r->x, t1, t2);  // x3 = alpha^2 - 8 beta
+
+  fe_sub(t1, beta, r->x);
+  fe_mul(t1, alpha, t1);
+  fe_sqr(gamma, gamma);
+  fe_add(gamma, gamma, gamma);
+  fe_add(gamma, gamma, gamma);
+  fe_add(gamma, gamma, gamma);
+  fe_sub(r->y, t1, gamma);  // y3 = alpha (4 beta - x3) - 8 gamma^2
+}
+
+/* r = p + q, q affine. r may be p. */
+void point_add_mixed(JacobianPoint* r, const JacobianPoint* p,
+                     const AffinePoint* q) {
+  if (fe_is_zero(p->z)) {
+    fe_copy(r->x, q->x);
+    fe_copy(r->y, q->y);
+    fe_copy(r->z, kOne);
+    return;
+  }
+
+  felem z1z1, u2, s2, h, rr, hh, hhh, v, t;
+
+  fe_sqr(z1z1, p->z);
+  fe_mul(u2, q->x, z1z1);
+  fe_mul(s2, p->z, z1z1);
+  fe_mul(s2, q->y, s2);
+  fe_sub(h, u2, p->x);
+  fe_sub(rr, s2, p->y);
+
+  if (fe_is_zero(h)) {
+    if (fe_is_zero(rr)) {
+      JacobianPoint q_jacobian;
+      fe_copy(q_jacobian.x, q->x);
+      fe_copy(q_jacobian.y, q->y);
+      fe_copy(q_jacobian.z, kOne);
+      point_double(r, &q_jacobian);
+    } else {
+      memset(r, 0, sizeof(*r));  // p = -q
+    }
+    return;
+  }
+
+  fe_sqr(hh, h);
+  fe_mul(hhh, h, hh);
+  fe_mul(v, p->x, hh);
+  fe_mul(r->z, p->z, h);
+
+  fe_mul(t, p->y, hhh);  // p->y is not used after this point
+  fe_sqr(r->x, rr);
+  fe_sub(r->x, r->x, hhh);
+  fe_sub(r->x, r->x, v);
+  fe_sub(r->x, r->x, v);  // x3 = r^2 - h^3 - 2v
+
+  fe_sub(v, v, r->x);
+  fe_mul(v, rr, v);
+  fe_sub(r->y, v, t);  // y3 = r (v - x3) - y1 h^3
+}
+
+/* Converts |n| Jacobian points, none at infinity, to affine coordinates with a
+ * single inversion */
+void batch_to_affine(AffinePoint* r, const JacobianPoint* p, size_t n,
+                     felem* scratch) {
+  fe_copy(scratch[0], p[0].z);
+  for (size_t i = 1; i < n; i++) fe_mul(scratch[i], scratch[i - 1], p[i].z);
+
+  felem inv, zinv, zinv2;
+  fe_inv(inv, scratch[n - 1]);
+  for (size_t i = n; i-- > 0;) {
+    if (i > 0) {
+      fe_mul(zinv, inv, scratch[i - 1]);
+      fe_mul(inv, inv, p[i].z);
+    } else {
+      fe_copy(zinv, inv);
+    }
+    fe_sqr(zinv2, zinv);
+    fe_mul(r[i].x, p[i].x, zinv2);
+    fe_mul(zinv2, zinv2, zinv);
+    fe_mul(r[i].y, p[i].y, zinv2);
+  }
+}
+
+void point_to_affine_words(Point* q, const JacobianPoint* p) {
+  felem zinv, zinv2, x, y;
+  fe_inv(zinv, p->z);
+  fe_sqr(zinv2, zinv);
+  fe_mul(x, p->x, zinv2);
+  fe_mul(zinv2, zinv2, zinv);
+  fe_mul(y, p->y, zinv2);
+
+  memset(q, 0, sizeof(*q));
+  fe_to_words(q->x, x);
+  fe_to_words(q->y, y);
+}
+
+inline uint32_t scalar_bit(const uint32_t* n, int bit) {
+  return (n[bit / DWORD_BITS] >> (bit % DWORD_BITS)) & 1;
+}
+
+/* Fixed-base comb: 8 teeth spaced 32 bits apart. kCombTable[b - 1] is the sum
+ * of 2^(32 j) G for each bit j set in b. */
+constexpr int kCombTeeth = 8;
+constexpr int kCombSpacing = 256 / kCombTeeth;
+constexpr size_t kCombTableSize = (1 << kCombTeeth) - 1;
+
+AffinePoint comb_table[kCombTableSize];
+std::once_flag comb_table_once;
+
+void comb_table_init() {
+  p_256_init_curve(KEY_LENGTH_DWORDS_P256);
+
+  JacobianPoint* jacobian = new JacobianPoint[kCombTableSize];
+  felem* scratch = new felem[kCombTableSize];
+
+  /* Teeth: 2^(32 j) G */
+  JacobianPoint tooth;
+  fe_from_words(tooth.x, curve_p256.G.x);
+  fe_from_words(tooth.y, curve_p256.G.y);
+  fe_copy(tooth.z, kOne);
+  for (int j = 0; j < kCombTeeth; j++) {
+    if (j > 0) {
+      for (int i = 0; i < kCombSpacing; i++) point_double(&tooth, &tooth);
+    }
+    jacobian[(1 << j) - 1] = tooth;
+  }
+  AffinePoint teeth[kCombTeeth];
+  for (int j = 0; j < kCombTeeth; j++) {
+    batch_to_affine(&teeth[j], &jacobian[(1 << j) - 1], 1, scratch);
+  }
+
+  /* Every other entry adds its highest tooth to a previous entry */
+  for (size_t b = 1; b <= kCombTableSize; b++) {
+    int top = 31 - __builtin_clz(b);
+    if (b == (1u << top)) continue;
+    size_t rest = b & ~(1u << top);
+    JacobianPoint p = jacobian[rest - 1];
+    point_add_mixed(&jacobian[b - 1], &p, &teeth[top]);
+  }
+
+  batch_to_affine(comb_table, jacobian, kCombTableSize, scratch);
+  delete[] scratch;
+  delete[] jacobian;
+}
+
+/* Width-5 NAF: odd digits in [-15, 15], at most one non-zero digit in any 5
+ * consecutive ones. Returns the number of digits. */
+constexpr int kWnafWidth = 5;
+constexpr int kWnafTableSize = 1 << (kWnafWidth - 2);
+
+int compute_wnaf(int8_t* naf, const uint32_t* n) {
+  /* One extra word for the carries of the negative digits */
+  uint32_t k[KEY_LENGTH_DWORDS_P256 + 1];
+  memcpy(k, n, KEY_LENGTH_DWORDS_P256 * sizeof(uint32_t));
+  k[KEY_LENGTH_DWORDS_P256] = 0;
+
+  int len = 0;
+  while (true) {
+    bool zero = true;
+    for (int i = 0; i <= KEY_LENGTH_DWORDS_P256; i++) zero &= (k[i] == 0);
+    if (zero) break;
+
+    int digit = 0;
+    if (k[0] & 1) {
+      digit = k[0] & ((1 << kWnafWidth) - 1);
+      if (digit >= (1 << (kWnafWidth - 1))) digit -= 1 << kWnafWidth;
+
+      /* k -= digit */
+      if (digit > 0) {
+        k[0] -= digit;  // no borrow, the low bits of k are digit
+      } else {
+        uint64_t carry = (uint32_t)(-digit);
+        for (int i = 0; i <= KEY_LENGTH_DWORDS_P256 && carry; i++) {
+          uint64_t t = (uint64_t)k[i] + carry;
+          k[i] = (uint32_t)t;
+          carry = t >> 32;
+        }
+      }
+    }
+    naf[len++] = digit;
+
+    for (int i = 0; i < KEY_LENGTH_DWORDS_P256; i++)
+      k[i] = (k[i] >> 1) | (k[i + 1] << 31);
+    k[KEY_LENGTH_DWORDS_P256] >>= 1;
+  }
+  return len;
+}
+
+}  // namespace
+
+void ECC_PointMult_Base(Point* q, const uint32_t* n) {
+  std::call_once(comb_table_once, comb_table_init);
+
+  JacobianPoint r;
+  memset(&r, 0, sizeof(r));
+  for (int i = kCombSpacing - 1; i >= 0; i--) {
+    point_double(&r, &r);
+    uint32_t b = 0;
+    for (int j = 0; j < kCombTeeth; j++)
+      b |= scalar_bit(n, j * kCombSpacing + i) << j;
+    if (b) point_add_mixed(&r, &r, &comb_table[b - 1]);
+  }
+  point_to_affine_words(q, &r);
+}
+
+void ECC_PointMult_WNAF(Point* q, const Point* p, const uint32_t* n) {
+  /* Odd multiples P, 3P, ..., 15P */
+  JacobianPoint jacobian[kWnafTableSize];
+  AffinePoint table[kWnafTableSize];
+  felem scratch[kWnafTableSize];
+
+  fe_from_words(table[0].x, p->x);
+  fe_from_words(table[0].y, p->y);
+  fe_copy(jacobian[0].x, table[0].x);
+  fe_copy(jacobian[0].y, table[0].y);
+  fe_copy(jacobian[0].z, kOne);
+
+  JacobianPoint twice;
+  AffinePoint twice_affine;
+  point_double(&twice, &jacobian[0]);
+  batch_to_affine(&twice_affine, &twice, 1, scratch);
+  for (int i = 1; i < kWnafTableSize; i++)
+    point_add_mixed(&jacobian[i], &jacobian[i - 1], &twice_affine);
+  batch_to_affine(table, jacobian, kWnafTableSize, scratch);
+
+  int8_t naf[256 + 1];
+  int len = compute_wnaf(naf, n);
+
+  JacobianPoint r;
+  memset(&r, 0, sizeof(r));
+  for (int i = len - 1; i >= 0; i--) {
+    point_double(&r, &r);
+    int digit = naf[i];
+    if (digit > 0) {
+      point_add_mixed(&r, &r, &table[digit / 2]);
+    } else if (digit < 0) {
+      AffinePoint neg;
+      fe_copy(neg.x, table[-digit / 2].x);
+      fe_neg(neg.y, table[-digit / 2].y);
+      point_add_mixed(&r, &r, &neg);
+    }
+  }
+  point_to_affine_words(q, &r);
+}
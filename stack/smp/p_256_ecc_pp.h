@@ -63,4 +63,10 @@ void ECC_PointMult_Bin_NAF(Point* q, Point* p, uint32_t* n, uint32_t keyLength);
 #define ECC_PointMult(q, p, n, keyLength) \
   ECC_PointMult_Bin_NAF(q, p, n, keyLength)
 
+// q = n * G, with a fixed-base comb table computed on first use
+void ECC_PointMult_Base(Point* q, const uint32_t* n);
+
+// q = n * p, with a windowed NAF of n. Same result as ECC_PointMult_Bin_NAF.
+void ECC_PointMult_WNAF(Point* q, const Point* p, const uint32_t* n);
+
 void p_256_init_curve(uint32_t keyLength);
@@ -503,6 +503,9 @@ void smp_proc_pair_cmd(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
   SMP_TRACE_DEBUG("%s: pairing_bda=%s", __func__,
                   p_cb->pairing_bda.ToString().c_str());
 
+  if (p_cb->phase_us[SMP_PHASE_START] == 0)
+    smp_mark_phase(p_cb, SMP_PHASE_START);
+
   /* erase all keys if it is slave proc pairing req */
   if (p_dev_rec && (p_cb->role == HCI_ROLE_SLAVE))
     btm_sec_clear_ble_keys(p_dev_rec);
@@ -1463,7 +1466,9 @@ void smp_both_have_public_keys(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
   SMP_TRACE_DEBUG("%s", __func__);
 
   /* invokes DHKey computation */
+  smp_mark_phase(p_cb, SMP_PHASE_BOTH_KEYS);
   smp_compute_dhkey(p_cb);
+  smp_mark_phase(p_cb, SMP_PHASE_DHKEY);
 
   /* on slave side invokes sending local public key to the peer */
   if (p_cb->role == HCI_ROLE_SLAVE) smp_send_pair_public_key(p_cb, NULL);
@@ -1697,6 +1702,7 @@ void smp_match_dhkey_checks(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
   }
 
   SMP_TRACE_EVENT("dhkey chcks match");
+  smp_mark_phase(p_cb, SMP_PHASE_AUTH);
 
   /* compare the max encryption key size, and save the smaller one for the link
    */
@@ -63,6 +63,7 @@ void SMP_Init(void) {
   smp_l2cap_if_init();
   /* initialization of P-256 parameters */
   p_256_init_curve(KEY_LENGTH_DWORDS_P256);
+  smp_key_pool_init();
 
   /* Initialize failure case for certification */
   smp_cb.cert_failure =
@@ -72,6 +73,21 @@ void SMP_Init(void) {
                     smp_cb.cert_failure);
 }
 
+/*******************************************************************************
+ *
+ * Function         SMP_Free
+ *
+ * Description      This function releases the resources of the SMP unit.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void SMP_Free(void) {
+  SMP_TRACE_EVENT("%s", __func__);
+
+  smp_key_pool_free();
+}
+
 /*******************************************************************************
  *
  * Function         SMP_SetTraceLevel
@@ -144,6 +160,7 @@ tSMP_STATUS SMP_Pair(const RawAddress& bd_addr) {
   } else {
     p_cb->flags = SMP_PAIR_FLAGS_WE_STARTED_DD;
     p_cb->pairing_bda = bd_addr;
+    smp_mark_phase(p_cb, SMP_PHASE_START);
 
     if (!L2CA_ConnectFixedChnl(L2CAP_SMP_CID, bd_addr)) {
       tSMP_INT_DATA smp_int_data;
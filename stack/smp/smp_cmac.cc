@@ -27,21 +27,27 @@
 #include <stdio.h>
 #include <string.h>
 
-#include "btm_ble_api.h"
-#include "hcimsgs.h"
+#include "aes.h"
 #include "smp_int.h"
 
+/* Number of messages whose blocks are encrypted together */
+#define CMAC_MAX_BATCH 8
+
 typedef struct {
-  uint8_t* text;
+  aes_context ctx;
+  uint8_t x[BT_OCTET16_LEN];    /* chaining value X, MSB as [0] */
+  uint8_t last[BT_OCTET16_LEN]; /* Mn (+) K1 or K2, MSB as [0] */
+  const uint8_t* text;          /* message, LSB as [0] */
   uint16_t len;
   uint16_t round;
 } tCMAC_CB;
 
-tCMAC_CB cmac_cb;
+/* Rb for AES-128 as block cipher, MSB as [0] */
+static const uint8_t const_Rb[BT_OCTET16_LEN] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x87};
 
-/* Rb for AES-128 as block cipher, LSB as [0] */
-BT_OCTET16 const_Rb = {0x87, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-                       0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+static const uint8_t const_Zero[BT_OCTET16_LEN] = {0};
 
 void print128(BT_OCTET16 x, const uint8_t* key_name) {
 #if (SMP_DEBUG == TRUE && SMP_DEBUG_VERBOSE == TRUE)
@@ -61,203 +67,215 @@ void print128(BT_OCTET16 x, const uint8_t* key_name) {
 
 /*******************************************************************************
  *
- * Function         padding
+ * Function         xor_128
  *
- * Description      utility function to padding the given text to be a 128 bits
- *                  data. The parameter dest is input and output parameter, it
- *                  must point to a BT_OCTET16_LEN memory space; where include
- *                  length bytes valid data.
+ * Description      utility function to xor two 128 bits values: a := a (+) b.
  *
  * Returns          void
  *
  ******************************************************************************/
-static void padding(BT_OCTET16 dest, uint8_t length) {
-  uint8_t i, *p = dest;
-  /* original last block */
-  for (i = length; i < BT_OCTET16_LEN; i++)
-    p[BT_OCTET16_LEN - i - 1] = (i == length) ? 0x80 : 0;
+static void xor_128(uint8_t* a, const uint8_t* b) {
+  for (uint8_t i = 0; i < BT_OCTET16_LEN; i++) a[i] ^= b[i];
 }
+
 /*******************************************************************************
  *
  * Function         leftshift_onebit
  *
- * Description      utility function to left shift one bit for a 128 bits value.
+ * Description      utility function to left shift one bit for a 128 bits value,
+ *                  MSB as [0].
  *
  * Returns          void
  *
  ******************************************************************************/
-static void leftshift_onebit(uint8_t* input, uint8_t* output) {
-  uint8_t i, overflow = 0, next_overflow = 0;
-  SMP_TRACE_EVENT("leftshift_onebit ");
-  /* input[0] is LSB */
-  for (i = 0; i < BT_OCTET16_LEN; i++) {
-    next_overflow = (input[i] & 0x80) ? 1 : 0;
+static void leftshift_onebit(const uint8_t* input, uint8_t* output) {
+  uint8_t i, overflow = 0;
+  for (i = BT_OCTET16_LEN; i-- > 0;) {
+    uint8_t next_overflow = input[i] >> 7;
     output[i] = (input[i] << 1) | overflow;
     overflow = next_overflow;
   }
-  return;
 }
+
 /*******************************************************************************
  *
- * Function         cmac_aes_cleanup
+ * Function         cmac_subkey
  *
- * Description      clean up function for AES_CMAC algorithm.
+ * Description      Derives the next subkey: K1 from L, or K2 from K1.
  *
  * Returns          void
  *
  ******************************************************************************/
-static void cmac_aes_cleanup(void) {
-  osi_free(cmac_cb.text);
-  memset(&cmac_cb, 0, sizeof(tCMAC_CB));
+static void cmac_subkey(const uint8_t* input, uint8_t* output) {
+  leftshift_onebit(input, output);
+  /* If MSB(input) = 1, then output = (input << 1) (+) Rb */
+  if (input[0] & 0x80) xor_128(output, const_Rb);
 }
 
 /*******************************************************************************
  *
- * Function         cmac_aes_k_calculate
+ * Function         cmac_get_block
  *
- * Description      This function is the calculation of block cipher using
- *                  AES-128.
+ * Description      Copies block |i| of the message, MSB first as the cipher
+ *                  expects it, into |block|. The block must be complete.
  *
  * Returns          void
  *
  ******************************************************************************/
-static bool cmac_aes_k_calculate(BT_OCTET16 key, uint8_t* p_signature,
-                                 uint16_t tlen) {
-  tSMP_ENC output;
-  uint8_t i = 1, err = 0;
-  uint8_t x[16] = {0};
-  uint8_t* p_mac;
-
-  SMP_TRACE_EVENT("cmac_aes_k_calculate ");
-
-  while (i <= cmac_cb.round) {
-    smp_xor_128(&cmac_cb.text[(cmac_cb.round - i) * BT_OCTET16_LEN],
-                x); /* Mi' := Mi (+) X  */
-
-    if (!SMP_Encrypt(key, BT_OCTET16_LEN,
-                     &cmac_cb.text[(cmac_cb.round - i) * BT_OCTET16_LEN],
-                     BT_OCTET16_LEN, &output)) {
-      err = 1;
-      break;
-    }
-
-    memcpy(x, output.param_buf, BT_OCTET16_LEN);
-    i++;
-  }
-
-  if (!err) {
-    p_mac = output.param_buf + (BT_OCTET16_LEN - tlen);
-    memcpy(p_signature, p_mac, tlen);
-
-    SMP_TRACE_DEBUG("tlen = %d p_mac = %d", tlen, p_mac);
-    SMP_TRACE_DEBUG(
-        "p_mac[0] = 0x%02x p_mac[1] = 0x%02x p_mac[2] = 0x%02x p_mac[3] = "
-        "0x%02x",
-        *p_mac, *(p_mac + 1), *(p_mac + 2), *(p_mac + 3));
-    SMP_TRACE_DEBUG(
-        "p_mac[4] = 0x%02x p_mac[5] = 0x%02x p_mac[6] = 0x%02x p_mac[7] = "
-        "0x%02x",
-        *(p_mac + 4), *(p_mac + 5), *(p_mac + 6), *(p_mac + 7));
-
-    return true;
+static void cmac_get_block(const tCMAC_CB* p_cb, uint16_t i, uint8_t* block) {
+  /* The message is stored LSB first: its first octet is the last one */
+  const uint8_t* p = p_cb->text + p_cb->len - i * BT_OCTET16_LEN;
+  for (uint8_t j = 0; j < BT_OCTET16_LEN; j++) block[j] = *--p;
+}
 
-  } else
-    return false;
+/*******************************************************************************
+ *
+ * Function         cmac_init
+ *
+ * Description      Expands the key and counts the blocks of one message.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void cmac_init(tCMAC_CB* p_cb, const uint8_t* key, const uint8_t* input,
+                      uint16_t length) {
+  uint8_t key_msb[BT_OCTET16_LEN];
+
+  for (uint8_t i = 0; i < BT_OCTET16_LEN; i++)
+    key_msb[i] = key[BT_OCTET16_LEN - 1 - i];
+  aes_set_key(key_msb, BT_OCTET16_LEN, &p_cb->ctx);
+
+  p_cb->text = input;
+  p_cb->len = (input != NULL) ? length : 0;
+  p_cb->round = (p_cb->len + BT_OCTET16_LEN - 1) / BT_OCTET16_LEN;
+  if (p_cb->round == 0) p_cb->round = 1;
+  memset(p_cb->x, 0, BT_OCTET16_LEN);
 }
+
 /*******************************************************************************
  *
  * Function         cmac_prepare_last_block
  *
  * Description      This function proceeed to prepare the last block of message
- *                  Mn depending on the size of the message.
+ *                  Mn depending on the size of the message, from
+ *                  L = CIPHk(0[128]).
  *
  * Returns          void
  *
  ******************************************************************************/
-static void cmac_prepare_last_block(BT_OCTET16 k1, BT_OCTET16 k2) {
-  //    uint8_t     x[16] = {0};
-  bool flag;
-
-  SMP_TRACE_EVENT("cmac_prepare_last_block ");
-  /* last block is a complete block set flag to 1 */
-  flag =
-      ((cmac_cb.len % BT_OCTET16_LEN) == 0 && cmac_cb.len != 0) ? true : false;
-
-  SMP_TRACE_WARNING("flag = %d round = %d", flag, cmac_cb.round);
-
-  if (flag) { /* last block is complete block */
-    smp_xor_128(&cmac_cb.text[0], k1);
-  } else /* padding then xor with k2 */
-  {
-    padding(&cmac_cb.text[0], (uint8_t)(cmac_cb.len % 16));
-
-    smp_xor_128(&cmac_cb.text[0], k2);
+static void cmac_prepare_last_block(tCMAC_CB* p_cb, const uint8_t* l) {
+  uint8_t k1[BT_OCTET16_LEN], k2[BT_OCTET16_LEN];
+  uint16_t rest = p_cb->len - (p_cb->round - 1) * BT_OCTET16_LEN;
+
+  cmac_subkey(l, k1);
+  if (rest == BT_OCTET16_LEN) { /* last block is complete block */
+    cmac_get_block(p_cb, p_cb->round - 1, p_cb->last);
+    xor_128(p_cb->last, k1);
+  } else { /* padding then xor with k2 */
+    for (uint16_t j = 0; j < BT_OCTET16_LEN; j++) {
+      if (j < rest)
+        p_cb->last[j] = p_cb->text[rest - 1 - j];
+      else
+        p_cb->last[j] = (j == rest) ? 0x80 : 0;
+    }
+    cmac_subkey(k1, k2);
+    xor_128(p_cb->last, k2);
   }
 }
+
 /*******************************************************************************
  *
- * Function         cmac_subkey_cont
+ * Function         cmac_aes_k_calculate
  *
- * Description      This is the callback function when CIPHk(0[128]) is
- *                  completed.
+ * Description      Computes the CMAC of up to CMAC_MAX_BATCH messages. The
+ *                  n-th blocks of all the messages are encrypted together.
  *
  * Returns          void
  *
  ******************************************************************************/
-static void cmac_subkey_cont(tSMP_ENC* p) {
-  uint8_t k1[BT_OCTET16_LEN], k2[BT_OCTET16_LEN];
-  uint8_t* pp = p->param_buf;
-  SMP_TRACE_EVENT("cmac_subkey_cont ");
-  print128(pp, (const uint8_t*)"K1 before shift");
-
-  /* If MSB(L) = 0, then K1 = L << 1 */
-  if ((pp[BT_OCTET16_LEN - 1] & 0x80) != 0) {
-    /* Else K1 = ( L << 1 ) (+) Rb */
-    leftshift_onebit(pp, k1);
-    smp_xor_128(k1, const_Rb);
-  } else {
-    leftshift_onebit(pp, k1);
+static void cmac_aes_k_calculate(tCMAC_CB* p_cbs, size_t num) {
+  uint8_t blocks[CMAC_MAX_BATCH][BT_OCTET16_LEN];
+  const unsigned char* in[CMAC_MAX_BATCH];
+  unsigned char* out[CMAC_MAX_BATCH];
+  const aes_context* ctx[CMAC_MAX_BATCH];
+  uint16_t max_round = 0;
+  size_t i, count;
+
+  /* subkeys from L := CIPHk(0[128]) */
+  for (i = 0; i < num; i++) {
+    in[i] = const_Zero;
+    out[i] = blocks[i];
+    ctx[i] = &p_cbs[i].ctx;
   }
-
-  if ((k1[BT_OCTET16_LEN - 1] & 0x80) != 0) {
-    /* K2 =  (K1 << 1) (+) Rb */
-    leftshift_onebit(k1, k2);
-    smp_xor_128(k2, const_Rb);
-  } else {
-    /* If MSB(K1) = 0, then K2 = K1 << 1 */
-    leftshift_onebit(k1, k2);
+  aes_encrypt_blocks(in, out, ctx, num);
+  for (i = 0; i < num; i++) {
+    cmac_prepare_last_block(&p_cbs[i], blocks[i]);
+    if (p_cbs[i].round > max_round) max_round = p_cbs[i].round;
   }
 
-  print128(k1, (const uint8_t*)"K1");
-  print128(k2, (const uint8_t*)"K2");
-
-  cmac_prepare_last_block(k1, k2);
+  for (uint16_t r = 0; r < max_round; r++) {
+    for (i = 0, count = 0; i < num; i++) {
+      tCMAC_CB* p_cb = &p_cbs[i];
+      if (r >= p_cb->round) continue;
+
+      /* Mi' := Mi (+) X, X := CIPHk(Mi') */
+      if (r == p_cb->round - 1)
+        memcpy(blocks[count], p_cb->last, BT_OCTET16_LEN);
+      else
+        cmac_get_block(p_cb, r, blocks[count]);
+      xor_128(blocks[count], p_cb->x);
+      in[count] = blocks[count];
+      out[count] = p_cb->x;
+      ctx[count] = &p_cb->ctx;
+      count++;
+    }
+    aes_encrypt_blocks(in, out, ctx, count);
+  }
 }
+
 /*******************************************************************************
  *
- * Function         cmac_generate_subkey
+ * Function         aes_cipher_msg_auth_code_multi
  *
- * Description      This is the function to generate the two subkeys.
+ * Description      This is the AES-CMAC Generation Function with tlen
+ *                  implemented, for several messages with their own key.
  *
- * Parameters       key - CMAC key, expect SRK when used by SMP.
+ * Parameters       msgs - messages to sign, with their key and signature
+ *                         buffer, as for aes_cipher_msg_auth_code().
+ *                  num_msgs - number of messages.
+ *                  tlen - lenth of mac desired
  *
- * Returns          void
+ * Returns          false if tlen is invalid, true in other cases.
  *
  ******************************************************************************/
-static bool cmac_generate_subkey(BT_OCTET16 key) {
-  BT_OCTET16 z = {0};
-  bool ret = true;
-  tSMP_ENC output;
-  SMP_TRACE_EVENT(" cmac_generate_subkey");
+bool aes_cipher_msg_auth_code_multi(tSMP_CMAC_MSG* msgs, size_t num_msgs,
+                                    uint16_t tlen) {
+  tCMAC_CB cbs[CMAC_MAX_BATCH];
 
-  if (SMP_Encrypt(key, BT_OCTET16_LEN, z, BT_OCTET16_LEN, &output)) {
-    cmac_subkey_cont(&output);
-    ;
-  } else
-    ret = false;
+  if (tlen > BT_OCTET16_LEN) {
+    SMP_TRACE_ERROR("%s: invalid tlen = %d", __func__, tlen);
+    return false;
+  }
+
+  while (num_msgs > 0) {
+    size_t num = (num_msgs < CMAC_MAX_BATCH) ? num_msgs : CMAC_MAX_BATCH;
+    size_t i;
 
-  return ret;
+    for (i = 0; i < num; i++)
+      cmac_init(&cbs[i], msgs[i].key, msgs[i].input, msgs[i].length);
+    cmac_aes_k_calculate(cbs, num);
+
+    /* The signature is stored LSB first */
+    for (i = 0; i < num; i++) {
+      for (uint16_t j = 0; j < tlen; j++)
+        msgs[i].p_signature[j] = cbs[i].x[tlen - 1 - j];
+    }
+    msgs += num;
+    num_msgs -= num;
+  }
+  return true;
 }
+
 /*******************************************************************************
  *
  * Function         aes_cipher_msg_auth_code
@@ -273,41 +291,13 @@ static bool cmac_generate_subkey(BT_OCTET16 key) {
  *                  p_signature - data pointer to where signed data to be
  *                                stored, tlen long.
  *
- * Returns          false if out of resources, true in other cases.
+ * Returns          false if tlen is invalid, true in other cases.
  *
  ******************************************************************************/
 bool aes_cipher_msg_auth_code(BT_OCTET16 key, uint8_t* input, uint16_t length,
                               uint16_t tlen, uint8_t* p_signature) {
-  uint16_t len, diff;
-  uint16_t n = (length + BT_OCTET16_LEN - 1) /
-               BT_OCTET16_LEN; /* n is number of rounds */
-  bool ret = false;
+  tSMP_CMAC_MSG msg = {key, input, length, p_signature};
 
   SMP_TRACE_EVENT("%s", __func__);
-
-  if (n == 0) n = 1;
-  len = n * BT_OCTET16_LEN;
-
-  SMP_TRACE_WARNING("AES128_CMAC started, allocate buffer size = %d", len);
-  /* allocate a memory space of multiple of 16 bytes to hold text  */
-  cmac_cb.text = (uint8_t*)osi_calloc(len);
-  cmac_cb.round = n;
-  diff = len - length;
-
-  if (input != NULL && length > 0) {
-    memcpy(&cmac_cb.text[diff], input, (int)length);
-    cmac_cb.len = length;
-  } else {
-    cmac_cb.len = 0;
-  }
-
-  /* prepare calculation for subkey s and last block of data */
-  if (cmac_generate_subkey(key)) {
-    /* start calculation */
-    ret = cmac_aes_k_calculate(key, p_signature, tlen);
-  }
-  /* clean up */
-  cmac_aes_cleanup();
-
-  return ret;
+  return aes_cipher_msg_auth_code_multi(&msg, 1, tlen);
 }
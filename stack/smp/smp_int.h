@@ -227,6 +227,20 @@ typedef union {
   tSMP_OOB_DATA_TYPE req_oob_type;
 } tSMP_INT_DATA;
 
+/* Pairing phases, timed for the debug dump. Each is the time the phase was
+ * reached, so the intervals between them break down the pairing latency. */
+enum {
+  SMP_PHASE_START,     /* pairing request sent or received */
+  SMP_PHASE_KEY_REQ,   /* local key pair requested */
+  SMP_PHASE_LOCAL_KEY, /* local key pair created */
+  SMP_PHASE_BOTH_KEYS, /* local and peer public keys available */
+  SMP_PHASE_DHKEY,     /* DHKey computed */
+  SMP_PHASE_AUTH,      /* DHKey checks matched */
+  SMP_PHASE_CMPL,      /* pairing complete */
+  SMP_PHASE_MAX
+};
+typedef uint8_t tSMP_PHASE;
+
 /* internal status mask */
 #define SMP_PAIR_FLAGS_WE_STARTED_DD (1)
 #define SMP_PAIR_FLAGS_PEER_STARTED_DD (1 << 1)
@@ -331,6 +345,7 @@ typedef struct {
   bool wait_for_authorization_complete;
   uint8_t cert_failure; /*failure case for certification */
   alarm_t* delayed_auth_timer_ent;
+  uint64_t phase_us[SMP_PHASE_MAX]; /* 0 if the phase was not reached */
 } tSMP_CB;
 
 /* Server Action functions are of this type */
@@ -492,6 +507,7 @@ extern void smp_save_secure_connections_long_term_key(tSMP_CB* p_cb);
 extern bool smp_calculate_f5_mackey_and_long_term_key(tSMP_CB* p_cb);
 extern void smp_remove_fixed_channel(tSMP_CB* p_cb);
 extern bool smp_request_oob_data(tSMP_CB* p_cb);
+extern void smp_mark_phase(tSMP_CB* p_cb, tSMP_PHASE phase);
 
 /* smp_keys.cc */
 extern void smp_generate_srand_mrand_confirm(tSMP_CB* p_cb,
@@ -504,6 +520,9 @@ extern void smp_generate_rand_cont(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
 extern void smp_create_private_key(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
 extern void smp_use_oob_private_key(tSMP_CB* p_cb, tSMP_INT_DATA* p_data);
 extern void smp_compute_dhkey(tSMP_CB* p_cb);
+extern void smp_key_pool_init(void);
+extern void smp_key_pool_free(void);
+extern void smp_key_pool_debug_dump(int fd);
 extern void smp_calculate_local_commitment(tSMP_CB* p_cb);
 extern void smp_calculate_peer_commitment(tSMP_CB* p_cb, BT_OCTET16 output_buf);
 extern void smp_calculate_numeric_comparison_display_number(
@@ -0,0 +1,180 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_smp_key_pool"
+
+#include "smp_key_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+#include "p_256_ecc_pp.h"
+
+constexpr size_t SmpKeyPool::kMaxCapacity;
+
+namespace {
+constexpr char kRandomPath[] = "/dev/urandom";
+
+// Reads |len| octets from the host random source into |buf|.
+bool read_random(int fd, uint8_t* buf, size_t len) {
+  while (len > 0) {
+    ssize_t ret;
+    OSI_NO_INTR(ret = read(fd, buf, len));
+    if (ret <= 0) return false;
+    buf += ret;
+    len -= ret;
+  }
+  return true;
+}
+}  // namespace
+
+SmpKeyPool::SmpKeyPool(size_t capacity, uint16_t max_uses)
+    : capacity_(std::min(capacity, kMaxCapacity)),
+      max_uses_(std::max<uint16_t>(max_uses, 1)),
+      head_(0),
+      size_(0),
+      hits_(0),
+      misses_(0),
+      generated_(0) {}
+
+SmpKeyPool::~SmpKeyPool() { Clear(); }
+
+void SmpKeyPool::ComputePublicKey(KeyPair* key_pair) {
+  uint32_t private_key[KEY_LENGTH_DWORDS_P256];
+  Point public_key;
+
+  memcpy(private_key, key_pair->private_key, BT_OCTET32_LEN);
+  ECC_PointMult_Base(&public_key, private_key);
+  memcpy(key_pair->public_x, public_key.x, BT_OCTET32_LEN);
+  memcpy(key_pair->public_y, public_key.y, BT_OCTET32_LEN);
+  memset(private_key, 0, sizeof(private_key));
+}
+
+bool SmpKeyPool::Take(KeyPair* key_pair) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (size_ == 0) {
+    misses_++;
+    return false;
+  }
+
+  hits_++;
+  Entry& entry = entries_[head_];
+  *key_pair = entry.key_pair;
+  if (++entry.uses >= max_uses_) {
+    memset(&entry, 0, sizeof(entry));
+    head_ = (head_ + 1) % kMaxCapacity;
+    size_--;
+  }
+  return true;
+}
+
+bool SmpKeyPool::Add(const BT_OCTET32 private_key) {
+  Entry entry;
+  memcpy(entry.key_pair.private_key, private_key, BT_OCTET32_LEN);
+  ComputePublicKey(&entry.key_pair);
+  entry.uses = 0;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  bool added = (size_ < capacity_);
+  if (added) {
+    entries_[(head_ + size_) % kMaxCapacity] = entry;
+    size_++;
+    generated_++;
+  }
+  memset(&entry, 0, sizeof(entry));
+  return added;
+}
+
+bool SmpKeyPool::Fill() {
+  int fd = open(kRandomPath, O_RDONLY | O_CLOEXEC);
+  if (fd == INVALID_FD) {
+    LOG_ERROR(LOG_TAG, "%s unable to open %s: %s", __func__, kRandomPath,
+              strerror(errno));
+    return false;
+  }
+
+  bool ok = true;
+  while (Size() < capacity_) {
+    BT_OCTET32 private_key;
+    if (!read_random(fd, private_key, sizeof(private_key))) {
+      LOG_ERROR(LOG_TAG, "%s unable to read %s: %s", __func__, kRandomPath,
+                strerror(errno));
+      ok = false;
+      break;
+    }
+    bool added = Add(private_key);
+    memset(private_key, 0, sizeof(private_key));
+    if (!added) break;
+  }
+  close(fd);
+  return ok;
+}
+
+void SmpKeyPool::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  memset(entries_, 0, sizeof(entries_));
+  head_ = 0;
+  size_ = 0;
+}
+
+size_t SmpKeyPool::Size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
+}
+
+uint64_t SmpKeyPool::Hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+uint64_t SmpKeyPool::Misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+uint64_t SmpKeyPool::Generated() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return generated_;
+}
+
+void SmpKeyPool::DebugDump(int fd) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  dprintf(fd,
+          "  Local key pairs ready                                   : %zu / "
+          "%zu\n",
+          size_, capacity_);
+  dprintf(fd,
+          "  Uses per key pair                                       : %u\n",
+          max_uses_);
+  dprintf(fd,
+          "  Key pairs taken from the pool / created on demand       : "
+          "%" PRIu64 " / %" PRIu64 "\n",
+          hits_, misses_);
+  dprintf(fd,
+          "  Key pairs generated                                     : "
+          "%" PRIu64 "\n",
+          generated_);
+}
@@ -0,0 +1,105 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#ifndef SMP_KEY_POOL_H
+#define SMP_KEY_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+
+#include "stack/include/bt_types.h"
+
+// Pool of precomputed local P-256 key pairs for LE Secure Connections.
+//
+// Creating the local key pair when pairing starts takes four HCI LE Rand
+// round trips and a point multiplication. The pool generates key pairs in
+// advance, from the host random source, so that pairing can start with a key
+// pair that is ready.
+//
+// Each key pair is handed out for at most |max_uses| pairings. The default
+// of one means a key pair is never reused; more uses trade the freshness of
+// the key pair for fewer multiplications.
+//
+// Take() is called on the stack thread and Fill() on a worker thread; the
+// key pairs are generated outside of the lock.
+class SmpKeyPool {
+ public:
+  static constexpr size_t kMaxCapacity = 8;
+
+  // A key pair, least significant octet first as in tSMP_CB.
+  struct KeyPair {
+    BT_OCTET32 private_key;
+    BT_OCTET32 public_x;
+    BT_OCTET32 public_y;
+  };
+
+  // Keeps up to |capacity| key pairs, capped at kMaxCapacity, each handed
+  // out for at most |max_uses| pairings.
+  SmpKeyPool(size_t capacity, uint16_t max_uses);
+  ~SmpKeyPool();
+
+  // Copies a key pair into |key_pair|. Returns false if the pool is empty.
+  bool Take(KeyPair* key_pair);
+
+  // Adds the key pair whose private key is |private_key|. Returns false if
+  // the pool is full.
+  bool Add(const BT_OCTET32 private_key);
+
+  // Generates key pairs until the pool is full. Returns false if the host
+  // random source failed.
+  bool Fill();
+
+  // Removes all the key pairs.
+  void Clear();
+
+  size_t Size() const;
+  size_t Capacity() const { return capacity_; }
+  uint16_t MaxUses() const { return max_uses_; }
+
+  uint64_t Hits() const;
+  uint64_t Misses() const;
+  uint64_t Generated() const;
+
+  // Dumps the pool statistics to the |fd| file descriptor.
+  void DebugDump(int fd) const;
+
+  // Computes the public key of |key_pair| from its private key.
+  static void ComputePublicKey(KeyPair* key_pair);
+
+ private:
+  struct Entry {
+    KeyPair key_pair;
+    uint16_t uses;
+  };
+
+  const size_t capacity_;
+  const uint16_t max_uses_;
+
+  mutable std::mutex mutex_;
+  Entry entries_[kMaxCapacity];  // Ring, oldest at |head_|
+  size_t head_;
+  size_t size_;
+
+  uint64_t hits_;
+  uint64_t misses_;
+  uint64_t generated_;
+};
+
+#endif  // SMP_KEY_POOL_H
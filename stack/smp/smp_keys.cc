@@ -28,6 +28,7 @@
 #endif
 #include <base/bind.h>
 #include <string.h>
+#include <mutex>
 #include "aes.h"
 #include "bt_utils.h"
 #include "btm_ble_api.h"
@@ -36,8 +37,11 @@
 #include "device/include/controller.h"
 #include "hcimsgs.h"
 #include "osi/include/osi.h"
+#include "osi/include/properties.h"
+#include "osi/include/thread.h"
 #include "p_256_ecc_pp.h"
 #include "smp_int.h"
+#include "smp_key_pool.h"
 
 using base::Bind;
 
@@ -49,6 +53,25 @@ static void smp_process_stk(tSMP_CB* p_cb, tSMP_ENC* p);
 static bool smp_calculate_legacy_short_term_key(tSMP_CB* p_cb,
                                                 tSMP_ENC* output);
 static void smp_process_private_key(tSMP_CB* p_cb);
+static void smp_local_key_pair_created(tSMP_CB* p_cb);
+static void smp_key_pool_fill(void* context);
+
+/* Number of precomputed local key pairs, 0 to create them on demand */
+#ifndef SMP_KEY_POOL_SIZE
+#define SMP_KEY_POOL_SIZE 2
+#endif
+#define SMP_KEY_POOL_SIZE_PROPERTY "persist.bluetooth.smp.key_pool_size"
+
+/* Number of pairings a precomputed local key pair is used for */
+#ifndef SMP_KEY_PAIR_MAX_USES
+#define SMP_KEY_PAIR_MAX_USES 1
+#endif
+#define SMP_KEY_PAIR_MAX_USES_PROPERTY "persist.bluetooth.smp.key_pair_max_uses"
+
+static SmpKeyPool* smp_key_pool = NULL;
+static thread_t* smp_key_pool_thread = NULL;
+/* Held to set or clear |smp_key_pool|, and by the dump thread to read it */
+static std::mutex smp_key_pool_lock;
 
 #define SMP_PASSKEY_MASK 0xfff00000
 
@@ -755,7 +778,23 @@ bool smp_calculate_legacy_short_term_key(tSMP_CB* p_cb, tSMP_ENC* output) {
  *
  ******************************************************************************/
 void smp_create_private_key(tSMP_CB* p_cb, tSMP_INT_DATA* p_data) {
+  SmpKeyPool::KeyPair key_pair;
+
   SMP_TRACE_DEBUG("%s", __func__);
+  smp_mark_phase(p_cb, SMP_PHASE_KEY_REQ);
+
+  if (smp_key_pool != NULL) {
+    bool taken = smp_key_pool->Take(&key_pair);
+    thread_post(smp_key_pool_thread, smp_key_pool_fill, smp_key_pool);
+    if (taken) {
+      memcpy(p_cb->private_key, key_pair.private_key, BT_OCTET32_LEN);
+      memcpy(p_cb->loc_publ_key.x, key_pair.public_x, BT_OCTET32_LEN);
+      memcpy(p_cb->loc_publ_key.y, key_pair.public_y, BT_OCTET32_LEN);
+      memset(&key_pair, 0, sizeof(key_pair));
+      smp_local_key_pair_created(p_cb);
+      return;
+    }
+  }
 
   btsnd_hcic_ble_rand(Bind(
       [](tSMP_CB* p_cb, BT_OCTET8 rand) {
@@ -835,11 +874,24 @@ void smp_process_private_key(tSMP_CB* p_cb) {
   SMP_TRACE_DEBUG("%s", __func__);
 
   memcpy(private_key, p_cb->private_key, BT_OCTET32_LEN);
-  ECC_PointMult(&public_key, &(curve_p256.G), (uint32_t*)private_key,
-                KEY_LENGTH_DWORDS_P256);
+  ECC_PointMult_Base(&public_key, (uint32_t*)private_key);
   memcpy(p_cb->loc_publ_key.x, public_key.x, BT_OCTET32_LEN);
   memcpy(p_cb->loc_publ_key.y, public_key.y, BT_OCTET32_LEN);
 
+  smp_local_key_pair_created(p_cb);
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_local_key_pair_created
+ *
+ * Description      This function notifies SM that the local private key /
+ *                  public key pair is created.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void smp_local_key_pair_created(tSMP_CB* p_cb) {
   smp_debug_print_nbyte_little_endian(p_cb->private_key, "private",
                                       BT_OCTET32_LEN);
   smp_debug_print_nbyte_little_endian(p_cb->loc_publ_key.x, "local public(x)",
@@ -847,9 +899,100 @@ void smp_process_private_key(tSMP_CB* p_cb) {
   smp_debug_print_nbyte_little_endian(p_cb->loc_publ_key.y, "local public(y)",
                                       BT_OCTET32_LEN);
   p_cb->flags |= SMP_PAIR_FLAG_HAVE_LOCAL_PUBL_KEY;
+  smp_mark_phase(p_cb, SMP_PHASE_LOCAL_KEY);
   smp_sm_event(p_cb, SMP_LOC_PUBL_KEY_CRTD_EVT, NULL);
 }
 
+/*******************************************************************************
+ *
+ * Function         smp_key_pool_fill
+ *
+ * Description      Generates local key pairs until the pool is full. Runs on
+ *                  the key pool thread.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void smp_key_pool_fill(void* context) {
+  static_cast<SmpKeyPool*>(context)->Fill();
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_key_pool_init
+ *
+ * Description      Starts precomputing local key pairs, unless the pool is
+ *                  disabled with SMP_KEY_POOL_SIZE_PROPERTY.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void smp_key_pool_init(void) {
+  if (smp_key_pool != NULL) return;
+
+  int32_t size =
+      osi_property_get_int32(SMP_KEY_POOL_SIZE_PROPERTY, SMP_KEY_POOL_SIZE);
+  int32_t max_uses = osi_property_get_int32(SMP_KEY_PAIR_MAX_USES_PROPERTY,
+                                            SMP_KEY_PAIR_MAX_USES);
+  if (size <= 0) return;
+  if (max_uses <= 0 || max_uses > UINT16_MAX) max_uses = 1;
+
+  /* The fixed-base table is built here, as p_256_init_curve() rewrites the
+   * curve parameters it is built from on this thread */
+  Point public_key;
+  uint32_t private_key[KEY_LENGTH_DWORDS_P256] = {1};
+  ECC_PointMult_Base(&public_key, private_key);
+
+  smp_key_pool_thread = thread_new("bt_smp_key_pool");
+  if (smp_key_pool_thread == NULL) {
+    SMP_TRACE_ERROR("%s: unable to create the key pool thread", __func__);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(smp_key_pool_lock);
+    smp_key_pool = new SmpKeyPool(size, max_uses);
+  }
+  thread_post(smp_key_pool_thread, smp_key_pool_fill, smp_key_pool);
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_key_pool_free
+ *
+ * Description      Stops precomputing local key pairs and erases them.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void smp_key_pool_free(void) {
+  if (smp_key_pool == NULL) return;
+
+  thread_free(smp_key_pool_thread);
+  smp_key_pool_thread = NULL;
+  std::lock_guard<std::mutex> lock(smp_key_pool_lock);
+  delete smp_key_pool;
+  smp_key_pool = NULL;
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_key_pool_debug_dump
+ *
+ * Description      Dumps the local key pair pool statistics.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void smp_key_pool_debug_dump(int fd) {
+  /* The pool locks its own state while it is dumped */
+  std::lock_guard<std::mutex> lock(smp_key_pool_lock);
+  if (smp_key_pool == NULL) {
+    dprintf(fd, "  Local key pair pool disabled\n");
+    return;
+  }
+  smp_key_pool->DebugDump(fd);
+}
+
 /*******************************************************************************
  *
  * Function         smp_compute_dhkey
@@ -872,8 +1015,7 @@ void smp_compute_dhkey(tSMP_CB* p_cb) {
   memcpy(peer_publ_key.x, p_cb->peer_publ_key.x, BT_OCTET32_LEN);
   memcpy(peer_publ_key.y, p_cb->peer_publ_key.y, BT_OCTET32_LEN);
 
-  ECC_PointMult(&new_publ_key, &peer_publ_key, (uint32_t*)private_key,
-                KEY_LENGTH_DWORDS_P256);
+  ECC_PointMult_WNAF(&new_publ_key, &peer_publ_key, (uint32_t*)private_key);
 
   memcpy(p_cb->dhkey, new_publ_key.x, BT_OCTET32_LEN);
 
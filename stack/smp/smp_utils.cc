@@ -24,7 +24,10 @@
 #include "bt_target.h"
 
 #include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
+#include <mutex>
 #include "bt_types.h"
 #include "bt_utils.h"
 #include "btm_ble_api.h"
@@ -34,8 +37,43 @@
 #include "l2c_api.h"
 #include "l2c_int.h"
 #include "osi/include/osi.h"
+#include "osi/include/time.h"
+#include "smp_api.h"
 #include "smp_int.h"
 
+/* Intervals between the pairing phases, as reported in the debug dump */
+typedef struct {
+  const char* name;
+  tSMP_PHASE from;
+  tSMP_PHASE to;
+} tSMP_PHASE_INTERVAL;
+
+static const tSMP_PHASE_INTERVAL smp_phase_intervals[] = {
+    {"Pairing feature exchange", SMP_PHASE_START, SMP_PHASE_KEY_REQ},
+    {"Local key pair creation", SMP_PHASE_KEY_REQ, SMP_PHASE_LOCAL_KEY},
+    {"Public key exchange", SMP_PHASE_LOCAL_KEY, SMP_PHASE_BOTH_KEYS},
+    {"DHKey computation", SMP_PHASE_BOTH_KEYS, SMP_PHASE_DHKEY},
+    {"Authentication stages", SMP_PHASE_DHKEY, SMP_PHASE_AUTH},
+    {"Encryption and key distribution", SMP_PHASE_AUTH, SMP_PHASE_CMPL},
+    {"Total", SMP_PHASE_START, SMP_PHASE_CMPL},
+};
+#define SMP_NUM_PHASE_INTERVALS \
+  (sizeof(smp_phase_intervals) / sizeof(smp_phase_intervals[0]))
+
+typedef struct {
+  uint32_t count;
+  uint64_t total_us;
+  uint64_t max_us;
+} tSMP_PHASE_STATS;
+
+static struct {
+  uint32_t pairings;
+  uint32_t failures;
+  tSMP_PHASE_STATS intervals[SMP_NUM_PHASE_INTERVALS];
+} smp_latency_stats;
+/* Held to update |smp_latency_stats|, and by the dump thread to read it */
+static std::mutex smp_latency_stats_lock;
+
 #define SMP_PAIRING_REQ_SIZE 7
 #define SMP_CONFIRM_CMD_SIZE (BT_OCTET16_LEN + 1)
 #define SMP_RAND_CMD_SIZE (BT_OCTET16_LEN + 1)
@@ -909,6 +947,92 @@ void smp_reset_control_value(tSMP_CB* p_cb) {
   smp_cb_cleanup(p_cb);
 }
 
+/*******************************************************************************
+ *
+ * Function         smp_mark_phase
+ *
+ * Description      This function records the time the pairing reached |phase|.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void smp_mark_phase(tSMP_CB* p_cb, tSMP_PHASE phase) {
+  p_cb->phase_us[phase] = time_get_os_boottime_us();
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_record_pairing_latency
+ *
+ * Description      This function adds the phases of the completed pairing to
+ *                  the latency statistics. Only LE pairings that went through
+ *                  every phase of an interval are counted in it.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void smp_record_pairing_latency(tSMP_CB* p_cb) {
+  if (p_cb->phase_us[SMP_PHASE_START] == 0) return;
+
+  std::lock_guard<std::mutex> lock(smp_latency_stats_lock);
+  if (p_cb->status != SMP_SUCCESS) {
+    smp_latency_stats.failures++;
+    return;
+  }
+
+  smp_mark_phase(p_cb, SMP_PHASE_CMPL);
+  smp_latency_stats.pairings++;
+  for (size_t i = 0; i < SMP_NUM_PHASE_INTERVALS; i++) {
+    uint64_t from = p_cb->phase_us[smp_phase_intervals[i].from];
+    uint64_t to = p_cb->phase_us[smp_phase_intervals[i].to];
+    if (from == 0 || to < from) continue;
+
+    tSMP_PHASE_STATS* p_stats = &smp_latency_stats.intervals[i];
+    p_stats->count++;
+    p_stats->total_us += to - from;
+    if (to - from > p_stats->max_us) p_stats->max_us = to - from;
+  }
+}
+
+/*******************************************************************************
+ *
+ * Function         smp_debug_dump
+ *
+ * Description      This function dumps the pairing latency breakdown and the
+ *                  local key pair pool statistics.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void smp_debug_dump(int fd) {
+  std::unique_lock<std::mutex> lock(smp_latency_stats_lock);
+  auto stats = smp_latency_stats;
+  lock.unlock();
+
+  dprintf(fd, "\nLE Security Manager:\n");
+  dprintf(fd,
+          "  Pairings completed / failed                             : "
+          "%u / %u\n",
+          stats.pairings, stats.failures);
+
+  dprintf(fd, "  Pairing latency (count, avg/max ms):\n");
+  for (size_t i = 0; i < SMP_NUM_PHASE_INTERVALS; i++) {
+    const tSMP_PHASE_STATS* p_stats = &stats.intervals[i];
+    if (p_stats->count == 0) {
+      dprintf(fd, "    %-34s: 0\n", smp_phase_intervals[i].name);
+      continue;
+    }
+    uint64_t avg_us = p_stats->total_us / p_stats->count;
+    dprintf(fd,
+            "    %-34s: %u, %" PRIu64 ".%03" PRIu64 " / %" PRIu64
+            ".%03" PRIu64 "\n",
+            smp_phase_intervals[i].name, p_stats->count, avg_us / 1000,
+            avg_us % 1000, p_stats->max_us / 1000, p_stats->max_us % 1000);
+  }
+
+  smp_key_pool_debug_dump(fd);
+}
+
 /*******************************************************************************
  *
  * Function         smp_proc_pairing_cmpl
@@ -940,6 +1064,7 @@ void smp_proc_pairing_cmpl(tSMP_CB* p_cb) {
 
   RawAddress pairing_bda = p_cb->pairing_bda;
 
+  smp_record_pairing_latency(p_cb);
   smp_reset_control_value(p_cb);
 
   if (p_callback) (*p_callback)(SMP_COMPLT_EVT, pairing_bda, &evt_data);
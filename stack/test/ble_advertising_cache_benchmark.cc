@@ -0,0 +1,245 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "stack/btm/ble_advertising_cache.h"
+#include "stack/include/advertise_data_parser.h"
+
+namespace {
+
+constexpr uint8_t kAdTypeFlags = 0x01;
+constexpr uint8_t kNoSid = 0xff;
+
+// One advertising report, as extracted by btm_ble_process_ext_adv_pkt()
+struct Report {
+  uint8_t addr_type;
+  RawAddress addr;
+  uint8_t sid;
+  bool legacy;
+  bool is_start;
+  bool data_complete;
+  bool wait_scan_rsp;
+  std::vector<uint8_t> data;
+};
+
+// Builds a capture of dense extended advertising traffic, as seen while
+// scanning in a crowded place: |num_sets| extended advertising sets sending
+// 600 octets of data in three chained reports, their reports interleaved
+// with each other, and legacy scannable advertisers answering scan requests.
+std::vector<Report> dense_capture(size_t num_sets) {
+  std::vector<Report> capture;
+  const size_t kFragments = 3;
+  const size_t kFragmentLen = 200;
+
+  for (size_t fragment = 0; fragment < kFragments; fragment++) {
+    for (size_t set = 0; set < num_sets; set++) {
+      Report report;
+      report.addr_type = 0x01;
+      report.addr = RawAddress::kEmpty;
+      report.addr.address[0] = 0x40;
+      report.addr.address[4] = set >> 8;
+      report.addr.address[5] = set;
+      report.sid = set % 16;
+      report.legacy = false;
+      report.is_start = false;
+      report.data_complete = (fragment == kFragments - 1);
+      report.wait_scan_rsp = false;
+      // Manufacturer specific data fields, flags in the first fragment
+      size_t offset = 0;
+      if (fragment == 0) {
+        report.data = {0x02, kAdTypeFlags, 0x06};
+        offset = report.data.size();
+      }
+      while (offset + 2 < kFragmentLen) {
+        size_t field_len = std::min<size_t>(kFragmentLen - offset - 1, 30);
+        report.data.push_back(field_len);
+        report.data.push_back(0xff);
+        for (size_t i = 1; i < field_len; i++) report.data.push_back(set + i);
+        offset += field_len + 1;
+      }
+      capture.push_back(report);
+
+      // A legacy scannable advertiser and its scan response
+      if (set % 4 == 0) {
+        Report adv;
+        adv.addr_type = 0x00;
+        adv.addr = report.addr;
+        adv.addr.address[0] = 0x00;
+        adv.sid = kNoSid;
+        adv.legacy = true;
+        adv.is_start = true;
+        adv.data_complete = true;
+        adv.wait_scan_rsp = true;
+        adv.data = {0x02, kAdTypeFlags, 0x06, 0x03, 0x03, 0x0f, 0x18};
+        adv.data.resize(31, 0x00);  // Zero padded
+        capture.push_back(adv);
+
+        Report scan_rsp = adv;
+        scan_rsp.is_start = false;
+        scan_rsp.wait_scan_rsp = false;
+        scan_rsp.data = {0x09, 0x09, 'B', 'e', 'n', 'c', 'h', 'm', 'a', 'r'};
+        scan_rsp.data.resize(31, 0x00);
+        capture.push_back(scan_rsp);
+      }
+    }
+  }
+  return capture;
+}
+
+// The cache and the reassembly path previously used by
+// btm_ble_process_adv_pkt_cont(), as a reference
+class ListAdvertisingCache {
+ public:
+  const std::vector<uint8_t>& Set(uint8_t addr_type, const RawAddress& addr,
+                                  std::vector<uint8_t> data) {
+    auto it = Find(addr_type, addr);
+    if (it != items.end()) {
+      it->data = std::move(data);
+      return it->data;
+    }
+    if (items.size() > cache_max) items.pop_back();
+    items.emplace_front(Item{addr_type, addr, std::move(data)});
+    return items.front().data;
+  }
+
+  const std::vector<uint8_t>& Append(uint8_t addr_type, const RawAddress& addr,
+                                     std::vector<uint8_t> data) {
+    auto it = Find(addr_type, addr);
+    if (it != items.end()) {
+      it->data.insert(it->data.end(), data.begin(), data.end());
+      return it->data;
+    }
+    if (items.size() > cache_max) items.pop_back();
+    items.emplace_front(Item{addr_type, addr, std::move(data)});
+    return items.front().data;
+  }
+
+  void Clear(uint8_t addr_type, const RawAddress& addr) {
+    auto it = Find(addr_type, addr);
+    if (it != items.end()) items.erase(it);
+  }
+
+ private:
+  struct Item {
+    uint8_t addr_type;
+    RawAddress addr;
+    std::vector<uint8_t> data;
+  };
+
+  std::list<Item>::iterator Find(uint8_t addr_type, const RawAddress& addr) {
+    for (auto it = items.begin(); it != items.end(); it++) {
+      if (it->addr_type == addr_type && it->addr == addr) return it;
+    }
+    return items.end();
+  }
+
+  const size_t cache_max = 7;
+  std::list<Item> items;
+};
+
+// Returns the flags of the reassembled data, or 0 if not reported
+uint8_t process_report_list(ListAdvertisingCache& cache, const Report& r) {
+  std::vector<uint8_t> tmp;
+  if (!r.data.empty()) tmp.insert(tmp.begin(), r.data.begin(), r.data.end());
+  if (r.legacy) AdvertiseDataParser::RemoveTrailingZeros(tmp);
+
+  const std::vector<uint8_t>& adv_data =
+      r.is_start ? cache.Set(r.addr_type, r.addr, std::move(tmp))
+                 : cache.Append(r.addr_type, r.addr, std::move(tmp));
+  if (!r.data_complete || r.wait_scan_rsp) return 0;
+  if (!AdvertiseDataParser::IsValid(adv_data)) return 0;
+
+  uint8_t len;
+  const uint8_t* p_flag =
+      AdvertiseDataParser::GetFieldByType(adv_data, kAdTypeFlags, &len);
+  uint8_t flags = p_flag ? *p_flag : 0;
+  cache.Clear(r.addr_type, r.addr);
+  return flags;
+}
+
+// Same as btm_ble_process_adv_pkt_cont()
+uint8_t process_report(AdvertisingCache& cache, const Report& r) {
+  const uint8_t* adv_data = r.data.data();
+  size_t adv_data_len = r.data.size();
+  if (r.legacy)
+    adv_data_len =
+        AdvertiseDataParser::LengthWithoutTrailingZeros(adv_data, adv_data_len);
+
+  bool reassemble = !r.data_complete || r.wait_scan_rsp;
+  if (r.is_start) {
+    if (reassemble) {
+      adv_data = cache.Set(r.addr_type, r.addr, r.sid, adv_data, adv_data_len,
+                           &adv_data_len);
+    } else {
+      cache.Clear(r.addr_type, r.addr, r.sid);
+    }
+  } else if (reassemble || cache.Contains(r.addr_type, r.addr, r.sid)) {
+    adv_data = cache.Append(r.addr_type, r.addr, r.sid, adv_data,
+                            adv_data_len, &adv_data_len);
+  }
+  if (reassemble) return 0;
+  if (!AdvertiseDataParser::IsValid(adv_data, adv_data_len)) {
+    cache.Clear(r.addr_type, r.addr, r.sid);
+    return 0;
+  }
+
+  uint8_t len;
+  const uint8_t* p_flag = AdvertiseDataParser::GetFieldByType(
+      adv_data, adv_data_len, kAdTypeFlags, &len);
+  uint8_t flags = p_flag ? *p_flag : 0;
+  cache.Clear(r.addr_type, r.addr, r.sid);
+  return flags;
+}
+
+void BM_ListAdvertisingCache(benchmark::State& state) {
+  std::vector<Report> capture = dense_capture(state.range(0));
+  ListAdvertisingCache cache;
+  uint64_t reported = 0;
+  for (auto _ : state) {
+    for (const Report& report : capture)
+      reported += (process_report_list(cache, report) != 0);
+  }
+  benchmark::DoNotOptimize(reported);
+  state.counters["reported"] = reported / state.iterations();
+  state.SetItemsProcessed(state.iterations() * capture.size());
+}
+BENCHMARK(BM_ListAdvertisingCache)->Arg(4)->Arg(16)->Arg(64);
+
+void BM_AdvertisingCache(benchmark::State& state) {
+  std::vector<Report> capture = dense_capture(state.range(0));
+  std::unique_ptr<AdvertisingCache> cache(new AdvertisingCache());
+  uint64_t reported = 0;
+  for (auto _ : state) {
+    for (const Report& report : capture)
+      reported += (process_report(*cache, report) != 0);
+  }
+  benchmark::DoNotOptimize(reported);
+  state.counters["reported"] = reported / state.iterations();
+  state.SetItemsProcessed(state.iterations() * capture.size());
+}
+BENCHMARK(BM_AdvertisingCache)->Arg(4)->Arg(16)->Arg(64);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,137 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "stack/btm/ble_advertising_cache.h"
+
+namespace {
+constexpr uint8_t kAddrType = 0x01;
+constexpr uint8_t kSid = 0x03;
+
+RawAddress address(size_t index) {
+  RawAddress addr = RawAddress::kEmpty;
+  addr.address[4] = index >> 8;
+  addr.address[5] = index;
+  return addr;
+}
+
+std::vector<uint8_t> cached(const uint8_t* data, size_t len) {
+  return std::vector<uint8_t>(data, data + len);
+}
+}  // namespace
+
+TEST(AdvertisingCacheTest, test_set_and_append) {
+  AdvertisingCache cache;
+  const uint8_t first[] = {0x02, 0x01, 0x06};
+  const uint8_t second[] = {0x03, 0x09, 0x41, 0x42};
+  size_t len;
+
+  const uint8_t* data =
+      cache.Set(kAddrType, address(1), kSid, first, sizeof(first), &len);
+  EXPECT_EQ(cached(data, len), std::vector<uint8_t>({0x02, 0x01, 0x06}));
+
+  data = cache.Append(kAddrType, address(1), kSid, second, sizeof(second),
+                      &len);
+  EXPECT_EQ(cached(data, len), std::vector<uint8_t>({0x02, 0x01, 0x06, 0x03,
+                                                     0x09, 0x41, 0x42}));
+
+  // Set restarts the data
+  data = cache.Set(kAddrType, address(1), kSid, second, sizeof(second), &len);
+  EXPECT_EQ(cached(data, len), std::vector<uint8_t>({0x03, 0x09, 0x41, 0x42}));
+  EXPECT_EQ(cache.Size(), 1u);
+}
+
+TEST(AdvertisingCacheTest, test_key_includes_type_and_sid) {
+  AdvertisingCache cache;
+  const uint8_t data[] = {0x02, 0x01, 0x06};
+  size_t len;
+
+  cache.Set(kAddrType, address(1), kSid, data, sizeof(data), &len);
+  EXPECT_TRUE(cache.Contains(kAddrType, address(1), kSid));
+  EXPECT_FALSE(cache.Contains(kAddrType + 1, address(1), kSid));
+  EXPECT_FALSE(cache.Contains(kAddrType, address(1), kSid + 1));
+  EXPECT_FALSE(cache.Contains(kAddrType, address(2), kSid));
+
+  cache.Append(kAddrType, address(1), kSid + 1, data, sizeof(data), &len);
+  EXPECT_EQ(len, sizeof(data));
+  EXPECT_EQ(cache.Size(), 2u);
+
+  cache.Clear(kAddrType, address(1), kSid);
+  EXPECT_FALSE(cache.Contains(kAddrType, address(1), kSid));
+  EXPECT_TRUE(cache.Contains(kAddrType, address(1), kSid + 1));
+  EXPECT_EQ(cache.Size(), 1u);
+}
+
+TEST(AdvertisingCacheTest, test_evicts_least_recently_used) {
+  AdvertisingCache cache;
+  const uint8_t data[] = {0x02, 0x01, 0x06};
+  size_t len;
+
+  for (size_t i = 0; i < AdvertisingCache::kMaxItems; i++)
+    cache.Set(kAddrType, address(i), kSid, data, sizeof(data), &len);
+  EXPECT_EQ(cache.Size(), AdvertisingCache::kMaxItems);
+
+  // Device 0 is used again, so device 1 is the least recently used
+  cache.Append(kAddrType, address(0), kSid, data, sizeof(data), &len);
+  cache.Set(kAddrType, address(1000), kSid, data, sizeof(data), &len);
+
+  EXPECT_EQ(cache.Size(), AdvertisingCache::kMaxItems);
+  EXPECT_EQ(cache.Evictions(), 1u);
+  EXPECT_TRUE(cache.Contains(kAddrType, address(0), kSid));
+  EXPECT_FALSE(cache.Contains(kAddrType, address(1), kSid));
+  EXPECT_TRUE(cache.Contains(kAddrType, address(1000), kSid));
+
+  cache.ClearAll();
+  EXPECT_EQ(cache.Size(), 0u);
+  EXPECT_FALSE(cache.Contains(kAddrType, address(0), kSid));
+}
+
+TEST(AdvertisingCacheTest, test_data_is_bounded) {
+  AdvertisingCache cache;
+  std::vector<uint8_t> data(1000, 0x00);
+  size_t len;
+
+  cache.Set(kAddrType, address(1), kSid, data.data(), data.size(), &len);
+  cache.Append(kAddrType, address(1), kSid, data.data(), data.size(), &len);
+  EXPECT_EQ(len, AdvertisingCache::kMaxDataLen);
+  EXPECT_EQ(cache.TruncatedBytes(), 2 * data.size() - len);
+}
+
+TEST(AdvertisingCacheTest, test_many_devices) {
+  AdvertisingCache cache;
+  size_t len;
+
+  // Reassemble more devices than the cache holds, a window at a time
+  for (size_t i = 0; i < 1000; i++) {
+    uint8_t fragment[] = {0x02, 0xff, (uint8_t)i};
+    cache.Set(kAddrType, address(i), kSid, fragment, sizeof(fragment), &len);
+    if (i >= AdvertisingCache::kMaxItems / 2) {
+      size_t done = i - AdvertisingCache::kMaxItems / 2;
+      const uint8_t* data = cache.Append(kAddrType, address(done), kSid,
+                                         fragment, sizeof(fragment), &len);
+      ASSERT_EQ(len, 6u);
+      EXPECT_EQ(data[2], (uint8_t)done);
+      cache.Clear(kAddrType, address(done), kSid);
+    }
+  }
+  EXPECT_EQ(cache.Evictions(), 0u);
+  EXPECT_EQ(cache.Size(), AdvertisingCache::kMaxItems / 2);
+}
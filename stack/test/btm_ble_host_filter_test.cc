@@ -0,0 +1,217 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "stack/btm/btm_ble_host_filter.h"
+
+using bluetooth::Uuid;
+
+namespace {
+constexpr uint8_t kFilter = 1;
+constexpr int8_t kRssi = -60;
+const RawAddress kAddr({0x11, 0x22, 0x33, 0x44, 0x55, 0x66});
+const RawAddress kOtherAddr({0x11, 0x22, 0x33, 0x44, 0x55, 0x67});
+
+// Heart Rate service, name "Polar H7", manufacturer 0x006b data 01 02 03, and
+// Battery service data
+const std::vector<uint8_t> kAdvData = {
+    0x02, 0x01, 0x06,                                     // Flags
+    0x03, 0x03, 0x0d, 0x18,                               // 16 bit UUIDs
+    0x09, 0x09, 'P', 'o', 'l', 'a', 'r', ' ', 'H', '7',   // Complete name
+    0x06, 0xff, 0x6b, 0x00, 0x01, 0x02, 0x03,             // Manufacturer data
+    0x04, 0x16, 0x0f, 0x18, 0x64};                        // Service data
+
+btgatt_filt_param_setup_t params(uint16_t feat_seln, uint8_t logic) {
+  btgatt_filt_param_setup_t p = {};
+  p.feat_seln = feat_seln;
+  p.list_logic_type = 0;
+  p.filt_logic_type = logic;
+  p.rssi_high_thres = (uint8_t)-128;
+  return p;
+}
+
+ApcfCommand uuid_command(const Uuid& uuid, const Uuid& mask = Uuid::kEmpty) {
+  ApcfCommand cmd = {};
+  cmd.type = BTM_BLE_PF_SRVC_UUID;
+  cmd.uuid = uuid;
+  cmd.uuid_mask = mask;
+  return cmd;
+}
+
+ApcfCommand name_command(const std::string& name) {
+  ApcfCommand cmd = {};
+  cmd.type = BTM_BLE_PF_LOCAL_NAME;
+  cmd.name.assign(name.begin(), name.end());
+  return cmd;
+}
+
+ApcfCommand manu_command(uint16_t company, std::vector<uint8_t> data,
+                         std::vector<uint8_t> mask) {
+  ApcfCommand cmd = {};
+  cmd.type = BTM_BLE_PF_MANU_DATA;
+  cmd.company = company;
+  cmd.data = data;
+  cmd.data_mask = mask;
+  return cmd;
+}
+
+bool matches(BleHostScanFilter& filter, const RawAddress& addr = kAddr,
+             int8_t rssi = kRssi) {
+  return filter.Matches(addr, rssi, kAdvData.data(), kAdvData.size());
+}
+
+uint16_t bit(uint8_t type) { return 1 << type; }
+}  // namespace
+
+TEST(BleHostScanFilterTest, test_inactive_matches_all) {
+  BleHostScanFilter filter;
+  ASSERT_TRUE(filter.Add(kFilter, {name_command("Nope")}));
+  EXPECT_FALSE(filter.IsActive());
+  EXPECT_TRUE(matches(filter));
+
+  // Enabled, but no filter has parameters
+  filter.Enable(true);
+  EXPECT_FALSE(filter.IsActive());
+  EXPECT_TRUE(matches(filter));
+
+  filter.SetParams(kFilter, params(bit(BTM_BLE_PF_LOCAL_NAME), 1));
+  EXPECT_TRUE(filter.IsActive());
+  EXPECT_FALSE(matches(filter));
+  EXPECT_EQ(filter.Evaluated(), 1u);
+  EXPECT_EQ(filter.Dropped(), 1u);
+}
+
+TEST(BleHostScanFilterTest, test_service_uuid) {
+  BleHostScanFilter filter;
+  filter.Enable(true);
+  filter.SetParams(kFilter, params(bit(BTM_BLE_PF_SRVC_UUID), 1));
+
+  ASSERT_TRUE(filter.Add(kFilter, {uuid_command(Uuid::From16Bit(0x180f))}));
+  EXPECT_FALSE(matches(filter));
+
+  ASSERT_TRUE(filter.Add(kFilter, {uuid_command(Uuid::From16Bit(0x180d))}));
+  EXPECT_TRUE(matches(filter));
+
+  // 16 bit UUIDs are expanded with the Base UUID
+  filter.Clear(kFilter);
+  ASSERT_TRUE(filter.Add(
+      kFilter, {uuid_command(Uuid::FromString(
+                   "0000180d-0000-1000-8000-00805f9b34fb"))}));
+  EXPECT_TRUE(matches(filter));
+
+  // The mask applies to the 16 bits of the UUID
+  filter.Clear(kFilter);
+  ASSERT_TRUE(filter.Add(kFilter, {uuid_command(Uuid::From16Bit(0x18ff),
+                                                Uuid::From16Bit(0xff00))}));
+  EXPECT_TRUE(matches(filter));
+}
+
+TEST(BleHostScanFilterTest, test_name_prefix) {
+  BleHostScanFilter filter;
+  filter.Enable(true);
+  filter.SetParams(kFilter, params(bit(BTM_BLE_PF_LOCAL_NAME), 1));
+
+  ASSERT_TRUE(filter.Add(kFilter, {name_command("Polar")}));
+  EXPECT_TRUE(matches(filter));
+
+  filter.Clear(kFilter);
+  ASSERT_TRUE(filter.Add(kFilter, {name_command("Polar H7 and more")}));
+  EXPECT_FALSE(matches(filter));
+}
+
+TEST(BleHostScanFilterTest, test_manufacturer_data) {
+  BleHostScanFilter filter;
+  filter.Enable(true);
+  filter.SetParams(kFilter, params(bit(BTM_BLE_PF_MANU_DATA), 1));
+
+  ASSERT_TRUE(filter.Add(kFilter, {manu_command(0x006b, {}, {})}));
+  EXPECT_TRUE(matches(filter));
+
+  filter.Clear(kFilter);
+  ASSERT_TRUE(
+      filter.Add(kFilter, {manu_command(0x006b, {0x01, 0xff}, {0xff, 0x00})}));
+  EXPECT_TRUE(matches(filter));
+
+  filter.Clear(kFilter);
+  ASSERT_TRUE(
+      filter.Add(kFilter, {manu_command(0x006b, {0x01, 0x03}, {0xff, 0xff})}));
+  EXPECT_FALSE(matches(filter));
+
+  filter.Clear(kFilter);
+  ASSERT_TRUE(filter.Add(kFilter, {manu_command(0x004c, {}, {})}));
+  EXPECT_FALSE(matches(filter));
+}
+
+TEST(BleHostScanFilterTest, test_address_and_logic) {
+  BleHostScanFilter filter;
+  filter.Enable(true);
+
+  ApcfCommand addr = {};
+  addr.type = BTM_BLE_PF_ADDR_FILTER;
+  addr.address = kAddr;
+  ASSERT_TRUE(filter.Add(kFilter, {addr, name_command("Polar"),
+                                   manu_command(0x004c, {}, {})}));
+
+  // Name or manufacturer, from the address
+  filter.SetParams(kFilter, params(bit(BTM_BLE_PF_ADDR_FILTER) |
+                                       bit(BTM_BLE_PF_LOCAL_NAME) |
+                                       bit(BTM_BLE_PF_MANU_DATA),
+                                   BTM_BLE_PF_LOGIC_OR));
+  EXPECT_TRUE(matches(filter));
+  EXPECT_FALSE(matches(filter, kOtherAddr));
+
+  // Name and manufacturer
+  filter.SetParams(kFilter, params(bit(BTM_BLE_PF_ADDR_FILTER) |
+                                       bit(BTM_BLE_PF_LOCAL_NAME) |
+                                       bit(BTM_BLE_PF_MANU_DATA),
+                                   BTM_BLE_PF_LOGIC_AND));
+  EXPECT_FALSE(matches(filter));
+
+  // Any filter in use can match
+  filter.SetParams(kFilter + 1, params(0, BTM_BLE_PF_LOGIC_AND));
+  EXPECT_TRUE(matches(filter));
+  filter.DeleteParams(kFilter + 1);
+  EXPECT_FALSE(matches(filter));
+}
+
+TEST(BleHostScanFilterTest, test_rssi_threshold) {
+  BleHostScanFilter filter;
+  filter.Enable(true);
+  btgatt_filt_param_setup_t p = params(0, BTM_BLE_PF_LOGIC_AND);
+  p.rssi_high_thres = (uint8_t)-70;
+  filter.SetParams(kFilter, p);
+
+  EXPECT_TRUE(matches(filter, kAddr, -70));
+  EXPECT_FALSE(matches(filter, kAddr, -71));
+}
+
+TEST(BleHostScanFilterTest, test_condition_limit) {
+  BleHostScanFilter filter;
+  std::vector<ApcfCommand> commands(BleHostScanFilter::kMaxConditions,
+                                    name_command("Polar"));
+  EXPECT_TRUE(filter.Add(kFilter, commands));
+  EXPECT_FALSE(filter.Add(kFilter + 1, {name_command("Polar")}));
+  EXPECT_FALSE(filter.Add(BleHostScanFilter::kMaxFilters, {}));
+
+  filter.Clear(kFilter);
+  EXPECT_EQ(filter.ConditionCount(), 0u);
+  EXPECT_TRUE(filter.Add(kFilter + 1, {name_command("Polar")}));
+}
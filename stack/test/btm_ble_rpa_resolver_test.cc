@@ -0,0 +1,139 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "stack/btm/btm_ble_rpa_resolver.h"
+
+namespace {
+constexpr uint64_t kExpiryMs = 15 * 60 * 1000;
+constexpr uint64_t kStartMs = 1000;
+
+// Core Specification v5.0, Vol 3, Part H, D.7: ah(IRK, 0x708194) = 0x0dfbaa
+// IRK least significant octet first, as stored in the security records
+const BT_OCTET16 kIrk = {0x9b, 0x7d, 0x39, 0x0a, 0xa6, 0x10, 0x10, 0x34,
+                         0x05, 0xad, 0xc8, 0x57, 0xa3, 0x34, 0x02, 0xec};
+const RawAddress kRpa({0x70, 0x81, 0x94, 0x0d, 0xfb, 0xaa});
+const RawAddress kOtherRpa({0x70, 0x81, 0x94, 0x0d, 0xfb, 0xab});
+
+// IRK that differs from kIrk in its first octet
+void other_irk(uint8_t index, BT_OCTET16 irk) {
+  memcpy(irk, kIrk, BT_OCTET16_LEN);
+  irk[0] ^= index + 1;
+}
+}  // namespace
+
+TEST(BtmBleRpaResolverTest, test_matches_spec_vector) {
+  EXPECT_TRUE(BtmBleRpaResolver::Matches(kRpa, kIrk));
+  EXPECT_FALSE(BtmBleRpaResolver::Matches(kOtherRpa, kIrk));
+}
+
+TEST(BtmBleRpaResolverTest, test_resolve_among_many_irks) {
+  BtmBleRpaResolver resolver(kExpiryMs);
+  int identities[100];
+  for (int i = 0; i < 99; i++) {
+    BT_OCTET16 irk;
+    other_irk(i, irk);
+    resolver.AddIrk(irk, &identities[i]);
+  }
+  resolver.AddIrk(kIrk, &identities[99]);
+  EXPECT_EQ(resolver.IrkCount(), 100u);
+
+  EXPECT_EQ(resolver.Resolve(kRpa, kStartMs), &identities[99]);
+  EXPECT_EQ(resolver.IrkEvaluations(), 100u);
+  EXPECT_EQ(resolver.Resolve(kOtherRpa, kStartMs), nullptr);
+  EXPECT_EQ(resolver.Resolved(), 1u);
+  EXPECT_EQ(resolver.Unresolved(), 1u);
+  EXPECT_EQ(resolver.CacheMisses(), 2u);
+}
+
+TEST(BtmBleRpaResolverTest, test_cache_hits) {
+  BtmBleRpaResolver resolver(kExpiryMs);
+  int identity;
+  resolver.AddIrk(kIrk, &identity);
+
+  EXPECT_EQ(resolver.Resolve(kRpa, kStartMs), &identity);
+  EXPECT_EQ(resolver.Resolve(kOtherRpa, kStartMs), nullptr);
+  uint64_t evaluations = resolver.IrkEvaluations();
+
+  // Both the resolved and the unresolved RPAs are cached
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(resolver.Resolve(kRpa, kStartMs + i), &identity);
+    EXPECT_EQ(resolver.Resolve(kOtherRpa, kStartMs + i), nullptr);
+  }
+  EXPECT_EQ(resolver.CacheHits(), 20u);
+  EXPECT_EQ(resolver.CacheMisses(), 2u);
+  EXPECT_EQ(resolver.IrkEvaluations(), evaluations);
+}
+
+TEST(BtmBleRpaResolverTest, test_cache_expiry) {
+  BtmBleRpaResolver resolver(kExpiryMs);
+  int identity;
+  resolver.AddIrk(kIrk, &identity);
+
+  EXPECT_EQ(resolver.Resolve(kRpa, kStartMs), &identity);
+  EXPECT_EQ(resolver.Resolve(kRpa, kStartMs + kExpiryMs - 1), &identity);
+  EXPECT_EQ(resolver.CacheHits(), 1u);
+  EXPECT_EQ(resolver.Resolve(kRpa, kStartMs + kExpiryMs), &identity);
+  EXPECT_EQ(resolver.CacheMisses(), 2u);
+}
+
+TEST(BtmBleRpaResolverTest, test_new_irk_drops_unresolved) {
+  BtmBleRpaResolver resolver(kExpiryMs);
+  EXPECT_EQ(resolver.Resolve(kRpa, kStartMs), nullptr);
+
+  int identity;
+  resolver.AddIrk(kIrk, &identity);
+  EXPECT_EQ(resolver.Resolve(kRpa, kStartMs), &identity);
+
+  resolver.Clear();
+  EXPECT_EQ(resolver.IrkCount(), 0u);
+  EXPECT_EQ(resolver.Resolve(kRpa, kStartMs), nullptr);
+}
+
+TEST(BtmBleRpaResolverTest, test_invalidate) {
+  BtmBleRpaResolver resolver(kExpiryMs);
+  int identity;
+  resolver.AddIrk(kIrk, &identity);
+
+  resolver.Resolve(kRpa, kStartMs);
+  resolver.Invalidate(kRpa);
+  resolver.Resolve(kRpa, kStartMs);
+  EXPECT_EQ(resolver.CacheHits(), 0u);
+  EXPECT_EQ(resolver.CacheMisses(), 2u);
+}
+
+TEST(BtmBleRpaResolverTest, test_cache_capacity) {
+  BtmBleRpaResolver resolver(kExpiryMs);
+  const size_t capacity =
+      BtmBleRpaResolver::kCacheSets * BtmBleRpaResolver::kCacheWays;
+
+  // Many more RPAs than the cache can hold: the least recently used are
+  // evicted and resolved again
+  for (size_t i = 0; i < 4 * capacity; i++) {
+    RawAddress rpa({0x40, 0x00, 0x00, 0x00, (uint8_t)(i >> 8), (uint8_t)i});
+    resolver.Resolve(rpa, kStartMs);
+  }
+  EXPECT_EQ(resolver.CacheMisses(), 4 * capacity);
+
+  // The most recent RPA is still cached
+  RawAddress last({0x40, 0x00, 0x00, 0x00, (uint8_t)((4 * capacity - 1) >> 8),
+                   (uint8_t)(4 * capacity - 1)});
+  resolver.Resolve(last, kStartMs);
+  EXPECT_EQ(resolver.CacheHits(), 1u);
+}
@@ -18,4 +18,8 @@
 
 #include <base/message_loop/message_loop.h>
 
-base::MessageLoop* get_message_loop() { return nullptr; }
\ No newline at end of file
+// The message loop the alarms set with alarm_set_on_mloop() run on, if a test
+// starts one
+base::MessageLoop* mock_btu_message_loop = nullptr;
+
+base::MessageLoop* get_message_loop() { return mock_btu_message_loop; }
@@ -0,0 +1,320 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "stack/gatt/gatt_int.h"
+
+tGATT_CB gatt_cb;
+
+namespace {
+constexpr uint8_t kTcbIdx = 1;
+constexpr tGATT_IF kGattIf = 3;
+constexpr tGATT_IF kOtherGattIf = 4;
+constexpr uint16_t kConnId = GATT_CREATE_CONN_ID(kTcbIdx, kGattIf);
+constexpr uint16_t kOtherConnId = GATT_CREATE_CONN_ID(kTcbIdx, kOtherGattIf);
+constexpr uint16_t kHandle = 0x002a;
+constexpr uint16_t kMtu = 23;
+
+std::vector<std::vector<uint8_t>> sent_pdus;
+tGATT_STATUS l2cap_status = GATT_SUCCESS;
+bool link_encrypted = false;
+
+struct ReadyCall {
+  uint16_t conn_id;
+  void* context;
+};
+std::vector<ReadyCall> ready_calls;
+
+void ready_cb(uint16_t conn_id, void* context) {
+  ready_calls.push_back({conn_id, context});
+}
+}  // namespace
+
+/* Below are methods that must be implemented if we don't want to compile the
+ * whole stack */
+tGATT_TCB* gatt_get_tcb_by_idx(uint8_t tcb_idx) {
+  if (tcb_idx >= GATT_MAX_PHY_CHANNEL || !gatt_cb.tcb[tcb_idx].in_use)
+    return NULL;
+  return &gatt_cb.tcb[tcb_idx];
+}
+
+tGATT_REG* gatt_get_regcb(tGATT_IF gatt_if) {
+  if (gatt_if < 1 || gatt_if > GATT_MAX_APPS) return NULL;
+  tGATT_REG* p_reg = &gatt_cb.cl_rcb[gatt_if - 1];
+  return p_reg->in_use ? p_reg : NULL;
+}
+
+tGATT_CH_STATE gatt_get_ch_state(tGATT_TCB* p_tcb) { return p_tcb->ch_state; }
+
+tGATT_STATUS attp_send_msg_to_l2cap(tGATT_TCB& tcb, BT_HDR* p_toL2CAP) {
+  uint8_t* p = (uint8_t*)(p_toL2CAP + 1) + p_toL2CAP->offset;
+  sent_pdus.emplace_back(p, p + p_toL2CAP->len);
+  osi_free(p_toL2CAP);
+  return l2cap_status;
+}
+
+bool BTM_BleDataSignature(const RawAddress& bd_addr, uint8_t* p_text,
+                          uint16_t len, BLE_SIGNATURE signature) {
+  memset(signature, 0x5a, GATT_AUTH_SIGN_LEN);
+  return true;
+}
+
+bool BTM_GetSecurityFlagsByTransport(const RawAddress& bd_addr,
+                                     uint8_t* p_sec_flags,
+                                     tBT_TRANSPORT transport) {
+  *p_sec_flags = link_encrypted ? BTM_SEC_FLAG_ENCRYPTED : 0;
+  return true;
+}
+
+class GattStreamTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (tGATT_TCB& tcb : gatt_cb.tcb) tcb = tGATT_TCB();
+    for (tGATT_REG& reg : gatt_cb.cl_rcb) reg = tGATT_REG();
+    sent_pdus.clear();
+    ready_calls.clear();
+    l2cap_status = GATT_SUCCESS;
+    link_encrypted = false;
+
+    tGATT_TCB& tcb = gatt_cb.tcb[kTcbIdx];
+    tcb.in_use = true;
+    tcb.tcb_idx = kTcbIdx;
+    tcb.transport = BT_TRANSPORT_LE;
+    tcb.ch_state = GATT_CH_OPEN;
+    tcb.payload_size = kMtu;
+    gatt_cb.cl_rcb[kGattIf - 1].in_use = true;
+    gatt_cb.cl_rcb[kOtherGattIf - 1].in_use = true;
+  }
+
+  void TearDown() override {
+    for (tGATT_TCB& tcb : gatt_cb.tcb) tcb = tGATT_TCB();
+  }
+
+  /* As gatt_channel_congestion() */
+  void Uncongest() {
+    gatt_cb.tcb[kTcbIdx].congested = false;
+    gatt_stream_resume(&gatt_cb.tcb[kTcbIdx]);
+  }
+
+  const std::vector<uint8_t> value_ = {0x01, 0x02, 0x03};
+  int context_ = 0;
+};
+
+TEST_F(GattStreamTest, test_open) {
+  EXPECT_EQ(GATTC_StreamOpen(GATT_CREATE_CONN_ID(kTcbIdx + 1, kGattIf),
+                             ready_cb, &context_),
+            GATT_ILLEGAL_PARAMETER);
+  EXPECT_EQ(GATTC_StreamOpen(GATT_CREATE_CONN_ID(kTcbIdx, kGattIf + 2),
+                             ready_cb, &context_),
+            GATT_ILLEGAL_PARAMETER);
+  EXPECT_EQ(GATTC_StreamOpen(kConnId, NULL, &context_),
+            GATT_ILLEGAL_PARAMETER);
+
+  // Writes need an open stream
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              false),
+            GATT_ILLEGAL_PARAMETER);
+  EXPECT_TRUE(sent_pdus.empty());
+
+  EXPECT_EQ(GATTC_StreamOpen(kConnId, ready_cb, &context_), GATT_SUCCESS);
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              false),
+            GATT_SUCCESS);
+  ASSERT_EQ(sent_pdus.size(), 1u);
+
+  // The stream of another application is separate
+  EXPECT_EQ(GATTC_StreamWrite(kOtherConnId, kHandle, value_.data(),
+                              value_.size(), false),
+            GATT_ILLEGAL_PARAMETER);
+
+  gatt_cb.tcb[kTcbIdx].ch_state = GATT_CH_CFG;
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              false),
+            GATT_WRONG_STATE);
+  EXPECT_EQ(sent_pdus.size(), 1u);
+}
+
+TEST_F(GattStreamTest, test_write) {
+  ASSERT_EQ(GATTC_StreamOpen(kConnId, ready_cb, &context_), GATT_SUCCESS);
+
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(),
+                                value_.size(), false),
+              GATT_SUCCESS);
+  }
+  std::vector<uint8_t> expected = {GATT_CMD_WRITE, 0x2a, 0x00,
+                                   0x01,           0x02, 0x03};
+  ASSERT_EQ(sent_pdus.size(), 3u);
+  for (const auto& pdu : sent_pdus) EXPECT_EQ(pdu, expected);
+
+  // Up to MTU - 3 octets
+  std::vector<uint8_t> large(kMtu - 3, 0xee);
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, large.data(), large.size(),
+                              false),
+            GATT_SUCCESS);
+  EXPECT_EQ(sent_pdus.back().size(), kMtu);
+  large.push_back(0xee);
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, large.data(), large.size(),
+                              false),
+            GATT_ILLEGAL_PARAMETER);
+  EXPECT_EQ(sent_pdus.size(), 4u);
+}
+
+TEST_F(GattStreamTest, test_signed_write) {
+  ASSERT_EQ(GATTC_StreamOpen(kConnId, ready_cb, &context_), GATT_SUCCESS);
+
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              true),
+            GATT_SUCCESS);
+  ASSERT_EQ(sent_pdus.size(), 1u);
+  std::vector<uint8_t> expected = {GATT_SIGN_CMD_WRITE, 0x2a, 0x00,
+                                   0x01,                0x02, 0x03};
+  expected.insert(expected.end(), GATT_AUTH_SIGN_LEN, 0x5a);
+  EXPECT_EQ(sent_pdus[0], expected);
+
+  // The signature takes 12 octets of the MTU
+  std::vector<uint8_t> large(kMtu - 3 - GATT_AUTH_SIGN_LEN + 1, 0xee);
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, large.data(), large.size(),
+                              true),
+            GATT_ILLEGAL_PARAMETER);
+
+  // Not signed on an encrypted link
+  link_encrypted = true;
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              true),
+            GATT_SUCCESS);
+  ASSERT_EQ(sent_pdus.size(), 2u);
+  expected = {GATT_CMD_WRITE, 0x2a, 0x00, 0x01, 0x02, 0x03};
+  EXPECT_EQ(sent_pdus[1], expected);
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, large.data(), large.size(),
+                              true),
+            GATT_SUCCESS);
+}
+
+TEST_F(GattStreamTest, test_congestion) {
+  ASSERT_EQ(GATTC_StreamOpen(kConnId, ready_cb, &context_), GATT_SUCCESS);
+
+  // The write congesting the channel is sent
+  l2cap_status = GATT_CONGESTED;
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              false),
+            GATT_CONGESTED);
+  EXPECT_EQ(sent_pdus.size(), 1u);
+
+  // The next ones are refused until the channel is no longer congested
+  l2cap_status = GATT_SUCCESS;
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(),
+                                value_.size(), false),
+              GATT_BUSY);
+  }
+  EXPECT_EQ(sent_pdus.size(), 1u);
+  EXPECT_TRUE(ready_calls.empty());
+
+  Uncongest();
+  ASSERT_EQ(ready_calls.size(), 1u);
+  EXPECT_EQ(ready_calls[0].conn_id, kConnId);
+  EXPECT_EQ(ready_calls[0].context, &context_);
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              false),
+            GATT_SUCCESS);
+  EXPECT_EQ(sent_pdus.size(), 2u);
+
+  // Not called again without a new congestion
+  Uncongest();
+  EXPECT_EQ(ready_calls.size(), 1u);
+}
+
+namespace {
+/* Writes until the channel is congested again */
+void write_until_congested(uint16_t conn_id, void* context) {
+  ready_calls.push_back({conn_id, context});
+  uint8_t value = 0;
+  l2cap_status = GATT_CONGESTED;
+  GATTC_StreamWrite(conn_id, kHandle, &value, 1, false);
+}
+}  // namespace
+
+TEST_F(GattStreamTest, test_congestion_resume_stops_when_congested) {
+  ASSERT_EQ(GATTC_StreamOpen(kConnId, write_until_congested, &context_),
+            GATT_SUCCESS);
+  ASSERT_EQ(GATTC_StreamOpen(kOtherConnId, write_until_congested, &context_),
+            GATT_SUCCESS);
+
+  l2cap_status = GATT_CONGESTED;
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              false),
+            GATT_CONGESTED);
+  EXPECT_EQ(GATTC_StreamWrite(kOtherConnId, kHandle, value_.data(),
+                              value_.size(), false),
+            GATT_BUSY);
+
+  // The first stream resumed congests the channel: the other keeps waiting
+  Uncongest();
+  ASSERT_EQ(ready_calls.size(), 1u);
+  uint16_t first = ready_calls[0].conn_id;
+
+  Uncongest();
+  ASSERT_EQ(ready_calls.size(), 2u);
+  EXPECT_NE(ready_calls[1].conn_id, first);
+}
+
+TEST_F(GattStreamTest, test_close) {
+  ASSERT_EQ(GATTC_StreamOpen(kConnId, ready_cb, &context_), GATT_SUCCESS);
+  l2cap_status = GATT_CONGESTED;
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              false),
+            GATT_CONGESTED);
+
+  GATTC_StreamClose(kConnId);
+  EXPECT_TRUE(gatt_cb.tcb[kTcbIdx].streams.empty());
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              false),
+            GATT_ILLEGAL_PARAMETER);
+
+  // A closed stream is not called back
+  Uncongest();
+  EXPECT_TRUE(ready_calls.empty());
+
+  // Closing twice is harmless
+  GATTC_StreamClose(kConnId);
+}
+
+TEST_F(GattStreamTest, test_deregister_closes_streams) {
+  ASSERT_EQ(GATTC_StreamOpen(kConnId, ready_cb, &context_), GATT_SUCCESS);
+  ASSERT_EQ(GATTC_StreamOpen(kOtherConnId, ready_cb, &context_),
+            GATT_SUCCESS);
+  l2cap_status = GATT_CONGESTED;
+  EXPECT_EQ(GATTC_StreamWrite(kConnId, kHandle, value_.data(), value_.size(),
+                              false),
+            GATT_CONGESTED);
+  EXPECT_EQ(GATTC_StreamWrite(kOtherConnId, kHandle, value_.data(),
+                              value_.size(), false),
+            GATT_BUSY);
+
+  // As GATT_Deregister()
+  gatt_stream_deregister(kGattIf);
+  EXPECT_EQ(gatt_cb.tcb[kTcbIdx].streams.count(kGattIf), 0u);
+
+  Uncongest();
+  ASSERT_EQ(ready_calls.size(), 1u);
+  EXPECT_EQ(ready_calls[0].conn_id, kOtherConnId);
+}
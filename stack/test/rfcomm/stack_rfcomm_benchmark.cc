@@ -0,0 +1,313 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "bt_types.h"
+#include "btm_api.h"
+#include "l2c_api.h"
+#include "osi/include/allocator.h"
+#include "port_api.h"
+
+#include "btm_int.h"
+#include "rfc_int.h"
+
+#include "mock_btm_layer.h"
+#include "mock_l2cap_layer.h"
+#include "stack_rfcomm_test_utils.h"
+#include "stack_test_packet_utils.h"
+
+// Throughput of the RFCOMM data path between a socket and the stack, over a
+// loopback L2CAP layer: the frames sent are dropped as soon as L2CAP gets
+// them, and the frames received are generated as the peer would send them.
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+using testing::_;
+using testing::DoAll;
+using testing::Invoke;
+using testing::NiceMock;
+using testing::Return;
+using testing::SaveArg;
+using testing::SaveArgPointee;
+
+using bluetooth::AllocateWrappedIncomingL2capAclPacket;
+using bluetooth::rfcomm::CreateQuickDataPacket;
+using bluetooth::rfcomm::CreateQuickMscPacket;
+using bluetooth::rfcomm::CreateQuickPnPacket;
+using bluetooth::rfcomm::CreateQuickSabmPacket;
+using bluetooth::rfcomm::GetDlci;
+
+constexpr uint16_t kAclHandle = 0x0009;
+constexpr uint16_t kLcid = 0x0054;
+constexpr uint8_t kScn = 8;
+constexpr uint16_t kMtu = 1600;
+constexpr int kFrames = 8;
+constexpr int kMaxBufs = 16;
+
+void port_cback(uint32_t code, uint16_t port_handle) {}
+
+// Stands for the socket layer: reads the data to send from |app_fd|
+int port_data_co_cback(uint16_t port_handle, uint8_t* p_buf, uint16_t len,
+                       int type);
+
+// A server port connected to a peer over the loopback L2CAP layer
+class LoopbackConnection {
+ public:
+  LoopbackConnection() {
+    bluetooth::manager::SetMockSecurityInternalInterface(&btm_interface_);
+    bluetooth::l2cap::SetMockInterface(&l2cap_interface_);
+    ON_CALL(l2cap_interface_, Register(BT_PSM_RFCOMM, _))
+        .WillByDefault(
+            DoAll(SaveArgPointee<1>(&l2cap_appl_info_), Return(BT_PSM_RFCOMM)));
+    ON_CALL(l2cap_interface_, ConfigRequest(_, _)).WillByDefault(Return(true));
+    ON_CALL(l2cap_interface_, ConfigResponse(_, _))
+        .WillByDefault(Return(true));
+    ON_CALL(l2cap_interface_, DataWrite(_, _))
+        .WillByDefault(Invoke([this](uint16_t cid, BT_HDR* p_data) {
+          frames_sent_++;
+          osi_free(p_data);
+          return L2CAP_DW_SUCCESS;
+        }));
+    tBTM_SEC_CALLBACK* security_callback = nullptr;
+    void* p_port = nullptr;
+    ON_CALL(btm_interface_,
+            MultiplexingProtocolAccessRequest(_, _, _, _, _, _, _))
+        .WillByDefault(DoAll(SaveArg<5>(&security_callback),
+                             SaveArg<6>(&p_port), Return(BTM_SUCCESS)));
+    RFCOMM_Init();
+
+    RFCOMM_CreateConnection(0x1112, kScn, true, kMtu, RawAddress::kAny,
+                            &handle_, port_cback);
+    PORT_SetEventMask(handle_, PORT_EV_RXCHAR);
+    PORT_SetEventCallback(handle_, port_cback);
+
+    // Same steps as StackRfcommTest::ConnectServerL2cap/ConnectServerPort
+    tL2CAP_CFG_INFO cfg = {.mtu_present = true, .mtu = L2CAP_MTU_SIZE};
+    l2cap_appl_info_.pL2CA_ConnectInd_Cb(peer_addr_, kLcid, BT_PSM_RFCOMM, 7);
+    l2cap_appl_info_.pL2CA_ConfigCfm_Cb(kLcid, &cfg);
+    l2cap_appl_info_.pL2CA_ConfigInd_Cb(kLcid, &cfg);
+    Receive(CreateQuickSabmPacket(RFCOMM_MX_DLCI, kLcid, kAclHandle));
+    Receive(CreateQuickPnPacket(true, Dlci(), true, kMtu,
+                                RFCOMM_PN_CONV_LAYER_CBFC_I >> 4, 0,
+                                RFCOMM_K_MAX, kLcid, kAclHandle));
+    Receive(CreateQuickSabmPacket(Dlci(), kLcid, kAclHandle));
+    security_callback(&peer_addr_, BT_TRANSPORT_BR_EDR, p_port, BTM_SUCCESS);
+    Receive(CreateQuickMscPacket(true, Dlci(), kLcid, kAclHandle, true, false,
+                                 true, true, false, true));
+    Receive(CreateQuickMscPacket(true, Dlci(), kLcid, kAclHandle, false, false,
+                                 true, true, false, true));
+
+    int fds[2];
+    socketpair(AF_LOCAL, SOCK_STREAM, 0, fds);
+    stack_fd_ = fds[0];
+    app_fd_ = fds[1];
+    int size = 1024 * 1024;
+    setsockopt(stack_fd_, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(app_fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    data_.assign(kFrames * kMtu, 'x');
+    credit_frame_ = CreateQuickDataPacket(Dlci(), true, kLcid, kAclHandle,
+                                          kFrames, std::vector<uint8_t>());
+    data_frame_ = CreateQuickDataPacket(
+        Dlci(), true, kLcid, kAclHandle, 0,
+        std::vector<uint8_t>(data_.begin(), data_.begin() + kMtu));
+  }
+
+  ~LoopbackConnection() {
+    close(stack_fd_);
+    close(app_fd_);
+    bluetooth::l2cap::SetMockInterface(nullptr);
+    bluetooth::manager::SetMockSecurityInternalInterface(nullptr);
+  }
+
+  uint8_t Dlci() const { return GetDlci(false, kScn); }
+  uint16_t handle() const { return handle_; }
+  int stack_fd() const { return stack_fd_; }
+  int app_fd() const { return app_fd_; }
+  const std::vector<char>& data() const { return data_; }
+  size_t frames_sent() const { return frames_sent_; }
+
+  void Receive(const std::vector<uint8_t>& packet) {
+    l2cap_appl_info_.pL2CA_DataInd_Cb(
+        kLcid, AllocateWrappedIncomingL2capAclPacket(packet));
+  }
+
+  // The peer sends |kFrames| frames of |kMtu| bytes
+  void ReceiveFrames() {
+    for (int i = 0; i < kFrames; i++) Receive(data_frame_);
+  }
+
+  // The peer grants credits for the |kFrames| frames sent
+  void GrantCredits() { Receive(credit_frame_); }
+
+  // The app writes |kFrames| frames worth of data to the socket
+  void AppWrite() {
+    ssize_t ret = write(app_fd_, data_.data(), data_.size());
+    benchmark::DoNotOptimize(ret);
+  }
+
+  // The app reads what the socket layer sent
+  void AppRead() {
+    std::vector<char> buf(data_.size());
+    size_t total = 0;
+    while (total < data_.size()) {
+      ssize_t ret = read(app_fd_, buf.data(), buf.size() - total);
+      if (ret <= 0) break;
+      total += ret;
+    }
+  }
+
+ private:
+  NiceMock<bluetooth::manager::MockBtmSecurityInternalInterface>
+      btm_interface_;
+  NiceMock<bluetooth::l2cap::MockL2capInterface> l2cap_interface_;
+  tL2CAP_APPL_INFO l2cap_appl_info_;
+  RawAddress peer_addr_ = {{0xAA, 0x00, 0x11, 0x22, 0x33, 0x00}};
+  uint16_t handle_ = 0;
+  size_t frames_sent_ = 0;
+  int stack_fd_ = -1;
+  int app_fd_ = -1;
+  std::vector<char> data_;
+  std::vector<uint8_t> credit_frame_;
+  std::vector<uint8_t> data_frame_;
+};
+
+LoopbackConnection* connection = nullptr;
+
+int port_data_co_cback(uint16_t port_handle, uint8_t* p_buf, uint16_t len,
+                       int type) {
+  int fd = connection->stack_fd();
+  switch (type) {
+    case DATA_CO_CALLBACK_TYPE_OUTGOING_SIZE:
+      return ioctl(fd, FIONREAD, (int*)p_buf) == 0;
+    case DATA_CO_CALLBACK_TYPE_OUTGOING:
+      return recv(fd, p_buf, len, 0) == len;
+    case DATA_CO_CALLBACK_TYPE_OUTGOING_BUFS: {
+      BT_HDR** pp_bufs = (BT_HDR**)p_buf;
+      struct iovec iov[kMaxBufs];
+      size_t size = 0;
+      for (uint16_t i = 0; i < len; i++) {
+        iov[i].iov_base = pp_bufs[i]->data + pp_bufs[i]->offset;
+        iov[i].iov_len = pp_bufs[i]->len;
+        size += pp_bufs[i]->len;
+      }
+      return readv(fd, iov, len) == (ssize_t)size;
+    }
+  }
+  return 0;
+}
+
+// App to peer, with one recv and one write to the port per buffer, as
+// PORT_WriteDataCO() used to
+void BM_SocketToPortPerBuffer(benchmark::State& state) {
+  LoopbackConnection conn;
+  for (auto _ : state) {
+    conn.AppWrite();
+    int available = 0;
+    ioctl(conn.stack_fd(), FIONREAD, &available);
+    while (available > 0) {
+      BT_HDR* p_buf = (BT_HDR*)osi_malloc(RFCOMM_DATA_BUF_SIZE);
+      p_buf->offset = L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET;
+      p_buf->len = (available < kMtu) ? available : kMtu;
+      p_buf->layer_specific = conn.handle();
+      p_buf->event = BT_EVT_TO_BTU_SP_DATA;
+      available -= p_buf->len;
+      recv(conn.stack_fd(), p_buf->data + p_buf->offset, p_buf->len, 0);
+      PORT_Write(conn.handle(), p_buf);
+    }
+    conn.GrantCredits();
+  }
+  state.counters["frames"] =
+      benchmark::Counter(conn.frames_sent(), benchmark::Counter::kAvgIterations);
+  state.SetBytesProcessed(state.iterations() * conn.data().size());
+}
+BENCHMARK(BM_SocketToPortPerBuffer);
+
+// App to peer, read straight into the stack buffers with one readv
+void BM_SocketToPortBatched(benchmark::State& state) {
+  LoopbackConnection conn;
+  connection = &conn;
+  PORT_SetDataCOCallback(conn.handle(), port_data_co_cback);
+  for (auto _ : state) {
+    conn.AppWrite();
+    int written = 0;
+    PORT_WriteDataCO(conn.handle(), &written);
+    conn.GrantCredits();
+  }
+  connection = nullptr;
+  state.counters["frames"] =
+      benchmark::Counter(conn.frames_sent(), benchmark::Counter::kAvgIterations);
+  state.SetBytesProcessed(state.iterations() * conn.data().size());
+}
+BENCHMARK(BM_SocketToPortBatched);
+
+// Peer to app, copied out of the port and sent with one send per buffer
+void BM_PortToSocketPerBuffer(benchmark::State& state) {
+  LoopbackConnection conn;
+  for (auto _ : state) {
+    conn.ReceiveFrames();
+    char buf[kMtu];
+    uint16_t length = 0;
+    do {
+      PORT_ReadData(conn.handle(), buf, sizeof(buf), &length);
+      if (length) send(conn.stack_fd(), buf, length, MSG_DONTWAIT);
+    } while (length);
+    conn.AppRead();
+  }
+  state.SetBytesProcessed(state.iterations() * conn.data().size());
+}
+BENCHMARK(BM_PortToSocketPerBuffer);
+
+// Peer to app, the port buffers sent as they are with one sendmsg
+void BM_PortToSocketBatched(benchmark::State& state) {
+  LoopbackConnection conn;
+  for (auto _ : state) {
+    conn.ReceiveFrames();
+    BT_HDR* bufs[kMaxBufs];
+    uint16_t count = 0;
+    PORT_ReadBuffers(conn.handle(), bufs, kMaxBufs, &count);
+    struct iovec iov[kMaxBufs];
+    for (uint16_t i = 0; i < count; i++) {
+      iov[i].iov_base = bufs[i]->data + bufs[i]->offset;
+      iov[i].iov_len = bufs[i]->len;
+    }
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    sendmsg(conn.stack_fd(), &msg, MSG_DONTWAIT);
+    for (uint16_t i = 0; i < count; i++) osi_free(bufs[i]);
+    conn.AppRead();
+  }
+  state.SetBytesProcessed(state.iterations() * conn.data().size());
+}
+BENCHMARK(BM_PortToSocketBatched);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -16,14 +16,21 @@
  *
  ******************************************************************************/
 
+#include <chrono>
+#include <future>
+
 #include <base/logging.h>
+#include <base/threading/thread.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <hardware/bluetooth.h>
 
 #include "bt_types.h"
 #include "btm_api.h"
 #include "l2c_api.h"
 #include "osi/include/osi.h"
+#include "osi/include/time.h"
+#include "osi/include/wakelock.h"
 #include "port_api.h"
 
 #include "btm_int.h"
@@ -59,10 +66,25 @@ void PrintTo(tL2CAP_CFG_INFO* value, ::std::ostream* os) {
   *os << DumpByteBufferToString((uint8_t*)value, sizeof(tL2CAP_CFG_INFO));
 }
 
+extern base::MessageLoop* mock_btu_message_loop;
+
+// The credit window follows the consumer rate and the credit round trip, so
+// the clock is advanced by the tests
+static uint64_t fake_boottime_us = 10000000;
+
+uint32_t time_get_os_boottime_ms(void) {
+  return (uint32_t)(fake_boottime_us / 1000);
+}
+
+uint64_t time_get_os_boottime_us(void) { return fake_boottime_us; }
+
+uint64_t time_gettimeofday_us(void) { return fake_boottime_us; }
+
 namespace {
 
 using testing::_;
 using testing::DoAll;
+using testing::InvokeWithoutArgs;
 using testing::Return;
 using testing::Test;
 using testing::StrictMock;
@@ -121,6 +143,23 @@ void port_event_cback_1(uint32_t code, uint16_t port_handle) {
   rfcomm_callback->PortEventCallback(code, port_handle, 1);
 }
 
+int acquire_wake_lock_cb(const char* lock_name) { return BT_STATUS_SUCCESS; }
+
+int release_wake_lock_cb(const char* lock_name) { return BT_STATUS_SUCCESS; }
+
+bt_os_callouts_t wakelock_callouts = {sizeof(bt_os_callouts_t), nullptr,
+                                      acquire_wake_lock_cb,
+                                      release_wake_lock_cb};
+
+bool rx_push_back = false;
+
+int port_data_co_cback(uint16_t port_handle, uint8_t* p_buf, uint16_t len,
+                       int type) {
+  if (type != DATA_CO_CALLBACK_TYPE_INCOMING) return false;
+  osi_free(p_buf);
+  return !rx_push_back;
+}
+
 RawAddress GetTestAddress(int index) {
   CHECK_LT(index, UINT8_MAX);
   RawAddress result = {
@@ -889,4 +928,494 @@ TEST_F(StackRfcommTest, TestConnectionCollision) {
   l2cap_appl_info_.pL2CA_DataInd_Cb(new_lcid, uih_msc_rsp_from_peer);
 }
 
+TEST_F(StackRfcommTest, ReadBuffersWithoutCopy) {
+  static const uint16_t acl_handle = 0x0009;
+  static const uint16_t lcid = 0x0054;
+  static const uint16_t test_uuid = 0x1112;
+  static const uint8_t test_scn = 8;
+  static const uint16_t test_mtu = 1600;
+  static const RawAddress test_address = GetTestAddress(0);
+  uint16_t server_handle = 0;
+  ASSERT_NO_FATAL_FAILURE(StartServerPort(test_uuid, test_scn, test_mtu,
+                                          port_mgmt_cback_0, port_event_cback_0,
+                                          &server_handle));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerL2cap(test_address, acl_handle, lcid));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerPort(
+      test_address, server_handle, test_scn, test_mtu, acl_handle, lcid, 0));
+
+  VLOG(1) << "Step 1";
+  // Peer sends three frames, queued in the port
+  const std::string messages[] = {"Hello", "World", "!\r"};
+  EXPECT_CALL(rfcomm_callback_, PortEventCallback(_, server_handle, 0))
+      .Times(3);
+  for (const std::string& message : messages) {
+    l2cap_appl_info_.pL2CA_DataInd_Cb(
+        lcid, AllocateWrappedIncomingL2capAclPacket(CreateQuickDataPacket(
+                  GetDlci(false, test_scn), true, lcid, acl_handle, 0,
+                  message)));
+  }
+
+  VLOG(1) << "Step 2";
+  // The received buffers are handed out in order
+  BT_HDR* bufs[8] = {};
+  uint16_t count = 0;
+  ASSERT_EQ(PORT_ReadBuffers(server_handle, bufs, 2, &count), PORT_SUCCESS);
+  ASSERT_EQ(count, 2);
+  for (int i = 0; i < 2; i++) {
+    EXPECT_EQ(std::string((char*)bufs[i]->data + bufs[i]->offset, bufs[i]->len),
+              messages[i]);
+    osi_free(bufs[i]);
+  }
+
+  VLOG(1) << "Step 3";
+  // Credits are given back once the low watermark is reached
+  BT_HDR* credit_packet = AllocateWrappedOutgoingL2capAclPacket(
+      CreateQuickDataPacket(GetDlci(false, test_scn), false, lcid, acl_handle,
+                            6, ""));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(credit_packet)))
+      .WillOnce(Return(L2CAP_DW_SUCCESS));
+  ASSERT_EQ(PORT_ReadBuffers(server_handle, bufs, 8, &count), PORT_SUCCESS);
+  ASSERT_EQ(count, 1);
+  EXPECT_EQ(std::string((char*)bufs[0]->data + bufs[0]->offset, bufs[0]->len),
+            messages[2]);
+  osi_free(bufs[0]);
+  osi_free(credit_packet);
+
+  ASSERT_EQ(PORT_ReadBuffers(server_handle, bufs, 8, &count), PORT_SUCCESS);
+  EXPECT_EQ(count, 0);
+}
+
+TEST_F(StackRfcommTest, WriteBuffersWithoutCopy) {
+  static const uint16_t acl_handle = 0x0009;
+  static const uint16_t lcid = 0x0054;
+  static const uint16_t test_uuid = 0x1112;
+  static const uint8_t test_scn = 8;
+  static const uint16_t test_mtu = 1600;
+  static const RawAddress test_address = GetTestAddress(0);
+  uint16_t server_handle = 0;
+  ASSERT_NO_FATAL_FAILURE(StartServerPort(test_uuid, test_scn, test_mtu,
+                                          port_mgmt_cback_0, port_event_cback_0,
+                                          &server_handle));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerL2cap(test_address, acl_handle, lcid));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerPort(
+      test_address, server_handle, test_scn, test_mtu, acl_handle, lcid, 0));
+
+  VLOG(1) << "Step 1";
+  // Buffers are allocated up to the peer MTU, and below the high watermarks
+  BT_HDR* bufs[32] = {};
+  uint16_t count = 0;
+  ASSERT_EQ(PORT_AllocWriteBuffers(server_handle, 3000, bufs, 32, &count),
+            PORT_SUCCESS);
+  ASSERT_GT(count, 1);
+  EXPECT_LE(bufs[0]->len, test_mtu);
+  uint16_t total = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    if (i < count - 1) EXPECT_EQ(bufs[i]->len, bufs[0]->len);
+    total += bufs[i]->len;
+  }
+  EXPECT_EQ(total, 3000);
+  for (uint16_t i = 0; i < count; i++) osi_free(bufs[i]);
+  ASSERT_EQ(PORT_AllocWriteBuffers(server_handle, 0xFFFF, bufs, 32, &count),
+            PORT_SUCCESS);
+  EXPECT_EQ(count, PORT_TX_BUF_HIGH_WM + 1);
+  for (uint16_t i = 0; i < count; i++) osi_free(bufs[i]);
+
+  VLOG(1) << "Step 2";
+  // The data written in the buffers is sent without copy, one frame each
+  const std::string messages[] = {"\r!dlroW", " olleH"};
+  ASSERT_EQ(PORT_AllocWriteBuffers(server_handle, 3000, bufs, 2, &count),
+            PORT_SUCCESS);
+  ASSERT_EQ(count, 2);
+  BT_HDR* data_packets[2];
+  for (int i = 0; i < 2; i++) {
+    memcpy(bufs[i]->data + bufs[i]->offset, messages[i].data(),
+           messages[i].size());
+    bufs[i]->len = messages[i].size();
+    // Credits for the peer are sent with the first frame
+    data_packets[i] = AllocateWrappedOutgoingL2capAclPacket(
+        CreateQuickDataPacket(GetDlci(false, test_scn), false, lcid,
+                              acl_handle, i == 0 ? 3 : 0, messages[i]));
+    EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(data_packets[i])))
+        .WillOnce(Return(L2CAP_DW_SUCCESS));
+  }
+  uint16_t written = 0;
+  ASSERT_EQ(PORT_WriteBuffers(server_handle, bufs, count, &written),
+            PORT_SUCCESS);
+  EXPECT_EQ(written, 2);
+  osi_free(data_packets[0]);
+  osi_free(data_packets[1]);
+
+  VLOG(1) << "Step 3";
+  // A buffer without room for the headers is rejected
+  BT_HDR* bad_buf = (BT_HDR*)osi_calloc(sizeof(BT_HDR) + 16);
+  bad_buf->len = 16;
+  ASSERT_EQ(PORT_WriteBuffers(server_handle, &bad_buf, 1, &written),
+            PORT_UNKNOWN_ERROR);
+  EXPECT_EQ(written, 0);
+
+  VLOG(1) << "Step 4";
+  // A buffer with more data than an RFCOMM_DATA_BUF_SIZE buffer holds is
+  // rejected, since later writes may be appended to it
+  bad_buf = (BT_HDR*)osi_calloc(RFCOMM_DATA_BUF_SIZE);
+  bad_buf->offset = RFCOMM_DATA_BUF_SIZE - sizeof(BT_HDR) - 16;
+  bad_buf->len = 16;
+  ASSERT_EQ(PORT_WriteBuffers(server_handle, &bad_buf, 1, &written),
+            PORT_UNKNOWN_ERROR);
+  EXPECT_EQ(written, 0);
+}
+
+TEST_F(StackRfcommTest, CreditStatistics) {
+  static const uint16_t acl_handle = 0x0009;
+  static const uint16_t lcid = 0x0054;
+  static const uint16_t test_uuid = 0x1112;
+  static const uint8_t test_scn = 8;
+  static const uint16_t test_mtu = 1600;
+  static const RawAddress test_address = GetTestAddress(0);
+  uint16_t server_handle = 0;
+  ASSERT_NO_FATAL_FAILURE(StartServerPort(test_uuid, test_scn, test_mtu,
+                                          port_mgmt_cback_0, port_event_cback_0,
+                                          &server_handle));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerL2cap(test_address, acl_handle, lcid));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerPort(
+      test_address, server_handle, test_scn, test_mtu, acl_handle, lcid, 0));
+
+  VLOG(1) << "Step 1";
+  // Peer sends a frame for each of its initial credits
+  const std::string message = "Hello";
+  EXPECT_CALL(rfcomm_callback_, PortEventCallback(_, server_handle, 0))
+      .Times(RFCOMM_K_MAX);
+  for (int i = 0; i < RFCOMM_K_MAX; i++) {
+    l2cap_appl_info_.pL2CA_DataInd_Cb(
+        lcid, AllocateWrappedIncomingL2capAclPacket(CreateQuickDataPacket(
+                  GetDlci(false, test_scn), true, lcid, acl_handle, 0,
+                  message)));
+  }
+  tPORT_STATS stats;
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.rx_frames, (uint32_t)RFCOMM_K_MAX);
+  EXPECT_EQ(stats.rx_bytes, RFCOMM_K_MAX * message.size());
+  EXPECT_EQ(stats.rx_credit_stalls, 1u);
+  EXPECT_EQ(stats.credits_granted, 0u);
+
+  VLOG(1) << "Step 2";
+  // The data kept in the receive queue limits the credits to its watermark,
+  // granted in a single frame
+  BT_HDR* credit_packet = AllocateWrappedOutgoingL2capAclPacket(
+      CreateQuickDataPacket(GetDlci(false, test_scn), false, lcid, acl_handle,
+                            PORT_RX_BUF_HIGH_WM, ""));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(credit_packet)))
+      .WillOnce(Return(L2CAP_DW_SUCCESS));
+  BT_HDR* bufs[RFCOMM_K_MAX] = {};
+  uint16_t count = 0;
+  ASSERT_EQ(PORT_ReadBuffers(server_handle, bufs, RFCOMM_K_MAX, &count),
+            PORT_SUCCESS);
+  ASSERT_EQ(count, RFCOMM_K_MAX);
+  for (BT_HDR* buf : bufs) osi_free(buf);
+  osi_free(credit_packet);
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.credits_granted, (uint32_t)PORT_RX_BUF_HIGH_WM);
+  EXPECT_EQ(stats.credit_frames, 1u);
+  EXPECT_EQ(stats.credit_window, PORT_RX_BUF_HIGH_WM);
+
+  VLOG(1) << "Step 3";
+  // Data beyond the credits of the peer waits for more
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, _))
+      .Times(RFCOMM_K_MAX)
+      .WillRepeatedly(Return(L2CAP_DW_SUCCESS));
+  for (int i = 0; i <= RFCOMM_K_MAX; i++) {
+    uint16_t len = 0;
+    PORT_WriteData(server_handle, message.data(), message.size(), &len);
+    EXPECT_EQ(len, message.size());
+  }
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.tx_frames, (uint32_t)RFCOMM_K_MAX);
+  EXPECT_EQ(stats.tx_credit_stalls, 1u);
+
+  VLOG(1) << "Step 4";
+  // The credit of the peer sends the data left
+  BT_HDR* data_packet = AllocateWrappedOutgoingL2capAclPacket(
+      CreateQuickDataPacket(GetDlci(false, test_scn), false, lcid, acl_handle,
+                            0, message));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(data_packet)))
+      .WillOnce(Return(L2CAP_DW_SUCCESS));
+  l2cap_appl_info_.pL2CA_DataInd_Cb(
+      lcid, AllocateWrappedIncomingL2capAclPacket(CreateQuickDataPacket(
+                GetDlci(false, test_scn), true, lcid, acl_handle, 1, "")));
+  osi_free(data_packet);
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.tx_frames, RFCOMM_K_MAX + 1u);
+  EXPECT_EQ(stats.tx_bytes, (RFCOMM_K_MAX + 1) * message.size());
+  EXPECT_EQ(stats.tx_credit_stalls, 1u);
+}
+
+TEST_F(StackRfcommTest, AdaptiveCreditWindow) {
+  static const uint16_t acl_handle = 0x0009;
+  static const uint16_t lcid = 0x0054;
+  static const uint16_t test_uuid = 0x1112;
+  static const uint8_t test_scn = 8;
+  static const uint16_t test_mtu = 1600;
+  static const RawAddress test_address = GetTestAddress(0);
+  uint16_t server_handle = 0;
+  ASSERT_NO_FATAL_FAILURE(StartServerPort(test_uuid, test_scn, test_mtu,
+                                          port_mgmt_cback_0, port_event_cback_0,
+                                          &server_handle));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerL2cap(test_address, acl_handle, lcid));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerPort(
+      test_address, server_handle, test_scn, test_mtu, acl_handle, lcid, 0));
+  ASSERT_EQ(PORT_SetDataCOCallback(server_handle, port_data_co_cback),
+            PORT_SUCCESS);
+
+  VLOG(1) << "Step 1";
+  // Until the consumer rate is known, credits are granted in batches of the
+  // receive queue watermarks. Peer sends a frame every 2 ms.
+  const std::string message = "Hello";
+  BT_HDR* credit_packet = AllocateWrappedOutgoingL2capAclPacket(
+      CreateQuickDataPacket(GetDlci(false, test_scn), false, lcid, acl_handle,
+                            PORT_RX_BUF_HIGH_WM - PORT_RX_BUF_LOW_WM, ""));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(credit_packet)))
+      .WillOnce(Return(L2CAP_DW_SUCCESS));
+  for (int i = 0; i < RFCOMM_K_MAX - PORT_RX_BUF_LOW_WM; i++) {
+    fake_boottime_us += 2000;
+    l2cap_appl_info_.pL2CA_DataInd_Cb(
+        lcid, AllocateWrappedIncomingL2capAclPacket(CreateQuickDataPacket(
+                  GetDlci(false, test_scn), true, lcid, acl_handle, 0,
+                  message)));
+  }
+  osi_free(credit_packet);
+  tPORT_STATS stats;
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.credit_window, PORT_RX_BUF_HIGH_WM);
+
+  VLOG(1) << "Step 2";
+  // Peer uses all its credits while the user holds the flow
+  ASSERT_EQ(PORT_FlowControl(server_handle, false), PORT_SUCCESS);
+  for (int i = 0; i < PORT_RX_BUF_HIGH_WM; i++) {
+    fake_boottime_us += 2000;
+    l2cap_appl_info_.pL2CA_DataInd_Cb(
+        lcid, AllocateWrappedIncomingL2capAclPacket(CreateQuickDataPacket(
+                  GetDlci(false, test_scn), true, lcid, acl_handle, 0,
+                  message)));
+  }
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.rx_credit_stalls, 1u);
+
+  VLOG(1) << "Step 3";
+  // Releasing the flow measures the consumer rate and grants the window, and
+  // the next frame of the peer measures the credit round trip
+  credit_packet = AllocateWrappedOutgoingL2capAclPacket(
+      CreateQuickDataPacket(GetDlci(false, test_scn), false, lcid, acl_handle,
+                            PORT_RX_BUF_HIGH_WM, ""));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(credit_packet)))
+      .WillOnce(Return(L2CAP_DW_SUCCESS));
+  ASSERT_EQ(PORT_FlowControl(server_handle, true), PORT_SUCCESS);
+  osi_free(credit_packet);
+  fake_boottime_us += 50000;
+  l2cap_appl_info_.pL2CA_DataInd_Cb(
+      lcid, AllocateWrappedIncomingL2capAclPacket(CreateQuickDataPacket(
+                GetDlci(false, test_scn), true, lcid, acl_handle, 0, message)));
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.credit_rate, 500u);
+  EXPECT_EQ(stats.credit_rtt_ms, 50u);
+  EXPECT_EQ(stats.credit_window, PORT_RX_BUF_HIGH_WM);
+
+  VLOG(1) << "Step 4";
+  // The window grows to the frames consumed over two round trips, up to its
+  // limit
+  credit_packet = AllocateWrappedOutgoingL2capAclPacket(
+      CreateQuickDataPacket(GetDlci(false, test_scn), false, lcid, acl_handle,
+                            PORT_RX_BUF_CREDIT_MAX - PORT_RX_BUF_LOW_WM, ""));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(credit_packet)))
+      .WillOnce(Return(L2CAP_DW_SUCCESS));
+  for (int i = 1; i < PORT_RX_BUF_HIGH_WM - PORT_RX_BUF_LOW_WM; i++) {
+    fake_boottime_us += 2000;
+    l2cap_appl_info_.pL2CA_DataInd_Cb(
+        lcid, AllocateWrappedIncomingL2capAclPacket(CreateQuickDataPacket(
+                  GetDlci(false, test_scn), true, lcid, acl_handle, 0,
+                  message)));
+  }
+  osi_free(credit_packet);
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.credit_window, PORT_RX_BUF_CREDIT_MAX);
+
+  VLOG(1) << "Step 5";
+  // Credits are then granted once half of the window is used
+  for (int i = 1; i < PORT_RX_BUF_CREDIT_MAX / 2; i++) {
+    fake_boottime_us += 2000;
+    l2cap_appl_info_.pL2CA_DataInd_Cb(
+        lcid, AllocateWrappedIncomingL2capAclPacket(CreateQuickDataPacket(
+                  GetDlci(false, test_scn), true, lcid, acl_handle, 0,
+                  message)));
+  }
+  credit_packet = AllocateWrappedOutgoingL2capAclPacket(
+      CreateQuickDataPacket(GetDlci(false, test_scn), false, lcid, acl_handle,
+                            PORT_RX_BUF_CREDIT_MAX / 2, ""));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(credit_packet)))
+      .WillOnce(Return(L2CAP_DW_SUCCESS));
+  fake_boottime_us += 2000;
+  l2cap_appl_info_.pL2CA_DataInd_Cb(
+      lcid, AllocateWrappedIncomingL2capAclPacket(CreateQuickDataPacket(
+                GetDlci(false, test_scn), true, lcid, acl_handle, 0, message)));
+  osi_free(credit_packet);
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.credit_window, PORT_RX_BUF_CREDIT_MAX);
+
+  VLOG(1) << "Step 6";
+  // Push-back of the data callback halves the window, down to the receive
+  // queue watermark
+  rx_push_back = true;
+  const uint16_t windows[] = {PORT_RX_BUF_CREDIT_MAX / 2,
+                              PORT_RX_BUF_CREDIT_MAX / 4, PORT_RX_BUF_HIGH_WM};
+  for (uint16_t window : windows) {
+    fake_boottime_us += 2000;
+    l2cap_appl_info_.pL2CA_DataInd_Cb(
+        lcid, AllocateWrappedIncomingL2capAclPacket(CreateQuickDataPacket(
+                  GetDlci(false, test_scn), true, lcid, acl_handle, 0,
+                  message)));
+    ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+    EXPECT_EQ(stats.credit_window, window);
+  }
+  rx_push_back = false;
+}
+
+TEST_F(StackRfcommTest, TxAggregation) {
+  static const uint16_t acl_handle = 0x0009;
+  static const uint16_t lcid = 0x0054;
+  static const uint16_t test_uuid = 0x1112;
+  static const uint8_t test_scn = 8;
+  static const uint16_t test_mtu = 1600;
+  static const RawAddress test_address = GetTestAddress(0);
+  uint16_t server_handle = 0;
+  ASSERT_NO_FATAL_FAILURE(StartServerPort(test_uuid, test_scn, test_mtu,
+                                          port_mgmt_cback_0, port_event_cback_0,
+                                          &server_handle));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerL2cap(test_address, acl_handle, lcid));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerPort(
+      test_address, server_handle, test_scn, test_mtu, acl_handle, lcid, 0));
+
+  VLOG(1) << "Step 1";
+  // Small writes are held, well within the delay
+  const std::string message = "Hello";
+  ASSERT_EQ(PORT_SetTxAggregation(server_handle, 60000), PORT_SUCCESS);
+  for (int i = 0; i < 3; i++) {
+    uint16_t len = 0;
+    PORT_WriteData(server_handle, message.data(), message.size(), &len);
+    EXPECT_EQ(len, message.size());
+  }
+  tPORT_STATS stats;
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.tx_writes, 3u);
+  EXPECT_EQ(stats.tx_frames, 0u);
+
+  VLOG(1) << "Step 2";
+  // Disabling the aggregation sends the writes held in a single frame
+  BT_HDR* data_packet = AllocateWrappedOutgoingL2capAclPacket(
+      CreateQuickDataPacket(GetDlci(false, test_scn), false, lcid, acl_handle,
+                            3, message + message + message));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(data_packet)))
+      .WillOnce(Return(L2CAP_DW_SUCCESS));
+  ASSERT_EQ(PORT_SetTxAggregation(server_handle, 0), PORT_SUCCESS);
+  osi_free(data_packet);
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.tx_frames, 1u);
+  EXPECT_EQ(stats.tx_bytes, 3 * message.size());
+
+  VLOG(1) << "Step 3";
+  // Writes filling a frame of the peer MTU are sent without waiting for the
+  // delay
+  BT_HDR* buf = nullptr;
+  uint16_t count = 0;
+  ASSERT_EQ(PORT_AllocWriteBuffers(server_handle, 0xFFFF, &buf, 1, &count),
+            PORT_SUCCESS);
+  ASSERT_EQ(count, 1);
+  const std::string rest(buf->len - message.size(), 'a');
+  osi_free(buf);
+  ASSERT_EQ(PORT_SetTxAggregation(server_handle, 60000), PORT_SUCCESS);
+  uint16_t len = 0;
+  PORT_WriteData(server_handle, message.data(), message.size(), &len);
+  data_packet = AllocateWrappedOutgoingL2capAclPacket(CreateQuickDataPacket(
+      GetDlci(false, test_scn), false, lcid, acl_handle, 0, message + rest));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(data_packet)))
+      .WillOnce(Return(L2CAP_DW_SUCCESS));
+  PORT_WriteData(server_handle, rest.data(), rest.size(), &len);
+  EXPECT_EQ(len, rest.size());
+  osi_free(data_packet);
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.tx_writes, 5u);
+  EXPECT_EQ(stats.tx_frames, 2u);
+
+  VLOG(1) << "Step 4";
+  // Writes are not appended to a buffer without room after its data, which
+  // is sent once the next write is queued
+  data_packet = AllocateWrappedOutgoingL2capAclPacket(CreateQuickDataPacket(
+      GetDlci(false, test_scn), false, lcid, acl_handle, 0, message));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(data_packet)))
+      .Times(2)
+      .WillRepeatedly(Return(L2CAP_DW_SUCCESS));
+  buf = (BT_HDR*)osi_malloc(RFCOMM_DATA_BUF_SIZE);
+  buf->offset = RFCOMM_DATA_BUF_SIZE - sizeof(BT_HDR) - message.size() - 1;
+  buf->len = message.size();
+  buf->layer_specific = server_handle;
+  buf->event = BT_EVT_TO_BTU_SP_DATA;
+  memcpy(buf->data + buf->offset, message.data(), message.size());
+  ASSERT_EQ(PORT_Write(server_handle, buf), PORT_SUCCESS);
+  PORT_WriteData(server_handle, message.data(), message.size(), &len);
+  EXPECT_EQ(len, message.size());
+  ASSERT_EQ(PORT_SetTxAggregation(server_handle, 0), PORT_SUCCESS);
+  osi_free(data_packet);
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.tx_writes, 7u);
+  EXPECT_EQ(stats.tx_frames, 4u);
+}
+
+TEST_F(StackRfcommTest, TxAggregationTimeout) {
+  static const uint16_t acl_handle = 0x0009;
+  static const uint16_t lcid = 0x0054;
+  static const uint16_t test_uuid = 0x1112;
+  static const uint8_t test_scn = 8;
+  static const uint16_t test_mtu = 1600;
+  static const RawAddress test_address = GetTestAddress(0);
+  uint16_t server_handle = 0;
+  ASSERT_NO_FATAL_FAILURE(StartServerPort(test_uuid, test_scn, test_mtu,
+                                          port_mgmt_cback_0, port_event_cback_0,
+                                          &server_handle));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerL2cap(test_address, acl_handle, lcid));
+  ASSERT_NO_FATAL_FAILURE(ConnectServerPort(
+      test_address, server_handle, test_scn, test_mtu, acl_handle, lcid, 0));
+
+  // The aggregation timer runs on the message loop of the stack
+  base::Thread thread("rfcomm_test_thread");
+  ASSERT_TRUE(thread.Start());
+  mock_btu_message_loop = thread.message_loop();
+  wakelock_set_os_callouts(&wakelock_callouts);
+
+  VLOG(1) << "Step 1";
+  // Small writes are held for the delay, then sent in a single frame
+  const std::string message = "Hello";
+  std::promise<void> sent;
+  BT_HDR* data_packet = AllocateWrappedOutgoingL2capAclPacket(
+      CreateQuickDataPacket(GetDlci(false, test_scn), false, lcid, acl_handle,
+                            3, message + message + message));
+  EXPECT_CALL(l2cap_interface_, DataWrite(lcid, BtHdrEqual(data_packet)))
+      .WillOnce(DoAll(InvokeWithoutArgs([&sent]() { sent.set_value(); }),
+                      Return(L2CAP_DW_SUCCESS)));
+  ASSERT_EQ(PORT_SetTxAggregation(server_handle, 100), PORT_SUCCESS);
+  for (int i = 0; i < 3; i++) {
+    uint16_t len = 0;
+    PORT_WriteData(server_handle, message.data(), message.size(), &len);
+    EXPECT_EQ(len, message.size());
+  }
+  EXPECT_EQ(sent.get_future().wait_for(std::chrono::seconds(2)),
+            std::future_status::ready);
+  osi_free(data_packet);
+  tPORT_STATS stats;
+  ASSERT_EQ(PORT_GetStats(server_handle, &stats), PORT_SUCCESS);
+  EXPECT_EQ(stats.tx_writes, 3u);
+  EXPECT_EQ(stats.tx_frames, 1u);
+  EXPECT_EQ(stats.tx_bytes, 3 * message.size());
+
+  thread.Stop();
+  mock_btu_message_loop = nullptr;
+  wakelock_set_os_callouts(nullptr);
+}
+
 }  // namespace
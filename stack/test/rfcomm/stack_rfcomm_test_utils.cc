@@ -116,12 +116,12 @@ std::vector<uint8_t> CreateRfcommPacket(uint8_t address, uint8_t control,
   result.push_back(address);
   result.push_back(control);
   size_t length = data.size();
-  if ((length & 0b1000000) != 0) {
+  if (length > 0b1111111) {
     // 15 bits of length in little endian order + EA(0)
     // Lower 7 bits + EA(0)
     result.push_back(static_cast<uint8_t>(length) << 1);
     // Upper 8 bits
-    result.push_back(static_cast<uint8_t>(length >> 8));
+    result.push_back(static_cast<uint8_t>(length >> 7));
   } else {
     // 7 bits of length + EA(1)
     result.push_back(static_cast<uint8_t>((length << 1) + 1));
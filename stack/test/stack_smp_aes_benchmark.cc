@@ -0,0 +1,149 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include <vector>
+
+#include "stack/include/smp_api.h"
+#include "stack/smp/aes.h"
+#include "stack/smp/smp_int.h"
+
+tSMP_CB smp_cb;
+
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+
+namespace {
+
+// Length of a signed write: handle, value, sign counter
+constexpr uint16_t kSignedWriteLen = 1 + 2 + 20 + 4;
+constexpr uint16_t kSignatureLen = 8;
+
+uint32_t next_random(uint32_t* seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed;
+}
+
+struct Block {
+  aes_context ctx;
+  uint8_t in[N_BLOCK];
+  uint8_t out[N_BLOCK];
+};
+
+// Deterministic pseudo-random keys and blocks, as for resolving an RPA
+// against |count| IRKs
+std::vector<Block> random_blocks(size_t count) {
+  std::vector<Block> blocks(count);
+  uint32_t seed = 0x2545f491;
+  for (Block& block : blocks) {
+    uint8_t key[N_BLOCK];
+    for (uint8_t& octet : key) octet = next_random(&seed);
+    for (uint8_t& octet : block.in) octet = next_random(&seed);
+    aes_set_key(key, sizeof(key), &block.ctx);
+  }
+  return blocks;
+}
+
+template <return_type (*Encrypt)(const unsigned char*, unsigned char*,
+                                 const aes_context*)>
+void BM_AesEncrypt(benchmark::State& state) {
+  if (Encrypt == aes_encrypt_ni && !aes_ni_supported()) {
+    state.SkipWithError("AES instructions not supported");
+    return;
+  }
+  std::vector<Block> blocks = random_blocks(state.range(0));
+  for (auto _ : state) {
+    for (Block& block : blocks) Encrypt(block.in, block.out, &block.ctx);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * blocks.size());
+  state.SetBytesProcessed(state.iterations() * blocks.size() * N_BLOCK);
+}
+BENCHMARK_TEMPLATE(BM_AesEncrypt, aes_encrypt_8bit)->Arg(64);
+BENCHMARK_TEMPLATE(BM_AesEncrypt, aes_encrypt_tables)->Arg(64);
+BENCHMARK_TEMPLATE(BM_AesEncrypt, aes_encrypt_ni)->Arg(64);
+
+void BM_AesEncryptBlocks(benchmark::State& state) {
+  std::vector<Block> blocks = random_blocks(state.range(0));
+  std::vector<const unsigned char*> in;
+  std::vector<unsigned char*> out;
+  std::vector<const aes_context*> ctx;
+  for (Block& block : blocks) {
+    in.push_back(block.in);
+    out.push_back(block.out);
+    ctx.push_back(&block.ctx);
+  }
+  for (auto _ : state) {
+    aes_encrypt_blocks(in.data(), out.data(), ctx.data(), blocks.size());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * blocks.size());
+  state.SetBytesProcessed(state.iterations() * blocks.size() * N_BLOCK);
+}
+BENCHMARK(BM_AesEncryptBlocks)->Arg(64);
+
+struct SignedWrite {
+  BT_OCTET16 csrk;
+  uint8_t data[kSignedWriteLen];
+  uint8_t signature[kSignatureLen];
+};
+
+// Signed writes from |count| peers, each with its own CSRK
+std::vector<SignedWrite> signed_writes(size_t count) {
+  std::vector<SignedWrite> writes(count);
+  uint32_t seed = 0x9e3779b9;
+  for (SignedWrite& write : writes) {
+    for (uint8_t& octet : write.csrk) octet = next_random(&seed);
+    for (uint8_t& octet : write.data) octet = next_random(&seed);
+  }
+  return writes;
+}
+
+// Signatures verified one at a time, as BTM_BleVerifySignature() does
+void BM_CmacSingle(benchmark::State& state) {
+  std::vector<SignedWrite> writes = signed_writes(state.range(0));
+  for (auto _ : state) {
+    for (SignedWrite& write : writes)
+      aes_cipher_msg_auth_code(write.csrk, write.data, sizeof(write.data),
+                               kSignatureLen, write.signature);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * writes.size());
+}
+BENCHMARK(BM_CmacSingle)->Arg(1)->Arg(8)->Arg(64);
+
+void BM_CmacMulti(benchmark::State& state) {
+  std::vector<SignedWrite> writes = signed_writes(state.range(0));
+  std::vector<tSMP_CMAC_MSG> msgs;
+  for (SignedWrite& write : writes)
+    msgs.push_back(
+        {write.csrk, write.data, sizeof(write.data), write.signature});
+  for (auto _ : state) {
+    aes_cipher_msg_auth_code_multi(msgs.data(), msgs.size(), kSignatureLen);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * writes.size());
+}
+BENCHMARK(BM_CmacMulti)->Arg(1)->Arg(8)->Arg(64);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,140 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+
+#include "stack/smp/p_256_ecc_pp.h"
+#include "stack/smp/smp_key_pool.h"
+
+namespace {
+void private_key(uint8_t seed, BT_OCTET32 key) {
+  for (size_t i = 0; i < BT_OCTET32_LEN; i++) key[i] = seed + i;
+}
+
+bool same_key_pair(const SmpKeyPool::KeyPair& a,
+                   const SmpKeyPool::KeyPair& b) {
+  return memcmp(&a, &b, sizeof(a)) == 0;
+}
+}  // namespace
+
+TEST(SmpKeyPoolTest, test_take_in_order) {
+  SmpKeyPool pool(2, 1);
+  SmpKeyPool::KeyPair key_pair;
+  EXPECT_FALSE(pool.Take(&key_pair));
+  EXPECT_EQ(pool.Misses(), 1u);
+
+  BT_OCTET32 first, second, third;
+  private_key(1, first);
+  private_key(2, second);
+  private_key(3, third);
+  EXPECT_TRUE(pool.Add(first));
+  EXPECT_TRUE(pool.Add(second));
+  EXPECT_FALSE(pool.Add(third));
+  EXPECT_EQ(pool.Size(), 2u);
+  EXPECT_EQ(pool.Generated(), 2u);
+
+  ASSERT_TRUE(pool.Take(&key_pair));
+  EXPECT_EQ(0, memcmp(key_pair.private_key, first, BT_OCTET32_LEN));
+  ASSERT_TRUE(pool.Take(&key_pair));
+  EXPECT_EQ(0, memcmp(key_pair.private_key, second, BT_OCTET32_LEN));
+  EXPECT_FALSE(pool.Take(&key_pair));
+  EXPECT_EQ(pool.Hits(), 2u);
+  EXPECT_EQ(pool.Misses(), 2u);
+}
+
+TEST(SmpKeyPoolTest, test_public_key) {
+  SmpKeyPool pool(1, 1);
+  BT_OCTET32 key;
+  private_key(7, key);
+  ASSERT_TRUE(pool.Add(key));
+
+  SmpKeyPool::KeyPair key_pair;
+  ASSERT_TRUE(pool.Take(&key_pair));
+
+  uint32_t scalar[KEY_LENGTH_DWORDS_P256];
+  memcpy(scalar, key, BT_OCTET32_LEN);
+  Point expected;
+  ECC_PointMult_Base(&expected, scalar);
+  EXPECT_EQ(0, memcmp(key_pair.public_x, expected.x, BT_OCTET32_LEN));
+  EXPECT_EQ(0, memcmp(key_pair.public_y, expected.y, BT_OCTET32_LEN));
+}
+
+TEST(SmpKeyPoolTest, test_reuse) {
+  SmpKeyPool pool(2, 3);
+  BT_OCTET32 key;
+  private_key(1, key);
+  ASSERT_TRUE(pool.Add(key));
+
+  SmpKeyPool::KeyPair first, key_pair;
+  ASSERT_TRUE(pool.Take(&first));
+  for (int i = 0; i < 2; i++) {
+    ASSERT_TRUE(pool.Take(&key_pair));
+    EXPECT_TRUE(same_key_pair(first, key_pair));
+  }
+  EXPECT_EQ(pool.Size(), 0u);
+  EXPECT_FALSE(pool.Take(&key_pair));
+}
+
+TEST(SmpKeyPoolTest, test_fill) {
+  SmpKeyPool pool(3, 1);
+  ASSERT_TRUE(pool.Fill());
+  EXPECT_EQ(pool.Size(), 3u);
+
+  SmpKeyPool::KeyPair a, b;
+  ASSERT_TRUE(pool.Take(&a));
+  ASSERT_TRUE(pool.Take(&b));
+  EXPECT_FALSE(same_key_pair(a, b));
+
+  Point pt;
+  memcpy(pt.x, a.public_x, BT_OCTET32_LEN);
+  memcpy(pt.y, a.public_y, BT_OCTET32_LEN);
+  EXPECT_TRUE(ECC_ValidatePoint(pt));
+
+  // Refilled up to the capacity only
+  ASSERT_TRUE(pool.Fill());
+  EXPECT_EQ(pool.Size(), 3u);
+  EXPECT_EQ(pool.Generated(), 5u);
+
+  pool.Clear();
+  EXPECT_EQ(pool.Size(), 0u);
+}
+
+TEST(SmpKeyPoolTest, test_fill_while_taking) {
+  SmpKeyPool pool(SmpKeyPool::kMaxCapacity, 1);
+  std::atomic<bool> done(false);
+  size_t taken = 0;
+
+  std::thread worker([&pool, &done]() {
+    for (int i = 0; i < 8; i++) pool.Fill();
+    done = true;
+  });
+  while (!done) {
+    SmpKeyPool::KeyPair key_pair;
+    if (pool.Take(&key_pair)) taken++;
+  }
+  worker.join();
+
+  SmpKeyPool::KeyPair key_pair;
+  while (pool.Take(&key_pair)) taken++;
+  EXPECT_EQ(taken, pool.Generated());
+  EXPECT_EQ(pool.Hits(), taken);
+}
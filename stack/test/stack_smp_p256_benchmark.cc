@@ -0,0 +1,119 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include <vector>
+
+#include "stack/smp/p_256_ecc_pp.h"
+
+namespace {
+
+constexpr size_t kNumKeys = 64;
+
+struct PrivateKey {
+  uint32_t n[KEY_LENGTH_DWORDS_P256];
+};
+
+// Deterministic pseudo-random private keys
+std::vector<PrivateKey> private_keys() {
+  std::vector<PrivateKey> keys(kNumKeys);
+  uint32_t seed = 0x2545f491;
+  for (PrivateKey& key : keys) {
+    for (uint32_t& word : key.n) {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      word = seed;
+    }
+  }
+  return keys;
+}
+
+// Public keys of the peers, for the DHKey computations
+std::vector<Point> peer_keys(const std::vector<PrivateKey>& keys) {
+  std::vector<Point> points(keys.size());
+  for (size_t i = 0; i < keys.size(); i++)
+    ECC_PointMult_Base(&points[i], keys[keys.size() - 1 - i].n);
+  return points;
+}
+
+// Local public key generation, as previously done by smp_process_private_key()
+void BM_KeyGen_BinNaf(benchmark::State& state) {
+  p_256_init_curve(KEY_LENGTH_DWORDS_P256);
+  std::vector<PrivateKey> keys = private_keys();
+  size_t i = 0;
+  for (auto _ : state) {
+    PrivateKey key = keys[i++ % keys.size()];
+    Point q;
+    ECC_PointMult_Bin_NAF(&q, &curve_p256.G, key.n, KEY_LENGTH_DWORDS_P256);
+    benchmark::DoNotOptimize(q);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_KeyGen_BinNaf);
+
+void BM_KeyGen_Comb(benchmark::State& state) {
+  p_256_init_curve(KEY_LENGTH_DWORDS_P256);
+  std::vector<PrivateKey> keys = private_keys();
+  size_t i = 0;
+  for (auto _ : state) {
+    Point q;
+    ECC_PointMult_Base(&q, keys[i++ % keys.size()].n);
+    benchmark::DoNotOptimize(q);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_KeyGen_Comb);
+
+// DHKey computation, as previously done by smp_compute_dhkey()
+void BM_Ecdh_BinNaf(benchmark::State& state) {
+  p_256_init_curve(KEY_LENGTH_DWORDS_P256);
+  std::vector<PrivateKey> keys = private_keys();
+  std::vector<Point> peers = peer_keys(keys);
+  size_t i = 0;
+  for (auto _ : state) {
+    PrivateKey key = keys[i % keys.size()];
+    Point peer = peers[i++ % peers.size()];
+    Point q;
+    ECC_PointMult_Bin_NAF(&q, &peer, key.n, KEY_LENGTH_DWORDS_P256);
+    benchmark::DoNotOptimize(q);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Ecdh_BinNaf);
+
+void BM_Ecdh_Wnaf(benchmark::State& state) {
+  p_256_init_curve(KEY_LENGTH_DWORDS_P256);
+  std::vector<PrivateKey> keys = private_keys();
+  std::vector<Point> peers = peer_keys(keys);
+  size_t i = 0;
+  for (auto _ : state) {
+    Point q;
+    ECC_PointMult_WNAF(&q, &peers[i % peers.size()], keys[i % keys.size()].n);
+    i++;
+    benchmark::DoNotOptimize(q);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Ecdh_Wnaf);
+
+}  // namespace
+
+BENCHMARK_MAIN();
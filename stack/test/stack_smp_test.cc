@@ -23,6 +23,7 @@
 #include "bt_trace.h"
 #include "hcidefs.h"
 #include "stack/include/smp_api.h"
+#include "stack/smp/aes.h"
 #include "stack/smp/p_256_ecc_pp.h"
 #include "stack/smp/smp_int.h"
 
@@ -308,4 +309,253 @@ TEST(SmpEccValidationTest, test_invalid_points) {
 
   EXPECT_FALSE(ECC_ValidatePoint(p));
 }
+
+// Order of the P-256 group, minus one
+static const uint32_t kOrderMinusOne[KEY_LENGTH_DWORDS_P256] = {
+    0xfc632550, 0xf3b9cac2, 0xa7179e84, 0xbce6faad,
+    0xffffffff, 0xffffffff, 0x00000000, 0xffffffff};
+
+// Deterministic pseudo-random 256 bit scalar
+static void random_scalar(uint32_t* seed, uint32_t* n) {
+  for (int i = 0; i < KEY_LENGTH_DWORDS_P256; i++) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    n[i] = *seed;
+  }
+}
+
+static void expect_same_point(const Point& expected, const Point& actual) {
+  for (int i = 0; i < KEY_LENGTH_DWORDS_P256; i++) {
+    EXPECT_EQ(expected.x[i], actual.x[i]) << "x[" << i << "]";
+    EXPECT_EQ(expected.y[i], actual.y[i]) << "y[" << i << "]";
+  }
+}
+
+// Test the fixed-base multiplication used for the local public key
+TEST(SmpEccMultTest, test_base_mult_spec_sample) {
+  p_256_init_curve(KEY_LENGTH_DWORDS_P256);
+
+  // Bluetooth Core Specification Version 5.0 | Vol 2, Part G | 7.1.2
+  // Sample 1: private key A, and public key A
+  uint32_t private_key[KEY_LENGTH_DWORDS_P256] = {
+      0xcd3c1abd, 0x5899b8a6, 0xeb40b799, 0x4aff607b,
+      0xd2103f50, 0x74c9b3e3, 0xa3c55f38, 0x3f49f6d4};
+  Point expected;
+  expected.x[7] = 0x20b003d2;
+  expected.x[6] = 0xf297be2c;
+  expected.x[5] = 0x5e2c83a7;
+  expected.x[4] = 0xe9f9a5b9;
+  expected.x[3] = 0xeff49111;
+  expected.x[2] = 0xacf4fddb;
+  expected.x[1] = 0xcc030148;
+  expected.x[0] = 0x0e359de6;
+  expected.y[7] = 0xdc809c49;
+  expected.y[6] = 0x652aeb6d;
+  expected.y[5] = 0x63329abf;
+  expected.y[4] = 0x5a52155c;
+  expected.y[3] = 0x766345c2;
+  expected.y[2] = 0x8fed3024;
+  expected.y[1] = 0x741c8ed0;
+  expected.y[0] = 0x1589d28b;
+
+  Point q;
+  ECC_PointMult_Base(&q, private_key);
+  expect_same_point(expected, q);
+}
+
+TEST(SmpEccMultTest, test_base_mult_matches_bin_naf) {
+  p_256_init_curve(KEY_LENGTH_DWORDS_P256);
+  uint32_t seed = 0x12345678;
+
+  for (int i = 0; i < 64; i++) {
+    uint32_t n[KEY_LENGTH_DWORDS_P256];
+    random_scalar(&seed, n);
+    if (i == 0) memcpy(n, kOrderMinusOne, sizeof(n));
+    if (i == 1) {
+      memset(n, 0, sizeof(n));
+      n[0] = 1;
+    }
+
+    Point expected, actual;
+    uint32_t n_copy[KEY_LENGTH_DWORDS_P256];
+    memcpy(n_copy, n, sizeof(n));
+    ECC_PointMult_Bin_NAF(&expected, &curve_p256.G, n_copy,
+                          KEY_LENGTH_DWORDS_P256);
+    ECC_PointMult_Base(&actual, n);
+    expect_same_point(expected, actual);
+  }
+}
+
+// Test the multiplication used for the DHKey
+TEST(SmpEccMultTest, test_wnaf_mult_matches_bin_naf) {
+  p_256_init_curve(KEY_LENGTH_DWORDS_P256);
+  uint32_t seed = 0x9abcdef0;
+
+  for (int i = 0; i < 64; i++) {
+    uint32_t peer_key[KEY_LENGTH_DWORDS_P256];
+    uint32_t n[KEY_LENGTH_DWORDS_P256];
+    random_scalar(&seed, peer_key);
+    random_scalar(&seed, n);
+    if (i == 0) memcpy(n, kOrderMinusOne, sizeof(n));
+
+    Point peer;
+    ECC_PointMult_Base(&peer, peer_key);
+    ASSERT_TRUE(ECC_ValidatePoint(peer));
+
+    Point expected, actual;
+    uint32_t n_copy[KEY_LENGTH_DWORDS_P256];
+    memcpy(n_copy, n, sizeof(n));
+    Point peer_copy = peer;
+    ECC_PointMult_Bin_NAF(&expected, &peer_copy, n_copy,
+                          KEY_LENGTH_DWORDS_P256);
+    ECC_PointMult_WNAF(&actual, &peer, n);
+    expect_same_point(expected, actual);
+  }
+}
+
+// FIPS-197 Appendix C.1: AES-128
+TEST(SmpAesTest, test_fips_197_vector) {
+  const uint8_t key[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                         0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+  const uint8_t plaintext[] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                               0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+  const uint8_t expected[] = {0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                              0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a};
+  aes_context ctx;
+  ASSERT_EQ(0, aes_set_key(key, sizeof(key), &ctx));
+
+  uint8_t out[N_BLOCK];
+  EXPECT_EQ(0, aes_encrypt_8bit(plaintext, out, &ctx));
+  EXPECT_EQ(0, memcmp(out, expected, N_BLOCK));
+  EXPECT_EQ(0, aes_encrypt_tables(plaintext, out, &ctx));
+  EXPECT_EQ(0, memcmp(out, expected, N_BLOCK));
+  EXPECT_EQ(0, aes_encrypt(plaintext, out, &ctx));
+  EXPECT_EQ(0, memcmp(out, expected, N_BLOCK));
+  if (aes_ni_supported()) {
+    EXPECT_EQ(0, aes_encrypt_ni(plaintext, out, &ctx));
+    EXPECT_EQ(0, memcmp(out, expected, N_BLOCK));
+  }
+}
+
+TEST(SmpAesTest, test_blocks_match_single_block) {
+  const int kBlocks = 11;
+  aes_context ctx[kBlocks];
+  uint8_t in[kBlocks][N_BLOCK];
+  uint8_t out[kBlocks][N_BLOCK];
+  const unsigned char* in_ptrs[kBlocks];
+  unsigned char* out_ptrs[kBlocks];
+  const aes_context* ctx_ptrs[kBlocks];
+  uint32_t seed = 0x2468ace0;
+
+  for (int i = 0; i < kBlocks; i++) {
+    uint32_t words[KEY_LENGTH_DWORDS_P256];
+    random_scalar(&seed, words);
+    aes_set_key((const uint8_t*)words, N_BLOCK, &ctx[i]);
+    memcpy(in[i], (const uint8_t*)words + N_BLOCK, N_BLOCK);
+    in_ptrs[i] = in[i];
+    out_ptrs[i] = out[i];
+    ctx_ptrs[i] = &ctx[i];
+  }
+  ASSERT_EQ(0, aes_encrypt_blocks(in_ptrs, out_ptrs, ctx_ptrs, kBlocks));
+
+  for (int i = 0; i < kBlocks; i++) {
+    uint8_t expected[N_BLOCK];
+    aes_encrypt_8bit(in[i], expected, &ctx[i]);
+    EXPECT_EQ(0, memcmp(out[i], expected, N_BLOCK)) << "block " << i;
+  }
+}
+
+// RFC 4493 section 4, in the little endian order used by SMP
+static void reverse_copy(const uint8_t* in, size_t len, uint8_t* out) {
+  for (size_t i = 0; i < len; i++) out[i] = in[len - 1 - i];
+}
+
+static const uint8_t kRfc4493Key[] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae,
+                                      0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88,
+                                      0x09, 0xcf, 0x4f, 0x3c};
+static const uint8_t kRfc4493Message[] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11,
+    0x73, 0x93, 0x17, 0x2a, 0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c,
+    0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51, 0x30, 0xc8, 0x1c, 0x46,
+    0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b,
+    0xe6, 0x6c, 0x37, 0x10};
+static const struct {
+  uint16_t length;
+  uint8_t mac[BT_OCTET16_LEN];
+} kRfc4493Examples[] = {
+    {0,
+     {0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12,
+      0x9b, 0x75, 0x67, 0x46}},
+    {16,
+     {0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d,
+      0xd0, 0x4a, 0x28, 0x7c}},
+    {40,
+     {0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61,
+      0x14, 0x97, 0xc8, 0x27}},
+    {64,
+     {0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17,
+      0x79, 0x36, 0x3c, 0xfe}},
+};
+
+TEST(SmpCmacTest, test_rfc_4493_examples) {
+  BT_OCTET16 key;
+  reverse_copy(kRfc4493Key, BT_OCTET16_LEN, key);
+
+  for (const auto& example : kRfc4493Examples) {
+    uint8_t message[sizeof(kRfc4493Message)];
+    reverse_copy(kRfc4493Message, example.length, message);
+    uint8_t expected[BT_OCTET16_LEN];
+    reverse_copy(example.mac, BT_OCTET16_LEN, expected);
+
+    uint8_t mac[BT_OCTET16_LEN];
+    ASSERT_TRUE(aes_cipher_msg_auth_code(key, message, example.length,
+                                         BT_OCTET16_LEN, mac));
+    EXPECT_EQ(0, memcmp(mac, expected, BT_OCTET16_LEN))
+        << "length " << example.length;
+
+    // A signature is the most significant octets of the mac
+    uint8_t signature[8];
+    ASSERT_TRUE(aes_cipher_msg_auth_code(key, message, example.length,
+                                         sizeof(signature), signature));
+    EXPECT_EQ(0, memcmp(signature, expected + BT_OCTET16_LEN - 8, 8));
+  }
+}
+
+TEST(SmpCmacTest, test_multi_matches_single) {
+  const size_t kMessages = 19;
+  BT_OCTET16 keys[kMessages];
+  uint8_t messages[kMessages][72];
+  uint8_t macs[kMessages][8];
+  tSMP_CMAC_MSG msgs[kMessages];
+  uint32_t seed = 0x13579bdf;
+
+  for (size_t i = 0; i < kMessages; i++) {
+    uint32_t words[KEY_LENGTH_DWORDS_P256];
+    random_scalar(&seed, words);
+    memcpy(keys[i], words, BT_OCTET16_LEN);
+    for (size_t j = 0; j < sizeof(messages[i]); j++) {
+      if (j % sizeof(words) == 0) random_scalar(&seed, words);
+      messages[i][j] = ((uint8_t*)words)[j % sizeof(words)];
+    }
+    // Messages of different lengths, with complete and padded last blocks
+    msgs[i] = {keys[i], messages[i], (uint16_t)(i * 4), macs[i]};
+  }
+  ASSERT_TRUE(aes_cipher_msg_auth_code_multi(msgs, kMessages, sizeof(macs[0])));
+
+  for (size_t i = 0; i < kMessages; i++) {
+    uint8_t expected[8];
+    ASSERT_TRUE(aes_cipher_msg_auth_code(keys[i], messages[i], msgs[i].length,
+                                         sizeof(expected), expected));
+    EXPECT_EQ(0, memcmp(macs[i], expected, sizeof(expected))) << "message "
+                                                               << i;
+  }
+}
+
+TEST(SmpCmacTest, test_invalid_tlen) {
+  BT_OCTET16 key = {0};
+  uint8_t mac[BT_OCTET16_LEN + 1];
+  EXPECT_FALSE(aes_cipher_msg_auth_code(key, NULL, 0, sizeof(mac), mac));
+}
 }  // namespace testing
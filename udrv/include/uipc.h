@@ -47,6 +47,7 @@ typedef enum {
 #define UIPC_REG_CBACK 2
 #define UIPC_REG_REMOVE_ACTIVE_READSET 3
 #define UIPC_SET_READ_POLL_TMO 4
+#define UIPC_REQ_RX_QUEUED_BYTES 5 /* param: uint32_t* bytes pending to read */
 
 typedef void(tUIPC_RCV_CBACK)(
     tUIPC_CH_ID ch_id,
@@ -60,6 +61,7 @@ const char* dump_uipc_event(tUIPC_EVENT event);
 typedef struct {
   int srvfd;
   int fd;
+  bool fd_monitored; /* fd is registered with the read task epoll set */
   int read_poll_tmo_ms;
   int task_evt_flags; /* event flags pending to be processed in read task */
   tUIPC_RCV_CBACK* cback;
@@ -70,10 +72,8 @@ struct tUIPC_STATE {
   int running;
   std::recursive_mutex mutex;
 
-  fd_set active_set;
-  fd_set read_set;
-  int max_fd;
-  int signal_fds[2];
+  int epoll_fd;
+  int wakeup_fd; /* eventfd used to interrupt the read task */
 
   tUIPC_CHAN ch[UIPC_CH_NUM];
 };
@@ -127,6 +127,17 @@ bool UIPC_Send(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id, uint16_t msg_evt,
 uint32_t UIPC_Read(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id, uint16_t* p_msg_evt,
                    uint8_t* p_buf, uint32_t len);
 
+/**
+ * Receive file descriptors passed by the peer over a UIPC channel
+ *
+ * @param ch_id Channel ID
+ * @param fds Array receiving the file descriptors
+ * @param max_fds Maximum number of file descriptors to receive
+ * @return the number of file descriptors received
+ */
+size_t UIPC_ReadFds(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id, int* fds,
+                    size_t max_fds);
+
 /**
  * Control the UIPC parameter
  *
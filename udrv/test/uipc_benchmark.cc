@@ -0,0 +1,189 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <mutex>
+
+#include "bt_trace.h"
+#include "bt_types.h"
+#include "osi/include/osi.h"
+#include "osi/include/socket_utils/sockets.h"
+#include "udrv/include/uipc.h"
+#include "utils/include/bt_utils.h"
+
+// Local stubs for the dependencies of libudrv-uipc
+uint8_t btif_trace_level = BT_TRACE_LEVEL_WARNING;
+void LogMsg(uint32_t trace_set_mask, const char* fmt_str, ...) {}
+void raise_priority_a2dp(tHIGH_PRIORITY_TASK high_task) {}
+
+namespace {
+
+// UIPC_Open() binds its sockets in the filesystem on the host and in the
+// abstract namespace on target, where no /tmp directory exists
+#if defined(OS_GENERIC)
+constexpr int kSocketNamespace = ANDROID_SOCKET_NAMESPACE_FILESYSTEM;
+constexpr char kCtrlPath[] = "/tmp/.uipc_benchmark_ctrl";
+constexpr char kAudioPath[] = "/tmp/.uipc_benchmark_audio";
+#else
+constexpr int kSocketNamespace = ANDROID_SOCKET_NAMESPACE_ABSTRACT;
+constexpr char kCtrlPath[] = "uipc_benchmark_ctrl";
+constexpr char kAudioPath[] = "uipc_benchmark_audio";
+#endif
+
+// Size of each PCM chunk written by the client: 20 ms of 48 kHz 16 bit stereo.
+constexpr size_t kAudioChunkSize = 3840;
+
+std::unique_ptr<tUIPC_STATE> uipc;
+std::mutex state_mutex;
+std::condition_variable state_cv;
+uint64_t audio_bytes_received = 0;
+uint64_t ctrl_commands_received = 0;
+
+void ctrl_cback(tUIPC_CH_ID ch_id, tUIPC_EVENT event) {
+  if (event != UIPC_RX_DATA_READY_EVT) return;
+
+  uint8_t cmd;
+  if (UIPC_Read(*uipc, ch_id, nullptr, &cmd, 1) != 1) return;
+  UIPC_Send(*uipc, ch_id, 0, &cmd, 1);
+
+  std::lock_guard<std::mutex> lock(state_mutex);
+  ctrl_commands_received++;
+  state_cv.notify_all();
+}
+
+void audio_cback(tUIPC_CH_ID ch_id, tUIPC_EVENT event) {
+  if (event != UIPC_RX_DATA_READY_EVT) return;
+
+  uint8_t buf[kAudioChunkSize];
+  uint32_t n = UIPC_Read(*uipc, ch_id, nullptr, buf, sizeof(buf));
+
+  std::lock_guard<std::mutex> lock(state_mutex);
+  audio_bytes_received += n;
+  state_cv.notify_all();
+}
+
+int connect_client(const char* path) {
+  int fd = socket(AF_LOCAL, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  if (osi_socket_local_client_connect(fd, path, kSocketNamespace,
+                                      SOCK_STREAM) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+class UipcBenchmark : public benchmark::Fixture {
+ public:
+  void SetUp(const benchmark::State& st) override {
+    audio_bytes_received = 0;
+    ctrl_commands_received = 0;
+    uipc = UIPC_Init();
+    UIPC_Open(*uipc, UIPC_CH_ID_AV_CTRL, ctrl_cback, kCtrlPath);
+    UIPC_Open(*uipc, UIPC_CH_ID_AV_AUDIO, audio_cback, kAudioPath);
+    ctrl_fd_ = connect_client(kCtrlPath);
+    audio_fd_ = connect_client(kAudioPath);
+  }
+
+  void TearDown(const benchmark::State& st) override {
+    if (ctrl_fd_ >= 0) close(ctrl_fd_);
+    if (audio_fd_ >= 0) close(audio_fd_);
+    UIPC_Close(*uipc, UIPC_CH_ID_ALL);
+    uipc.reset();
+  }
+
+ protected:
+  // Sends one control command and waits for it to be echoed back.
+  bool ControlRoundTrip() {
+    uint8_t cmd = kControlCmd;
+    if (send(ctrl_fd_, &cmd, 1, MSG_NOSIGNAL) != 1) return false;
+    return recv(ctrl_fd_, &cmd, 1, 0) == 1;
+  }
+
+  // Writes one audio chunk and waits until the read task consumed it.
+  bool WriteAudioChunk(uint64_t* expected) {
+    static uint8_t chunk[kAudioChunkSize];
+    if (send(audio_fd_, chunk, sizeof(chunk), MSG_NOSIGNAL) !=
+        (ssize_t)sizeof(chunk))
+      return false;
+    *expected += sizeof(chunk);
+
+    std::unique_lock<std::mutex> lock(state_mutex);
+    return state_cv.wait_for(lock, std::chrono::seconds(1), [&] {
+      return audio_bytes_received >= *expected;
+    });
+  }
+
+  static constexpr uint8_t kControlCmd = 0x42;
+  int ctrl_fd_ = -1;
+  int audio_fd_ = -1;
+};
+
+BENCHMARK_F(UipcBenchmark, BM_ControlRoundTrip)(benchmark::State& state) {
+  if (ctrl_fd_ < 0) {
+    state.SkipWithError("Unable to connect the control channel");
+    return;
+  }
+  for (auto _ : state) {
+    if (!ControlRoundTrip()) {
+      state.SkipWithError("Control round trip failed");
+      break;
+    }
+  }
+}
+
+BENCHMARK_F(UipcBenchmark, BM_AudioThroughput)(benchmark::State& state) {
+  if (audio_fd_ < 0) {
+    state.SkipWithError("Unable to connect the audio channel");
+    return;
+  }
+  uint64_t expected = 0;
+  for (auto _ : state) {
+    if (!WriteAudioChunk(&expected)) {
+      state.SkipWithError("Audio write failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(expected);
+}
+
+// Audio streaming while the control channel is polled the way the audio HAL
+// polls for the presentation position.
+BENCHMARK_F(UipcBenchmark, BM_AudioThroughputWithControl)
+(benchmark::State& state) {
+  if (ctrl_fd_ < 0 || audio_fd_ < 0) {
+    state.SkipWithError("Unable to connect the channels");
+    return;
+  }
+  uint64_t expected = 0;
+  for (auto _ : state) {
+    if (!WriteAudioChunk(&expected) || !ControlRoundTrip()) {
+      state.SkipWithError("Audio or control transfer failed");
+      break;
+    }
+  }
+  state.SetBytesProcessed(expected);
+}
+
+}  // namespace
+
+BENCHMARK_MAIN();
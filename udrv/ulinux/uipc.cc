@@ -30,10 +30,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/prctl.h>
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/un.h>
@@ -55,18 +57,22 @@
 
 #define PCM_FILENAME "/data/test.pcm"
 
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
-
 #define CASE_RETURN_STR(const) \
   case const:                  \
     return #const;
 
 #define UIPC_DISCONNECTED (-1)
 
-#define SAFE_FD_ISSET(fd, set) (((fd) == -1) ? false : FD_ISSET((fd), (set)))
-
 #define UIPC_FLUSH_BUFFER_SIZE 1024
 
+#define UIPC_MAX_EPOLL_EVENTS 8
+
+/* epoll tags: channel id, optionally marked as the channel server socket */
+#define UIPC_EPOLL_TAG_SERVER 0x100
+#define UIPC_EPOLL_TAG_WAKEUP 0x200
+
+#define UIPC_MAX_RX_FDS 4
+
 /*****************************************************************************
  *  Local type definitions
  *****************************************************************************/
@@ -75,6 +81,12 @@ typedef enum {
   UIPC_TASK_FLAG_DISCONNECT_CHAN = 0x1,
 } tUIPC_TASK_FLAGS;
 
+/* Per channel work collected from one epoll_wait() round */
+typedef enum {
+  UIPC_PENDING_ACCEPT = 0x1,
+  UIPC_PENDING_DATA = 0x2,
+} tUIPC_PENDING_FLAGS;
+
 /*****************************************************************************
  *  Static functions
  *****************************************************************************/
@@ -178,6 +190,50 @@ static int accept_server_socket(int sfd) {
  *
  ****************************************************************************/
 
+/* epoll user data: file descriptor in the upper 32 bits, tag in the lower */
+static inline uint64_t uipc_epoll_data(int fd, uint32_t tag) {
+  return ((uint64_t)(uint32_t)fd << 32) | tag;
+}
+
+static inline int uipc_epoll_data_fd(uint64_t data) {
+  return (int)(uint32_t)(data >> 32);
+}
+
+static inline uint32_t uipc_epoll_data_tag(uint64_t data) {
+  return (uint32_t)data;
+}
+
+/* Registers |fd| with the read task. Channel data sockets are registered
+ * edge-triggered: the read task is only woken up when new data arrives, or
+ * when it re-arms the socket because data was left unread. */
+static int uipc_epoll_ctl(tUIPC_STATE& uipc, int op, int fd, uint32_t tag,
+                          bool edge_triggered) {
+  struct epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN | EPOLLRDHUP;
+  if (edge_triggered) event.events |= EPOLLET;
+  event.data.u64 = uipc_epoll_data(fd, tag);
+
+  return epoll_ctl(uipc.epoll_fd, op, fd, &event);
+}
+
+static int uipc_epoll_add(tUIPC_STATE& uipc, int fd, uint32_t tag,
+                          bool edge_triggered) {
+  if (uipc_epoll_ctl(uipc, EPOLL_CTL_ADD, fd, tag, edge_triggered) < 0) {
+    BTIF_TRACE_ERROR("%s: unable to add fd %d (%s)", __func__, fd,
+                     strerror(errno));
+    return -1;
+  }
+  return 0;
+}
+
+static void uipc_epoll_del(tUIPC_STATE& uipc, int fd) {
+  if (epoll_ctl(uipc.epoll_fd, EPOLL_CTL_DEL, fd, NULL) < 0) {
+    BTIF_TRACE_WARNING("%s: unable to remove fd %d (%s)", __func__, fd,
+                       strerror(errno));
+  }
+}
+
 static int uipc_main_init(tUIPC_STATE& uipc) {
   int i;
 
@@ -185,24 +241,31 @@ static int uipc_main_init(tUIPC_STATE& uipc) {
 
   uipc.tid = 0;
   uipc.running = 0;
-  memset(&uipc.active_set, 0, sizeof(uipc.active_set));
-  memset(&uipc.read_set, 0, sizeof(uipc.read_set));
-  uipc.max_fd = 0;
-  memset(&uipc.signal_fds, 0, sizeof(uipc.signal_fds));
   memset(&uipc.ch, 0, sizeof(uipc.ch));
 
-  /* setup interrupt socket pair */
-  if (socketpair(AF_UNIX, SOCK_STREAM, 0, uipc.signal_fds) < 0) {
+  uipc.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (uipc.epoll_fd < 0) {
+    BTIF_TRACE_ERROR("%s: epoll_create1 failed (%s)", __func__,
+                     strerror(errno));
+    return -1;
+  }
+
+  /* setup interrupt event */
+  uipc.wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (uipc.wakeup_fd < 0) {
+    BTIF_TRACE_ERROR("%s: eventfd failed (%s)", __func__, strerror(errno));
+    close(uipc.epoll_fd);
+    uipc.epoll_fd = UIPC_DISCONNECTED;
     return -1;
   }
 
-  FD_SET(uipc.signal_fds[0], &uipc.active_set);
-  uipc.max_fd = MAX(uipc.max_fd, uipc.signal_fds[0]);
+  uipc_epoll_add(uipc, uipc.wakeup_fd, UIPC_EPOLL_TAG_WAKEUP, false);
 
   for (i = 0; i < UIPC_CH_NUM; i++) {
     tUIPC_CHAN* p = &uipc.ch[i];
     p->srvfd = UIPC_DISCONNECTED;
     p->fd = UIPC_DISCONNECTED;
+    p->fd_monitored = false;
     p->task_evt_flags = 0;
     p->cback = NULL;
   }
@@ -215,11 +278,13 @@ void uipc_main_cleanup(tUIPC_STATE& uipc) {
 
   BTIF_TRACE_EVENT("uipc_main_cleanup");
 
-  close(uipc.signal_fds[0]);
-  close(uipc.signal_fds[1]);
-
   /* close any open channels */
   for (i = 0; i < UIPC_CH_NUM; i++) uipc_close_ch_locked(uipc, i);
+
+  close(uipc.wakeup_fd);
+  close(uipc.epoll_fd);
+  uipc.wakeup_fd = UIPC_DISCONNECTED;
+  uipc.epoll_fd = UIPC_DISCONNECTED;
 }
 
 /* check pending events in read task */
@@ -236,67 +301,77 @@ static void uipc_check_task_flags_locked(tUIPC_STATE& uipc) {
   }
 }
 
-static int uipc_check_fd_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
-  if (ch_id >= UIPC_CH_NUM) return -1;
+static void uipc_accept_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
+  BTIF_TRACE_EVENT("INCOMING CONNECTION ON CH %d", ch_id);
 
-  // BTIF_TRACE_EVENT("CHECK SRVFD %d (ch %d)", uipc.ch[ch_id].srvfd,
-  // ch_id);
+  // Close the previous connection
+  if (uipc.ch[ch_id].fd != UIPC_DISCONNECTED) {
+    BTIF_TRACE_EVENT("CLOSE CONNECTION (FD %d)", uipc.ch[ch_id].fd);
+    if (uipc.ch[ch_id].fd_monitored) uipc_epoll_del(uipc, uipc.ch[ch_id].fd);
+    close(uipc.ch[ch_id].fd);
+    uipc.ch[ch_id].fd = UIPC_DISCONNECTED;
+    uipc.ch[ch_id].fd_monitored = false;
+  }
 
-  if (SAFE_FD_ISSET(uipc.ch[ch_id].srvfd, &uipc.read_set)) {
-    BTIF_TRACE_EVENT("INCOMING CONNECTION ON CH %d", ch_id);
+  uipc.ch[ch_id].fd = accept_server_socket(uipc.ch[ch_id].srvfd);
 
-    // Close the previous connection
-    if (uipc.ch[ch_id].fd != UIPC_DISCONNECTED) {
-      BTIF_TRACE_EVENT("CLOSE CONNECTION (FD %d)", uipc.ch[ch_id].fd);
-      close(uipc.ch[ch_id].fd);
-      FD_CLR(uipc.ch[ch_id].fd, &uipc.active_set);
-      uipc.ch[ch_id].fd = UIPC_DISCONNECTED;
-    }
+  BTIF_TRACE_EVENT("NEW FD %d", uipc.ch[ch_id].fd);
 
-    uipc.ch[ch_id].fd = accept_server_socket(uipc.ch[ch_id].srvfd);
+  if (uipc.ch[ch_id].fd < 0) {
+    BTIF_TRACE_ERROR("FAILED TO ACCEPT CH %d", ch_id);
+    uipc.ch[ch_id].fd = UIPC_DISCONNECTED;
+    return;
+  }
 
-    BTIF_TRACE_EVENT("NEW FD %d", uipc.ch[ch_id].fd);
+  if (uipc.ch[ch_id].cback) {
+    /*  if we have a callback we should monitor this fd and notify user with
+        callback event */
+    BTIF_TRACE_EVENT("MONITOR FD %d", uipc.ch[ch_id].fd);
+    if (uipc_epoll_add(uipc, uipc.ch[ch_id].fd, ch_id, true) == 0)
+      uipc.ch[ch_id].fd_monitored = true;
 
-    if ((uipc.ch[ch_id].fd >= 0) && uipc.ch[ch_id].cback) {
-      /*  if we have a callback we should add this fd to the active set
-          and notify user with callback event */
-      BTIF_TRACE_EVENT("ADD FD %d TO ACTIVE SET", uipc.ch[ch_id].fd);
-      FD_SET(uipc.ch[ch_id].fd, &uipc.active_set);
-      uipc.max_fd = MAX(uipc.max_fd, uipc.ch[ch_id].fd);
-    }
+    uipc.ch[ch_id].cback(ch_id, UIPC_OPEN_EVT);
+  }
+}
 
-    if (uipc.ch[ch_id].fd < 0) {
-      BTIF_TRACE_ERROR("FAILED TO ACCEPT CH %d", ch_id);
-      return -1;
-    }
+/* Returns true if |fd| still has unread data queued. */
+static bool uipc_fd_has_pending_data(int fd) {
+  int pending = 0;
+  if (ioctl(fd, FIONREAD, &pending) < 0) return false;
+  return pending > 0;
+}
 
-    if (uipc.ch[ch_id].cback) uipc.ch[ch_id].cback(ch_id, UIPC_OPEN_EVT);
-  }
+static void uipc_check_fd_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
+                                 uint32_t pending) {
+  if (ch_id >= UIPC_CH_NUM) return;
 
-  // BTIF_TRACE_EVENT("CHECK FD %d (ch %d)", uipc.ch[ch_id].fd, ch_id);
+  if (pending & UIPC_PENDING_ACCEPT) uipc_accept_locked(uipc, ch_id);
 
-  if (SAFE_FD_ISSET(uipc.ch[ch_id].fd, &uipc.read_set)) {
-    // BTIF_TRACE_EVENT("INCOMING DATA ON CH %d", ch_id);
+  if (!(pending & UIPC_PENDING_DATA)) return;
 
-    if (uipc.ch[ch_id].cback)
-      uipc.ch[ch_id].cback(ch_id, UIPC_RX_DATA_READY_EVT);
+  int fd = uipc.ch[ch_id].fd;
+  if (!uipc.ch[ch_id].cback) return;
+  uipc.ch[ch_id].cback(ch_id, UIPC_RX_DATA_READY_EVT);
+
+  /* Edge-triggered: if the user left data queued, re-arm the socket so that
+     it is reported again by the next epoll_wait(), after the lock was
+     released, rather than notifying the user again here */
+  if (uipc.ch[ch_id].fd == fd && uipc.ch[ch_id].fd_monitored &&
+      !(uipc.ch[ch_id].task_evt_flags & UIPC_TASK_FLAG_DISCONNECT_CHAN) &&
+      uipc_fd_has_pending_data(fd)) {
+    uipc_epoll_ctl(uipc, EPOLL_CTL_MOD, fd, ch_id, true);
   }
-  return 0;
 }
 
 static void uipc_check_interrupt_locked(tUIPC_STATE& uipc) {
-  if (SAFE_FD_ISSET(uipc.signal_fds[0], &uipc.read_set)) {
-    char sig_recv = 0;
-    OSI_NO_INTR(
-        recv(uipc.signal_fds[0], &sig_recv, sizeof(sig_recv), MSG_WAITALL));
-  }
+  eventfd_t value;
+  OSI_NO_INTR(eventfd_read(uipc.wakeup_fd, &value));
 }
 
 static inline void uipc_wakeup_locked(tUIPC_STATE& uipc) {
-  char sig_on = 1;
   BTIF_TRACE_EVENT("UIPC SEND WAKE UP");
 
-  OSI_NO_INTR(send(uipc.signal_fds[1], &sig_on, sizeof(sig_on), 0));
+  OSI_NO_INTR(eventfd_write(uipc.wakeup_fd, 1));
 }
 
 static int uipc_setup_server_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
@@ -316,56 +391,37 @@ static int uipc_setup_server_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
     return -1;
   }
 
-  BTIF_TRACE_EVENT("ADD SERVER FD TO ACTIVE SET %d", fd);
-  FD_SET(fd, &uipc.active_set);
-  uipc.max_fd = MAX(uipc.max_fd, fd);
-
   uipc.ch[ch_id].srvfd = fd;
   uipc.ch[ch_id].cback = cback;
   uipc.ch[ch_id].read_poll_tmo_ms = DEFAULT_READ_POLL_TMO_MS;
 
-  /* trigger main thread to update read set */
-  uipc_wakeup_locked(uipc);
+  /* epoll_ctl() is thread safe, the read task picks the server up directly */
+  BTIF_TRACE_EVENT("MONITOR SERVER FD %d", fd);
+  uipc_epoll_add(uipc, fd, ch_id | UIPC_EPOLL_TAG_SERVER, false);
 
   return 0;
 }
 
 static void uipc_flush_ch_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
   char buf[UIPC_FLUSH_BUFFER_SIZE];
-  struct pollfd pfd;
-
-  pfd.events = POLLIN;
-  pfd.fd = uipc.ch[ch_id].fd;
+  int fd = uipc.ch[ch_id].fd;
 
-  if (uipc.ch[ch_id].fd == UIPC_DISCONNECTED) {
+  if (fd == UIPC_DISCONNECTED) {
     BTIF_TRACE_EVENT("%s() - fd disconnected. Exiting", __func__);
     return;
   }
 
+  /* drain everything queued without blocking; reading a sufficiently large
+     buffer ensures the flush empties the socket faster than it is refilled */
   while (1) {
-    int ret;
-    OSI_NO_INTR(ret = poll(&pfd, 1, 1));
-    if (ret == 0) {
-      BTIF_TRACE_VERBOSE("%s(): poll() timeout - nothing to do. Exiting",
-                         __func__);
-      return;
-    }
-    if (ret < 0) {
-      BTIF_TRACE_WARNING(
-          "%s() - poll() failed: return %d errno %d (%s). Exiting", __func__,
-          ret, errno, strerror(errno));
-      return;
-    }
-    BTIF_TRACE_VERBOSE("%s() - polling fd %d, revents: 0x%x, ret %d", __func__,
-                       pfd.fd, pfd.revents, ret);
-    if (pfd.revents & (POLLERR | POLLHUP)) {
-      BTIF_TRACE_WARNING("%s() - POLLERR or POLLHUP. Exiting", __func__);
-      return;
+    ssize_t ret;
+    OSI_NO_INTR(ret = recv(fd, buf, sizeof(buf), MSG_DONTWAIT));
+    if (ret > 0) continue;
+    if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+      BTIF_TRACE_WARNING("%s() - recv() failed: errno %d (%s). Exiting",
+                         __func__, errno, strerror(errno));
     }
-
-    /* read sufficiently large buffer to ensure flush empties socket faster than
-       it is getting refilled */
-    read(pfd.fd, &buf, UIPC_FLUSH_BUFFER_SIZE);
+    return;
   }
 }
 
@@ -384,34 +440,28 @@ static void uipc_flush_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
 }
 
 static int uipc_close_ch_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
-  int wakeup = 0;
-
   BTIF_TRACE_EVENT("CLOSE CHANNEL %d", ch_id);
 
   if (ch_id >= UIPC_CH_NUM) return -1;
 
   if (uipc.ch[ch_id].srvfd != UIPC_DISCONNECTED) {
     BTIF_TRACE_EVENT("CLOSE SERVER (FD %d)", uipc.ch[ch_id].srvfd);
+    uipc_epoll_del(uipc, uipc.ch[ch_id].srvfd);
     close(uipc.ch[ch_id].srvfd);
-    FD_CLR(uipc.ch[ch_id].srvfd, &uipc.active_set);
     uipc.ch[ch_id].srvfd = UIPC_DISCONNECTED;
-    wakeup = 1;
   }
 
   if (uipc.ch[ch_id].fd != UIPC_DISCONNECTED) {
     BTIF_TRACE_EVENT("CLOSE CONNECTION (FD %d)", uipc.ch[ch_id].fd);
+    if (uipc.ch[ch_id].fd_monitored) uipc_epoll_del(uipc, uipc.ch[ch_id].fd);
     close(uipc.ch[ch_id].fd);
-    FD_CLR(uipc.ch[ch_id].fd, &uipc.active_set);
     uipc.ch[ch_id].fd = UIPC_DISCONNECTED;
-    wakeup = 1;
+    uipc.ch[ch_id].fd_monitored = false;
   }
 
   /* notify this connection is closed */
   if (uipc.ch[ch_id].cback) uipc.ch[ch_id].cback(ch_id, UIPC_CLOSE_EVT);
 
-  /* trigger main thread update if something was updated */
-  if (wakeup) uipc_wakeup_locked(uipc);
-
   return 0;
 }
 
@@ -428,6 +478,8 @@ void uipc_close_locked(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id) {
 
 static void* uipc_read_task(void* arg) {
   tUIPC_STATE& uipc = *((tUIPC_STATE*)arg);
+  struct epoll_event events[UIPC_MAX_EPOLL_EVENTS];
+  uint32_t pending[UIPC_CH_NUM];
   int ch_id;
   int result;
 
@@ -436,36 +488,49 @@ static void* uipc_read_task(void* arg) {
   raise_priority_a2dp(TASK_UIPC_READ);
 
   while (uipc.running) {
-    uipc.read_set = uipc.active_set;
-
-    result = select(uipc.max_fd + 1, &uipc.read_set, NULL, NULL, NULL);
-
-    if (result == 0) {
-      BTIF_TRACE_EVENT("select timeout");
-      continue;
-    }
+    OSI_NO_INTR(result = epoll_wait(uipc.epoll_fd, events,
+                                    UIPC_MAX_EPOLL_EVENTS, -1));
     if (result < 0) {
-      if (errno != EINTR) {
-        BTIF_TRACE_EVENT("select failed %s", strerror(errno));
-      }
+      BTIF_TRACE_EVENT("epoll_wait failed %s", strerror(errno));
       continue;
     }
 
     {
       std::lock_guard<std::recursive_mutex> guard(uipc.mutex);
 
-      /* clear any wakeup interrupt */
-      uipc_check_interrupt_locked(uipc);
+      memset(pending, 0, sizeof(pending));
+      for (int i = 0; i < result; i++) {
+        uint32_t tag = uipc_epoll_data_tag(events[i].data.u64);
+        int fd = uipc_epoll_data_fd(events[i].data.u64);
+
+        if (tag == UIPC_EPOLL_TAG_WAKEUP) {
+          /* clear any wakeup interrupt */
+          uipc_check_interrupt_locked(uipc);
+          continue;
+        }
+
+        ch_id = tag & ~UIPC_EPOLL_TAG_SERVER;
+        if (ch_id >= UIPC_CH_NUM) continue;
+
+        /* ignore events for descriptors that were replaced in the meantime */
+        if (tag & UIPC_EPOLL_TAG_SERVER) {
+          if (uipc.ch[ch_id].srvfd == fd) pending[ch_id] |= UIPC_PENDING_ACCEPT;
+        } else if (uipc.ch[ch_id].fd == fd) {
+          pending[ch_id] |= UIPC_PENDING_DATA;
+        }
+      }
 
       /* check pending task events */
       uipc_check_task_flags_locked(uipc);
 
       /* make sure we service audio channel first */
-      uipc_check_fd_locked(uipc, UIPC_CH_ID_AV_AUDIO);
+      uipc_check_fd_locked(uipc, UIPC_CH_ID_AV_AUDIO,
+                           pending[UIPC_CH_ID_AV_AUDIO]);
 
       /* check for other connections */
       for (ch_id = 0; ch_id < UIPC_CH_NUM; ch_id++) {
-        if (ch_id != UIPC_CH_ID_AV_AUDIO) uipc_check_fd_locked(uipc, ch_id);
+        if (ch_id != UIPC_CH_ID_AV_AUDIO)
+          uipc_check_fd_locked(uipc, ch_id, pending[ch_id]);
       }
     }
   }
@@ -687,6 +752,88 @@ uint32_t UIPC_Read(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id,
   return n_read;
 }
 
+/*******************************************************************************
+ **
+ ** Function         UIPC_ReadFds
+ **
+ ** Description      Called to receive file descriptors passed by the peer
+ **                  with SCM_RIGHTS. The descriptors must be sent together
+ **                  with a single dummy octet.
+ **
+ ** Returns          return the number of file descriptors received.
+ **
+ ******************************************************************************/
+
+size_t UIPC_ReadFds(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id, int* fds,
+                    size_t max_fds) {
+  if (ch_id >= UIPC_CH_NUM || max_fds > UIPC_MAX_RX_FDS) {
+    BTIF_TRACE_ERROR("UIPC_ReadFds : invalid ch id %d or fd count %zu", ch_id,
+                     max_fds);
+    return 0;
+  }
+
+  int fd = uipc.ch[ch_id].fd;
+  if (fd == UIPC_DISCONNECTED) {
+    BTIF_TRACE_ERROR("UIPC_ReadFds : channel %d closed", ch_id);
+    return 0;
+  }
+
+  struct pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN | POLLHUP;
+
+  int poll_ret;
+  OSI_NO_INTR(poll_ret = poll(&pfd, 1, uipc.ch[ch_id].read_poll_tmo_ms));
+  if (poll_ret <= 0) {
+    BTIF_TRACE_WARNING("UIPC_ReadFds : poll failed or timed out (%d)",
+                       poll_ret);
+    return 0;
+  }
+
+  uint8_t dummy;
+  struct iovec iov;
+  iov.iov_base = &dummy;
+  iov.iov_len = sizeof(dummy);
+
+  char control[CMSG_SPACE(sizeof(int) * UIPC_MAX_RX_FDS)];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t n;
+  OSI_NO_INTR(n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC));
+  if (n <= 0) {
+    BTIF_TRACE_WARNING("UIPC_ReadFds : recvmsg failed (%s)", strerror(errno));
+    return 0;
+  }
+
+  size_t n_fds = 0;
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+
+    const int* rx_fds = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+    size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for (size_t i = 0; i < count; i++) {
+      if (n_fds < max_fds) {
+        fds[n_fds++] = rx_fds[i];
+      } else {
+        close(rx_fds[i]);
+      }
+    }
+  }
+
+  if (msg.msg_flags & MSG_CTRUNC) {
+    BTIF_TRACE_WARNING("UIPC_ReadFds : control data truncated");
+  }
+
+  return n_fds;
+}
+
 /*******************************************************************************
  *
  * Function         UIPC_Ioctl
@@ -715,13 +862,12 @@ extern bool UIPC_Ioctl(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id, uint32_t request,
       break;
 
     case UIPC_REG_REMOVE_ACTIVE_READSET:
-      /* user will read data directly and not use select loop */
-      if (uipc.ch[ch_id].fd != UIPC_DISCONNECTED) {
-        /* remove this channel from active set */
-        FD_CLR(uipc.ch[ch_id].fd, &uipc.active_set);
-
-        /* refresh active set */
-        uipc_wakeup_locked(uipc);
+      /* user will read data directly and not use the read task */
+      if (uipc.ch[ch_id].fd != UIPC_DISCONNECTED &&
+          uipc.ch[ch_id].fd_monitored) {
+        /* stop monitoring this channel */
+        uipc_epoll_del(uipc, uipc.ch[ch_id].fd);
+        uipc.ch[ch_id].fd_monitored = false;
       }
       break;
 
@@ -731,6 +877,16 @@ extern bool UIPC_Ioctl(tUIPC_STATE& uipc, tUIPC_CH_ID ch_id, uint32_t request,
                        uipc.ch[ch_id].read_poll_tmo_ms);
       break;
 
+    case UIPC_REQ_RX_QUEUED_BYTES: {
+      int pending = 0;
+      if (ch_id >= UIPC_CH_NUM || uipc.ch[ch_id].fd == UIPC_DISCONNECTED ||
+          ioctl(uipc.ch[ch_id].fd, FIONREAD, &pending) < 0) {
+        return false;
+      }
+      *(uint32_t*)param = (pending > 0) ? pending : 0;
+      return true;
+    }
+
     default:
       BTIF_TRACE_EVENT("UIPC_Ioctl : request not handled (%d)", request);
       break;